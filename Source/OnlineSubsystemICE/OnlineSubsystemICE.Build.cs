@@ -27,8 +27,13 @@ public class OnlineSubsystemICE : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[]
 			{
-				"HTTP"
+				"HTTP",
+				"Json",
+				"WebSockets"
 			}
 		);
+
+		// X25519 and AES-GCM of the encrypted datagram channel (ICESecureChannel)
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "OpenSSL");
 	}
 }
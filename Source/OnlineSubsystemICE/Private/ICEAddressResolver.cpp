@@ -0,0 +1,166 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICEAddressResolver.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "SocketSubsystem.h"
+#include "IPAddress.h"
+#include "AddressInfoTypes.h"
+#include "Misc/ScopeLock.h"
+
+FICEAddressResolver& FICEAddressResolver::Get()
+{
+	static FICEAddressResolver Resolver;
+	return Resolver;
+}
+
+FICEAddressResolver::FICEAddressResolver()
+	: CacheTTL(300.0f)
+{
+}
+
+void FICEAddressResolver::SetCacheTTL(float InCacheTTL)
+{
+	FScopeLock Lock(&CacheLock);
+	CacheTTL = FMath::Max(InCacheTTL, 0.0f);
+}
+
+EICEResolveStatus FICEAddressResolver::Resolve(const FString& Host, bool bAllowIPv6, TSharedPtr<FInternetAddr>& OutAddr)
+{
+	OutAddr.Reset();
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem || Host.IsEmpty())
+	{
+		return EICEResolveStatus::Failed;
+	}
+
+	// Numeric addresses need no lookup (GetAddressFromString never queries DNS)
+	TSharedPtr<FInternetAddr> NumericAddr = SocketSubsystem->GetAddressFromString(Host);
+	if (NumericAddr.IsValid() && NumericAddr->IsValid())
+	{
+		if (!bAllowIPv6 && NumericAddr->GetProtocolType() == FNetworkProtocolTypes::IPv6)
+		{
+			return EICEResolveStatus::Failed;
+		}
+		OutAddr = NumericAddr;
+		return EICEResolveStatus::Resolved;
+	}
+
+	FScopeLock Lock(&CacheLock);
+	FCacheEntry& Entry = Cache.FindOrAdd(Host);
+
+	// First lookup, or refresh of an expired one (the stale addresses are served meanwhile)
+	const float TTL = Entry.bFailed ? FMath::Min(CacheTTL, FAILED_LOOKUP_TTL) : CacheTTL;
+	if (!Entry.bPending && (Entry.ResolvedTime == 0.0 || FPlatformTime::Seconds() - Entry.ResolvedTime > TTL))
+	{
+		StartLookup(Host, Entry);
+	}
+
+	// Prefer IPv4: every STUN/TURN server reachable over IPv6 is expected to be reachable over IPv4 too
+	for (const TSharedPtr<FInternetAddr>& Addr : Entry.Addresses)
+	{
+		if (Addr->GetProtocolType() == FNetworkProtocolTypes::IPv4)
+		{
+			OutAddr = Addr->Clone();
+			return EICEResolveStatus::Resolved;
+		}
+	}
+	if (bAllowIPv6 && Entry.Addresses.Num() > 0)
+	{
+		OutAddr = Entry.Addresses[0]->Clone();
+		return EICEResolveStatus::Resolved;
+	}
+
+	return Entry.bPending && Entry.Addresses.Num() == 0 ? EICEResolveStatus::Pending : EICEResolveStatus::Failed;
+}
+
+void FICEAddressResolver::Prewarm(const TArray<FString>& ServerAddresses)
+{
+	for (const FString& ServerAddress : ServerAddresses)
+	{
+		FString Host;
+		int32 Port;
+		ParseServerAddress(ServerAddress.TrimStartAndEnd(), Host, Port);
+
+		TSharedPtr<FInternetAddr> Addr;
+		if (!Host.IsEmpty() && Resolve(Host, true, Addr) == EICEResolveStatus::Pending)
+		{
+			UE_LOG(LogOnlineICE, Verbose, TEXT("Resolving %s in the background"), *Host);
+		}
+	}
+}
+
+void FICEAddressResolver::StartLookup(const FString& Host, FCacheEntry& Entry)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem)
+	{
+		return;
+	}
+
+	Entry.bPending = true;
+
+	// The callback may run on a worker thread; the resolver is a static and outlives every lookup
+	SocketSubsystem->GetAddressInfoAsync([this, Host](FAddressInfoResult Result)
+	{
+		FScopeLock Lock(&CacheLock);
+		FCacheEntry* CachedEntry = Cache.Find(Host);
+		if (!CachedEntry)
+		{
+			return;
+		}
+
+		CachedEntry->bPending = false;
+		CachedEntry->ResolvedTime = FPlatformTime::Seconds();
+
+		if (Result.ReturnCode == SE_NO_ERROR && Result.Results.Num() > 0)
+		{
+			CachedEntry->Addresses.Reset(Result.Results.Num());
+			for (const FAddressInfoResultData& Data : Result.Results)
+			{
+				CachedEntry->Addresses.Add(Data.Address);
+			}
+			CachedEntry->bFailed = false;
+			UE_LOG(LogOnlineICE, Log, TEXT("Resolved %s to %s (%d addresses)"),
+				*Host, *CachedEntry->Addresses[0]->ToString(false), CachedEntry->Addresses.Num());
+		}
+		else
+		{
+			// A failed refresh keeps serving the previous addresses
+			CachedEntry->bFailed = CachedEntry->Addresses.Num() == 0;
+			UE_LOG(LogOnlineICE, Warning, TEXT("Failed to resolve %s (error %d)"), *Host, (int32)Result.ReturnCode);
+		}
+	}, *Host, nullptr, EAddressInfoFlags::Default, NAME_None, SOCKTYPE_Datagram);
+}
+
+void FICEAddressResolver::ParseServerAddress(const FString& ServerAddress, FString& OutHost, int32& OutPort, int32 DefaultPort)
+{
+	OutPort = DefaultPort;
+
+	// [IPv6]:port
+	if (ServerAddress.StartsWith(TEXT("[")))
+	{
+		int32 BracketPos;
+		if (ServerAddress.FindChar(']', BracketPos))
+		{
+			OutHost = ServerAddress.Mid(1, BracketPos - 1);
+			if (ServerAddress.IsValidIndex(BracketPos + 1) && ServerAddress[BracketPos + 1] == ':')
+			{
+				OutPort = FCString::Atoi(*ServerAddress.Mid(BracketPos + 2));
+			}
+			return;
+		}
+	}
+
+	// A bare IPv6 address has several colons and no port
+	int32 ColonPos;
+	if (ServerAddress.FindChar(':', ColonPos) && ServerAddress.Find(TEXT(":"), ESearchCase::CaseSensitive, ESearchDir::FromEnd) == ColonPos)
+	{
+		OutHost = ServerAddress.Left(ColonPos);
+		OutPort = FCString::Atoi(*ServerAddress.Mid(ColonPos + 1));
+	}
+	else
+	{
+		OutHost = ServerAddress;
+	}
+}
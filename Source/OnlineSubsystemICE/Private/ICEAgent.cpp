@@ -1,28 +1,28 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "ICEAgent.h"
+#include "ICEReceiveThread.h"
+#include "ICEAddressResolver.h"
+#include "STUNMessage.h"
 #include "OnlineSubsystemICEPackage.h"
 #include "Sockets.h"
 #include "SocketSubsystem.h"
 #include "IPAddress.h"
 #include "Misc/SecureHash.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+DECLARE_STATS_GROUP(TEXT("ICE"), STATGROUP_ICE, STATCAT_Advanced);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Send Path Allocations"), STAT_ICESendAllocations, STATGROUP_ICE);
+
+CSV_DEFINE_CATEGORY(ICE, true);
 
 // ICEAgent.cpp ya no necesita definir la categoría de log, se mueve al módulo
 
 // STUN/TURN protocol constants (RFC 5389/5766)
 namespace STUNConstants
 {
-	constexpr int32 TRANSACTION_ID_LENGTH = 12;
-	constexpr int32 MESSAGE_INTEGRITY_ATTR_SIZE = 24; // Header(4) + HMAC-SHA1(20)
-	constexpr int32 HMAC_SHA1_SIZE = 20;
-	constexpr uint8 ERROR_CLASS_MASK = 0x07;
-	constexpr int32 ERROR_CLASS_MULTIPLIER = 100;
-	constexpr int32 SHA1_BLOCK_SIZE = 64;
-	
-	// STUN Magic Cookie (RFC 5389)
-	constexpr uint32 MAGIC_COOKIE = 0x2112A442;
-	constexpr uint16 MAGIC_COOKIE_HIGH = 0x2112; // First 16 bits of magic cookie
-	
 	// TURN Channel number range (RFC 5766)
 	constexpr uint16 CHANNEL_NUMBER_MIN = 0x4000;
 	constexpr uint16 CHANNEL_NUMBER_MAX = 0x7FFF;
@@ -39,21 +39,61 @@ namespace HandshakeConstants
 	static const uint8 MAGIC_NUMBER[4] = {0x49, 0x43, 0x45, 0x48}; // "ICEH"
 	constexpr uint8 PACKET_TYPE_HELLO_REQUEST = 0x01;
 	constexpr uint8 PACKET_TYPE_HELLO_RESPONSE = 0x02;
+	constexpr uint8 PACKET_KIND_MASK = 0x1F;
+	constexpr uint8 PACKET_FLAG_FEC = 0x20;
+	constexpr uint8 PACKET_FLAG_KEY_SHARE = 0x40;
+	constexpr uint8 PACKET_FLAG_AUTHENTICATED = 0x80;
 	constexpr int32 HANDSHAKE_PACKET_SIZE = 9;
+	constexpr int32 AUTHENTICATED_HEADER_SIZE = 14; // + Sequence (4 bytes) + Username length (1 byte)
+	constexpr int32 MAX_USERNAME_LENGTH = 128;
+	constexpr int32 MAX_HANDSHAKE_PACKET_SIZE = AUTHENTICATED_HEADER_SIZE + MAX_USERNAME_LENGTH + FICESecureChannel::KEY_SHARE_SIZE + FSTUNHMACKey::HASH_SIZE;
+	constexpr int32 REPLAY_WINDOW_SIZE = 64;
 	constexpr int32 MAX_RECEIVE_BUFFER_SIZE = 1024;
+	constexpr int32 MAX_PACKETS_PER_TICK = 32;
+}
+
+// Coalesced datagram format: [Marker (1 byte)] then, per message, [Length (2 bytes)] [Message]
+namespace CoalesceConstants
+{
+	constexpr uint8 BUNDLE_MARKER = 0xCE;
+	constexpr int32 BUNDLE_HEADER_SIZE = 1;
+	constexpr int32 MESSAGE_HEADER_SIZE = 2;
+	constexpr int32 MAX_MESSAGE_SIZE = 0xFFFF;
+}
+
+/** Check whether a datagram is a STUN success or error response (class bits 1x) */
+static bool IsSTUNResponse(const uint8* Buffer, int32 Size)
+{
+	return FSTUNMessageView::IsSTUNMessage(Buffer, Size) && (Buffer[0] & 0x01) != 0;
+}
+
+/** Readable name of a TURN transaction type for logging */
+static const TCHAR* GetTURNTransactionName(EICETURNTransactionType Type)
+{
+	switch (Type)
+	{
+		case EICETURNTransactionType::Refresh: return TEXT("Refresh");
+		case EICETURNTransactionType::CreatePermission: return TEXT("CreatePermission");
+		case EICETURNTransactionType::ChannelBind: return TEXT("ChannelBind");
+		default: return TEXT("Unknown");
+	}
 }
 
+TMap<FString, FICETURNCredentials> FICEAgent::TURNCredentialCache;
+TMap<FString, FICEServerRTT> FICEAgent::ServerRTTCache;
+
 FString FICECandidate::ToString() const
 {
 	return FString::Printf(TEXT("candidate:%s %d %s %d %s %d typ %s"),
 		*Foundation,
 		ComponentId,
-		*Transport,
+		TEXT("UDP"),
 		Priority,
 		*Address,
 		Port,
 		Type == EICECandidateType::Host ? TEXT("host") :
-		Type == EICECandidateType::ServerReflexive ? TEXT("srflx") : TEXT("relay"));
+		Type == EICECandidateType::ServerReflexive ? TEXT("srflx") :
+		Type == EICECandidateType::PeerReflexive ? TEXT("prflx") : TEXT("relay"));
 }
 
 FICECandidate FICECandidate::FromString(const FString& CandidateString)
@@ -71,11 +111,12 @@ FICECandidate FICECandidate::FromString(const FString& CandidateString)
 	TArray<FString> Parts;
 	ParseString.ParseIntoArray(Parts, TEXT(" "));
 	
-	if (Parts.Num() >= 8)
+	// Only UDP candidates can be checked, others are returned invalid
+	if (Parts.Num() >= 8 && Parts[2].Equals(TEXT("UDP"), ESearchCase::IgnoreCase))
 	{
 		Candidate.Foundation = Parts[0];
 		Candidate.ComponentId = FCString::Atoi(*Parts[1]);
-		Candidate.Transport = Parts[2];
+		Candidate.Transport = EICETransport::UDP;
 		Candidate.Priority = FCString::Atoi(*Parts[3]);
 		Candidate.Address = Parts[4];
 		Candidate.Port = FCString::Atoi(*Parts[5]);
@@ -94,1427 +135,4273 @@ FICECandidate FICECandidate::FromString(const FString& CandidateString)
 			{
 				Candidate.Type = EICECandidateType::Relayed;
 			}
+			else if (Parts[7] == TEXT("prflx"))
+			{
+				Candidate.Type = EICECandidateType::PeerReflexive;
+			}
 		}
 	}
 	
 	return Candidate;
 }
 
-FICEAgent::FICEAgent(const FICEAgentConfig& InConfig)
-	: Config(InConfig)
-	, Socket(nullptr)
-	, TURNSocket(nullptr)
-	, TURNAllocationLifetime(600)
-	, TimeSinceTURNRefresh(0.0f)
-	, TURNChannelNumber(STUNConstants::CHANNEL_NUMBER_MIN)
-	, bTURNAllocationActive(false)
-	, bIsConnected(false)
-	, ConnectionState(EICEConnectionState::New)
-	, DirectConnectionAttempts(0)
-	, TotalConnectionAttempts(0)
-	, RetryDelay(1.0f)
-	, TimeSinceLastAttempt(0.0f)
-	, bHandshakeSent(false)
-	, bHandshakeReceived(false)
-	, HandshakeTimeout(MAX_HANDSHAKE_TIMEOUT)
-	, TimeSinceHandshakeStart(0.0f)
-	, TimeSinceLastHandshakeSend(0.0f)
+namespace ICECandidateBinary
 {
-	FMemory::Memzero(TURNTransactionID, sizeof(TURNTransactionID));
+	// Flags byte: type in bits 0-1, IPv6 in bit 2, related address present in bit 3, transport in bits 4-5
+	constexpr uint8 TYPE_MASK = 0x03;
+	constexpr uint8 FLAG_IPV6 = 0x04;
+	constexpr uint8 FLAG_RELATED = 0x08;
+	constexpr uint8 TRANSPORT_SHIFT = 4;
+
+	/** Append the raw bytes of a numeric address and a port (network order) */
+	bool WriteAddress(ISocketSubsystem* SocketSubsystem, const FString& Address, int32 Port, bool bIPv6, TArray<uint8>& Out)
+	{
+		TSharedPtr<FInternetAddr> Addr = SocketSubsystem->GetAddressFromString(Address);
+		if (!Addr.IsValid() || !Addr->IsValid())
+		{
+			return false;
+		}
+
+		const TArray<uint8> RawIp = Addr->GetRawIp();
+		if (RawIp.Num() != (bIPv6 ? 16 : 4))
+		{
+			return false;
+		}
+		Out.Append(RawIp);
+		Out.Add((uint8)(Port >> 8));
+		Out.Add((uint8)(Port & 0xFF));
+		return true;
+	}
+
+	/** Read an address written by WriteAddress */
+	bool ReadAddress(ISocketSubsystem* SocketSubsystem, const uint8* Data, int32 Size, int32& Offset, bool bIPv6, FString& OutAddress, int32& OutPort)
+	{
+		const int32 IpSize = bIPv6 ? 16 : 4;
+		if (Offset + IpSize + 2 > Size)
+		{
+			return false;
+		}
+
+		TSharedRef<FInternetAddr> Addr = SocketSubsystem->CreateInternetAddr(bIPv6 ? FNetworkProtocolTypes::IPv6 : FNetworkProtocolTypes::IPv4);
+		Addr->SetRawIp(TArray<uint8>(Data + Offset, IpSize));
+		OutAddress = Addr->ToString(false);
+		OutPort = (Data[Offset + IpSize] << 8) | Data[Offset + IpSize + 1];
+		Offset += IpSize + 2;
+		return true;
+	}
 }
 
-FICEAgent::~FICEAgent()
+bool FICECandidate::ToBinary(TArray<uint8>& Out) const
 {
-	Close();
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	const FTCHARToUTF8 FoundationUTF8(*Foundation);
+	if (!SocketSubsystem || FoundationUTF8.Length() > 255)
+	{
+		return false;
+	}
+
+	const bool bIPv6 = IsIPv6();
+	const bool bHasRelated = !RelatedAddress.IsEmpty();
+	const int32 StartSize = Out.Num();
+
+	// flags, component, priority (network order), foundation (length-prefixed), address, port, [related address, port]
+	Out.Add((uint8)Type | (bIPv6 ? ICECandidateBinary::FLAG_IPV6 : 0) | (bHasRelated ? ICECandidateBinary::FLAG_RELATED : 0) |
+		((uint8)Transport << ICECandidateBinary::TRANSPORT_SHIFT));
+	Out.Add((uint8)ComponentId);
+	const uint32 UnsignedPriority = (uint32)Priority;
+	Out.Add((uint8)(UnsignedPriority >> 24));
+	Out.Add((uint8)(UnsignedPriority >> 16));
+	Out.Add((uint8)(UnsignedPriority >> 8));
+	Out.Add((uint8)UnsignedPriority);
+	Out.Add((uint8)FoundationUTF8.Length());
+	Out.Append((const uint8*)FoundationUTF8.Get(), FoundationUTF8.Length());
+
+	if (!ICECandidateBinary::WriteAddress(SocketSubsystem, Address, Port, bIPv6, Out) ||
+		(bHasRelated && !ICECandidateBinary::WriteAddress(SocketSubsystem, RelatedAddress, RelatedPort, bIPv6, Out)))
+	{
+		Out.SetNum(StartSize);
+		return false;
+	}
+	return true;
 }
 
-bool FICEAgent::GatherCandidates()
+bool FICECandidate::FromBinary(const uint8* Data, int32 Size, int32& Offset, FICECandidate& OutCandidate)
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Gathering ICE candidates"));
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem || Offset + 7 > Size)
+	{
+		return false;
+	}
 
-	LocalCandidates.Empty();
+	const uint8 Flags = Data[Offset];
+	if ((Flags >> ICECandidateBinary::TRANSPORT_SHIFT) != (uint8)EICETransport::UDP)
+	{
+		return false;
+	}
+	const bool bIPv6 = (Flags & ICECandidateBinary::FLAG_IPV6) != 0;
 
-	// Gather host candidates
-	GatherHostCandidates();
+	FICECandidate Candidate;
+	Candidate.Type = (EICECandidateType)(Flags & ICECandidateBinary::TYPE_MASK);
+	Candidate.ComponentId = Data[Offset + 1];
+	Candidate.Priority = (int32)(((uint32)Data[Offset + 2] << 24) | ((uint32)Data[Offset + 3] << 16) | ((uint32)Data[Offset + 4] << 8) | Data[Offset + 5]);
 
-	// Gather server reflexive candidates (STUN)
-	if (Config.STUNServers.Num() > 0)
+	const int32 FoundationLength = Data[Offset + 6];
+	int32 ReadOffset = Offset + 7;
+	if (ReadOffset + FoundationLength > Size)
 	{
-		GatherServerReflexiveCandidates();
+		return false;
 	}
+	const FUTF8ToTCHAR FoundationTCHAR((const ANSICHAR*)(Data + ReadOffset), FoundationLength);
+	Candidate.Foundation = FString(FoundationTCHAR.Length(), FoundationTCHAR.Get());
+	ReadOffset += FoundationLength;
 
-	// Gather relayed candidates (TURN)
-	if (Config.TURNServers.Num() > 0)
+	if (!ICECandidateBinary::ReadAddress(SocketSubsystem, Data, Size, ReadOffset, bIPv6, Candidate.Address, Candidate.Port))
 	{
-		GatherRelayedCandidates();
+		return false;
+	}
+	if ((Flags & ICECandidateBinary::FLAG_RELATED) &&
+		!ICECandidateBinary::ReadAddress(SocketSubsystem, Data, Size, ReadOffset, bIPv6, Candidate.RelatedAddress, Candidate.RelatedPort))
+	{
+		return false;
 	}
 
-	UE_LOG(LogOnlineICE, Log, TEXT("Gathered %d ICE candidates"), LocalCandidates.Num());
-	return LocalCandidates.Num() > 0;
+	Offset = ReadOffset;
+	OutCandidate = MoveTemp(Candidate);
+	return true;
 }
 
-void FICEAgent::GatherHostCandidates()
+FString FICECandidatePair::ToString() const
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Gathering host candidates"));
-
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	if (!SocketSubsystem)
+	const TCHAR* StateName = TEXT("Unknown");
+	switch (State)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
-		return;
+		case EICECandidatePairState::Frozen:     StateName = TEXT("Frozen"); break;
+		case EICECandidatePairState::Waiting:    StateName = TEXT("Waiting"); break;
+		case EICECandidatePairState::InProgress: StateName = TEXT("InProgress"); break;
+		case EICECandidatePairState::Succeeded:  StateName = TEXT("Succeeded"); break;
+		case EICECandidatePairState::Failed:     StateName = TEXT("Failed"); break;
 	}
 
-	// Get local address
-	bool bCanBindAll;
-	TSharedPtr<FInternetAddr> LocalAddr = SocketSubsystem->GetLocalHostAddr(*GLog, bCanBindAll);
-	if (!LocalAddr.IsValid() || !LocalAddr->IsValid())
+	return FString::Printf(TEXT("%s:%d -> %s:%d [%s] priority=%llu foundation=%s%s"),
+		*Local.Address, Local.Port,
+		*Remote.Address, Remote.Port,
+		StateName,
+		Priority,
+		*Foundation,
+		IsRelayed() ? TEXT(" (relay)") : TEXT(""));
+}
+
+void FICEPairStats::AddRTTSample(float RTT)
+{
+	if (RTTSamples == 0)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get local address"));
-		return;
+		SmoothedRTT = RTT;
+		Jitter = 0.0f;
+	}
+	else
+	{
+		// RFC 6298 smoothing (alpha = 1/8), jitter as in RFC 3550 (1/16 of the change between samples)
+		SmoothedRTT += (RTT - SmoothedRTT) / 8.0f;
+		Jitter += (FMath::Abs(RTT - LatestRTT) - Jitter) / 16.0f;
 	}
 
-	FICECandidate HostCandidate;
-	HostCandidate.Foundation = TEXT("1");
-	HostCandidate.ComponentId = 1;
-	HostCandidate.Transport = TEXT("UDP");
-	HostCandidate.Priority = CalculatePriority(EICECandidateType::Host, 65535, 1);
-	HostCandidate.Address = LocalAddr->ToString(false);
-	// Port will be assigned when socket is created during connectivity checks
-	// We use 0 to indicate "any available port"
-	HostCandidate.Port = 0;
-	HostCandidate.Type = EICECandidateType::Host;
-
-	LocalCandidates.Add(HostCandidate);
+	LatestRTT = RTT;
+	++RTTSamples;
+}
 
-	UE_LOG(LogOnlineICE, Log, TEXT("Added host candidate: %s"), *HostCandidate.ToString());
+FString FICEPairStats::ToString() const
+{
+	return FString::Printf(TEXT("rtt=%.1fms (last %.1fms) jitter=%.1fms loss=%.1f%% (%u/%u answered, %u lost)"),
+		SmoothedRTT, LatestRTT, Jitter, GetLossRate() * 100.0f, ResponsesReceived, RequestsSent, RequestsLost);
 }
 
-void FICEAgent::GatherServerReflexiveCandidates()
+/** Upper bounds of FICELatencyHistogram buckets (ms), the last bucket has none */
+static const float HistogramBucketBounds[FICELatencyHistogram::NUM_BUCKETS - 1] =
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Gathering server reflexive candidates"));
+	1.0f, 2.0f, 5.0f, 10.0f, 25.0f, 50.0f, 100.0f, 250.0f, 500.0f, 1000.0f, 2500.0f, 5000.0f
+};
 
-	for (const FString& STUNServer : Config.STUNServers)
+void FICELatencyHistogram::AddSample(float Milliseconds)
+{
+	int32 Bucket = 0;
+	while (Bucket < NUM_BUCKETS - 1 && Milliseconds > HistogramBucketBounds[Bucket])
 	{
-		FString PublicIP;
-		int32 PublicPort;
+		++Bucket;
+	}
+	++Buckets[Bucket];
 
-		if (PerformSTUNRequest(STUNServer, PublicIP, PublicPort))
-		{
-			FICECandidate SrflxCandidate;
-			SrflxCandidate.Foundation = TEXT("2");
-			SrflxCandidate.ComponentId = 1;
-			SrflxCandidate.Transport = TEXT("UDP");
-			SrflxCandidate.Priority = CalculatePriority(EICECandidateType::ServerReflexive, 65535, 1);
-			SrflxCandidate.Address = PublicIP;
-			SrflxCandidate.Port = PublicPort;
-			SrflxCandidate.Type = EICECandidateType::ServerReflexive;
+	Min = Count > 0 ? FMath::Min(Min, Milliseconds) : Milliseconds;
+	Max = Count > 0 ? FMath::Max(Max, Milliseconds) : Milliseconds;
+	Sum += Milliseconds;
+	++Count;
+}
+
+void FICELatencyHistogram::Reset()
+{
+	FMemory::Memzero(Buckets);
+	Count = 0;
+	Min = 0.0f;
+	Max = 0.0f;
+	Sum = 0.0;
+}
 
-			LocalCandidates.Add(SrflxCandidate);
+float FICELatencyHistogram::GetPercentile(float Percentile) const
+{
+	if (Count == 0)
+	{
+		return 0.0f;
+	}
 
-			UE_LOG(LogOnlineICE, Log, TEXT("Added server reflexive candidate: %s"), *SrflxCandidate.ToString());
-			break; // Only need one STUN server to succeed
+	const uint32 Rank = FMath::Max<uint32>(1, FMath::CeilToInt(Count * FMath::Clamp(Percentile, 0.0f, 100.0f) / 100.0f));
+	uint32 Seen = 0;
+	for (int32 Bucket = 0; Bucket < NUM_BUCKETS - 1; ++Bucket)
+	{
+		Seen += Buckets[Bucket];
+		if (Seen >= Rank)
+		{
+			return FMath::Min(HistogramBucketBounds[Bucket], Max);
 		}
 	}
+	return Max;
 }
 
-void FICEAgent::GatherRelayedCandidates()
+FString FICELatencyHistogram::ToString() const
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Gathering relayed candidates via TURN"));
-
-	if (Config.TURNServers.Num() == 0)
+	if (Count == 0)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("No TURN servers configured"));
-		return;
+		return TEXT("no samples");
 	}
+	return FString::Printf(TEXT("n=%u min=%.1fms mean=%.1fms p50<=%.0fms p95<=%.0fms max=%.1fms"),
+		Count, Min, GetMean(), GetPercentile(50.0f), GetPercentile(95.0f), Max);
+}
 
-	for (const FString& TURNServer : Config.TURNServers)
-	{
-		FString RelayIP;
-		int32 RelayPort;
+void FICEAgentStats::Reset()
+{
+	GatheringTime.Reset();
+	ServerResponseTimes.Empty();
+	ConnectTime.Reset();
+	ConnectivityChecksSent = 0;
+	ConsentChecksSent = 0;
+	DirectConnections = 0;
+	RelayedConnections = 0;
+	PacketsSent = 0;
+	BytesSent = 0;
+	PacketsReceived = 0;
+	BytesReceived = 0;
+	RelayedBytesSent = 0;
+	RelayedBytesReceived = 0;
+	SendFailures = 0;
+	TURNRefreshLatency.Reset();
+	TURNBindLatency.Reset();
+	TURNFailures = 0;
+}
 
-		if (PerformTURNAllocation(TURNServer, Config.TURNUsername, Config.TURNCredential, RelayIP, RelayPort))
-		{
-			FICECandidate RelayCandidate;
-			RelayCandidate.Foundation = TEXT("3");
-			RelayCandidate.ComponentId = 1;
-			RelayCandidate.Transport = TEXT("UDP");
-			RelayCandidate.Priority = CalculatePriority(EICECandidateType::Relayed, 65535, 1);
-			RelayCandidate.Address = RelayIP;
-			RelayCandidate.Port = RelayPort;
-			RelayCandidate.Type = EICECandidateType::Relayed;
+void FICEAgentStats::Dump(FOutputDevice& Ar) const
+{
+	Ar.Logf(TEXT("Gathering: %s"), *GatheringTime.ToString());
+	for (const TPair<FString, FICELatencyHistogram>& Server : ServerResponseTimes)
+	{
+		Ar.Logf(TEXT("  Server %s: %s"), *Server.Key, *Server.Value.ToString());
+	}
+	Ar.Logf(TEXT("Connect: %s"), *ConnectTime.ToString());
+	Ar.Logf(TEXT("Checks: %u connectivity, %u consent; selected pairs: %u direct, %u relayed"),
+		ConnectivityChecksSent, ConsentChecksSent, DirectConnections, RelayedConnections);
+	Ar.Logf(TEXT("Sent: %llu packets, %llu bytes (%llu relayed), %u failed"), PacketsSent, BytesSent, RelayedBytesSent, SendFailures);
+	Ar.Logf(TEXT("Received: %llu packets, %llu bytes (%llu relayed)"), PacketsReceived, BytesReceived, RelayedBytesReceived);
+	Ar.Logf(TEXT("TURN Refresh: %s"), *TURNRefreshLatency.ToString());
+	Ar.Logf(TEXT("TURN Permission/Channel: %s (%u transactions failed)"), *TURNBindLatency.ToString(), TURNFailures);
+}
+
+FICEAgent::FICEAgent(const FICEAgentConfig& InConfig)
+	: Config(InConfig)
+	, Socket(nullptr)
+	, bSharedSocket(false)
+	, bMultiplexTURNOnSharedSocket(false)
+	, ReportedDroppedPackets(0)
+	, TURNSocket(nullptr)
+	, bTURNServerSelected(false)
+	, TURNAllocationLifetime(600)
+	, TimeSinceTURNRefresh(0.0f)
+	, TURNChannelNumber(0)
+	, TimeSinceChannelBindAttempt(0.0f)
+	, TimeSinceRelayBindRefresh(0.0f)
+	, bTURNAllocationActive(false)
+	, bIsConnected(false)
+	, SelectedCheckToken(0)
+	, bRestartInProgress(false)
+	, bDirectUpgradeInProgress(false)
+	, DirectUpgradeRounds(0)
+	, TimeSinceDirectUpgradeRound(0.0f)
+	, bTURNReleasePending(false)
+	, TimeSinceDirectUpgrade(0.0f)
+	, DirectUpgradeCount(0)
+	, ConsentToken(0)
+	, bConsentPending(false)
+	, TimeSinceConsentCheck(0.0f)
+	, NextConsentCheckDelay(0.0f)
+	, TimeSinceConsent(0.0f)
+	, ConnectionState(EICEConnectionState::New)
+	, TotalConnectionAttempts(0)
+	, bControlling(false)
+	, NextHandshakeSequence(0)
+	, RemoteSequenceMax(0)
+	, RemoteSequenceWindow(0)
+	, bRemoteSequenceSeen(false)
+	, RejectedHandshakeCount(0)
+	, bRemoteCredentialsRejected(false)
+	, bHasRemoteKeyShare(false)
+	, SendScheduler(InConfig.PacingInitialRate, InConfig.PacingMinRate, InConfig.PacingMaxRate, InConfig.PacingBurstSize,
+		InConfig.PacingQueueLimit, InConfig.PacingTargetDelay)
+	, FECCodec(InConfig.FECMinLossRate, InConfig.FECMaxGroupSize)
+	, bFECActive(false)
+	, ChecksStartTime(0.0)
+	, bChecksInProgress(false)
+	, TimeSinceLastPacedCheck(0.0f)
+	, NextCheckToken(0)
+	, NextRelayChannel(STUNConstants::CHANNEL_NUMBER_MIN)
+	, bGatheringInProgress(false)
+	, bWaitingForDNS(false)
+	, TimeSinceGatheringStart(0.0f)
+{
+	ResetLocalCandidates();
+	FMemory::Memzero(RemoteKeyShare);
 
-			LocalCandidates.Add(RelayCandidate);
+	// Pair tokens start at a random value so stale responses from a previous agent don't match
+	NextCheckToken = ((uint32)FMath::Rand() << 16) ^ FPlatformTime::Cycles();
+	NextHandshakeSequence = ((uint32)FMath::Rand() << 16) ^ (uint32)FMath::Rand();
 
-			UE_LOG(LogOnlineICE, Log, TEXT("Added relay candidate: %s"), *RelayCandidate.ToString());
-			break; // Only need one TURN server to succeed
-		}
+	GenerateLocalCredentials();
+
+	// Size the send scratch buffers once, so sends at MTU size never allocate
+	SendAllocationCount = 0;
+	SendGatherBuffer.Reserve(SEND_HEADROOM + FICEPacketSlot::MAX_PACKET_SIZE);
+	RelaySendBuffer.Reserve(SEND_HEADROOM + FICEPacketSlot::MAX_PACKET_SIZE);
+	if (Config.bEncryptTraffic)
+	{
+		SecureSendBuffer.Reserve(SEND_HEADROOM + FICESecureChannel::RECORD_OVERHEAD + FICEPacketSlot::MAX_PACKET_SIZE);
+	}
+
+	CoalescedSize = 0;
+	CoalesceStartTime = 0.0;
+	CoalescedMessageCount = 0;
+	CoalescedDatagramCount = 0;
+	ReceiveBundleOffset = 0;
+	if (Config.bCoalesceSends)
+	{
+		CoalesceBuffer.Reserve(SEND_HEADROOM + FICESecureChannel::RECORD_OVERHEAD + FICEPacketSlot::MAX_PACKET_SIZE);
+		ReceiveBundleBuffer.Reserve(FICEPacketSlot::MAX_PACKET_SIZE);
+	}
+	if (Config.bEnableFEC)
+	{
+		FECSendBuffer.Reserve(SEND_HEADROOM + FICEFECCodec::HEADER_SIZE + FICEPacketSlot::MAX_PACKET_SIZE);
 	}
 }
 
-bool FICEAgent::PerformSTUNRequest(const FString& ServerAddress, FString& OutPublicIP, int32& OutPublicPort)
+FICEAgent::~FICEAgent()
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Performing STUN request to: %s"), *ServerAddress);
+	Close();
+}
 
-	// Parse server address
-	FString Host;
-	int32 Port;
-	ParseServerAddress(ServerAddress, Host, Port, 3478);
+bool FICEAgent::GatherCandidates()
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Gathering ICE candidates"));
 
-	if (!ValidateSocketSubsystem())
-	{
-		return false;
-	}
+	// Abort any gathering still in flight before starting over
+	CancelGatherRequests();
 
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	ResetLocalCandidates();
 
-	// Resolve STUN server address
-	TSharedPtr<FInternetAddr> STUNAddr = SocketSubsystem->GetAddressFromString(Host);
-	if (!STUNAddr.IsValid() || !STUNAddr->IsValid())
+	// Without credentials no HELLO could be signed, try again in case the random source was only briefly unavailable
+	if (LocalPassword.IsEmpty() && !GenerateLocalCredentials())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to resolve STUN server: %s"), *Host);
 		return false;
 	}
-	STUNAddr->SetPort(Port);
 
-	// Create a temporary socket for STUN request
-	FSocket* STUNSocket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("STUN"), STUNAddr->GetProtocolType());
-	if (!STUNSocket)
+	// Every server request is sent from the agent socket, so the mappings it learns are those of the checked port
+	if (!CreateCheckSocket())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to create STUN socket"));
 		return false;
 	}
 
-	// Build and send STUN Binding Request
-	uint8 STUNRequest[20];
-	BuildSTUNBindingRequest(STUNRequest);
+	TimeSinceGatheringStart = 0.0f;
+	bGatheringInProgress = true;
 
-	int32 BytesSent;
-	if (!STUNSocket->SendTo(STUNRequest, sizeof(STUNRequest), BytesSent, *STUNAddr))
+	if (ConnectionState == EICEConnectionState::New || ConnectionState == EICEConnectionState::Failed)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send STUN request"));
-		SocketSubsystem->DestroySocket(STUNSocket);
-		return false;
+		UpdateConnectionState(EICEConnectionState::Gathering);
 	}
 
-	// Wait for response with timeout
-	if (!STUNSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(5.0)))
+	// Gather host candidates (available immediately)
+	GatherHostCandidates();
+
+	// Server hostnames still looked up for the first time hold the server requests back until Tick,
+	// cached lookups answer immediately
+	bWaitingForDNS = IsServerResolutionPending();
+	if (bWaitingForDNS)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("STUN request timeout"));
-		SocketSubsystem->DestroySocket(STUNSocket);
-		return false;
+		UE_LOG(LogOnlineICE, Log, TEXT("Waiting for DNS before querying STUN/TURN servers"));
 	}
-
-	// Receive STUN response
-	uint8 STUNResponse[1024];
-	int32 BytesRead = 0;
-	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
-
-	if (!STUNSocket->RecvFrom(STUNResponse, sizeof(STUNResponse), BytesRead, *FromAddr))
+	else
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to receive STUN response"));
-		SocketSubsystem->DestroySocket(STUNSocket);
-		return false;
+		GatherServerCandidates();
 	}
 
-	// Parse STUN response
-	bool bSuccess = ParseSTUNResponse(STUNResponse, BytesRead, OutPublicIP, OutPublicPort);
-	
-	if (bSuccess)
+	const bool bStarted = LocalCandidates.Num() > 0 || GatherRequests.Num() > 0 || bWaitingForDNS;
+
+	// Nothing left in flight (no servers configured or every request failed to send)
+	if (GatherRequests.Num() == 0 && !bWaitingForDNS)
 	{
-		UE_LOG(LogOnlineICE, Log, TEXT("STUN discovered public address: %s:%d"), *OutPublicIP, OutPublicPort);
+		CompleteGathering();
 	}
 	else
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("Failed to parse STUN response"));
+		UE_LOG(LogOnlineICE, Log, TEXT("Gathering in progress: %d candidates ready, %d server requests pending (deadline %.1fs)"),
+			LocalCandidates.Num(), GatherRequests.Num(), Config.GatheringTimeout);
 	}
 
-	SocketSubsystem->DestroySocket(STUNSocket);
-	return bSuccess;
+	return bStarted;
 }
 
-bool FICEAgent::PerformTURNAllocation(const FString& ServerAddress, const FString& Username, const FString& Credential, FString& OutRelayIP, int32& OutRelayPort)
+void FICEAgent::GatherServerCandidates()
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Performing TURN allocation to: %s"), *ServerAddress);
+	// Gather server reflexive candidates (STUN) - requests are answered from Tick
+	if (Config.STUNServers.Num() > 0)
+	{
+		GatherServerReflexiveCandidates();
+	}
 
-	if (Username.IsEmpty() || Credential.IsEmpty())
+	// Gather relayed candidates (TURN) - allocation is completed from Tick
+	if (Config.TURNServers.Num() > 0)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("TURN username or credential not configured"));
-		return false;
+		GatherRelayedCandidates();
 	}
+}
 
-	// Parse server address
-	FString Host;
-	int32 Port = 3478; // Default TURN port
+bool FICEAgent::IsGathering() const
+{
+	return bGatheringInProgress;
+}
 
-	int32 ColonPos;
-	if (ServerAddress.FindChar(':', ColonPos))
+void FICEAgent::AddLocalCandidate(const FICECandidate& Candidate)
+{
+	// Appended to the range of its type, the ranges after it shift by one
+	const int32 TypeIndex = (int32)Candidate.Type;
+	check(TypeIndex < NUM_CANDIDATE_TYPES);
+	LocalCandidates.Insert(Candidate, LocalCandidateTypeEnd[TypeIndex]);
+	for (int32 Index = TypeIndex; Index < NUM_CANDIDATE_TYPES; ++Index)
 	{
-		Host = ServerAddress.Left(ColonPos);
-		Port = FCString::Atoi(*ServerAddress.Mid(ColonPos + 1));
+		++LocalCandidateTypeEnd[Index];
 	}
-	else
+
+	// Candidates gathered while checks are running join the checklist
+	if (bChecksInProgress)
 	{
-		Host = ServerAddress;
+		for (const FICECandidate& Remote : RemoteCandidates)
+		{
+			const int32 PairIndex = AddCandidatePair(Candidate, Remote);
+			if (PairIndex != INDEX_NONE)
+			{
+				InitializePairState(PairIndex);
+			}
+		}
 	}
 
+	// Trickle the candidate to listeners as soon as it is known
+	OnLocalCandidateGathered.Broadcast(Candidate);
+}
+
+void FICEAgent::GatherHostCandidates()
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Gathering host candidates"));
+
 	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
 	if (!SocketSubsystem)
 	{
 		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
-		return false;
+		return;
 	}
 
-	// Resolve TURN server address
-	TSharedPtr<FInternetAddr> TURNAddr = SocketSubsystem->GetAddressFromString(Host);
-	if (!TURNAddr.IsValid() || !TURNAddr->IsValid())
+	// The agent socket is bound to the any address, so every interface reaches it on the same port
+	// (IPv6 interfaces only when the socket is dual-stack)
+	const bool bDualStack = Socket && Socket->GetProtocol() == FNetworkProtocolTypes::IPv6;
+
+	TArray<FString> Addresses;
+	TArray<TSharedPtr<FInternetAddr>> AdapterAddresses;
+	if (SocketSubsystem->GetLocalAdapterAddresses(AdapterAddresses))
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to resolve TURN server: %s"), *Host);
-		return false;
-	}
+		for (const TSharedPtr<FInternetAddr>& AdapterAddr : AdapterAddresses)
+		{
+			if (!AdapterAddr.IsValid() || !AdapterAddr->IsValid())
+			{
+				continue;
+			}
 
-	TURNAddr->SetPort(Port);
+			const FString Address = GetCandidateAddress(*AdapterAddr);
+			const bool bIPv6 = Address.Contains(TEXT(":"));
 
-	// Clean up existing TURN socket if any
-	if (TURNSocket)
-	{
-		SocketSubsystem->DestroySocket(TURNSocket);
-		TURNSocket = nullptr;
-	}
+			// Loopback never reaches a peer; link-local IPv6 needs a scope ID candidates can't carry
+			if (bIPv6 && (!bDualStack || Address == TEXT("::1") || Address.StartsWith(TEXT("fe80:"))))
+			{
+				continue;
+			}
+			if (!bIPv6 && (Address.StartsWith(TEXT("127.")) || Address == TEXT("0.0.0.0")))
+			{
+				continue;
+			}
 
-	// Create socket for TURN (keep it persistent for refresh and data relay)
-	TURNSocket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("TURN"), TURNAddr->GetProtocolType());
-	if (!TURNSocket)
-	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to create TURN socket"));
-		return false;
+			Addresses.AddUnique(Address);
+		}
 	}
 
-	// Store TURN server address for later use (refresh, permissions, etc.)
-	TURNServerAddr = TURNAddr;
-
-	// First attempt: Send request without authentication to get realm and nonce
-	// The server will respond with 401 Unauthorized if authentication is required
-	bool bSuccess = PerformTURNAllocationRequest(TURNAddr, Username, Credential, FString(), FString(), OutRelayIP, OutRelayPort, false);
-	
-	if (bSuccess)
+	// No adapter list on this platform: fall back to the default route address
+	if (Addresses.Num() == 0)
 	{
-		// Store relay address for data transmission
-		TURNRelayAddr = SocketSubsystem->GetAddressFromString(OutRelayIP);
-		if (TURNRelayAddr.IsValid())
+		bool bCanBindAll;
+		TSharedPtr<FInternetAddr> LocalAddr = SocketSubsystem->GetLocalHostAddr(*GLog, bCanBindAll);
+		if (!LocalAddr.IsValid() || !LocalAddr->IsValid())
 		{
-			TURNRelayAddr->SetPort(OutRelayPort);
+			UE_LOG(LogOnlineICE, Error, TEXT("Failed to get local address"));
+			return;
 		}
-		
-		bTURNAllocationActive = true;
-		TimeSinceTURNRefresh = 0.0f;
-		
-		UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation successful, keeping socket open for data relay"));
+		Addresses.Add(GetCandidateAddress(*LocalAddr));
 	}
-	else
+
+	// IPv6 first (RFC 8421), then in adapter order; the local preference keeps that order in the checklist
+	Addresses.StableSort([](const FString& A, const FString& B)
+	{
+		return A.Contains(TEXT(":")) && !B.Contains(TEXT(":"));
+	});
+	if (Addresses.Num() > MAX_HOST_CANDIDATES)
 	{
-		// Clean up on failure
-		SocketSubsystem->DestroySocket(TURNSocket);
-		TURNSocket = nullptr;
+		UE_LOG(LogOnlineICE, Log, TEXT("Keeping %d of %d local addresses as host candidates"), MAX_HOST_CANDIDATES, Addresses.Num());
+		Addresses.SetNum(MAX_HOST_CANDIDATES);
 	}
-	
-	return bSuccess;
-}
 
-bool FICEAgent::PerformTURNAllocationRequest(const TSharedPtr<FInternetAddr>& TURNAddr, 
-	const FString& Username, const FString& Credential, const FString& Realm, const FString& Nonce,
-	FString& OutRelayIP, int32& OutRelayPort, bool bIsRetry)
-{
-	// Build TURN Allocate Request (RFC 5766)
-	// Message format: Type (2) | Length (2) | Magic Cookie (4) | Transaction ID (12) | Attributes
-	TArray<uint8> TURNRequest;
-	// 512 bytes to accommodate header(20) + REQUESTED-TRANSPORT(8) + USERNAME(variable) + 
-	// REALM(variable) + NONCE(variable) + MESSAGE-INTEGRITY(24) with padding
-	TURNRequest.SetNum(512);
-	FMemory::Memzero(TURNRequest.GetData(), TURNRequest.Num());
-
-	int32 Offset = 0;
-
-	// Message Type: Allocate Request (0x0003)
-	TURNRequest[Offset++] = 0x00;
-	TURNRequest[Offset++] = 0x03;
+	for (int32 AddressIndex = 0; AddressIndex < Addresses.Num(); ++AddressIndex)
+	{
+		FICECandidate HostCandidate;
+		// Each base address gets its own foundation, so one interface failing doesn't freeze the others
+		HostCandidate.Foundation = AddressIndex == 0 ? FString(TEXT("1")) : FString::Printf(TEXT("1%d"), AddressIndex);
+		HostCandidate.ComponentId = 1;
+		HostCandidate.Transport = EICETransport::UDP;
+		HostCandidate.Priority = CalculatePriority(EICECandidateType::Host, 65535 - AddressIndex, 1);
+		HostCandidate.Address = Addresses[AddressIndex];
+		// The agent socket is bound before gathering starts
+		HostCandidate.Port = Socket ? Socket->GetPortNo() : 0;
+		HostCandidate.Type = EICECandidateType::Host;
 
-	// Message Length: Will be set later
-	int32 LengthOffset = Offset;
-	Offset += 2;
+		UE_LOG(LogOnlineICE, Log, TEXT("Added host candidate: %s"), *HostCandidate.ToString());
+		AddLocalCandidate(HostCandidate);
+	}
+}
 
-	// Magic Cookie: 0x2112A442
-	TURNRequest[Offset++] = 0x21;
-	TURNRequest[Offset++] = 0x12;
-	TURNRequest[Offset++] = 0xA4;
-	TURNRequest[Offset++] = 0x42;
+void FICEAgent::GatherServerReflexiveCandidates()
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Gathering server reflexive candidates"));
 
-	// Transaction ID: Random bytes (RFC 5389)
-	uint8 TransactionID[STUNConstants::TRANSACTION_ID_LENGTH];
-	for (int32 i = 0; i < STUNConstants::TRANSACTION_ID_LENGTH; i++)
+	// Query every STUN server at once; the first response is trickled straight away, the others still run to their
+	// answer or timeout so every server's RTT is measured, and a mapping already gathered is dropped as redundant
+	for (const FString& STUNServer : Config.STUNServers)
 	{
-		TransactionID[i] = FMath::Rand() & 0xFF;
-		TURNRequest[Offset++] = TransactionID[i];
+		StartSTUNRequest(STUNServer);
 	}
+}
 
-	// Add REQUESTED-TRANSPORT attribute (UDP = 17)
-	// Type: 0x0019, Length: 4
-	TURNRequest[Offset++] = 0x00;
-	TURNRequest[Offset++] = 0x19;
-	TURNRequest[Offset++] = 0x00;
-	TURNRequest[Offset++] = 0x04;
-	TURNRequest[Offset++] = 17; // UDP protocol
-	TURNRequest[Offset++] = 0x00;
-	TURNRequest[Offset++] = 0x00;
-	TURNRequest[Offset++] = 0x00;
+void FICEAgent::GatherRelayedCandidates()
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Gathering relayed candidates via TURN"));
 
-	// Add USERNAME attribute
-	// Type: 0x0006
-	int32 UsernameLen = Username.Len();
-	TURNRequest[Offset++] = 0x00;
-	TURNRequest[Offset++] = 0x06;
-	TURNRequest[Offset++] = (UsernameLen >> 8) & 0xFF;
-	TURNRequest[Offset++] = UsernameLen & 0xFF;
-	for (int32 i = 0; i < UsernameLen; i++)
+	if (Config.TURNServers.Num() == 0)
 	{
-		TURNRequest[Offset++] = Username[i];
+		UE_LOG(LogOnlineICE, Warning, TEXT("No TURN servers configured"));
+		return;
 	}
-	// Pad to 4-byte boundary
-	while (Offset % 4 != 0)
+
+	if (Config.TURNUsername.IsEmpty() || Config.TURNCredential.IsEmpty())
 	{
-		TURNRequest[Offset++] = 0x00;
+		UE_LOG(LogOnlineICE, Error, TEXT("TURN username or credential not configured"));
+		return;
 	}
 
-	// If we have Realm and Nonce, add authentication attributes
-	if (!Realm.IsEmpty() && !Nonce.IsEmpty())
+	// A live allocation from a previous session is still refreshed, hand out its relay address again
+	if (bTURNAllocationActive && TURNSocket && TURNRelayAddr.IsValid() && Config.TURNServers.Contains(ActiveTURNServer))
 	{
-		// Add REALM attribute
-		// Type: 0x0014
-		int32 RealmLen = Realm.Len();
-		TURNRequest[Offset++] = 0x00;
-		TURNRequest[Offset++] = 0x14;
-		TURNRequest[Offset++] = (RealmLen >> 8) & 0xFF;
-		TURNRequest[Offset++] = RealmLen & 0xFF;
-		for (int32 i = 0; i < RealmLen; i++)
-		{
-			TURNRequest[Offset++] = Realm[i];
-		}
-		while (Offset % 4 != 0)
+		UE_LOG(LogOnlineICE, Log, TEXT("Reusing live TURN allocation on %s"), *ActiveTURNServer);
+		AddRelayedCandidate();
+		return;
+	}
+
+	// Allocate on the nearest server: known from a recent pass, or measured now by probing every server at once
+	// (failover to the next one happens from Tick, never blocking)
+	bTURNServerSelected = false;
+	if (Config.TURNServers.Num() == 1)
+	{
+		SelectTURNServer(INDEX_NONE);
+	}
+	else if (GetCachedTURNServerOrder())
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Using cached TURN server selection: %s"), *Config.TURNServers[TURNServerOrder[0]]);
+		bTURNServerSelected = true;
+		StartTURNAllocation(0);
+	}
+	else if (!StartTURNProbes())
+	{
+		SelectTURNServer(INDEX_NONE);
+	}
+}
+
+bool FICEAgent::StartTURNProbes()
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem || !Socket)
+	{
+		return false;
+	}
+
+	int32 NumProbes = 0;
+	for (int32 ServerIndex = 0; ServerIndex < Config.TURNServers.Num(); ++ServerIndex)
+	{
+		const FString& ServerAddress = Config.TURNServers[ServerIndex];
+
+		TSharedPtr<FInternetAddr> TURNAddr;
+		if (ResolveServerAddress(ServerAddress, TURNAddr) != EICEResolveStatus::Resolved)
 		{
-			TURNRequest[Offset++] = 0x00;
+			UE_LOG(LogOnlineICE, Error, TEXT("Failed to resolve TURN server: %s"), *ServerAddress);
+			RecordServerRTT(ServerAddress, 0.0f, false);
+			continue;
 		}
+		TURNAddr = ToSocketAddress(TURNAddr);
+
+		// Every TURN server is a STUN server: an unauthenticated Binding measures the path without allocating anything
+		FICEGatherRequest Request;
+		Request.Type = EICECandidateType::Relayed;
+		Request.bProbe = true;
+		Request.ServerAddress = ServerAddress;
+		Request.ServerIndex = ServerIndex;
+		Request.ServerAddr = TURNAddr;
+		Request.RequestSocket = Socket;
+		FSTUNMessage::GenerateTransactionID(Request.TransactionID);
+		FSTUNMessage ProbeRequest(STUNMessageType::BINDING_REQUEST, Request.TransactionID);
 
-		// Add NONCE attribute
-		// Type: 0x0015
-		int32 NonceLen = Nonce.Len();
-		TURNRequest[Offset++] = 0x00;
-		TURNRequest[Offset++] = 0x15;
-		TURNRequest[Offset++] = (NonceLen >> 8) & 0xFF;
-		TURNRequest[Offset++] = NonceLen & 0xFF;
-		for (int32 i = 0; i < NonceLen; i++)
+		int32 BytesSent;
+		if (!Socket->SendTo(ProbeRequest.GetData(), ProbeRequest.Num(), BytesSent, *TURNAddr))
 		{
-			TURNRequest[Offset++] = Nonce[i];
+			UE_LOG(LogOnlineICE, Warning, TEXT("Failed to send probe to TURN server %s"), *ServerAddress);
+			continue;
 		}
-		while (Offset % 4 != 0)
+
+		Request.SentTime = FPlatformTime::Seconds();
+		GatherRequests.Add(MoveTemp(Request));
+		++NumProbes;
+	}
+
+	if (NumProbes > 0)
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Probing %d TURN servers, allocating on the first to answer"), NumProbes);
+	}
+	return NumProbes > 0;
+}
+
+bool FICEAgent::GetCachedTURNServerOrder()
+{
+	if (Config.ServerSelectionTTL <= 0.0f)
+	{
+		return false;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	TURNServerOrder.Reset();
+	for (int32 ServerIndex = 0; ServerIndex < Config.TURNServers.Num(); ++ServerIndex)
+	{
+		const FICEServerRTT* Measurement = ServerRTTCache.Find(Config.TURNServers[ServerIndex]);
+		if (!Measurement || Now - Measurement->MeasuredTime > Config.ServerSelectionTTL)
 		{
-			TURNRequest[Offset++] = 0x00;
+			return false;
 		}
+		TURNServerOrder.Add(ServerIndex);
+	}
 
-		// Add MESSAGE-INTEGRITY attribute (20 bytes HMAC-SHA1)
-		// Type: 0x0008, Length: 20
-		// Note: This must be the last attribute before FINGERPRINT (which we don't use)
-		int32 MessageIntegrityOffset = Offset;
-		TURNRequest[Offset++] = 0x00;
-		TURNRequest[Offset++] = 0x08;
-		TURNRequest[Offset++] = 0x00;
-		TURNRequest[Offset++] = 0x14; // Length = 20 bytes
-		
-		// Placeholder for HMAC-SHA1 (will be calculated)
-		for (int32 i = 0; i < 20; i++)
+	// Reachable servers first, fastest first; the configured order breaks ties
+	TURNServerOrder.StableSort([this](int32 A, int32 B)
+	{
+		const FICEServerRTT& RTTA = ServerRTTCache[Config.TURNServers[A]];
+		const FICEServerRTT& RTTB = ServerRTTCache[Config.TURNServers[B]];
+		if (RTTA.bReachable != RTTB.bReachable)
 		{
-			TURNRequest[Offset++] = 0x00;
+			return RTTA.bReachable;
 		}
+		return RTTA.bReachable && RTTA.RTT < RTTB.RTT;
+	});
+	return true;
+}
 
-		// Calculate HMAC-SHA1 for MESSAGE-INTEGRITY
-		// According to RFC 5389 Section 15.4, the length field is adjusted to point to 
-		// the end of MESSAGE-INTEGRITY attribute before calculating HMAC
-		int32 MessageLengthForIntegrity = MessageIntegrityOffset - 20 + STUNConstants::MESSAGE_INTEGRITY_ATTR_SIZE;
-		TURNRequest[LengthOffset] = (MessageLengthForIntegrity >> 8) & 0xFF;
-		TURNRequest[LengthOffset + 1] = MessageLengthForIntegrity & 0xFF;
-
-		// Key = MD5(username:realm:password) for long-term credentials
-		FString KeyString = Username + TEXT(":") + Realm + TEXT(":") + Credential;
-		uint8 KeyMD5[16];
-		CalculateMD5(KeyString, KeyMD5);
+void FICEAgent::SelectTURNServer(int32 FastestServerIndex)
+{
+	bTURNServerSelected = true;
 
-		// Calculate HMAC-SHA1 over the message from the STUN header up to (and including)
-		// the attribute preceding MESSAGE-INTEGRITY, which means excluding MESSAGE-INTEGRITY itself
-		// RFC 5389 Section 15.4: "from the STUN header up to, and including, the attribute preceding MESSAGE-INTEGRITY"
-		uint8 HMAC[20];
-		CalculateHMACSHA1(TURNRequest.GetData(), MessageIntegrityOffset, KeyMD5, 16, HMAC);
-		
-		// Copy HMAC to MESSAGE-INTEGRITY attribute
-		for (int32 i = 0; i < 20; i++)
-		{
-			TURNRequest[MessageIntegrityOffset + 4 + i] = HMAC[i];
-		}
-		
-		// Note: The length field has already been set to MessageLengthForIntegrity for 
-		// MESSAGE-INTEGRITY validation. We must NOT overwrite it, as per RFC 5389 Section 15.4.
+	// The fastest server first, the others keep their configured order for failover
+	TURNServerOrder.Reset();
+	if (FastestServerIndex != INDEX_NONE)
+	{
+		TURNServerOrder.Add(FastestServerIndex);
 	}
-	else
+	for (int32 ServerIndex = 0; ServerIndex < Config.TURNServers.Num(); ++ServerIndex)
 	{
-		// Calculate final message length (everything after the header)
-		// Only do this when MESSAGE-INTEGRITY is not present
-		int32 MessageLength = Offset - 20;
-		TURNRequest[LengthOffset] = (MessageLength >> 8) & 0xFF;
-		TURNRequest[LengthOffset + 1] = MessageLength & 0xFF;
+		TURNServerOrder.AddUnique(ServerIndex);
 	}
 
-	// Resize to actual size
-	TURNRequest.SetNum(Offset);
+	StartTURNAllocation(0);
+}
 
-	// Send TURN Allocate request
-	int32 BytesSent;
-	if (!TURNSocket->SendTo(TURNRequest.GetData(), TURNRequest.Num(), BytesSent, *TURNAddr))
+void FICEAgent::RecordServerRTT(const FString& ServerAddress, float RTT, bool bReachable)
+{
+	FICEServerRTT& Measurement = ServerRTTCache.FindOrAdd(ServerAddress);
+	Measurement.RTT = bReachable ? RTT : 0.0f;
+	Measurement.bReachable = bReachable;
+	Measurement.MeasuredTime = FPlatformTime::Seconds();
+}
+
+bool FICEAgent::StartSTUNRequest(const FString& ServerAddress)
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Performing STUN request to: %s"), *ServerAddress);
+
+	if (!ValidateSocketSubsystem())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send TURN Allocate request"));
 		return false;
 	}
 
-	// Wait for response with timeout
-	if (!TURNSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(5.0)))
+	// Resolve STUN server address (from the DNS cache, hostnames were looked up before gathering)
+	TSharedPtr<FInternetAddr> STUNAddr;
+	if (ResolveServerAddress(ServerAddress, STUNAddr) != EICEResolveStatus::Resolved)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("TURN Allocate request timeout"));
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to resolve STUN server: %s"), *ServerAddress);
 		return false;
 	}
+	STUNAddr = ToSocketAddress(STUNAddr);
 
-	// Receive TURN response
-	uint8 TURNResponse[1024];
-	int32 BytesRead = 0;
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	if (!SocketSubsystem)
+	// The request leaves from the agent socket: the reflexive address is the mapping of the port the peer will check
+	if (!Socket)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
+		UE_LOG(LogOnlineICE, Error, TEXT("No ICE socket to send the STUN request from"));
 		return false;
 	}
-	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
 
-	if (!TURNSocket->RecvFrom(TURNResponse, sizeof(TURNResponse), BytesRead, *FromAddr))
+	// Build and send STUN Binding Request (no attributes for basic request)
+	FICEGatherRequest Request;
+	FSTUNMessage::GenerateTransactionID(Request.TransactionID);
+	FSTUNMessage STUNRequest(STUNMessageType::BINDING_REQUEST, Request.TransactionID);
+
+	int32 BytesSent;
+	if (!Socket->SendTo(STUNRequest.GetData(), STUNRequest.Num(), BytesSent, *STUNAddr))
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to receive TURN response"));
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send STUN request"));
 		return false;
 	}
+	Request.SentTime = FPlatformTime::Seconds();
 
-	// Parse TURN response
-	if (BytesRead >= 20)
-	{
-		uint16 MessageType = (TURNResponse[0] << 8) | TURNResponse[1];
-		uint16 MessageLength = (TURNResponse[2] << 8) | TURNResponse[3];
-
-		// Check if it's an Allocate Success Response (0x0103)
-		if (MessageType == 0x0103 && BytesRead >= 20 + MessageLength)
-		{
-			UE_LOG(LogOnlineICE, Log, TEXT("TURN Allocate successful"));
-
-			bool bFoundRelayAddress = false;
-
-			// Parse attributes to find XOR-RELAYED-ADDRESS (0x0016) and LIFETIME (0x000D)
-			int32 AttrOffset = 20;
-			while (AttrOffset < BytesRead)
-			{
-				if (AttrOffset + 4 > BytesRead) break;
+	Request.Type = EICECandidateType::ServerReflexive;
+	Request.ServerAddress = ServerAddress;
+	Request.ServerAddr = STUNAddr;
+	Request.RequestSocket = Socket;
 
-				uint16 AttrType = (TURNResponse[AttrOffset] << 8) | TURNResponse[AttrOffset + 1];
-				uint16 AttrLength = (TURNResponse[AttrOffset + 2] << 8) | TURNResponse[AttrOffset + 3];
+	GatherRequests.Add(MoveTemp(Request));
+	return true;
+}
 
-				if (AttrType == 0x0016 && AttrLength >= 8) // XOR-RELAYED-ADDRESS
-				{
-					// Ensure we have enough bytes to read the attribute value
-					if (AttrOffset + 4 + AttrLength > BytesRead)
-					{
-						UE_LOG(LogOnlineICE, Warning, TEXT("Incomplete XOR-RELAYED-ADDRESS attribute"));
-						break;
-					}
+bool FICEAgent::StartTURNAllocation(int32 OrderIndex)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
+		return false;
+	}
 
-					// Family (1 byte at offset 5)
-					uint8 Family = TURNResponse[AttrOffset + 5];
+	for (; OrderIndex < TURNServerOrder.Num(); ++OrderIndex)
+	{
+		if (!Config.TURNServers.IsValidIndex(TURNServerOrder[OrderIndex]))
+		{
+			continue;
+		}
+		const FString& ServerAddress = Config.TURNServers[TURNServerOrder[OrderIndex]];
+		UE_LOG(LogOnlineICE, Log, TEXT("Performing TURN allocation to: %s"), *ServerAddress);
 
-					if (Family == 0x01) // IPv4
-					{
-						// XOR-ed Port (2 bytes at offset 6-7)
-						uint16 XorPort = (TURNResponse[AttrOffset + 6] << 8) | TURNResponse[AttrOffset + 7];
-						OutRelayPort = XorPort ^ STUNConstants::MAGIC_COOKIE_HIGH;
-
-						// XOR-ed IP (4 bytes at offset 8-11)
-						uint32 XorIP = (TURNResponse[AttrOffset + 8] << 24) | (TURNResponse[AttrOffset + 9] << 16) |
-						              (TURNResponse[AttrOffset + 10] << 8) | TURNResponse[AttrOffset + 11];
-						uint32 RelayIPValue = XorIP ^ STUNConstants::MAGIC_COOKIE;
-
-						// Convert to string
-						OutRelayIP = FString::Printf(TEXT("%d.%d.%d.%d"),
-							(RelayIPValue >> 24) & 0xFF,
-							(RelayIPValue >> 16) & 0xFF,
-							(RelayIPValue >> 8) & 0xFF,
-							RelayIPValue & 0xFF);
-
-						UE_LOG(LogOnlineICE, Log, TEXT("TURN allocated relay address: %s:%d"), *OutRelayIP, OutRelayPort);
-						bFoundRelayAddress = true;
-					}
-				}
-				else if (AttrType == 0x000D && AttrLength == 4) // LIFETIME
-				{
-					// Parse lifetime value (4 bytes, big-endian)
-					if (AttrOffset + 8 <= BytesRead)
-					{
-						TURNAllocationLifetime = (TURNResponse[AttrOffset + 4] << 24) | 
-						                         (TURNResponse[AttrOffset + 5] << 16) |
-						                         (TURNResponse[AttrOffset + 6] << 8) | 
-						                         TURNResponse[AttrOffset + 7];
-						UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation lifetime: %d seconds"), TURNAllocationLifetime);
-					}
-				}
+		// Resolve TURN server address (from the DNS cache)
+		TSharedPtr<FInternetAddr> TURNAddr;
+		if (ResolveServerAddress(ServerAddress, TURNAddr) != EICEResolveStatus::Resolved)
+		{
+			UE_LOG(LogOnlineICE, Error, TEXT("Failed to resolve TURN server: %s"), *ServerAddress);
+			continue;
+		}
 
-				// Move to next attribute (pad to 4-byte boundary)
-				AttrOffset += 4 + ((AttrLength + 3) & ~3);
-			}
+		// Clean up existing TURN socket if any
+		ReleaseTURNSocket();
+		bTURNAllocationActive = false;
 
-			return bFoundRelayAddress;
+		// The allocation lives on the agent socket (relayed and direct traffic share the port);
+		// a pool socket holds one allocation per server, the other agents of the pool keep a dedicated TURN socket
+		if (Socket && (!bSharedSocket || bMultiplexTURNOnSharedSocket))
+		{
+			TURNSocket = Socket;
+			TURNAddr = ToSocketAddress(TURNAddr);
 		}
-		else if (MessageType == 0x0113) // Allocate Error Response
+		else
 		{
-			// Parse error response to extract error code and authentication info
-			int32 ErrorCode = 0;
-			FString ErrorRealm;
-			FString ErrorNonce;
-			
-			int32 AttrOffset = 20;
-			while (AttrOffset < BytesRead)
+			TURNSocket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("TURN"), TURNAddr->GetProtocolType());
+			if (!TURNSocket)
 			{
-				if (AttrOffset + 4 > BytesRead) break;
-
-				uint16 AttrType = (TURNResponse[AttrOffset] << 8) | TURNResponse[AttrOffset + 1];
-				uint16 AttrLength = (TURNResponse[AttrOffset + 2] << 8) | TURNResponse[AttrOffset + 3];
-
-				if (AttrOffset + 4 + AttrLength > BytesRead) break;
+				UE_LOG(LogOnlineICE, Error, TEXT("Failed to create TURN socket"));
+				continue;
+			}
+			TURNSocket->SetNonBlocking(true);
+		}
 
-				// ERROR-CODE attribute (0x0009)
-				if (AttrType == 0x0009 && AttrLength >= 4)
-				{
-					// Error code format: 21 bits reserved, 3 bits class, 8 bits number (RFC 5389)
-					// Error code is at offset 2-3 within attribute value
-					uint8 ClassByte = TURNResponse[AttrOffset + 4 + 2]; // Contains class in lower 3 bits
-					uint8 NumberByte = TURNResponse[AttrOffset + 4 + 3];
-					ErrorCode = ((ClassByte & STUNConstants::ERROR_CLASS_MASK) * STUNConstants::ERROR_CLASS_MULTIPLIER) + NumberByte;
-					
-					// Extract error reason phrase if present (starts at byte 4 of attribute value)
-					if (AttrLength > 4)
-					{
-						FString ErrorReason;
-						for (int32 i = 4; i < AttrLength; i++)
-						{
-							ErrorReason += (char)TURNResponse[AttrOffset + 4 + i];
-						}
-						UE_LOG(LogOnlineICE, Warning, TEXT("TURN Error %d: %s"), ErrorCode, *ErrorReason);
-					}
-					else
-					{
-						UE_LOG(LogOnlineICE, Warning, TEXT("TURN Error %d"), ErrorCode);
-					}
-				}
-				// REALM attribute (0x0014)
-				else if (AttrType == 0x0014)
-				{
-					for (int32 i = 0; i < AttrLength; i++)
-					{
-						ErrorRealm += (char)TURNResponse[AttrOffset + 4 + i];
-					}
-				}
-				// NONCE attribute (0x0015)
-				else if (AttrType == 0x0015)
-				{
-					for (int32 i = 0; i < AttrLength; i++)
-					{
-						ErrorNonce += (char)TURNResponse[AttrOffset + 4 + i];
-					}
-				}
+		// Store TURN server address for later use (refresh, permissions, etc.)
+		TURNServerAddr = TURNAddr;
 
-				// Move to next attribute (pad to 4-byte boundary)
-				AttrOffset += 4 + ((AttrLength + 3) & ~3);
-			}
+		FICEGatherRequest Request;
+		Request.Type = EICECandidateType::Relayed;
+		Request.ServerAddress = ServerAddress;
+		Request.ServerIndex = OrderIndex;
+		Request.ServerAddr = TURNAddr;
+		Request.RequestSocket = TURNSocket;
 
-			// If error is 401 Unauthorized and we haven't retried yet, retry with authentication
-			if (ErrorCode == 401 && !ErrorRealm.IsEmpty() && !ErrorNonce.IsEmpty() && !bIsRetry)
-			{
-				UE_LOG(LogOnlineICE, Log, TEXT("TURN requires authentication, retrying with credentials"));
-				UE_LOG(LogOnlineICE, Log, TEXT("Realm: %s, Nonce: %s"), *ErrorRealm, *ErrorNonce);
-				
-				// Retry with authentication (set bIsRetry to true to prevent infinite loops)
-				return PerformTURNAllocationRequest(TURNAddr, Username, Credential, 
-					ErrorRealm, ErrorNonce, OutRelayIP, OutRelayPort, true);
-			}
-			
-			UE_LOG(LogOnlineICE, Error, TEXT("TURN Allocate failed - error %d received"), ErrorCode);
-			return false;
+		// Known server: authenticate straight away with the cached realm/nonce/key
+		// Otherwise send without authentication, the server answers 401 with its realm and nonce
+		const FICETURNCredentials* CachedCredentials = TURNCredentialCache.Find(GetTURNCredentialCacheKey(ServerAddress));
+		if (CachedCredentials)
+		{
+			UE_LOG(LogOnlineICE, Log, TEXT("Using cached TURN credentials for %s (realm %s)"), *ServerAddress, *CachedCredentials->Realm);
 		}
-		else
+		Request.bCachedCredentials = CachedCredentials != nullptr;
+
+		if (SendTURNAllocateRequest(Request, CachedCredentials))
 		{
-			UE_LOG(LogOnlineICE, Warning, TEXT("Unexpected TURN response type: 0x%04X"), MessageType);
+			GatherRequests.Add(MoveTemp(Request));
+			return true;
 		}
+
+		ReleaseTURNSocket();
 	}
 
-	UE_LOG(LogOnlineICE, Warning, TEXT("Failed to parse TURN Allocate response"));
 	return false;
 }
 
-int32 FICEAgent::CalculatePriority(EICECandidateType Type, int32 LocalPreference, int32 ComponentId)
+bool FICEAgent::SendTURNAllocateRequest(FICEGatherRequest& Request, const FICETURNCredentials* Credentials)
 {
-	// ICE priority calculation as per RFC 8445
-	int32 TypePreference;
-	switch (Type)
+	// Transaction ID: Random bytes (RFC 5389), remembered to match the response
+	FSTUNMessage::GenerateTransactionID(Request.TransactionID);
+
+	// Build TURN Allocate Request (RFC 5766 Section 6.1)
+	FSTUNMessage TURNRequest(STUNMessageType::ALLOCATE_REQUEST, Request.TransactionID);
+
+	// REQUESTED-TRANSPORT: protocol (UDP = 17) followed by 3 reserved bytes
+	TURNRequest.AddUInt32(STUNAttribute::REQUESTED_TRANSPORT, 17u << 24);
+	TURNRequest.AddString(STUNAttribute::USERNAME, Config.TURNUsername);
+
+	// If we have Realm and Nonce, add authentication attributes
+	// MESSAGE-INTEGRITY must be the last attribute before FINGERPRINT (which we don't use)
+	if (Credentials)
 	{
-		case EICECandidateType::Host:
-			TypePreference = 126;
-			break;
-		case EICECandidateType::ServerReflexive:
-			TypePreference = 100;
-			break;
-		case EICECandidateType::Relayed:
-			TypePreference = 0;
-			break;
-		default:
-			TypePreference = 0;
-			break;
+		TURNRequest.AddString(STUNAttribute::REALM, Credentials->Realm);
+		TURNRequest.AddString(STUNAttribute::NONCE, Credentials->Nonce);
+		TURNRequest.AddMessageIntegrity(Credentials->Key, sizeof(Credentials->Key));
 	}
 
-	return (TypePreference << 24) | (LocalPreference << 8) | (256 - ComponentId);
+	if (!TURNRequest.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("TURN Allocate request too large (credentials of %d characters)"),
+			Config.TURNUsername.Len() + (Credentials ? Credentials->Realm.Len() + Credentials->Nonce.Len() : 0));
+		return false;
+	}
+
+	// Send TURN Allocate request
+	int32 BytesSent;
+	if (!Request.RequestSocket->SendTo(TURNRequest.GetData(), TURNRequest.Num(), BytesSent, *Request.ServerAddr))
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send TURN Allocate request"));
+		return false;
+	}
+
+	Request.bAuthenticated = Credentials != nullptr;
+	Request.Elapsed = 0.0f;
+	return true;
 }
 
-TArray<FICECandidate> FICEAgent::GetLocalCandidates() const
+FString FICEAgent::GetTURNCredentialCacheKey(const FString& ServerAddress) const
 {
-	return LocalCandidates;
+	return ServerAddress + TEXT("|") + Config.TURNUsername;
 }
 
-void FICEAgent::AddRemoteCandidate(const FICECandidate& Candidate)
+const FICETURNCredentials& FICEAgent::CacheTURNCredentials(const FString& ServerAddress, const FString& Realm, const FString& Nonce)
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Adding remote candidate: %s"), *Candidate.ToString());
-	RemoteCandidates.Add(Candidate);
+	FICETURNCredentials& Credentials = TURNCredentialCache.FindOrAdd(GetTURNCredentialCacheKey(ServerAddress));
+
+	// Key = MD5(username:realm:password), only the nonce changes while the realm stays the same
+	if (Credentials.Realm != Realm || Credentials.Nonce.IsEmpty())
+	{
+		Credentials.Realm = Realm;
+		CalculateMD5(Config.TURNUsername + TEXT(":") + Realm + TEXT(":") + Config.TURNCredential, Credentials.Key);
+	}
+	Credentials.Nonce = Nonce;
+
+	return Credentials;
 }
 
-void FICEAgent::UpdateConnectionState(EICEConnectionState NewState)
+void FICEAgent::AddRelayedCandidate()
 {
-	FScopeLock Lock(&ConnectionLock);
-	
-	if (ConnectionState == NewState)
+	if (!TURNRelayAddr.IsValid())
 	{
 		return;
 	}
 
-	// Logging para diagnóstico
-	UE_LOG(LogOnlineICE, Log, TEXT("ICE state change: %s -> %s"),
-		*GetConnectionStateName(ConnectionState),
-		*GetConnectionStateName(NewState));
-
-	ConnectionState = NewState;
-
-	// Notificar a los delegados
-	OnConnectionStateChanged.Broadcast(NewState);
+	FICECandidate RelayCandidate;
+	RelayCandidate.Foundation = TEXT("3");
+	RelayCandidate.ComponentId = 1;
+	RelayCandidate.Transport = EICETransport::UDP;
+	RelayCandidate.Priority = CalculatePriority(EICECandidateType::Relayed, 65535, 1);
+	RelayCandidate.Address = TURNRelayAddr->ToString(false);
+	RelayCandidate.Port = TURNRelayAddr->GetPort();
+	RelayCandidate.Type = EICECandidateType::Relayed;
 
-	// Reset timers en cambio de estado
-	TimeSinceLastAttempt = 0.0f;
+	UE_LOG(LogOnlineICE, Log, TEXT("Added relay candidate: %s"), *RelayCandidate.ToString());
+	AddLocalCandidate(RelayCandidate);
 }
 
-bool FICEAgent::StartConnectivityChecks()
+void FICEAgent::HandleTURNAllocateResponse(FICEGatherRequest& Request, const FSTUNMessageView& Response)
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Starting ICE connectivity checks - Current state: %s"), *GetConnectionStateName(ConnectionState));
+	// Requests are finished unless a 401 challenge triggers the authenticated retry below
+	Request.bDone = true;
 
-	// Validar estado previo - evitar llamadas cuando ya estamos conectados
-	if (ConnectionState == EICEConnectionState::Connected)
+	if (Response.GetMessageType() == STUNMessageType::ALLOCATE_SUCCESS)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("Already connected, ignoring StartConnectivityChecks call"));
-		return true;
-	}
+		UE_LOG(LogOnlineICE, Log, TEXT("TURN Allocate successful"));
 
-	// Evitar reintentos infinitos - límite total de intentos
-	if (TotalConnectionAttempts >= MAX_TOTAL_ATTEMPTS)
-	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Max total connection attempts (%d) reached, giving up"), MAX_TOTAL_ATTEMPTS);
-		UpdateConnectionState(EICEConnectionState::Failed);
-		return false;
-	}
+		FSTUNAddress RelayAddress;
+		if (!Response.GetXorAddress(STUNAttribute::XOR_RELAYED_ADDRESS, RelayAddress) || !RelayAddress.IsIPv4())
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("TURN Allocate response missing XOR-RELAYED-ADDRESS"));
+			return;
+		}
 
-	// Incrementar contador total de intentos
-	TotalConnectionAttempts++;
+		const FString RelayIP = RelayAddress.ToString();
+		UE_LOG(LogOnlineICE, Log, TEXT("TURN allocated relay address: %s:%d"), *RelayIP, RelayAddress.Port);
 
-	if (LocalCandidates.Num() == 0 || RemoteCandidates.Num() == 0)
-	{
-		UE_LOG(LogOnlineICE, Error, TEXT("No candidates available for connectivity checks (Local: %d, Remote: %d)"), 
-			LocalCandidates.Num(), RemoteCandidates.Num());
-		UpdateConnectionState(EICEConnectionState::Failed);
-		return false;
-	}
+		uint32 Lifetime = 0;
+		if (Response.GetUInt32(STUNAttribute::LIFETIME, Lifetime))
+		{
+			TURNAllocationLifetime = (int32)Lifetime;
+			UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation lifetime: %d seconds"), TURNAllocationLifetime);
+		}
 
-	// Limpiar socket existente si hay uno (evitar sockets huérfanos)
-	if (Socket)
-	{
-		UE_LOG(LogOnlineICE, Log, TEXT("Cleaning up existing socket before creating new connection"));
+		// Store relay address for data transmission
 		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
 		if (SocketSubsystem)
 		{
-			SocketSubsystem->DestroySocket(Socket);
+			TURNRelayAddr = SocketSubsystem->GetAddressFromString(RelayIP);
+			if (TURNRelayAddr.IsValid())
+			{
+				TURNRelayAddr->SetPort(RelayAddress.Port);
+			}
 		}
-		Socket = nullptr;
-	}
 
-	// Resetear estado de handshake para nuevo intento
-	bHandshakeSent = false;
-	bHandshakeReceived = false;
-	TimeSinceHandshakeStart = 0.0f;
-	TimeSinceLastHandshakeSend = 0.0f;
+		bTURNAllocationActive = true;
+		TimeSinceTURNRefresh = 0.0f;
+		ActiveTURNServer = Request.ServerAddress;
+		Request.bSucceeded = true;
 
-	// Select candidates based on strategy (direct or relay)
-	bool bUsingRelay = false;
-	
-	// Try direct candidates first (host and server reflexive)
-	if (DirectConnectionAttempts < MAX_DIRECT_ATTEMPTS)
+		UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation successful, keeping socket open for data relay"));
+		AddRelayedCandidate();
+		return;
+	}
+
+	if (Response.GetMessageType() != STUNMessageType::ALLOCATE_ERROR)
 	{
-		DirectConnectionAttempts++;
+		UE_LOG(LogOnlineICE, Warning, TEXT("Unexpected TURN response type: 0x%04X"), Response.GetMessageType());
+		return;
+	}
 
-		// Filter direct candidates (host and server reflexive) in a single pass
-		// Note: Both types are direct connections
-		TArray<EICECandidateType> DirectTypes = { EICECandidateType::Host, EICECandidateType::ServerReflexive };
-		TArray<FICECandidate> DirectLocalCandidates = FilterCandidatesByTypes(LocalCandidates, DirectTypes);
-		TArray<FICECandidate> DirectRemoteCandidates = FilterCandidatesByTypes(RemoteCandidates, DirectTypes);
+	// Parse error response to extract error code and authentication info
+	FString ErrorReason;
+	const int32 ErrorCode = Response.GetErrorCode(&ErrorReason);
+	FString ErrorRealm = Response.GetString(STUNAttribute::REALM);
+	const FString ErrorNonce = Response.GetString(STUNAttribute::NONCE);
+	UE_LOG(LogOnlineICE, Warning, TEXT("TURN Error %d: %s"), ErrorCode, *ErrorReason);
 
-		// If direct candidates are available, select them
-		if (DirectLocalCandidates.Num() > 0 && DirectRemoteCandidates.Num() > 0)
+	// 401 Unauthorized (or 438 Stale Nonce for cached credentials): retry once with the new challenge
+	const bool bCanRetry = !Request.bAuthenticated || Request.bCachedCredentials;
+	if ((ErrorCode == 401 || ErrorCode == 438) && bCanRetry && !ErrorNonce.IsEmpty())
+	{
+		// Cached credentials rejected outright (e.g. rotated password): derive the key again
+		if (ErrorCode == 401 && Request.bCachedCredentials)
 		{
-			SelectedLocalCandidate = SelectHighestPriorityCandidate(DirectLocalCandidates);
-			SelectedRemoteCandidate = SelectHighestPriorityCandidate(DirectRemoteCandidates);
+			TURNCredentialCache.Remove(GetTURNCredentialCacheKey(Request.ServerAddress));
+		}
 
-			UpdateConnectionState(EICEConnectionState::ConnectingDirect);
-			UE_LOG(LogOnlineICE, Log, TEXT("Attempting direct connection (try %d/%d) - Local: %s (priority: %d), Remote: %s (priority: %d)"),
-				DirectConnectionAttempts, MAX_DIRECT_ATTEMPTS,
-				*SelectedLocalCandidate.ToString(), SelectedLocalCandidate.Priority,
-				*SelectedRemoteCandidate.ToString(), SelectedRemoteCandidate.Priority);
+		// A stale nonce response may omit the realm, keep the cached one
+		const FICETURNCredentials* CachedCredentials = TURNCredentialCache.Find(GetTURNCredentialCacheKey(Request.ServerAddress));
+		if (ErrorRealm.IsEmpty() && CachedCredentials)
+		{
+			ErrorRealm = CachedCredentials->Realm;
 		}
-		else
+
+		if (!ErrorRealm.IsEmpty())
 		{
-			UE_LOG(LogOnlineICE, Warning, TEXT("No direct candidates available (Local: %d, Remote: %d), skipping to relay"),
-				DirectLocalCandidates.Num(), DirectRemoteCandidates.Num());
-			// Mark for immediate relay usage
-			DirectConnectionAttempts = MAX_DIRECT_ATTEMPTS;
-			bUsingRelay = true;
+			UE_LOG(LogOnlineICE, Log, TEXT("TURN requires authentication, retrying with credentials"));
+			UE_LOG(LogOnlineICE, Log, TEXT("Realm: %s, Nonce: %s"), *ErrorRealm, *ErrorNonce);
+
+			// Send the authenticated request; the response is picked up by a later Tick
+			const FICETURNCredentials& Credentials = CacheTURNCredentials(Request.ServerAddress, ErrorRealm, ErrorNonce);
+			Request.bCachedCredentials = false;
+			Request.bDone = !SendTURNAllocateRequest(Request, &Credentials);
+			return;
 		}
 	}
-	else
-	{
-		// Direct connection attempts exhausted, use relay
-		bUsingRelay = true;
-	}
 
-	// If we need to use relay, select relay candidates
-	if (bUsingRelay)
-	{
-		UE_LOG(LogOnlineICE, Log, TEXT("Direct connection attempts exhausted or unavailable, trying relay candidates"));
+	UE_LOG(LogOnlineICE, Error, TEXT("TURN Allocate failed - error %d received"), ErrorCode);
+}
 
-		// Filter relay candidates using the helper
-		TArray<FICECandidate> RelayLocalCandidates = FilterCandidatesByType(LocalCandidates, EICECandidateType::Relayed);
-		TArray<FICECandidate> RelayRemoteCandidates = FilterCandidatesByType(RemoteCandidates, EICECandidateType::Relayed);
+void FICEAgent::TickGathering(float DeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FICEAgent::TickGathering);
 
-		// Check if relay candidates are available
-		if (RelayLocalCandidates.Num() > 0 && RelayRemoteCandidates.Num() > 0)
-		{
-			SelectedLocalCandidate = SelectHighestPriorityCandidate(RelayLocalCandidates);
-			SelectedRemoteCandidate = SelectHighestPriorityCandidate(RelayRemoteCandidates);
+	TimeSinceGatheringStart += DeltaTime;
 
-			UpdateConnectionState(EICEConnectionState::ConnectingRelay);
-			UE_LOG(LogOnlineICE, Log, TEXT("Selected relay candidates - Local: %s (priority: %d), Remote: %s (priority: %d)"),
-				*SelectedLocalCandidate.ToString(), SelectedLocalCandidate.Priority,
-				*SelectedRemoteCandidate.ToString(), SelectedRemoteCandidate.Priority);
-		}
-		else
+	// Server requests start once every hostname is resolved; a lookup still running at the deadline counts as failed
+	if (bWaitingForDNS)
+	{
+		if (IsServerResolutionPending() && TimeSinceGatheringStart < Config.GatheringTimeout)
 		{
-			UE_LOG(LogOnlineICE, Error, TEXT("No relay candidates available (Local relay: %d, Remote relay: %d)"),
-				RelayLocalCandidates.Num(), RelayRemoteCandidates.Num());
-			UpdateConnectionState(EICEConnectionState::Failed);
-			return false;
+			return;
 		}
+		bWaitingForDNS = false;
+		GatherServerCandidates();
 	}
 
-	// Validate that we have valid selected candidates before continuing
-	if (!SelectedLocalCandidate.IsValid() || !SelectedRemoteCandidate.IsValid())
-	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Selected candidates are invalid - Local: %s, Remote: %s"),
-			*SelectedLocalCandidate.ToString(), *SelectedRemoteCandidate.ToString());
-		UpdateConnectionState(EICEConnectionState::Failed);
-		return false;
-	}
-
-	// Create socket for communication
 	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
 	if (!SocketSubsystem)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
-		UpdateConnectionState(EICEConnectionState::Failed);
-		return false;
+		return;
 	}
 
-	TSharedPtr<FInternetAddr> RemoteAddr = SocketSubsystem->GetAddressFromString(SelectedRemoteCandidate.Address);
-	if (!RemoteAddr.IsValid())
+	int32 TURNFailoverIndex = INDEX_NONE;
+	bool bProbePending = false;
+
+	for (FICEGatherRequest& Request : GatherRequests)
+	{
+		Request.Elapsed += DeltaTime;
+
+		// Poll a dedicated request socket without blocking, responses on the agent socket are demultiplexed from Tick
+		uint32 PendingDataSize = 0;
+		if (Request.RequestSocket && Request.RequestSocket != Socket &&
+			Request.RequestSocket->HasPendingData(PendingDataSize) && PendingDataSize > 0)
+		{
+			uint8 Response[HandshakeConstants::MAX_RECEIVE_BUFFER_SIZE];
+			int32 BytesRead = 0;
+			TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+
+			// Ignore datagrams that don't answer the outstanding transaction
+			FSTUNMessageView Message;
+			if (Request.RequestSocket->RecvFrom(Response, sizeof(Response), BytesRead, *FromAddr) &&
+				Message.Parse(Response, BytesRead) &&
+				Message.IsResponse() &&
+				Message.HasTransactionID(Request.TransactionID))
+			{
+				DispatchGatherResponse(Request, Message);
+			}
+		}
+
+		if (!Request.bDone && Request.Elapsed >= GATHER_REQUEST_TIMEOUT)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("%s request to %s timed out"),
+				Request.bProbe ? TEXT("TURN probe") : Request.Type == EICECandidateType::Relayed ? TEXT("TURN Allocate") : TEXT("STUN"),
+				*Request.ServerAddress);
+			Request.bDone = true;
+			if (Request.bProbe || Request.Type == EICECandidateType::ServerReflexive)
+			{
+				RecordServerRTT(Request.ServerAddress, 0.0f, false);
+			}
+		}
+
+		if (Request.bProbe)
+		{
+			bProbePending |= !Request.bDone;
+		}
+		else if (Request.bDone && !Request.bSucceeded && Request.Type == EICECandidateType::Relayed)
+		{
+			TURNFailoverIndex = Request.ServerIndex + 1;
+		}
+	}
+
+	// No TURN server validly answered its probe: try them in the configured order anyway, the Allocate may still get through
+	if (!bTURNServerSelected && !bProbePending && GatherRequests.ContainsByPredicate([](const FICEGatherRequest& Request) { return Request.bProbe; }))
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("No TURN server validly answered its probe, allocating in configured order"));
+		SelectTURNServer(INDEX_NONE);
+	}
+
+	for (int32 Index = GatherRequests.Num() - 1; Index >= 0; --Index)
+	{
+		if (GatherRequests[Index].bDone)
+		{
+			ReleaseGatherRequest(GatherRequests[Index]);
+			GatherRequests.RemoveAtSwap(Index);
+		}
+	}
+
+	// Fail over to the next TURN server without waiting for the whole gathering pass
+	if (TURNFailoverIndex != INDEX_NONE && TURNFailoverIndex < TURNServerOrder.Num())
+	{
+		StartTURNAllocation(TURNFailoverIndex);
+	}
+
+	if (TimeSinceGatheringStart >= Config.GatheringTimeout && GatherRequests.Num() > 0)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Gathering deadline (%.1fs) reached, abandoning %d pending requests"),
+			Config.GatheringTimeout, GatherRequests.Num());
+		CancelGatherRequests();
+	}
+
+	if (GatherRequests.Num() == 0)
+	{
+		CompleteGathering();
+	}
+}
+
+void FICEAgent::HandleSTUNBindingResponse(FICEGatherRequest& Request, const FSTUNMessageView& Response)
+{
+	Request.bDone = true;
+
+	// Parse STUN response
+	FString PublicIP;
+	int32 PublicPort = 0;
+	if (!ParseSTUNResponse(Response, PublicIP, PublicPort))
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Failed to parse STUN response"));
+		return;
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("STUN discovered public address: %s:%d"), *PublicIP, PublicPort);
+	Request.bSucceeded = true;
+
+	// Servers answering in the same tick usually see the same mapping: redundant candidates are dropped
+	// (RFC 8445 Section 5.1.3) rather than added and trickled twice
+	for (const FICECandidate& Existing : GetLocalCandidatesOfType(EICECandidateType::ServerReflexive))
+	{
+		if (Existing.Port == PublicPort && Existing.Address == PublicIP)
+		{
+			UE_LOG(LogOnlineICE, Verbose, TEXT("Server reflexive address %s:%d already gathered"), *PublicIP, PublicPort);
+			return;
+		}
+	}
+
+	FICECandidate SrflxCandidate;
+	SrflxCandidate.Foundation = TEXT("2");
+	SrflxCandidate.ComponentId = 1;
+	SrflxCandidate.Transport = EICETransport::UDP;
+	SrflxCandidate.Priority = CalculatePriority(EICECandidateType::ServerReflexive, 65535, 1);
+	SrflxCandidate.Address = PublicIP;
+	SrflxCandidate.Port = PublicPort;
+	SrflxCandidate.Type = EICECandidateType::ServerReflexive;
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Added server reflexive candidate: %s"), *SrflxCandidate.ToString());
+	AddLocalCandidate(SrflxCandidate);
+}
+
+void FICEAgent::ReleaseGatherRequest(FICEGatherRequest& Request)
+{
+	// STUN requests are sent from the agent socket, which outlives them
+	// The TURN socket is kept for refresh and data relay only if the allocation succeeded
+	if (Request.Type == EICECandidateType::Relayed && !Request.bProbe && !Request.bSucceeded && Request.RequestSocket == TURNSocket && TURNSocket)
+	{
+		ReleaseTURNSocket();
+		bTURNAllocationActive = false;
+	}
+
+	Request.RequestSocket = nullptr;
+}
+
+int32 FICEAgent::FindGatherRequest(const FSTUNMessageView& Response) const
+{
+	return GatherRequests.IndexOfByPredicate([&Response](const FICEGatherRequest& Request)
+	{
+		return !Request.bDone && Response.HasTransactionID(Request.TransactionID);
+	});
+}
+
+bool FICEAgent::HandleGatherResponse(const uint8* Buffer, int32 Size)
+{
+	FSTUNMessageView Response;
+	if (!Response.Parse(Buffer, Size) || !Response.IsResponse())
+	{
+		return false;
+	}
+
+	const int32 Index = FindGatherRequest(Response);
+	if (Index == INDEX_NONE)
+	{
+		return false;
+	}
+
+	DispatchGatherResponse(GatherRequests[Index], Response);
+	return true;
+}
+
+void FICEAgent::DispatchGatherResponse(FICEGatherRequest& Request, const FSTUNMessageView& Response)
+{
+	const float RTT = (float)((FPlatformTime::Seconds() - Request.SentTime) * 1000.0);
+	Stats.ServerResponseTimes.FindOrAdd(Request.ServerAddress).AddSample(RTT);
+
+	if (Request.bProbe)
+	{
+		// Only a success or an authentication challenge shows a working STUN/TURN server; any other error (a proxy,
+		// a server refusing service) would win the race and fail the Allocate, so it counts as unreachable instead
+		Request.bDone = true;
+		if (!Response.IsSuccessResponse() && Response.GetErrorCode() != 401)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("TURN server %s rejected its probe (error %d)"), *Request.ServerAddress, Response.GetErrorCode());
+			RecordServerRTT(Request.ServerAddress, 0.0f, false);
+			return;
+		}
+
+		Request.bSucceeded = true;
+		RecordServerRTT(Request.ServerAddress, RTT, true);
+		UE_LOG(LogOnlineICE, Log, TEXT("TURN server %s answered in %.1fms"), *Request.ServerAddress, RTT);
+
+		if (!bTURNServerSelected)
+		{
+			SelectTURNServer(Request.ServerIndex);
+		}
+	}
+	else if (Request.Type == EICECandidateType::ServerReflexive)
+	{
+		RecordServerRTT(Request.ServerAddress, RTT, true);
+		HandleSTUNBindingResponse(Request, Response);
+	}
+	else
+	{
+		HandleTURNAllocateResponse(Request, Response);
+	}
+}
+
+void FICEAgent::CancelGatherRequests()
+{
+	for (FICEGatherRequest& Request : GatherRequests)
+	{
+		ReleaseGatherRequest(Request);
+	}
+	GatherRequests.Empty();
+	bWaitingForDNS = false;
+}
+
+void FICEAgent::CompleteGathering()
+{
+	if (!bGatheringInProgress)
+	{
+		return;
+	}
+
+	bGatheringInProgress = false;
+
+	if (ConnectionState == EICEConnectionState::Gathering)
+	{
+		UpdateConnectionState(EICEConnectionState::New);
+	}
+
+	Stats.GatheringTime.AddSample(TimeSinceGatheringStart * 1000.0f);
+	UE_LOG(LogOnlineICE, Log, TEXT("Gathered %d ICE candidates in %.2f seconds"), LocalCandidates.Num(), TimeSinceGatheringStart);
+	OnGatheringComplete.Broadcast();
+}
+
+int32 FICEAgent::CalculatePriority(EICECandidateType Type, int32 LocalPreference, int32 ComponentId)
+{
+	// ICE priority calculation as per RFC 8445
+	int32 TypePreference;
+	switch (Type)
+	{
+		case EICECandidateType::Host:
+			TypePreference = 126;
+			break;
+		case EICECandidateType::PeerReflexive:
+			TypePreference = 110;
+			break;
+		case EICECandidateType::ServerReflexive:
+			TypePreference = 100;
+			break;
+		case EICECandidateType::Relayed:
+			TypePreference = 0;
+			break;
+		default:
+			TypePreference = 0;
+			break;
+	}
+
+	return (TypePreference << 24) | (LocalPreference << 8) | (256 - ComponentId);
+}
+
+TArrayView<const FICECandidate> FICEAgent::GetLocalCandidatesOfType(EICECandidateType Type) const
+{
+	const int32 TypeIndex = (int32)Type;
+	const int32 Begin = TypeIndex > 0 ? LocalCandidateTypeEnd[TypeIndex - 1] : 0;
+	return TArrayView<const FICECandidate>(LocalCandidates.GetData() + Begin, LocalCandidateTypeEnd[TypeIndex] - Begin);
+}
+
+void FICEAgent::RemoveLocalCandidatesOfType(EICECandidateType Type)
+{
+	const int32 TypeIndex = (int32)Type;
+	const int32 Begin = TypeIndex > 0 ? LocalCandidateTypeEnd[TypeIndex - 1] : 0;
+	const int32 Count = LocalCandidateTypeEnd[TypeIndex] - Begin;
+	if (Count == 0)
+	{
+		return;
+	}
+
+	LocalCandidates.RemoveAt(Begin, Count);
+	for (int32 Index = TypeIndex; Index < NUM_CANDIDATE_TYPES; ++Index)
+	{
+		LocalCandidateTypeEnd[Index] -= Count;
+	}
+}
+
+void FICEAgent::ResetLocalCandidates()
+{
+	LocalCandidates.Reset();
+	FMemory::Memzero(LocalCandidateTypeEnd);
+}
+
+void FICEAgent::AddRemoteCandidate(const FICECandidate& Candidate)
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Adding remote candidate: %s"), *Candidate.ToString());
+	RemoteCandidates.Add(Candidate);
+
+	// Trickled remote candidates join a running checklist
+	if (bChecksInProgress)
+	{
+		for (const FICECandidate& Local : LocalCandidates)
+		{
+			const int32 PairIndex = AddCandidatePair(Local, Candidate);
+			if (PairIndex != INDEX_NONE)
+			{
+				InitializePairState(PairIndex);
+			}
+		}
+	}
+}
+
+void FICEAgent::UpdateConnectionState(EICEConnectionState NewState)
+{
+	FScopeLock Lock(&ConnectionLock);
+	
+	if (ConnectionState == NewState)
+	{
+		return;
+	}
+
+	// Logging para diagnóstico
+	UE_LOG(LogOnlineICE, Log, TEXT("ICE state change: %s -> %s"),
+		*GetConnectionStateName(ConnectionState),
+		*GetConnectionStateName(NewState));
+
+	ConnectionState = NewState;
+
+	// Notificar a los delegados
+	OnConnectionStateChanged.Broadcast(NewState);
+}
+
+bool FICEAgent::StartConnectivityChecks()
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Starting ICE connectivity checks - Current state: %s"), *GetConnectionStateName(ConnectionState));
+
+	// Validar estado previo - evitar llamadas cuando ya estamos conectados (salvo durante un ICE restart)
+	if (ConnectionState == EICEConnectionState::Connected && !bRestartInProgress)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Already connected, ignoring StartConnectivityChecks call"));
+		return true;
+	}
+
+	// Requests are signed with the peer's password; until it is signaled the checks wait, the peer's own signed
+	// requests are still answered
+	if (!RemoteHandshakeKey.IsSet() && !Config.bAllowUnsignedHandshake)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("No remote credentials, connectivity checks wait for the peer's offer"));
+		return false;
+	}
+
+	// Evitar reintentos infinitos - límite total de intentos
+	if (TotalConnectionAttempts >= MAX_TOTAL_ATTEMPTS)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Max total connection attempts (%d) reached, giving up"), MAX_TOTAL_ATTEMPTS);
+		UpdateConnectionState(EICEConnectionState::Failed);
+		return false;
+	}
+
+	// Incrementar contador total de intentos
+	TotalConnectionAttempts++;
+
+	if (LocalCandidates.Num() == 0 || RemoteCandidates.Num() == 0)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("No candidates available for connectivity checks (Local: %d, Remote: %d)"), 
+			LocalCandidates.Num(), RemoteCandidates.Num());
+		if (!bRestartInProgress)
+		{
+			UpdateConnectionState(EICEConnectionState::Failed);
+		}
+		return false;
+	}
+
+	// Every direct pair is checked from the same socket (reused across attempts)
+	if (!CreateCheckSocket())
+	{
+		return false;
+	}
+
+	// Form the checklist: every local candidate paired with every remote candidate
+	// A restart keeps the selected pair, it carries the traffic until a new pair succeeds
+	TArray<FICECandidatePair> KeptPairs;
+	const bool bKeepSelectedPair = bIsConnected && FindSelectedPair() != nullptr;
+	if (bKeepSelectedPair)
+	{
+		KeptPairs.Add(*FindSelectedPair());
+	}
+	CheckList = MoveTemp(KeptPairs);
+	TriggeredCheckQueue.Empty();
+	for (const FICECandidate& Local : LocalCandidates)
+	{
+		for (const FICECandidate& Remote : RemoteCandidates)
+		{
+			AddCandidatePair(Local, Remote);
+		}
+	}
+
+	const int32 NumNewPairs = bKeepSelectedPair ? CheckList.Num() - 1 : CheckList.Num();
+	if (NumNewPairs <= 0)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("No usable candidate pairs (Local: %d, Remote: %d)"),
+			LocalCandidates.Num(), RemoteCandidates.Num());
+		if (!bRestartInProgress)
+		{
+			UpdateConnectionState(EICEConnectionState::Failed);
+		}
+		return false;
+	}
+
+	// CheckList is sorted, so the first pair of each foundation becomes Waiting
+	for (int32 PairIndex = 0; PairIndex < CheckList.Num(); ++PairIndex)
+	{
+		if (!bKeepSelectedPair || CheckList[PairIndex].CheckToken != SelectedCheckToken)
+		{
+			InitializePairState(PairIndex);
+		}
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Checklist formed with %d candidate pairs (%s, Ta=%.0fms)"),
+		CheckList.Num(), bControlling ? TEXT("controlling") : TEXT("controlled"), Config.ConnectivityCheckInterval * 1000.0f);
+	for (const FICECandidatePair& Pair : CheckList)
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("  %s"), *Pair.ToString());
+	}
+
+	bChecksInProgress = true;
+	ChecksStartTime = FPlatformTime::Seconds();
+
+	// First check goes out right away, the rest are paced from Tick
+	// (while connected the sockets are left to ProcessConnectedHandshakes and ReceiveData)
+	TimeSinceLastPacedCheck = Config.ConnectivityCheckInterval;
+	if (bIsConnected)
+	{
+		AdvanceConnectivityChecks(0.0f);
+	}
+	else
+	{
+		TickConnectivityChecks(0.0f);
+	}
+
+	return true;
+}
+
+bool FICEAgent::RestartICE()
+{
+	// Checks already running (or never started) are abandoned with the old candidates
+	CheckList.RemoveAll([this](const FICECandidatePair& Pair)
+	{
+		return !bIsConnected || Pair.CheckToken != SelectedCheckToken;
+	});
+	TriggeredCheckQueue.Empty();
+	RemoteCandidates.Empty();
+	bChecksInProgress = false;
+	bDirectUpgradeInProgress = false;
+	bTURNReleasePending = false;
+	TotalConnectionAttempts = 0;
+
+	// A restart is signaled by new credentials (RFC 8445 Section 9), the peer sends its own with its new candidates
+	GenerateLocalCredentials();
+	RemoteUfrag.Empty();
+	RemotePassword.Empty();
+	bRemoteCredentialsRejected = false;
+	ResetHandshakeReplayWindow();
+	UpdateHandshakeCredentials();
+
+	if (bIsConnected)
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("ICE restart: gathering new candidates, %s:%d keeps carrying traffic"),
+			*SelectedRemoteCandidate.Address, SelectedRemoteCandidate.Port);
+		bRestartInProgress = true;
+	}
+	else
+	{
+		// Nothing to keep: start over on the same socket (and TURN allocation)
+		UE_LOG(LogOnlineICE, Log, TEXT("ICE restart while not connected, gathering new candidates"));
+		if (ConnectionState != EICEConnectionState::Gathering)
+		{
+			UpdateConnectionState(EICEConnectionState::New);
+		}
+	}
+
+	return GatherCandidates();
+}
+
+bool FICEAgent::GenerateLocalCredentials()
+{
+	// ice-chars (RFC 8445 Section 15.1): 64 of them, so the low 6 bits of a random byte pick one without bias
+	static const TCHAR ICEChars[] = TEXT("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+	static_assert(UE_ARRAY_COUNT(ICEChars) - 1 == 64, "ice-chars are indexed by 6 random bits");
+
+	uint8 RandomBytes[UFRAG_LENGTH + PASSWORD_LENGTH];
+	LocalUfrag.Reset(UFRAG_LENGTH);
+	LocalPassword.Reset(PASSWORD_LENGTH);
+
+	if (!FICESecureChannel::GenerateRandomBytes(RandomBytes, sizeof(RandomBytes)))
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("No secure random source, ICE credentials not generated"));
+		UpdateHandshakeCredentials();
+		return false;
+	}
+
+	for (int32 i = 0; i < UFRAG_LENGTH; ++i)
+	{
+		LocalUfrag.AppendChar(ICEChars[RandomBytes[i] & 63]);
+	}
+	for (int32 i = 0; i < PASSWORD_LENGTH; ++i)
+	{
+		LocalPassword.AppendChar(ICEChars[RandomBytes[UFRAG_LENGTH + i] & 63]);
+	}
+	FMemory::Memzero(RandomBytes);
+
+	UpdateHandshakeCredentials();
+	return true;
+}
+
+bool FICEAgent::SetRemoteCredentials(const FString& Ufrag, const FString& Password)
+{
+	// Both usernames are "ufrag:ufrag"; one that doesn't fit the HELLO could only be checked unsigned, which would let
+	// anyone able to send an offer turn authentication off
+	const int32 UsernameLength = FTCHARToUTF8(*Ufrag).Length() + 1 + FTCHARToUTF8(*LocalUfrag).Length();
+	if (UsernameLength > HandshakeConstants::MAX_USERNAME_LENGTH)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Remote ufrag too long (%d chars), rejecting the peer's credentials"), Ufrag.Len());
+		bRemoteCredentialsRejected = true;
+		bChecksInProgress = false;
+		UpdateConnectionState(EICEConnectionState::Failed);
+		return false;
+	}
+	bRemoteCredentialsRejected = false;
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Remote credentials set (ufrag %s)"), *Ufrag);
+
+	// Another peer (or the same one after a restart) numbers its packets afresh; requests it sent
+	// before we learnt its first credentials were already checked against the window
+	if (!RemoteUfrag.IsEmpty() && RemoteUfrag != Ufrag)
+	{
+		ResetHandshakeReplayWindow();
+	}
+
+	RemoteUfrag = Ufrag;
+	RemotePassword = Password;
+	UpdateHandshakeCredentials();
+
+	// The peer's requests may have delivered its key share before its password
+	TryEstablishSecureChannel();
+	return true;
+}
+
+void FICEAgent::UpdateHandshakeCredentials()
+{
+	auto ToBytes = [](const FString& String, TArray<uint8>& OutBytes)
+	{
+		FTCHARToUTF8 StringUTF8(*String);
+		OutBytes.Reset(StringUTF8.Length());
+		OutBytes.Append((const uint8*)StringUTF8.Get(), StringUTF8.Length());
+	};
+
+	// The key schedule is derived once per password, each packet then costs one HMAC over its own bytes
+	LocalHandshakeKey.SetKey(LocalPassword);
+	ToBytes(LocalUfrag + TEXT(":") + RemoteUfrag, IncomingHandshakeUsername);
+	ToBytes(RemoteUfrag + TEXT(":") + LocalUfrag, OutgoingHandshakeUsername);
+
+	// SetRemoteCredentials keeps the usernames within MAX_USERNAME_LENGTH
+	RemoteHandshakeKey.Reset();
+	if (!RemotePassword.IsEmpty())
+	{
+		RemoteHandshakeKey.SetKey(RemotePassword);
+	}
+}
+
+void FICEAgent::AcceptRemoteKeyShare(const uint8* KeyShare)
+{
+	if (!Config.bEncryptTraffic)
+	{
+		return;
+	}
+
+	FMemory::Memcpy(RemoteKeyShare, KeyShare, FICESecureChannel::KEY_SHARE_SIZE);
+	bHasRemoteKeyShare = true;
+	TryEstablishSecureChannel();
+}
+
+void FICEAgent::TryEstablishSecureChannel()
+{
+	if (!Config.bEncryptTraffic || !bHasRemoteKeyShare || RemotePassword.IsEmpty() || !SecureChannel.EnsureKeyShare())
+	{
+		return;
+	}
+	SecureChannel.Establish(RemoteKeyShare, bControlling, LocalPassword, RemotePassword);
+}
+
+void FICEAgent::SetControlling(bool bInControlling)
+{
+	if (bControlling == bInControlling)
+	{
+		return;
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("ICE role set to %s"), bInControlling ? TEXT("controlling") : TEXT("controlled"));
+	bControlling = bInControlling;
+
+	// Pair priorities depend on which side is controlling, and so do the traffic keys of each direction
+	SortCheckList();
+	TryEstablishSecureChannel();
+}
+
+uint64 FICEAgent::ComputePairPriority(uint32 ControllingPriority, uint32 ControlledPriority)
+{
+	// RFC 8445 Section 6.1.2.3: 2^32*MIN(G,D) + 2*MAX(G,D) + (G>D?1:0)
+	const uint64 MinPriority = FMath::Min(ControllingPriority, ControlledPriority);
+	const uint64 MaxPriority = FMath::Max(ControllingPriority, ControlledPriority);
+	return (MinPriority << 32) + (MaxPriority << 1) + (ControllingPriority > ControlledPriority ? 1 : 0);
+}
+
+int32 FICEAgent::AddCandidatePair(const FICECandidate& Local, const FICECandidate& Remote)
+{
+	if (!Remote.IsValid())
+	{
+		return INDEX_NONE;
+	}
+
+	// Component IDs must match for a pair to be formed
+	if (Local.ComponentId != Remote.ComponentId && Local.ComponentId != 0 && Remote.ComponentId != 0)
+	{
+		return INDEX_NONE;
+	}
+
+	// Only candidates of the same address family are paired (RFC 8445 Section 6.1.2.2)
+	if (Local.IsIPv6() != Remote.IsIPv6())
+	{
+		return INDEX_NONE;
+	}
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem)
+	{
+		return INDEX_NONE;
+	}
+
+	TSharedPtr<FInternetAddr> RemoteAddr = SocketSubsystem->GetAddressFromString(Remote.Address);
+	if (!RemoteAddr.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Skipping pair with unparsable remote address: %s"), *Remote.Address);
+		return INDEX_NONE;
+	}
+	RemoteAddr->SetPort(Remote.Port);
+
+	// Direct pairs are checked from the agent socket; relayed ones keep the address the TURN server expects
+	if (Local.Type != EICECandidateType::Relayed)
+	{
+		RemoteAddr = ToSocketAddress(RemoteAddr);
+	}
+
+	FICECandidatePair NewPair;
+	NewPair.Local = Local;
+	NewPair.Remote = Remote;
+	NewPair.RemoteAddr = RemoteAddr;
+	NewPair.Foundation = Local.Foundation + TEXT(":") + Remote.Foundation;
+	NewPair.Priority = bControlling
+		? ComputePairPriority((uint32)Local.Priority, (uint32)Remote.Priority)
+		: ComputePairPriority((uint32)Remote.Priority, (uint32)Local.Priority);
+	NewPair.CheckToken = NextCheckToken++;
+
+	// Server reflexive candidates are replaced by their base (RFC 8445 Section 6.1.2.4):
+	// all direct pairs share the check socket, so pairs reaching the same remote address
+	// over the same path are redundant and only the highest priority one is kept
+	for (int32 PairIndex = 0; PairIndex < CheckList.Num(); ++PairIndex)
+	{
+		// During a restart the selected pair is kept aside: its path may be the one that broke
+		FICECandidatePair& Existing = CheckList[PairIndex];
+		if (bRestartInProgress && Existing.CheckToken == SelectedCheckToken)
+		{
+			continue;
+		}
+		if (Existing.IsRelayed() == NewPair.IsRelayed() && *Existing.RemoteAddr == *RemoteAddr)
+		{
+			const bool bExistingStarted = Existing.State != EICECandidatePairState::Frozen && Existing.State != EICECandidatePairState::Waiting;
+			if (bExistingStarted || Existing.Priority >= NewPair.Priority)
+			{
+				return INDEX_NONE;
+			}
+
+			CheckList.RemoveAt(PairIndex);
+			break;
+		}
+	}
+
+	if (NewPair.IsRelayed())
+	{
+		NewPair.RelayChannel = NextRelayChannel;
+		NextRelayChannel = NextRelayChannel < STUNConstants::CHANNEL_NUMBER_MAX ? NextRelayChannel + 1 : STUNConstants::CHANNEL_NUMBER_MIN;
+	}
+
+	// Insert keeping the list sorted by descending priority
+	int32 InsertIndex = 0;
+	while (InsertIndex < CheckList.Num() && CheckList[InsertIndex].Priority >= NewPair.Priority)
+	{
+		++InsertIndex;
+	}
+	CheckList.Insert(NewPair, InsertIndex);
+
+	return InsertIndex;
+}
+
+void FICEAgent::SortCheckList()
+{
+	for (FICECandidatePair& Pair : CheckList)
+	{
+		Pair.Priority = bControlling
+			? ComputePairPriority((uint32)Pair.Local.Priority, (uint32)Pair.Remote.Priority)
+			: ComputePairPriority((uint32)Pair.Remote.Priority, (uint32)Pair.Local.Priority);
+	}
+
+	CheckList.StableSort([](const FICECandidatePair& A, const FICECandidatePair& B)
+	{
+		return A.Priority > B.Priority;
+	});
+}
+
+void FICEAgent::InitializePairState(int32 PairIndex)
+{
+	FICECandidatePair& Pair = CheckList[PairIndex];
+
+	// Only one pair per foundation is checked at first, the others wait for its result
+	for (int32 Index = 0; Index < CheckList.Num(); ++Index)
+	{
+		if (Index != PairIndex &&
+		    CheckList[Index].Foundation == Pair.Foundation &&
+		    CheckList[Index].State != EICECandidatePairState::Frozen &&
+		    CheckList[Index].State != EICECandidatePairState::Failed)
+		{
+			Pair.State = EICECandidatePairState::Frozen;
+			return;
+		}
+	}
+
+	Pair.State = EICECandidatePairState::Waiting;
+}
+
+void FICEAgent::UnfreezePairsWithFoundation(const FString& Foundation)
+{
+	for (FICECandidatePair& Pair : CheckList)
+	{
+		if (Pair.State == EICECandidatePairState::Frozen && Pair.Foundation == Foundation)
+		{
+			Pair.State = EICECandidatePairState::Waiting;
+		}
+	}
+}
+
+int32 FICEAgent::SelectNextPairToCheck()
+{
+	// Triggered checks go first
+	while (TriggeredCheckQueue.Num() > 0)
+	{
+		const uint32 Token = TriggeredCheckQueue[0];
+		TriggeredCheckQueue.RemoveAt(0);
+
+		const int32 PairIndex = CheckList.IndexOfByPredicate([Token](const FICECandidatePair& Pair) { return Pair.CheckToken == Token; });
+		if (PairIndex != INDEX_NONE && CheckList[PairIndex].State == EICECandidatePairState::Waiting)
+		{
+			return PairIndex;
+		}
+	}
+
+	// Then the highest priority Waiting pair (CheckList is sorted)
+	for (int32 PairIndex = 0; PairIndex < CheckList.Num(); ++PairIndex)
+	{
+		if (CheckList[PairIndex].State == EICECandidatePairState::Waiting)
+		{
+			return PairIndex;
+		}
+	}
+
+	// Nothing Waiting: unfreeze the highest priority Frozen pair
+	for (int32 PairIndex = 0; PairIndex < CheckList.Num(); ++PairIndex)
+	{
+		if (CheckList[PairIndex].State == EICECandidatePairState::Frozen)
+		{
+			CheckList[PairIndex].State = EICECandidatePairState::Waiting;
+			return PairIndex;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+void FICEAgent::TriggerCheck(int32 PairIndex)
+{
+	FICECandidatePair& Pair = CheckList[PairIndex];
+	if (Pair.State == EICECandidatePairState::InProgress || Pair.State == EICECandidatePairState::Succeeded)
+	{
+		return;
+	}
+
+	UE_LOG(LogOnlineICE, Verbose, TEXT("Triggered check for %s"), *Pair.ToString());
+
+	Pair.State = EICECandidatePairState::Waiting;
+	Pair.Transmissions = 0;
+	TriggeredCheckQueue.AddUnique(Pair.CheckToken);
+
+	// A checklist that already failed is revived by the peer's checks
+	bChecksInProgress = true;
+}
+
+bool FICEAgent::CreateCheckSocket()
+{
+	if (Socket)
+	{
+		return true;
+	}
+
+	// Bound on every interface with an OS-assigned port, before any candidate exists:
+	// host candidates are the socket's interface addresses, reflexive and relayed ones its mappings
+	Socket = CreateAgentSocket(TEXT("ICE"), Config.bEnableIPv6);
+	if (!Socket)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to create ICE socket"));
+		UpdateConnectionState(EICEConnectionState::Failed);
+		return false;
+	}
+
+	StartReceiveThread();
+
+	return true;
+}
+
+FSocket* FICEAgent::CreateAgentSocket(const FString& Description, bool bDualStack)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
+		return nullptr;
+	}
+
+	// Try dual-stack IPv6 first, then plain IPv4
+	const FName Protocols[] = { FNetworkProtocolTypes::IPv6, FNetworkProtocolTypes::IPv4 };
+	for (const FName& Protocol : Protocols)
+	{
+		const bool bIPv6 = Protocol == FNetworkProtocolTypes::IPv6;
+		if (bIPv6 && !bDualStack)
+		{
+			continue;
+		}
+
+		TSharedRef<FInternetAddr> LocalAddr = SocketSubsystem->CreateInternetAddr(Protocol);
+		LocalAddr->SetAnyAddress();
+		LocalAddr->SetPort(0);
+
+		FSocket* NewSocket = SocketSubsystem->CreateSocket(NAME_DGram, Description, Protocol);
+		if (!NewSocket)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Failed to create %s %s socket"), *Description, *Protocol.ToString());
+			continue;
+		}
+
+		// Enable address reuse to allow multiple ICE agents or reconnections on the same port
+		NewSocket->SetReuseAddr(true);
+
+		// IPv4 peers reach the IPv6 socket as IPv4-mapped addresses
+		if ((bIPv6 && !NewSocket->SetIPv6Only(false)) || !NewSocket->Bind(*LocalAddr))
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Failed to bind %s socket to %s:%d"), *Description, *LocalAddr->ToString(false), LocalAddr->GetPort());
+			SocketSubsystem->DestroySocket(NewSocket);
+			continue;
+		}
+
+		// Set socket to non-blocking mode for async operations
+		NewSocket->SetNonBlocking(true);
+
+		// Disable receive error notifications to prevent socket from becoming invalid on ICMP errors
+		NewSocket->SetRecvErr(false);
+
+		TSharedRef<FInternetAddr> BoundAddr = SocketSubsystem->CreateInternetAddr(Protocol);
+		NewSocket->GetAddress(*BoundAddr);
+		UE_LOG(LogOnlineICE, Log, TEXT("%s socket bound to %s (%s)"), *Description, *BoundAddr->ToString(true),
+			bIPv6 ? TEXT("dual-stack") : TEXT("IPv4"));
+		return NewSocket;
+	}
+
+	return nullptr;
+}
+
+TSharedPtr<FInternetAddr> FICEAgent::ToSocketAddress(const TSharedPtr<FInternetAddr>& Addr) const
+{
+	if (!Addr.IsValid() || !Socket || Socket->GetProtocol() != FNetworkProtocolTypes::IPv6 ||
+		Addr->GetProtocolType() != FNetworkProtocolTypes::IPv4)
+	{
+		return Addr;
+	}
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	TSharedPtr<FInternetAddr> MappedAddr = SocketSubsystem ? SocketSubsystem->GetAddressFromString(TEXT("::ffff:") + Addr->ToString(false)) : nullptr;
+	if (!MappedAddr.IsValid() || !MappedAddr->IsValid())
+	{
+		return Addr;
+	}
+
+	MappedAddr->SetPort(Addr->GetPort());
+	return MappedAddr;
+}
+
+FString FICEAgent::GetCandidateAddress(const FInternetAddr& Addr)
+{
+	FString Address = Addr.ToString(false);
+
+	// ::ffff:a.b.c.d is how a dual-stack socket reports an IPv4 host
+	static const FString MappedPrefix = TEXT("::ffff:");
+	if (Address.StartsWith(MappedPrefix) && Address.Contains(TEXT(".")))
+	{
+		Address.RightChopInline(MappedPrefix.Len());
+	}
+	return Address;
+}
+
+void FICEAgent::StartReceiveThread()
+{
+	if (!Config.bUseIOThread || !Socket || ReceiveThread.IsValid())
+	{
+		return;
+	}
+
+	if (!FPlatformProcess::SupportsMultithreading())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("ICE I/O thread requested but multithreading is not supported, polling from Tick"));
+		return;
+	}
+
+	ReceiveRing = MakeUnique<FICEPacketRing>(Config.IOThreadRingCapacity);
+	ReportedDroppedPackets = 0;
+
+	ReceiveThread = MakeUnique<FICEReceiveThread>(Socket, *ReceiveRing);
+	if (!ReceiveThread->IsRunning())
+	{
+		ReceiveThread.Reset();
+		ReceiveRing.Reset();
+		return;
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("ICE receive thread started (ring capacity %d)"), Config.IOThreadRingCapacity);
+}
+
+void FICEAgent::StopReceiveThread()
+{
+	// Joins the thread, so the socket can be destroyed safely afterwards
+	ReceiveThread.Reset();
+
+	// On a pool socket the ring is filled by the pool and lives as long as the attachment
+	if (!bSharedSocket)
+	{
+		ReceiveRing.Reset();
+	}
+}
+
+void FICEAgent::AttachSharedSocket(FSocket* InSocket, bool bInMultiplexTURN)
+{
+	check(!Socket && InSocket);
+
+	Socket = InSocket;
+	bSharedSocket = true;
+	bMultiplexTURNOnSharedSocket = bInMultiplexTURN;
+	ReceiveRing = MakeUnique<FICEPacketRing>(Config.IOThreadRingCapacity);
+	ReportedDroppedPackets = 0;
+}
+
+bool FICEAgent::DeliverPacket(const uint8* Data, int32 Size, const FInternetAddr& FromAddr)
+{
+	if (!bSharedSocket || !ReceiveRing.IsValid())
+	{
+		return false;
+	}
+
+	FICEPacketSlot* Slot = ReceiveRing->BeginWrite();
+	if (!Slot)
+	{
+		ReceiveRing->AddDropped();
+		return false;
+	}
+
+	Slot->Size = FMath::Min(Size, FICEPacketSlot::MAX_PACKET_SIZE);
+	FMemory::Memcpy(Slot->Data, Data, Slot->Size);
+	Slot->FromAddr->SetRawIp(FromAddr.GetRawIp());
+	Slot->FromAddr->SetPort(FromAddr.GetPort());
+	ReceiveRing->EndWrite();
+	return true;
+}
+
+bool FICEAgent::AcceptsDatagramFrom(const FInternetAddr& FromAddr, const uint8* Data, int32 Size) const
+{
+	// Relayed data belongs to the agent whose allocation lives on the pool socket
+	const bool bFromTURNServer = IsTURNMultiplexed() && TURNServerAddr.IsValid() && *TURNServerAddr == FromAddr;
+
+	// Servers answer every agent of the pool from one address, only the transaction ID tells them apart
+	if (FSTUNMessageView::IsSTUNMessage(Data, Size))
+	{
+		FSTUNMessageView Message;
+		if (!Message.Parse(Data, Size))
+		{
+			return false;
+		}
+		if (!Message.IsResponse())
+		{
+			return bFromTURNServer;
+		}
+		return FindGatherRequest(Message) != INDEX_NONE || (bFromTURNServer &&
+			TURNTransactions.ContainsByPredicate([&Message](const FICETURNTransaction& Transaction)
+			{
+				return Message.HasTransactionID(Transaction.TransactionID);
+			}));
+	}
+
+	if (bFromTURNServer)
+	{
+		return true;
+	}
+
+	if (SelectedRemoteAddr.IsValid() && *SelectedRemoteAddr == FromAddr)
+	{
+		return true;
+	}
+
+	if (FindDirectPairForAddress(FromAddr) != INDEX_NONE)
+	{
+		return true;
+	}
+
+	// Remote candidates not paired yet (checks not started, or pruned pairs)
+	const FString FromIP = FromAddr.ToString(false);
+	const int32 FromPort = FromAddr.GetPort();
+	const bool bKnownCandidate = RemoteCandidates.ContainsByPredicate([&FromIP, FromPort](const FICECandidate& Candidate)
+	{
+		return Candidate.Port == FromPort && Candidate.Address == FromIP;
+	});
+	if (bKnownCandidate)
+	{
+		return true;
+	}
+
+	// A response from an unknown address (peer reflexive) still echoes a token only this agent handed out
+	if (IsHandshakePacket(Data, Size) && (Data[4] & HandshakeConstants::PACKET_KIND_MASK) == HandshakeConstants::PACKET_TYPE_HELLO_RESPONSE)
+	{
+		const uint32 Token = ((uint32)Data[5] << 24) | ((uint32)Data[6] << 16) | ((uint32)Data[7] << 8) | (uint32)Data[8];
+		return CheckList.ContainsByPredicate([Token](const FICECandidatePair& Pair) { return Pair.CheckToken == Token; });
+	}
+
+	return false;
+}
+
+bool FICEAgent::IsActive() const
+{
+	return bGatheringInProgress || bChecksInProgress || bIsConnected || bTURNAllocationActive ||
+		TURNTransactions.Num() > 0 || CheckList.Num() > 0;
+}
+
+bool FICEAgent::ReceiveDirectPacket(uint8* Buffer, int32 BufferSize, int32& OutSize, FInternetAddr& OutFromAddr)
+{
+	OutSize = 0;
+
+	if (!ReceiveRing.IsValid())
+	{
+		// Polling mode: read straight from the socket
+		uint32 PendingDataSize = 0;
+		if (!Socket || !Socket->HasPendingData(PendingDataSize) || PendingDataSize == 0)
+		{
+			return false;
+		}
+		return Socket->RecvFrom(Buffer, BufferSize, OutSize, OutFromAddr);
+	}
+
+	const uint32 DroppedPackets = ReceiveRing->GetDroppedCount();
+	if (DroppedPackets != ReportedDroppedPackets)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("ICE receive ring full, %u datagrams dropped so far"), DroppedPackets);
+		ReportedDroppedPackets = DroppedPackets;
+	}
+
+	const FICEPacketSlot* Slot = ReceiveRing->BeginRead();
+	if (!Slot)
+	{
+		return false;
+	}
+
+	OutSize = FMath::Min(Slot->Size, BufferSize);
+	FMemory::Memcpy(Buffer, Slot->Data, OutSize);
+	OutFromAddr.SetRawIp(Slot->FromAddr->GetRawIp());
+	OutFromAddr.SetPort(Slot->FromAddr->GetPort());
+	ReceiveRing->EndRead();
+	return true;
+}
+
+void FICEAgent::TickConnectivityChecks(float DeltaTime)
+{
+	// Responses and peer checks may arrive on the direct socket or through TURN
+	ProcessReceivedData();
+
+	if (bIsConnected || !bChecksInProgress)
+	{
+		return;
+	}
+
+	AdvanceConnectivityChecks(DeltaTime);
+}
+
+void FICEAgent::AdvanceConnectivityChecks(float DeltaTime)
+{
+	// Retransmit pending checks, pairs that never answer fail
+	for (FICECandidatePair& Pair : CheckList)
+	{
+		if (Pair.State != EICECandidatePairState::InProgress)
+		{
+			continue;
+		}
+
+		Pair.TimeSinceLastCheck += DeltaTime;
+		if (Pair.TimeSinceLastCheck >= CHECK_RETRANSMIT_INTERVAL)
+		{
+			if (Pair.Transmissions >= MAX_CHECK_TRANSMISSIONS)
+			{
+				UE_LOG(LogOnlineICE, Verbose, TEXT("Candidate pair failed (no response): %s"), *Pair.ToString());
+				Pair.State = EICECandidatePairState::Failed;
+				Pair.Stats.RequestsLost++;
+			}
+			else if (!SendConnectivityCheck(Pair))
+			{
+				Pair.State = EICECandidatePairState::Failed;
+			}
+		}
+	}
+
+	// Start one new check every Ta
+	TimeSinceLastPacedCheck += DeltaTime;
+	while (TimeSinceLastPacedCheck >= Config.ConnectivityCheckInterval)
+	{
+		const int32 PairIndex = SelectNextPairToCheck();
+		if (PairIndex == INDEX_NONE)
+		{
+			// Nothing to send: the next pair that shows up may go out immediately
+			TimeSinceLastPacedCheck = Config.ConnectivityCheckInterval;
+			break;
+		}
+
+		TimeSinceLastPacedCheck -= Config.ConnectivityCheckInterval;
+
+		FICECandidatePair& Pair = CheckList[PairIndex];
+		Pair.State = EICECandidatePairState::InProgress;
+		Pair.Transmissions = 0;
+		if (!SendConnectivityCheck(Pair))
+		{
+			Pair.State = EICECandidatePairState::Failed;
+		}
+	}
+
+	// Reflect the path still being tried in the connection state
+	bool bDirectPending = false;
+	bool bRelayPending = false;
+	for (const FICECandidatePair& Pair : CheckList)
+	{
+		// The pair still selected during a restart (Succeeded) isn't being checked
+		if (Pair.State == EICECandidatePairState::Failed || Pair.State == EICECandidatePairState::Succeeded)
+		{
+			continue;
+		}
+
+		if (Pair.IsRelayed())
+		{
+			bRelayPending = true;
+		}
+		else
+		{
+			bDirectPending = true;
+		}
+	}
+
+	// A restart or a direct upgrade never leaves Connected: it either migrates (CompleteHandshake) or keeps the current pair
+	if (bIsConnected)
+	{
+		if (!bDirectPending && !bRelayPending && !bGatheringInProgress)
+		{
+			if (bRestartInProgress)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE restart: every new pair failed, staying on the selected pair"));
+			}
+			bChecksInProgress = false;
+			bRestartInProgress = false;
+		}
+		return;
+	}
+
+	if (bDirectPending)
+	{
+		UpdateConnectionState(EICEConnectionState::ConnectingDirect);
+	}
+	else if (bRelayPending)
+	{
+		UpdateConnectionState(EICEConnectionState::ConnectingRelay);
+	}
+	else if (!bGatheringInProgress)
+	{
+		// Keep the socket open: a late check from the peer can still revive the checklist
+		UE_LOG(LogOnlineICE, Error, TEXT("All %d candidate pairs failed"), CheckList.Num());
+		bChecksInProgress = false;
+		UpdateConnectionState(EICEConnectionState::Failed);
+	}
+}
+
+bool FICEAgent::IsConnected() const
+{
+	return bIsConnected;
+}
+
+bool FICEAgent::SendData(const uint8* Data, int32 Size, EICESendPriority Priority)
+{
+	if (Config.bPaceSends || Config.bCoalesceSends || Config.bEncryptTraffic)
+	{
+		const TArrayView<const uint8> Buffers[] = { TArrayView<const uint8>(Data, Size) };
+		bool bResult = false;
+		if (Config.bPaceSends && !PaceSend(Buffers, Priority, bResult))
+		{
+			return bResult;
+		}
+		return SendMessage(Buffers);
+	}
+	return SendDatagram(Data, Size);
+}
+
+bool FICEAgent::SendDatagram(const uint8* Data, int32 Size)
+{
+	if (bFECActive)
+	{
+		return SendFECDatagram(Data, Size);
+	}
+	return TransmitDatagram(Data, Size);
+}
+
+bool FICEAgent::TransmitDatagram(const uint8* Data, int32 Size)
+{
+	if (!bIsConnected)
+	{
+		return false;
+	}
+
+	// Use TURN relay if the local candidate is relayed
+	if (SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive)
+	{
+		return CountSentDatagram(SendDataThroughTURN(Data, Size), Size, true);
+	}
+
+	// Otherwise use direct connection (address resolved once when the pair was selected)
+	if (!Socket || !SelectedRemoteAddr.IsValid())
+	{
+		return false;
+	}
+
+	int32 BytesSent;
+	return CountSentDatagram(Socket->SendTo(Data, Size, BytesSent, *SelectedRemoteAddr) && BytesSent == Size, Size, false);
+}
+
+bool FICEAgent::CountSentDatagram(bool bSent, int32 Size, bool bRelayed)
+{
+	if (!bSent)
+	{
+		++Stats.SendFailures;
+		return false;
+	}
+
+	++Stats.PacketsSent;
+	Stats.BytesSent += Size;
+	if (bRelayed)
+	{
+		Stats.RelayedBytesSent += Size;
+	}
+	CSV_CUSTOM_STAT(ICE, PacketsSent, 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(ICE, BytesSent, Size, ECsvCustomStatOp::Accumulate);
+	return true;
+}
+
+void FICEAgent::CountReceivedDatagram(int32 Size, bool bRelayed)
+{
+	++Stats.PacketsReceived;
+	Stats.BytesReceived += Size;
+	if (bRelayed)
+	{
+		Stats.RelayedBytesReceived += Size;
+	}
+	CSV_CUSTOM_STAT(ICE, PacketsReceived, 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(ICE, BytesReceived, Size, ECsvCustomStatOp::Accumulate);
+}
+
+bool FICEAgent::SendDataGather(TArrayView<const TArrayView<const uint8>> Buffers, EICESendPriority Priority)
+{
+	bool bResult = false;
+	if (Config.bPaceSends && !PaceSend(Buffers, Priority, bResult))
+	{
+		return bResult;
+	}
+	return SendMessage(Buffers);
+}
+
+bool FICEAgent::SendMessage(TArrayView<const TArrayView<const uint8>> Buffers)
+{
+	if (Config.bCoalesceSends)
+	{
+		return CoalesceSend(Buffers);
+	}
+	if (Config.bEncryptTraffic)
+	{
+		return SealAndSend(Buffers);
+	}
+
+	if (Buffers.Num() == 1)
+	{
+		return SendDatagram(Buffers[0].GetData(), Buffers[0].Num());
+	}
+
+	// FSocket has no scatter/gather send, concatenate into a buffer that is kept between calls
+	int32 TotalSize = 0;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		TotalSize += Buffer.Num();
+	}
+
+	// Leave room for the ChannelData header so relayed sends don't copy the payload again
+	uint8* Scratch = ReserveSendScratch(SendGatherBuffer, SEND_HEADROOM + TotalSize);
+
+	int32 Offset = SEND_HEADROOM;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		FMemory::Memcpy(Scratch + Offset, Buffer.GetData(), Buffer.Num());
+		Offset += Buffer.Num();
+	}
+
+	return SendDatagramInPlace(Scratch, TotalSize);
+}
+
+bool FICEAgent::SendDataInPlace(uint8* Buffer, int32 PayloadSize, EICESendPriority Priority)
+{
+	if (!Buffer)
+	{
+		return false;
+	}
+
+	if (Config.bPaceSends || Config.bCoalesceSends || Config.bEncryptTraffic)
+	{
+		const TArrayView<const uint8> Buffers[] = { TArrayView<const uint8>(Buffer + SEND_HEADROOM, PayloadSize) };
+		bool bResult = false;
+		if (Config.bPaceSends && !PaceSend(Buffers, Priority, bResult))
+		{
+			return bResult;
+		}
+
+		// The bundle and record framing don't fit around the caller's payload, it is copied into a scratch buffer
+		if (Config.bCoalesceSends || Config.bEncryptTraffic)
+		{
+			return SendMessage(Buffers);
+		}
+	}
+	return SendDatagramInPlace(Buffer, PayloadSize);
+}
+
+bool FICEAgent::PaceSend(TArrayView<const TArrayView<const uint8>> Buffers, EICESendPriority Priority, bool& OutResult)
+{
+	OutResult = false;
+	if (!bIsConnected)
+	{
+		return false;
+	}
+
+	// Queued datagrams whose tokens came in since the last send leave first
+	DrainPacedSends();
+
+	int32 PayloadSize = 0;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		PayloadSize += Buffer.Num();
+	}
+
+	// Tokens count what goes on the wire: IP/UDP headers, relay, record and bundle framing
+	const int32 WireSize = PayloadSize + FMath::Max(0, Config.PathMTU - GetMaxPayloadSize());
+	if (SendScheduler.TryConsume(WireSize, Priority))
+	{
+		return true;
+	}
+
+	OutResult = SendScheduler.Enqueue(Buffers, WireSize, Priority);
+	return false;
+}
+
+void FICEAgent::DrainPacedSends()
+{
+	if (!SendScheduler.HasQueued() || !bIsConnected)
+	{
+		return;
+	}
+
+	SendScheduler.Drain([this](TArrayView<const uint8> Datagram)
+	{
+		const TArrayView<const uint8> Buffers[] = { Datagram };
+		return SendMessage(Buffers);
+	});
+}
+
+bool FICEAgent::SendDatagramInPlace(uint8* Buffer, int32 PayloadSize)
+{
+	// The FEC header doesn't fit in the headroom, the datagram is framed in a scratch buffer
+	if (bFECActive && Buffer)
+	{
+		return SendFECDatagram(Buffer + SEND_HEADROOM, PayloadSize);
+	}
+	return TransmitDatagramInPlace(Buffer, PayloadSize);
+}
+
+bool FICEAgent::TransmitDatagramInPlace(uint8* Buffer, int32 PayloadSize)
+{
+	if (!bIsConnected || !Buffer)
+	{
+		return false;
+	}
+
+	if (SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive)
+	{
+		if (TURNChannelNumber >= STUNConstants::CHANNEL_NUMBER_MIN && TURNChannelNumber <= STUNConstants::CHANNEL_NUMBER_MAX
+			&& PayloadSize <= GetMaxRelayPayloadSize(true))
+		{
+			return CountSentDatagram(SendTURNChannelDataInPlace(TURNChannelNumber, Buffer, PayloadSize), PayloadSize, true);
+		}
+
+		// Send indication framing doesn't fit in the headroom, let the regular path size-check and frame it
+		return CountSentDatagram(SendDataThroughTURN(Buffer + SEND_HEADROOM, PayloadSize), PayloadSize, true);
+	}
+
+	// Direct sends simply skip the headroom
+	return TransmitDatagram(Buffer + SEND_HEADROOM, PayloadSize);
+}
+
+bool FICEAgent::SendFECDatagram(const uint8* Data, int32 Size)
+{
+	if (!bIsConnected)
+	{
+		return false;
+	}
+
+	// [SEND_HEADROOM] [FEC header] [Datagram]
+	uint8* Scratch = ReserveSendScratch(FECSendBuffer, SEND_HEADROOM + FICEFECCodec::HEADER_SIZE + Size);
+	const bool bGroupComplete = FECCodec.EncodePacket(Data, Size, Scratch + SEND_HEADROOM);
+	FMemory::Memcpy(Scratch + SEND_HEADROOM + FICEFECCodec::HEADER_SIZE, Data, Size);
+	const bool bSent = TransmitDatagramInPlace(Scratch, FICEFECCodec::HEADER_SIZE + Size);
+
+	// The datagram is in the parity even if it failed to leave, the peer may still rebuild it
+	if (bGroupComplete)
+	{
+		Scratch = ReserveSendScratch(FECSendBuffer, SEND_HEADROOM + FECCodec.GetParityPacketSize());
+		const int32 ParitySize = FECCodec.BuildParity(Scratch + SEND_HEADROOM);
+		TransmitDatagramInPlace(Scratch, ParitySize);
+	}
+	return bSent;
+}
+
+bool FICEAgent::SealAndSend(TArrayView<const TArrayView<const uint8>> Buffers)
+{
+	if (!bIsConnected || !SecureChannel.IsEstablished())
+	{
+		return false;
+	}
+
+	int32 TotalSize = 0;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		TotalSize += Buffer.Num();
+	}
+
+	// [SEND_HEADROOM] [Record header] [Payload] [Tag], sealed in place then sent without another copy
+	uint8* Scratch = ReserveSendScratch(SecureSendBuffer, SEND_HEADROOM + FICESecureChannel::RECORD_OVERHEAD + TotalSize);
+	uint8* Record = Scratch + SEND_HEADROOM;
+
+	int32 Offset = FICESecureChannel::RECORD_HEADER_SIZE;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		FMemory::Memcpy(Record + Offset, Buffer.GetData(), Buffer.Num());
+		Offset += Buffer.Num();
+	}
+
+	const int32 RecordSize = SecureChannel.Seal(Record, TotalSize);
+	return RecordSize > 0 && SendDatagramInPlace(Scratch, RecordSize);
+}
+
+bool FICEAgent::CoalesceSend(TArrayView<const TArrayView<const uint8>> Buffers)
+{
+	if (!bIsConnected || (Config.bEncryptTraffic && !SecureChannel.IsEstablished()))
+	{
+		return false;
+	}
+
+	int32 MessageSize = 0;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		MessageSize += Buffer.Num();
+	}
+	if (MessageSize > CoalesceConstants::MAX_MESSAGE_SIZE)
+	{
+		return false;
+	}
+
+	// A message that doesn't fit the path MTU next to the queued ones starts a new datagram
+	const int32 MaxBundleSize = GetMaxPayloadSize() + CoalesceConstants::BUNDLE_HEADER_SIZE + CoalesceConstants::MESSAGE_HEADER_SIZE;
+	if (CoalescedSize > 0 && CoalescedSize + CoalesceConstants::MESSAGE_HEADER_SIZE + MessageSize > MaxBundleSize)
+	{
+		FlushSends();
+	}
+
+	// [SEND_HEADROOM] [Record header] [Bundle] [Tag], so the flush seals and frames the bundle where it is
+	const int32 BundleStart = SEND_HEADROOM + (Config.bEncryptTraffic ? FICESecureChannel::RECORD_HEADER_SIZE : 0);
+	const int32 BundleEnd = FMath::Max(CoalescedSize, CoalesceConstants::BUNDLE_HEADER_SIZE) + CoalesceConstants::MESSAGE_HEADER_SIZE + MessageSize;
+	const int32 RequiredSize = BundleStart + BundleEnd + FICESecureChannel::TAG_SIZE;
+	if (RequiredSize > CoalesceBuffer.Num())
+	{
+		ReserveSendScratch(CoalesceBuffer, FMath::Max(RequiredSize, BundleStart + MaxBundleSize + FICESecureChannel::TAG_SIZE));
+	}
+
+	uint8* Bundle = CoalesceBuffer.GetData() + BundleStart;
+	if (CoalescedSize == 0)
+	{
+		Bundle[0] = CoalesceConstants::BUNDLE_MARKER;
+		CoalescedSize = CoalesceConstants::BUNDLE_HEADER_SIZE;
+		CoalesceStartTime = FPlatformTime::Seconds();
+	}
+
+	uint8* Message = Bundle + CoalescedSize;
+	Message[0] = (uint8)(MessageSize >> 8);
+	Message[1] = (uint8)(MessageSize & 0xFF);
+	int32 Offset = CoalesceConstants::MESSAGE_HEADER_SIZE;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		FMemory::Memcpy(Message + Offset, Buffer.GetData(), Buffer.Num());
+		Offset += Buffer.Num();
+	}
+	CoalescedSize = BundleEnd;
+	++CoalescedMessageCount;
+
+	if (Config.CoalesceWindow > 0.0f && FPlatformTime::Seconds() - CoalesceStartTime >= Config.CoalesceWindow)
+	{
+		return FlushSends();
+	}
+	return true;
+}
+
+bool FICEAgent::FlushSends()
+{
+	if (CoalescedSize == 0)
+	{
+		return true;
+	}
+
+	const int32 BundleSize = CoalescedSize;
+	CoalescedSize = 0;
+	if (!bIsConnected)
+	{
+		return false;
+	}
+
+	++CoalescedDatagramCount;
+	uint8* Scratch = CoalesceBuffer.GetData();
+	if (Config.bEncryptTraffic)
+	{
+		const int32 RecordSize = SecureChannel.Seal(Scratch + SEND_HEADROOM, BundleSize);
+		return RecordSize > 0 && SendDatagramInPlace(Scratch, RecordSize);
+	}
+	return SendDatagramInPlace(Scratch, BundleSize);
+}
+
+uint8* FICEAgent::ReserveSendScratch(TArray<uint8>& Buffer, int32 Size)
+{
+	if (Size > Buffer.Max())
+	{
+		++SendAllocationCount;
+		INC_DWORD_STAT(STAT_ICESendAllocations);
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Growing ICE send scratch buffer to %d bytes"), Size);
+	}
+
+	Buffer.SetNumUninitialized(Size, EAllowShrinking::No);
+	return Buffer.GetData();
+}
+
+bool FICEAgent::ReceiveData(uint8* Data, int32 MaxSize, int32& OutSize)
+{
+	FICEPacket Packet(Data, MaxSize);
+	if (!ReceiveAppPacket(Packet))
+	{
+		OutSize = 0;
+		return false;
+	}
+
+	// Callers of ReceiveData expect the payload at the start of their buffer
+	if (Packet.Offset > 0)
+	{
+		FMemory::Memmove(Data, Packet.GetPayload(), Packet.Size);
+	}
+	OutSize = Packet.Size;
+	return true;
+}
+
+int32 FICEAgent::ReceiveBatch(TArrayView<FICEPacket> Packets)
+{
+	int32 NumReceived = 0;
+	while (NumReceived < Packets.Num() && ReceiveAppPacket(Packets[NumReceived]))
+	{
+		++NumReceived;
+	}
+	return NumReceived;
+}
+
+bool FICEAgent::HasPendingData(uint32& PendingDataSize) const
+{
+	PendingDataSize = 0;
+
+	if (!bIsConnected)
+	{
+		return false;
+	}
+
+	// Datagram rebuilt from parity
+	if (FECCodec.HasRecovered())
+	{
+		PendingDataSize = FECCodec.GetRecoveredSize();
+		return true;
+	}
+
+	// Messages left over from the last coalesced datagram
+	if (ReceiveBundleOffset < ReceiveBundleBuffer.Num())
+	{
+		const uint8* Message = ReceiveBundleBuffer.GetData() + ReceiveBundleOffset;
+		PendingDataSize = (Message[0] << 8) | Message[1];
+		return true;
+	}
+
+	if (SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive && !IsTURNMultiplexed())
+	{
+		return TURNSocket && TURNSocket->HasPendingData(PendingDataSize) && PendingDataSize > 0;
+	}
+
+	if (ReceiveRing.IsValid())
+	{
+		const FICEPacketSlot* Slot = ReceiveRing->BeginRead();
+		if (!Slot)
+		{
+			return false;
+		}
+		PendingDataSize = Slot->Size;
+		return true;
+	}
+
+	return Socket && Socket->HasPendingData(PendingDataSize) && PendingDataSize > 0;
+}
+
+void FICEAgent::GetLocalAddress(FInternetAddr& OutAddr) const
+{
+	if (Socket)
+	{
+		Socket->GetAddress(OutAddr);
+	}
+}
+
+int32 FICEAgent::GetLocalPort() const
+{
+	return Socket ? Socket->GetPortNo() : 0;
+}
+
+bool FICEAgent::ReceiveAppPacket(FICEPacket& Packet)
+{
+	if (!Config.bEncryptTraffic && !Config.bCoalesceSends)
+	{
+		return ReceiveFECDatagram(Packet);
+	}
+
+	// Messages left over from the last bundle come before new datagrams
+	if (Config.bCoalesceSends && PopBundledMessage(Packet))
+	{
+		return true;
+	}
+
+	while (ReceiveFECDatagram(Packet))
+	{
+		// Records are opened where they were received, plaintext and forged datagrams are dropped
+		if (Config.bEncryptTraffic)
+		{
+			int32 PayloadSize = 0;
+			if (!SecureChannel.Open(Packet.Data + Packet.Offset, Packet.Size, PayloadSize))
+			{
+				UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Dropping %d byte datagram that failed to open"), Packet.Size);
+				continue;
+			}
+			Packet.Offset += FICESecureChannel::RECORD_HEADER_SIZE;
+			Packet.Size = PayloadSize;
+		}
+
+		if (Config.bCoalesceSends && !UnpackBundle(Packet))
+		{
+			UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Dropping malformed %d byte coalesced datagram"), Packet.Size);
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+bool FICEAgent::ReceiveFECDatagram(FICEPacket& Packet)
+{
+	if (!bFECActive)
+	{
+		return ReceiveDatagram(Packet);
+	}
+
+	// A datagram rebuilt from parity comes before new ones
+	if (FECCodec.PopRecovered(Packet.Data, Packet.Capacity, Packet.Size))
+	{
+		Packet.Offset = 0;
+		return true;
+	}
+
+	while (ReceiveDatagram(Packet))
+	{
+		switch (FECCodec.Receive(Packet.Data + Packet.Offset, Packet.Size))
+		{
+			case EICEFECResult::Data:
+				Packet.Offset += FICEFECCodec::HEADER_SIZE;
+				Packet.Size -= FICEFECCodec::HEADER_SIZE;
+				return true;
+
+			case EICEFECResult::Consumed:
+				if (FECCodec.PopRecovered(Packet.Data, Packet.Capacity, Packet.Size))
+				{
+					Packet.Offset = 0;
+					return true;
+				}
+				break;
+
+			default:
+				UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Dropping %d byte datagram without FEC header"), Packet.Size);
+				break;
+		}
+	}
+	return false;
+}
+
+bool FICEAgent::UnpackBundle(FICEPacket& Packet)
+{
+	const uint8* Bundle = Packet.Data + Packet.Offset;
+	const int32 Size = Packet.Size;
+	if (Size < CoalesceConstants::BUNDLE_HEADER_SIZE + CoalesceConstants::MESSAGE_HEADER_SIZE || Bundle[0] != CoalesceConstants::BUNDLE_MARKER)
+	{
+		return false;
+	}
+
+	// Every length is checked before the first message is returned, a truncated bundle is dropped whole
+	int32 Position = CoalesceConstants::BUNDLE_HEADER_SIZE;
+	while (Position < Size)
+	{
+		if (Position + CoalesceConstants::MESSAGE_HEADER_SIZE > Size)
+		{
+			return false;
+		}
+		const int32 MessageSize = (Bundle[Position] << 8) | Bundle[Position + 1];
+		Position += CoalesceConstants::MESSAGE_HEADER_SIZE + MessageSize;
+	}
+	if (Position != Size)
+	{
+		return false;
+	}
+
+	const int32 FirstSize = (Bundle[1] << 8) | Bundle[2];
+	const int32 FirstEnd = CoalesceConstants::BUNDLE_HEADER_SIZE + CoalesceConstants::MESSAGE_HEADER_SIZE + FirstSize;
+
+	// The caller's buffer is reused by the next receive, later messages wait in ours
+	ReceiveBundleBuffer.Reset();
+	ReceiveBundleBuffer.Append(Bundle + FirstEnd, Size - FirstEnd);
+	ReceiveBundleOffset = 0;
+
+	Packet.Offset += CoalesceConstants::BUNDLE_HEADER_SIZE + CoalesceConstants::MESSAGE_HEADER_SIZE;
+	Packet.Size = FirstSize;
+	return true;
+}
+
+bool FICEAgent::PopBundledMessage(FICEPacket& Packet)
+{
+	while (ReceiveBundleOffset < ReceiveBundleBuffer.Num())
+	{
+		const uint8* Message = ReceiveBundleBuffer.GetData() + ReceiveBundleOffset;
+		const int32 MessageSize = (Message[0] << 8) | Message[1];
+		ReceiveBundleOffset += CoalesceConstants::MESSAGE_HEADER_SIZE + MessageSize;
+
+		if (!Packet.Data || MessageSize > Packet.Capacity)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Dropping %d byte coalesced message, receive buffer holds %d"), MessageSize, Packet.Capacity);
+			continue;
+		}
+
+		FMemory::Memcpy(Packet.Data, Message + CoalesceConstants::MESSAGE_HEADER_SIZE, MessageSize);
+		Packet.Offset = 0;
+		Packet.Size = MessageSize;
+		return true;
+	}
+
+	ReceiveBundleBuffer.Reset();
+	ReceiveBundleOffset = 0;
+	return false;
+}
+
+bool FICEAgent::ReceiveDatagram(FICEPacket& Packet)
+{
+	Packet.Size = 0;
+	Packet.Offset = 0;
+
+	if (!bIsConnected || !Packet.Data || Packet.Capacity <= 0)
+	{
+		return false;
+	}
+
+	if (!ReceiveFromAddr.IsValid())
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		if (!SocketSubsystem)
+		{
+			return false;
+		}
+		ReceiveFromAddr = SocketSubsystem->CreateInternetAddr();
+	}
+
+	const bool bRelayed = SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive;
+
+	// Skip over handshake packets and stray datagrams until a game datagram shows up
+	while (true)
+	{
+		if (bRelayed && !IsTURNMultiplexed())
+		{
+			uint32 PendingDataSize = 0;
+			if (!TURNSocket || !TURNSocket->HasPendingData(PendingDataSize) || PendingDataSize == 0)
+			{
+				return false;
+			}
+
+			// Receive straight into the caller's buffer, the TURN framing stays in front of the payload
+			int32 BytesRead = 0;
+			if (!TURNSocket->RecvFrom(Packet.Data, Packet.Capacity, BytesRead, *ReceiveFromAddr))
+			{
+				return false;
+			}
+
+			if (HandleTURNResponse(Packet.Data, BytesRead))
+			{
+				continue;
+			}
+
+			int32 PayloadOffset = 0;
+			int32 PayloadSize = 0;
+			uint16 ChannelNumber = 0;
+			if (!UnwrapTURNPacket(Packet.Data, BytesRead, PayloadOffset, PayloadSize, &ChannelNumber))
+			{
+				continue;
+			}
+
+			if (HandleHandshakePacket(Packet.Data + PayloadOffset, PayloadSize, nullptr, ChannelNumber))
+			{
+				continue;
+			}
+
+			Packet.Offset = PayloadOffset;
+			Packet.Size = PayloadSize;
+			CountReceivedDatagram(PayloadSize, true);
+			return true;
+		}
+		else
+		{
+			int32 BytesRead = 0;
+			if (!ReceiveDirectPacket(Packet.Data, Packet.Capacity, BytesRead, *ReceiveFromAddr))
+			{
+				return false;
+			}
+
+			// Server traffic shares the socket: responses are consumed, relayed data is unwrapped in place
+			if (IsServerDatagram(Packet.Data, BytesRead, *ReceiveFromAddr))
+			{
+				int32 PayloadOffset = 0;
+				int32 PayloadSize = 0;
+				uint16 ChannelNumber = 0;
+				if (!HandleServerDatagram(Packet.Data, BytesRead, *ReceiveFromAddr, PayloadOffset, PayloadSize, &ChannelNumber) ||
+					HandleHandshakePacket(Packet.Data + PayloadOffset, PayloadSize, nullptr, ChannelNumber) ||
+					!bRelayed)
+				{
+					continue;
+				}
+
+				Packet.Offset = PayloadOffset;
+				Packet.Size = PayloadSize;
+				CountReceivedDatagram(PayloadSize, true);
+				return true;
+			}
+
+			if (HandleHandshakePacket(Packet.Data, BytesRead, ReceiveFromAddr.Get(), 0))
+			{
+				continue;
+			}
+
+			// Only the validated remote address may inject game traffic (or a direct pair the peer upgraded to)
+			if ((!SelectedRemoteAddr.IsValid() || !(*ReceiveFromAddr == *SelectedRemoteAddr)) && !FollowPeerToDirectPair(*ReceiveFromAddr))
+			{
+				UE_LOG(LogOnlineICE, Verbose, TEXT("Dropping datagram from unexpected address %s"), *ReceiveFromAddr->ToString(true));
+				continue;
+			}
+
+			Packet.Size = BytesRead;
+			CountReceivedDatagram(BytesRead, false);
+			return true;
+		}
+	}
+}
+
+void FICEAgent::ProcessConnectedHandshakes()
+{
+	if (!ValidateSocketSubsystem())
+	{
+		return;
+	}
+
+	if (!ReceiveFromAddr.IsValid())
+	{
+		ReceiveFromAddr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+	}
+
+	// Peek buffers must hold a full datagram, some platforms fail truncated peeks
+	uint8 PeekBuffer[FICEPacketSlot::MAX_PACKET_SIZE];
+
+	// Handle the datagram at the head of the agent socket unless ReceiveData must see it
+	// (game data from the peer, or relayed game data while the selected pair is relayed)
+	const bool bRelayed = SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive;
+	auto HandleControlDatagram = [this, bRelayed](const uint8* Data, int32 Size, const FInternetAddr& FromAddr)
+	{
+		if (IsServerDatagram(Data, Size, FromAddr))
+		{
+			int32 PayloadOffset = 0;
+			int32 PayloadSize = 0;
+			uint16 ChannelNumber = 0;
+			if (!HandleServerDatagram(Data, Size, FromAddr, PayloadOffset, PayloadSize, &ChannelNumber))
+			{
+				return true;
+			}
+			if (IsHandshakePacket(Data + PayloadOffset, PayloadSize))
+			{
+				HandleHandshakePacket(Data + PayloadOffset, PayloadSize, nullptr, ChannelNumber);
+				return true;
+			}
+			return !bRelayed;
+		}
+
+		if (!IsHandshakePacket(Data, Size))
+		{
+			// Game data on a direct pair while we still relay: the peer upgraded first, ReceiveData reads it once we follow
+			if (FollowPeerToDirectPair(FromAddr))
+			{
+				return false;
+			}
+
+			// ReceiveData only reads the dedicated TURN socket while relaying, nothing else would dequeue it
+			return bRelayed && !IsTURNMultiplexed();
+		}
+		HandleHandshakePacket(Data, Size, &FromAddr, 0);
+		return true;
+	};
+
+	for (int32 PacketCount = 0; PacketCount < HandshakeConstants::MAX_PACKETS_PER_TICK; ++PacketCount)
+	{
+		if (ReceiveRing.IsValid())
+		{
+			const FICEPacketSlot* Slot = ReceiveRing->BeginRead();
+			if (!Slot || !HandleControlDatagram(Slot->Data, Slot->Size, *Slot->FromAddr))
+			{
+				break;
+			}
+			ReceiveRing->EndRead();
+			continue;
+		}
+
+		uint32 PendingDataSize = 0;
+		if (!Socket || !Socket->HasPendingData(PendingDataSize) || PendingDataSize == 0)
+		{
+			break;
+		}
+
+		// Handled while peeked, then dequeued
+		int32 BytesRead = 0;
+		if (!Socket->RecvFrom(PeekBuffer, sizeof(PeekBuffer), BytesRead, *ReceiveFromAddr, ESocketReceiveFlags::Peek) ||
+		    !HandleControlDatagram(PeekBuffer, BytesRead, *ReceiveFromAddr))
+		{
+			break;
+		}
+
+		Socket->RecvFrom(PeekBuffer, sizeof(PeekBuffer), BytesRead, *ReceiveFromAddr);
+	}
+
+	// A multiplexed allocation was drained above
+	if (!TURNSocket || !bTURNAllocationActive || IsTURNMultiplexed())
+	{
+		return;
+	}
+
+	// Game traffic on the TURN socket is left for ReceiveData when relaying, anything else is drained here
+	for (int32 PacketCount = 0; PacketCount < HandshakeConstants::MAX_PACKETS_PER_TICK; ++PacketCount)
+	{
+		uint32 PendingDataSize = 0;
+		if (!TURNSocket->HasPendingData(PendingDataSize) || PendingDataSize == 0)
+		{
+			break;
+		}
+
+		int32 BytesRead = 0;
+		if (!TURNSocket->RecvFrom(PeekBuffer, sizeof(PeekBuffer), BytesRead, *ReceiveFromAddr, ESocketReceiveFlags::Peek))
+		{
+			break;
+		}
+
+		const bool bResponse = IsSTUNResponse(PeekBuffer, BytesRead);
+		int32 PayloadOffset = 0;
+		int32 PayloadSize = 0;
+		uint16 ChannelNumber = 0;
+		const bool bHandshake = !bResponse &&
+			UnwrapTURNPacket(PeekBuffer, BytesRead, PayloadOffset, PayloadSize, &ChannelNumber) &&
+			IsHandshakePacket(PeekBuffer + PayloadOffset, PayloadSize);
+		if (bRelayed && !bResponse && !bHandshake)
+		{
+			break;
+		}
+
+		TURNSocket->RecvFrom(PeekBuffer, sizeof(PeekBuffer), BytesRead, *ReceiveFromAddr);
+		if (bResponse)
+		{
+			HandleTURNResponse(PeekBuffer, BytesRead);
+		}
+		else if (bHandshake)
+		{
+			HandleHandshakePacket(PeekBuffer + PayloadOffset, PayloadSize, nullptr, ChannelNumber);
+		}
+	}
+}
+
+bool FICEAgent::IsHandshakePacket(const uint8* Buffer, int32 Size) const
+{
+	return Size >= HandshakeConstants::HANDSHAKE_PACKET_SIZE && VerifyHandshakeMagicNumber(Buffer);
+}
+
+/**
+ * Build a handshake packet
+ * Format: [Magic Number (4 bytes)] [Type (1 byte)] [Token (4 bytes)]
+ * Signed packets go on with [Sequence (4 bytes)] [Username length (1 byte)] [Username] [Key share (32 bytes)] [HMAC-SHA1 (20 bytes)],
+ * the username ("RFRAG:LFRAG") being carried by requests only, the key share when traffic is encrypted (type flag 0x40)
+ * and the HMAC covering every byte before it; type flag 0x20 advertises FEC
+ * Responses echo the token of the request so the check can be matched to its pair
+ */
+int32 FICEAgent::BuildHandshakePacket(uint8* OutPacket, uint8 PacketType, uint32 Token)
+{
+	FMemory::Memcpy(OutPacket, HandshakeConstants::MAGIC_NUMBER, 4);
+	OutPacket[4] = PacketType;
+	OutPacket[5] = (Token >> 24) & 0xFF;
+	OutPacket[6] = (Token >> 16) & 0xFF;
+	OutPacket[7] = (Token >> 8) & 0xFF;
+	OutPacket[8] = Token & 0xFF;
+
+	// Every HELLO advertises FEC, it is used once each side has seen the other's
+	if (Config.bEnableFEC)
+	{
+		OutPacket[4] |= HandshakeConstants::PACKET_FLAG_FEC;
+	}
+
+	if ((PacketType & HandshakeConstants::PACKET_FLAG_AUTHENTICATED) == 0)
+	{
+		return HandshakeConstants::HANDSHAKE_PACKET_SIZE;
+	}
+
+	const uint32 Sequence = NextHandshakeSequence++;
+	OutPacket[9] = (Sequence >> 24) & 0xFF;
+	OutPacket[10] = (Sequence >> 16) & 0xFF;
+	OutPacket[11] = (Sequence >> 8) & 0xFF;
+	OutPacket[12] = Sequence & 0xFF;
+
+	const bool bRequest = (PacketType & HandshakeConstants::PACKET_KIND_MASK) == HandshakeConstants::PACKET_TYPE_HELLO_REQUEST;
+	const int32 UsernameLength = bRequest ? OutgoingHandshakeUsername.Num() : 0;
+	OutPacket[13] = (uint8)UsernameLength;
+	if (UsernameLength > 0)
+	{
+		FMemory::Memcpy(OutPacket + HandshakeConstants::AUTHENTICATED_HEADER_SIZE, OutgoingHandshakeUsername.GetData(), UsernameLength);
+	}
+
+	int32 SignedSize = HandshakeConstants::AUTHENTICATED_HEADER_SIZE + UsernameLength;
+
+	// The key share of the encrypted channel rides on signed packets only, so the HMAC authenticates it
+	if (Config.bEncryptTraffic && SecureChannel.EnsureKeyShare())
+	{
+		OutPacket[4] |= HandshakeConstants::PACKET_FLAG_KEY_SHARE;
+		FMemory::Memcpy(OutPacket + SignedSize, SecureChannel.GetLocalKeyShare(), FICESecureChannel::KEY_SHARE_SIZE);
+		SignedSize += FICESecureChannel::KEY_SHARE_SIZE;
+	}
+
+	const FSTUNHMACKey& Key = bRequest ? RemoteHandshakeKey : LocalHandshakeKey;
+	Key.Calculate(OutPacket, SignedSize, OutPacket + SignedSize);
+	return SignedSize + FSTUNHMACKey::HASH_SIZE;
+}
+
+uint8 FICEAgent::GetHandshakeRequestType() const
+{
+	return HandshakeConstants::PACKET_TYPE_HELLO_REQUEST | (RemoteHandshakeKey.IsSet() ? HandshakeConstants::PACKET_FLAG_AUTHENTICATED : 0);
+}
+
+bool FICEAgent::AuthenticateHandshakePacket(const uint8* Buffer, int32 Size)
+{
+	const uint8 PacketType = Buffer[4];
+	const bool bRequest = (PacketType & HandshakeConstants::PACKET_KIND_MASK) == HandshakeConstants::PACKET_TYPE_HELLO_REQUEST;
+
+	if (bRemoteCredentialsRejected)
+	{
+		return false;
+	}
+
+	// Unsigned packets are spoofable by anyone: only legacy peers (bAllowUnsignedHandshake) send them, and only until
+	// their credentials are signaled. A signed request needs nothing from the peer, it is checked with our own password
+	if ((PacketType & HandshakeConstants::PACKET_FLAG_AUTHENTICATED) == 0)
+	{
+		return Config.bAllowUnsignedHandshake && !RemoteHandshakeKey.IsSet() && Size == HandshakeConstants::HANDSHAKE_PACKET_SIZE &&
+			(PacketType & HandshakeConstants::PACKET_FLAG_KEY_SHARE) == 0;
+	}
+
+	// Size and username first: they reject floods without hashing anything
+	if (Size < HandshakeConstants::AUTHENTICATED_HEADER_SIZE + FSTUNHMACKey::HASH_SIZE)
+	{
+		return false;
+	}
+	const int32 UsernameLength = Buffer[13];
+	const int32 KeyShareSize = (PacketType & HandshakeConstants::PACKET_FLAG_KEY_SHARE) ? FICESecureChannel::KEY_SHARE_SIZE : 0;
+	if (Size != HandshakeConstants::AUTHENTICATED_HEADER_SIZE + UsernameLength + KeyShareSize + FSTUNHMACKey::HASH_SIZE)
+	{
+		return false;
+	}
+
+	if (bRequest)
+	{
+		// "LFRAG:RFRAG", only the "LFRAG:" prefix can be checked before the peer's ufrag is signaled
+		const int32 ExpectedLength = IncomingHandshakeUsername.Num();
+		const bool bLengthMatches = RemoteUfrag.IsEmpty() ? UsernameLength >= ExpectedLength : UsernameLength == ExpectedLength;
+		if (!bLengthMatches || FMemory::Memcmp(Buffer + HandshakeConstants::AUTHENTICATED_HEADER_SIZE, IncomingHandshakeUsername.GetData(), ExpectedLength) != 0)
+		{
+			return false;
+		}
+	}
+	else if (UsernameLength != 0)
+	{
+		return false;
+	}
+
+	const uint32 Sequence = ((uint32)Buffer[9] << 24) | ((uint32)Buffer[10] << 16) | ((uint32)Buffer[11] << 8) | (uint32)Buffer[12];
+	if (IsHandshakeReplay(Sequence))
+	{
+		return false;
+	}
+
+	// Requests to us are signed with our password, responses to our requests with the peer's
+	const int32 SignedSize = Size - FSTUNHMACKey::HASH_SIZE;
+	const FSTUNHMACKey& Key = bRequest ? LocalHandshakeKey : RemoteHandshakeKey;
+	if (!Key.Verify(Buffer, SignedSize, Buffer + SignedSize))
+	{
+		return false;
+	}
+
+	RecordHandshakeSequence(Sequence);
+
+	if (KeyShareSize > 0)
+	{
+		AcceptRemoteKeyShare(Buffer + HandshakeConstants::AUTHENTICATED_HEADER_SIZE + UsernameLength);
+	}
+	return true;
+}
+
+bool FICEAgent::IsHandshakeReplay(uint32 Sequence) const
+{
+	if (!bRemoteSequenceSeen)
+	{
+		return false;
+	}
+
+	// Serial number arithmetic, the peer's counter starts anywhere and wraps
+	const int32 Delta = (int32)(Sequence - RemoteSequenceMax);
+	if (Delta > 0)
+	{
+		return false;
+	}
+
+	const int32 Age = -Delta;
+	return Age >= HandshakeConstants::REPLAY_WINDOW_SIZE || (RemoteSequenceWindow & (1ull << Age)) != 0;
+}
+
+void FICEAgent::RecordHandshakeSequence(uint32 Sequence)
+{
+	if (!bRemoteSequenceSeen)
+	{
+		RemoteSequenceMax = Sequence;
+		RemoteSequenceWindow = 1;
+		bRemoteSequenceSeen = true;
+		return;
+	}
+
+	const int32 Delta = (int32)(Sequence - RemoteSequenceMax);
+	if (Delta > 0)
+	{
+		RemoteSequenceWindow = Delta >= HandshakeConstants::REPLAY_WINDOW_SIZE ? 0 : RemoteSequenceWindow << Delta;
+		RemoteSequenceWindow |= 1;
+		RemoteSequenceMax = Sequence;
+	}
+	else
+	{
+		RemoteSequenceWindow |= 1ull << -Delta;
+	}
+}
+
+void FICEAgent::ResetHandshakeReplayWindow()
+{
+	RemoteSequenceMax = 0;
+	RemoteSequenceWindow = 0;
+	bRemoteSequenceSeen = false;
+}
+
+void FICEAgent::Tick(float DeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FICEAgent::Tick);
+
+	// Poll outstanding STUN/TURN gathering requests (never blocks)
+	if (bGatheringInProgress)
+	{
+		TickGathering(DeltaTime);
+	}
+
+	// Handle TURN allocation refresh if active
+	if (bTURNAllocationActive)
+	{
+		TimeSinceTURNRefresh += DeltaTime;
+		
+		// Refresh TURN allocation before it expires (refresh at 80% of lifetime)
+		float RefreshInterval = TURNAllocationLifetime * 0.8f;
+		if (TimeSinceTURNRefresh >= RefreshInterval && !HasPendingTURNTransaction(EICETURNTransactionType::Refresh))
+		{
+			UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation needs refresh (%.1f seconds elapsed, lifetime: %d)"),
+				TimeSinceTURNRefresh, TURNAllocationLifetime);
+			
+			// The response is matched on the receive path, nothing waits for it here
+			if (!StartTURNRefresh())
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("TURN refresh failed, allocation may expire"));
+				// Try to refresh again sooner
+				TimeSinceTURNRefresh = RefreshInterval - 30.0f; // Retry in 30 seconds
+			}
+		}
+	}
+
+	// Retransmit outstanding Refresh/CreatePermission/ChannelBind requests
+	TickTURNTransactions(DeltaTime);
+
+	// Delegate to state-specific handlers
+	switch (ConnectionState)
+	{
+		case EICEConnectionState::ConnectingDirect:
+		case EICEConnectionState::ConnectingRelay:
+			TickConnectivityChecks(DeltaTime);
+			break;
+			
+		case EICEConnectionState::Connected:
+			// Answer the peer's remaining checks, game datagrams are left for ReceiveData/ReceiveBatch
+			ProcessConnectedHandshakes();
+			TickRelayBindings(DeltaTime);
+			TickConsent(DeltaTime);
+
+			// ICE restart or direct upgrade: new pairs are checked while the selected one carries traffic
+			if (bChecksInProgress)
+			{
+				AdvanceConnectivityChecks(DeltaTime);
+			}
+			TickDirectUpgrade(DeltaTime);
+			break;
+
+		case EICEConnectionState::Failed:
+			// A failed checklist keeps listening, the peer's checks may still revive it
+			if (Socket && CheckList.Num() > 0)
+			{
+				TickConnectivityChecks(DeltaTime);
+			}
+			else
+			{
+				ProcessReceivedData();
+			}
+			break;
+			
+		default:
+			// Nobody else reads the sockets in these states, keep STUN/TURN responses flowing
+			ProcessReceivedData();
+			break;
+	}
+
+	// Paced datagrams leave as tokens come back, then messages coalesced since the last flush (once per frame at the latest)
+	DrainPacedSends();
+	FlushSends();
+
+#if CSV_PROFILER
+	const FICECandidatePair* SelectedPair = bIsConnected && FCsvProfiler::Get()->IsCapturing() ? FindSelectedPair() : nullptr;
+	if (SelectedPair)
+	{
+		CSV_CUSTOM_STAT(ICE, SelectedPairRTT, SelectedPair->Stats.SmoothedRTT, ECsvCustomStatOp::Max);
+	}
+#endif
+}
+
+bool FICEAgent::SendConnectivityCheck(FICECandidatePair& Pair)
+{
+	// Relayed pairs need a TURN permission and channel towards the remote candidate
+	if (Pair.IsRelayed() && !Pair.bRelayBound)
+	{
+		if (!bTURNAllocationActive || !TURNSocket)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Cannot check relayed pair, TURN allocation is not active: %s"), *Pair.ToString());
+			return false;
+		}
+
+		// Permission and channel are requested together; without a channel the pair uses Send/Data indications
+		if (!Pair.bRelaySetupStarted)
+		{
+			if (!StartTURNCreatePermission(Pair))
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("TURN permission creation failed for %s:%d"), *Pair.Remote.Address, Pair.Remote.Port);
+				return false;
+			}
+			StartTURNChannelBind(Pair);
+			Pair.bRelaySetupStarted = true;
+		}
+
+		// The check goes out as soon as the permission is installed (see CompleteTURNTransaction)
+		Pair.TimeSinceLastCheck = 0.0f;
+		return true;
+	}
+
+	// A retransmission gives up on the previous transmission
+	if (Pair.Transmissions > 0)
+	{
+		Pair.Stats.RequestsLost++;
+	}
+
+	Pair.Transmissions++;
+	Pair.TimeSinceLastCheck = 0.0f;
+	Pair.Stats.RequestsSent++;
+	++Stats.ConnectivityChecksSent;
+	Pair.LastRequestTime = FPlatformTime::Seconds();
+
+	UE_LOG(LogOnlineICE, Verbose, TEXT("Connectivity check %d/%d: %s"), Pair.Transmissions, MAX_CHECK_TRANSMISSIONS, *Pair.ToString());
+
+	// A peer that rejects unsigned requests would only count them against us
+	if (!RemoteHandshakeKey.IsSet() && !Config.bAllowUnsignedHandshake)
+	{
+		return false;
+	}
+	return SendHandshakePacket(Pair, GetHandshakeRequestType(), Pair.CheckToken);
+}
+
+bool FICEAgent::SendHandshakePacket(const FICECandidatePair& Pair, uint8 PacketType, uint32 Token)
+{
+	if (!Pair.IsRelayed())
+	{
+		return Pair.RemoteAddr.IsValid() && SendHandshakePacket(*Pair.RemoteAddr, PacketType, Token);
+	}
+
+	uint8 HandshakePacket[HandshakeConstants::MAX_HANDSHAKE_PACKET_SIZE];
+	const int32 PacketSize = BuildHandshakePacket(HandshakePacket, PacketType, Token);
+
+	if (Pair.bChannelBound)
+	{
+		return SendTURNChannelData(Pair.RelayChannel, HandshakePacket, PacketSize);
+	}
+	return Pair.RemoteAddr.IsValid() && SendTURNSendIndication(*Pair.RemoteAddr, HandshakePacket, PacketSize);
+}
+
+bool FICEAgent::SendHandshakePacket(const FInternetAddr& RemoteAddr, uint8 PacketType, uint32 Token)
+{
+	if (!Socket)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Cannot send handshake: socket is null"));
+		return false;
+	}
+
+	uint8 HandshakePacket[HandshakeConstants::MAX_HANDSHAKE_PACKET_SIZE];
+	const int32 PacketSize = BuildHandshakePacket(HandshakePacket, PacketType, Token);
+
+	int32 BytesSent = 0;
+	if (Socket->SendTo(HandshakePacket, PacketSize, BytesSent, RemoteAddr) && BytesSent == PacketSize)
+	{
+		return true;
+	}
+
+	UE_LOG(LogOnlineICE, Warning, TEXT("Failed to send handshake packet to %s: sent %d of %d bytes"), 
+		*RemoteAddr.ToString(true), BytesSent, PacketSize);
+	return false;
+}
+
+bool FICEAgent::ProcessReceivedData()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FICEAgent::ProcessReceivedData);
+
+	if (!ValidateSocketSubsystem())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to parse remote address: %s"), *SelectedRemoteCandidate.Address);
-		UpdateConnectionState(EICEConnectionState::Failed);
 		return false;
 	}
-	RemoteAddr->SetPort(SelectedRemoteCandidate.Port);
 
-	// Parse local candidate address for binding
-	TSharedPtr<FInternetAddr> LocalAddr = SocketSubsystem->GetAddressFromString(SelectedLocalCandidate.Address);
-	if (!LocalAddr.IsValid())
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	uint8 ReceiveBuffer[HandshakeConstants::MAX_RECEIVE_BUFFER_SIZE];
+	bool bProcessed = false;
+
+	// Agent socket: server responses, relayed checks (when TURN is multiplexed) and direct checks
+	if (Socket)
+	{
+		TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+		for (int32 PacketCount = 0; PacketCount < HandshakeConstants::MAX_PACKETS_PER_TICK; ++PacketCount)
+		{
+			int32 BytesRead = 0;
+			if (!ReceiveDirectPacket(ReceiveBuffer, sizeof(ReceiveBuffer), BytesRead, *FromAddr))
+			{
+				break;
+			}
+
+			if (IsServerDatagram(ReceiveBuffer, BytesRead, *FromAddr))
+			{
+				int32 PayloadOffset = 0;
+				int32 PayloadSize = 0;
+				uint16 ChannelNumber = 0;
+				if (HandleServerDatagram(ReceiveBuffer, BytesRead, *FromAddr, PayloadOffset, PayloadSize, &ChannelNumber))
+				{
+					bProcessed |= HandleHandshakePacket(ReceiveBuffer + PayloadOffset, PayloadSize, nullptr, ChannelNumber);
+				}
+				continue;
+			}
+
+			bProcessed |= HandleHandshakePacket(ReceiveBuffer, BytesRead, &FromAddr.Get(), 0);
+		}
+	}
+
+	// Dedicated TURN socket (pool agents): relayed checks arrive there
+	bProcessed |= ProcessTURNSocket();
+
+	return bProcessed;
+}
+
+bool FICEAgent::ProcessTURNSocket()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FICEAgent::ProcessTURNSocket);
+
+	if (!TURNSocket || !bTURNAllocationActive || IsTURNMultiplexed())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to parse local address: %s"), *SelectedLocalCandidate.Address);
-		UpdateConnectionState(EICEConnectionState::Failed);
 		return false;
 	}
-	
-	// For server reflexive and relay candidates, we need to bind to the local interface (0.0.0.0)
-	// and let the OS assign a port, as we can't bind directly to the public/relay address
-	if (SelectedLocalCandidate.Type == EICECandidateType::ServerReflexive || 
-	    SelectedLocalCandidate.Type == EICECandidateType::Relayed)
+
+	uint8 ReceiveBuffer[HandshakeConstants::MAX_RECEIVE_BUFFER_SIZE];
+	bool bProcessed = false;
+
+	for (int32 PacketCount = 0; PacketCount < HandshakeConstants::MAX_PACKETS_PER_TICK; ++PacketCount)
 	{
-		// Bind to any address (0.0.0.0) and let OS assign port
-		LocalAddr->SetAnyAddress();
-		LocalAddr->SetPort(0); // OS will assign an ephemeral port
+		uint32 PendingDataSize = 0;
+		if (!TURNSocket->HasPendingData(PendingDataSize) || PendingDataSize == 0)
+		{
+			break;
+		}
+
+		// TURN responses are dispatched inside ReceiveDataFromTURN
+		int32 BytesRead = 0;
+		uint16 ChannelNumber = 0;
+		if (ReceiveDataFromTURN(ReceiveBuffer, sizeof(ReceiveBuffer), BytesRead, &ChannelNumber))
+		{
+			bProcessed |= HandleHandshakePacket(ReceiveBuffer, BytesRead, nullptr, ChannelNumber);
+		}
 	}
-	else
+
+	return bProcessed;
+}
+
+bool FICEAgent::HandleHandshakePacket(const uint8* Buffer, int32 Size, const FInternetAddr* FromAddr, uint16 RelayChannel)
+{
+	if (Size < HandshakeConstants::HANDSHAKE_PACKET_SIZE)
 	{
-		// For host candidates, we can bind to the specific local address
-		LocalAddr->SetPort(SelectedLocalCandidate.Port);
+		return false; // Packet too small to be a valid handshake
 	}
 
-	Socket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("ICE"), RemoteAddr->GetProtocolType());
-	if (!Socket)
+	// Verify magic number
+	if (!VerifyHandshakeMagicNumber(Buffer))
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to create ICE socket"));
-		UpdateConnectionState(EICEConnectionState::Failed);
 		return false;
 	}
 
-	// Bind socket to local address
-	if (!Socket->Bind(*LocalAddr))
+	// Credentials are checked before any lookup or state change, spoofed HELLOs cost one HMAC at most
+	if (!AuthenticateHandshakePacket(Buffer, Size))
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to bind socket to local address: %s:%d"), 
-			*LocalAddr->ToString(false), LocalAddr->GetPort());
-		CleanupSocketOnError();
-		return false;
+		++RejectedHandshakeCount;
+		UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Rejected unauthenticated handshake packet from %s"),
+			FromAddr ? *FromAddr->ToString(true) : *FString::Printf(TEXT("TURN channel 0x%04X"), RelayChannel));
+		return true;
 	}
 
-	// Set socket to non-blocking mode for async operations
-	Socket->SetNonBlocking(true);
-	
-	// Enable address reuse to allow multiple ICE agents or reconnections on the same port
-	// This is necessary for ICE as we may need to quickly rebind after connection failures
-	Socket->SetReuseAddr(true);
-	
-	// Disable receive error notifications to prevent socket from becoming invalid on ICMP errors
-	Socket->SetRecvErr(false);
+	if (Config.bEnableFEC && !bFECActive && (Buffer[4] & HandshakeConstants::PACKET_FLAG_FEC) != 0)
+	{
+		bFECActive = true;
+		UE_LOG(LogOnlineICE, Log, TEXT("Peer supports FEC, protecting game datagrams with parity"));
+	}
 
-	// Get the actual bound port
-	TSharedRef<FInternetAddr> BoundAddr = SocketSubsystem->CreateInternetAddr();
-	Socket->GetAddress(*BoundAddr);
-	if (BoundAddr->IsValid())
+	const uint8 PacketType = Buffer[4] & HandshakeConstants::PACKET_KIND_MASK;
+	const uint8 ResponseType = HandshakeConstants::PACKET_TYPE_HELLO_RESPONSE | (Buffer[4] & HandshakeConstants::PACKET_FLAG_AUTHENTICATED);
+	const uint32 Token = ((uint32)Buffer[5] << 24) | ((uint32)Buffer[6] << 16) | ((uint32)Buffer[7] << 8) | (uint32)Buffer[8];
+	const FString FromString = FromAddr ? FromAddr->ToString(true) : FString::Printf(TEXT("TURN channel 0x%04X"), RelayChannel);
+
+	// Pair the packet arrived on (direct by address, relayed by channel)
+	int32 PairIndex = INDEX_NONE;
+	if (FromAddr)
 	{
-		int32 ActualPort = BoundAddr->GetPort();
-		UE_LOG(LogOnlineICE, Log, TEXT("Socket bound to %s:%d"), 
-			*BoundAddr->ToString(false), ActualPort);
-		
-		// Update local candidate port if it was 0 (OS assigned)
-		if (SelectedLocalCandidate.Port == 0)
+		PairIndex = FindDirectPairForAddress(*FromAddr);
+	}
+	else
+	{
+		PairIndex = CheckList.IndexOfByPredicate([RelayChannel](const FICECandidatePair& Pair)
 		{
-			SelectedLocalCandidate.Port = ActualPort;
-			
-			// Also update the port in the LocalCandidates array for future use
-			for (FICECandidate& Candidate : LocalCandidates)
+			return Pair.IsRelayed() && Pair.RelayChannel == RelayChannel;
+		});
+	}
+
+	if (PacketType == HandshakeConstants::PACKET_TYPE_HELLO_REQUEST)
+	{
+		// Once connected these are the peer's consent checks, one every ConsentCheckInterval
+		if (bIsConnected)
+		{
+			UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Received consent check from %s"), *FromString);
+
+			// Consent on the direct pair we upgraded to: the peer has moved too, the relay is no longer needed
+			if (bTURNReleasePending && FromAddr && PairIndex != INDEX_NONE && CheckList[PairIndex].CheckToken == SelectedCheckToken)
 			{
-				if (Candidate.Address == SelectedLocalCandidate.Address && 
-				    Candidate.Type == SelectedLocalCandidate.Type &&
-				    Candidate.Port == 0)
-				{
-					Candidate.Port = ActualPort;
-					UE_LOG(LogOnlineICE, Log, TEXT("Updated local candidate port to %d in candidates list"), ActualPort);
-					break;
-				}
+				ReleaseTURNAllocation();
+				PairIndex = FindDirectPairForAddress(*FromAddr);
 			}
-			
-			UE_LOG(LogOnlineICE, Log, TEXT("Updated selected local candidate port to %d"), ActualPort);
 		}
-	}
+		else
+		{
+			UE_LOG(LogOnlineICE, Log, TEXT("Received handshake HELLO request from %s"), *FromString);
+		}
 
-	// If using TURN relay, create permission and bind channel
-	if (SelectedLocalCandidate.Type == EICECandidateType::Relayed)
-	{
-		// Validar que la asignación TURN esté activa y el socket exista
-		if (!bTURNAllocationActive)
+		// Respond on the path the request came from, echoing its token
+		// (signed like the request was)
+		if (FromAddr)
 		{
-			UE_LOG(LogOnlineICE, Error, TEXT("Selected relay candidate but TURN allocation is not active"));
-			CleanupSocketOnError();
-			return false;
+			SendHandshakePacket(*FromAddr, ResponseType, Token);
+		}
+		else if (PairIndex != INDEX_NONE)
+		{
+			SendHandshakePacket(CheckList[PairIndex], ResponseType, Token);
 		}
 
-		if (!TURNSocket)
+		// The socket is bound since gathering, a peer may check us before our checklist exists:
+		// answering is enough, the checklist is formed from the signaled candidates
+		// (once connected, only a restart or a direct upgrade still has pairs to trigger)
+		if (bIsConnected && !bChecksInProgress && PairIndex != INDEX_NONE && !CheckList[PairIndex].UsesRelay() &&
+			CheckList[PairIndex].State != EICECandidatePairState::Succeeded && FindSelectedPair() && FindSelectedPair()->UsesRelay() &&
+			Config.DirectUpgradeInterval > 0.0f)
 		{
-			UE_LOG(LogOnlineICE, Error, TEXT("Selected relay candidate but TURN socket is not available"));
-			CleanupSocketOnError();
-			return false;
+			// The peer is still punching a direct pair we gave up on: check it back so both sides can move together
+			bDirectUpgradeInProgress = true;
+		}
+		else if ((bIsConnected && !bChecksInProgress) || CheckList.Num() == 0)
+		{
+			return true;
 		}
 
-		UE_LOG(LogOnlineICE, Log, TEXT("Setting up TURN relay for communication"));
-		
-		// Create permission for remote peer
-		if (PerformTURNCreatePermission(SelectedRemoteCandidate.Address, SelectedRemoteCandidate.Port))
+		// Unknown sender on the direct path: learn it as a peer reflexive candidate
+		if (PairIndex == INDEX_NONE && FromAddr)
 		{
-			UE_LOG(LogOnlineICE, Log, TEXT("TURN permission created for peer"));
-			
-			// Bind channel for efficient data transfer
-			if (PerformTURNChannelBind(SelectedRemoteCandidate.Address, SelectedRemoteCandidate.Port, TURNChannelNumber))
+			const FString PeerAddress = GetCandidateAddress(*FromAddr);
+			const bool bPeerIPv6 = PeerAddress.Contains(TEXT(":"));
+			const FICECandidate* BaseCandidate = GetLocalCandidatesOfType(EICECandidateType::Host).FindByPredicate([bPeerIPv6](const FICECandidate& Candidate)
 			{
-				UE_LOG(LogOnlineICE, Log, TEXT("TURN channel bound successfully"));
-			}
-			else
+				return Candidate.IsIPv6() == bPeerIPv6;
+			});
+
+			if (BaseCandidate)
 			{
-				UE_LOG(LogOnlineICE, Warning, TEXT("TURN channel binding failed, will use Send indication"));
+				FICECandidate PeerReflexive;
+				PeerReflexive.Foundation = TEXT("prflx");
+				PeerReflexive.ComponentId = BaseCandidate->ComponentId;
+				PeerReflexive.Transport = EICETransport::UDP;
+				PeerReflexive.Priority = CalculatePriority(EICECandidateType::PeerReflexive, 65535, 1);
+				PeerReflexive.Address = PeerAddress;
+				PeerReflexive.Port = FromAddr->GetPort();
+				PeerReflexive.Type = EICECandidateType::PeerReflexive;
+
+				UE_LOG(LogOnlineICE, Log, TEXT("Learned peer reflexive candidate: %s"), *PeerReflexive.ToString());
+				RemoteCandidates.Add(PeerReflexive);
+
+				PairIndex = AddCandidatePair(*BaseCandidate, PeerReflexive);
 			}
 		}
-		else
+
+		// The peer reached us on this pair: check it back right away
+		if (PairIndex != INDEX_NONE)
 		{
-			UE_LOG(LogOnlineICE, Warning, TEXT("TURN permission creation failed"));
+			TriggerCheck(PairIndex);
 		}
+		return true;
 	}
-
-	// Start handshake to verify bidirectional connection
-	UE_LOG(LogOnlineICE, Log, TEXT("Socket created, starting handshake to verify connection"));
-	UpdateConnectionState(EICEConnectionState::PerformingHandshake);
-	
-	// Send initial handshake packet
-	if (!SendHandshake())
+	else if (PacketType == HandshakeConstants::PACKET_TYPE_HELLO_RESPONSE)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("Failed to send initial handshake packet"));
+		if (bIsConnected)
+		{
+			// Consent renewed; late answers to the pair's connectivity checks are ignored
+			FICECandidatePair* SelectedPair = FindSelectedPair();
+			if (bConsentPending && Token == ConsentToken && SelectedPair)
+			{
+				bConsentPending = false;
+				TimeSinceConsent = 0.0f;
+				RecordPairResponse(*SelectedPair, true);
+				if (Config.bPaceSends)
+				{
+					SendScheduler.AddRTTSample(SelectedPair->Stats.LatestRTT);
+				}
+				if (bFECActive)
+				{
+					FECCodec.AddLossSample(false);
+				}
+				UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Consent renewed from %s: %s"), *FromString, *SelectedPair->Stats.ToString());
+				return true;
+			}
+
+			// Outside a restart there is no check left to answer
+			if (!bChecksInProgress)
+			{
+				return true;
+			}
+		}
+
+		UE_LOG(LogOnlineICE, Log, TEXT("Received handshake HELLO response from %s"), *FromString);
+
+		// Correlate by echoed token; peers that don't echo it are matched by address
+		const int32 TokenPairIndex = CheckList.IndexOfByPredicate([Token](const FICECandidatePair& Pair) { return Pair.CheckToken == Token; });
+		if (TokenPairIndex != INDEX_NONE)
+		{
+			PairIndex = TokenPairIndex;
+		}
+
+		if (PairIndex == INDEX_NONE || CheckList[PairIndex].State == EICECandidatePairState::Frozen ||
+			(bIsConnected && CheckList[PairIndex].CheckToken == SelectedCheckToken))
+		{
+			UE_LOG(LogOnlineICE, Verbose, TEXT("Ignoring handshake response that matches no pending check"));
+			return true;
+		}
+
+		FICECandidatePair& Pair = CheckList[PairIndex];
+		if (Pair.State == EICECandidatePairState::InProgress)
+		{
+			// Only a check sent once can be timed, a retransmitted one is ambiguous (Karn's rule)
+			RecordPairResponse(Pair, Pair.Transmissions == 1);
+		}
+		Pair.State = EICECandidatePairState::Succeeded;
+		UnfreezePairsWithFoundation(Pair.Foundation);
+
+		CompleteHandshake(PairIndex);
+		return true;
 	}
 
-	return true;
+	return false;
 }
 
-bool FICEAgent::IsConnected() const
+int32 FICEAgent::FindDirectPairForAddress(const FInternetAddr& FromAddr) const
 {
-	return bIsConnected;
+	return CheckList.IndexOfByPredicate([&FromAddr](const FICECandidatePair& Pair)
+	{
+		return !Pair.IsRelayed() && Pair.RemoteAddr.IsValid() && *Pair.RemoteAddr == FromAddr;
+	});
 }
 
-bool FICEAgent::SendData(const uint8* Data, int32 Size)
+void FICEAgent::Close()
 {
-	if (!bIsConnected)
-	{
-		return false;
-	}
+	ResetConnection();
 
-	// Use TURN relay if the local candidate is relayed
-	if (SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive)
+	// Clean up TURN socket and resources (the allocation expires on the server)
+	ReleaseTURNSocket();
+
+	// The receive thread reads Socket, stop it first
+	StopReceiveThread();
+
+	if (bSharedSocket)
 	{
-		return SendDataThroughTURN(Data, Size, SelectedRemoteCandidate.Address, SelectedRemoteCandidate.Port);
+		// Hand a pool socket back, the pool destroys it
+		Socket = nullptr;
+		ReceiveRing.Reset();
+		bSharedSocket = false;
+		bMultiplexTURNOnSharedSocket = false;
 	}
-
-	// Otherwise use direct connection
-	if (!Socket)
+	else if (Socket)
 	{
-		return false;
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		if (SocketSubsystem)
+		{
+			SocketSubsystem->DestroySocket(Socket);
+		}
+		Socket = nullptr;
 	}
 
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	if (!SocketSubsystem)
+	TURNTransactions.Empty();
+	bTURNAllocationActive = false;
+	TimeSinceTURNRefresh = 0.0f;
+	TURNServerAddr.Reset();
+	TURNRelayAddr.Reset();
+	ActiveTURNServer.Empty();
+}
+
+void FICEAgent::ResetConnection()
+{
+	// Release gathering sockets first, an allocation still in flight owns the TURN socket
+	CancelGatherRequests();
+	bGatheringInProgress = false;
+
+	// The agent socket stays bound (and its NAT binding alive) for the next session,
+	// only drop what was queued for the old peer
+	while (ReceiveRing.IsValid() && ReceiveRing->BeginRead())
 	{
-		return false;
+		ReceiveRing->EndRead();
 	}
 
-	TSharedPtr<FInternetAddr> RemoteAddr = SocketSubsystem->GetAddressFromString(SelectedRemoteCandidate.Address);
-	if (!RemoteAddr.IsValid())
 	{
-		return false;
+		FScopeLock Lock(&ConnectionLock);
+		ConnectionState = EICEConnectionState::New;
 	}
-	RemoteAddr->SetPort(SelectedRemoteCandidate.Port);
 
-	int32 BytesSent;
-	return Socket->SendTo(Data, Size, BytesSent, *RemoteAddr) && BytesSent == Size;
+	bIsConnected = false;
+	TotalConnectionAttempts = 0;
+	bChecksInProgress = false;
+	TimeSinceLastPacedCheck = 0.0f;
+	CheckList.Empty();
+	TriggeredCheckQueue.Empty();
+
+	// Permissions and channels belong to the old peer, only the allocation refresh outlives the session
+	TURNTransactions.RemoveAll([](const FICETURNTransaction& Transaction)
+	{
+		return Transaction.Type != EICETURNTransactionType::Refresh;
+	});
+	TURNChannelNumber = 0;
+	TimeSinceChannelBindAttempt = 0.0f;
+	TimeSinceRelayBindRefresh = 0.0f;
+	SelectedLocalCandidate = FICECandidate();
+	SelectedRemoteCandidate = FICECandidate();
+	SelectedRemoteAddr.Reset();
+	SelectedCheckToken = 0;
+	PeerAddr.Reset();
+	bRestartInProgress = false;
+	bDirectUpgradeInProgress = false;
+	DirectUpgradeRounds = 0;
+	bTURNReleasePending = false;
+	bConsentPending = false;
+	TimeSinceConsent = 0.0f;
+	ResetLocalCandidates();
+	RemoteCandidates.Empty();
+
+	// Coalesced and paced messages belong to the old peer, and so does the bandwidth estimate
+	CoalescedSize = 0;
+	SendScheduler.Reset();
+	ReceiveBundleBuffer.Reset();
+	ReceiveBundleOffset = 0;
+
+	// FEC is negotiated again by the next peer's HELLOs, and its loss estimate starts over
+	FECCodec.Reset();
+	bFECActive = false;
+
+	// The next session gets fresh ephemeral keys
+	SecureChannel.Reset();
+	bHasRemoteKeyShare = false;
+	FMemory::Memzero(RemoteKeyShare);
 }
 
-bool FICEAgent::ReceiveData(uint8* Data, int32 MaxSize, int32& OutSize)
+void FICEAgent::CalculateMD5(const FString& Input, uint8* OutHash)
 {
-	if (!bIsConnected)
+	// Calculate MD5 hash for TURN authentication using Unreal's built-in FMD5
+	// This is used to create the key for HMAC-SHA1: MD5(username:realm:password)
+	
+	// Convert FString to UTF8
+	FTCHARToUTF8 UTF8String(*Input);
+	
+	// Calculate MD5 using Unreal's secure hash implementation
+	FMD5 MD5Context;
+	MD5Context.Update((const uint8*)UTF8String.Get(), UTF8String.Length());
+	MD5Context.Final(OutHash);
+}
+
+void FICEAgent::CompleteHandshake(int32 PairIndex)
+{
+	// ICE restart: the new pair takes over in one step, the old one leaves the checklist
+	if (bIsConnected && bRestartInProgress)
 	{
-		OutSize = 0;
-		return false;
-	}
+		const uint32 NewPairToken = CheckList[PairIndex].CheckToken;
+		UE_LOG(LogOnlineICE, Log, TEXT("ICE restart: migrating from %s:%d to %s"),
+			*SelectedRemoteCandidate.Address, SelectedRemoteCandidate.Port, *CheckList[PairIndex].ToString());
 
-	// Use TURN relay if the local candidate is relayed
-	if (SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive)
+		const int32 OldPairIndex = CheckList.IndexOfByPredicate([this](const FICECandidatePair& Candidate) { return Candidate.CheckToken == SelectedCheckToken; });
+		if (OldPairIndex != INDEX_NONE)
+		{
+			CheckList.RemoveAt(OldPairIndex);
+		}
+		PairIndex = CheckList.IndexOfByPredicate([NewPairToken](const FICECandidatePair& Candidate) { return Candidate.CheckToken == NewPairToken; });
+		bRestartInProgress = false;
+	}
+	else if (bIsConnected)
 	{
-		return ReceiveDataFromTURN(Data, MaxSize, OutSize);
+		// Direct-path upgrade: the relayed pair stays selected unless the direct one is faster
+		if (!ShouldUpgradeToPair(PairIndex))
+		{
+			return;
+		}
+		RecordDirectUpgrade(CheckList[PairIndex]);
 	}
 
-	// Otherwise use direct connection
-	if (!Socket)
+	SelectPair(PairIndex);
+}
+
+void FICEAgent::SelectPair(int32 PairIndex)
+{
+	const FICECandidatePair& Pair = CheckList[PairIndex];
+
+	// The first pair that works in both directions carries the traffic
+	SelectedLocalCandidate = Pair.Local;
+	SelectedRemoteCandidate = Pair.Remote;
+	SelectedRemoteAddr = Pair.RemoteAddr;
+	SelectedCheckToken = Pair.CheckToken;
+	if (!PeerAddr.IsValid())
 	{
-		OutSize = 0;
-		return false;
+		PeerAddr = Pair.RemoteAddr;
 	}
 
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	if (!SocketSubsystem)
+	// The successful check counts as consent, the first consent check follows one interval later
+	bConsentPending = false;
+	TimeSinceConsent = 0.0f;
+	TimeSinceConsentCheck = 0.0f;
+	NextConsentCheckDelay = Config.ConsentCheckInterval * FMath::FRandRange(0.8f, 1.2f);
+	if (Pair.IsRelayed())
 	{
-		OutSize = 0;
-		return false;
+		TURNChannelNumber = Pair.bChannelBound ? Pair.RelayChannel : 0;
+		TimeSinceChannelBindAttempt = 0.0f;
+		TimeSinceRelayBindRefresh = 0.0f;
 	}
 
-	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
-	return Socket->RecvFrom(Data, MaxSize, OutSize, *FromAddr);
-}
-
-void FICEAgent::Tick(float DeltaTime)
-{
-	TimeSinceLastAttempt += DeltaTime;
+	bChecksInProgress = false;
+	TriggeredCheckQueue.Empty();
 
-	// Handle TURN allocation refresh if active
-	if (bTURNAllocationActive)
+	if (ChecksStartTime > 0.0)
 	{
-		TimeSinceTURNRefresh += DeltaTime;
-		
-		// Refresh TURN allocation before it expires (refresh at 80% of lifetime)
-		float RefreshInterval = TURNAllocationLifetime * 0.8f;
-		if (TimeSinceTURNRefresh >= RefreshInterval)
-		{
-			UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation needs refresh (%.1f seconds elapsed, lifetime: %d)"),
-				TimeSinceTURNRefresh, TURNAllocationLifetime);
-			
-			if (!PerformTURNRefresh())
-			{
-				UE_LOG(LogOnlineICE, Warning, TEXT("TURN refresh failed, allocation may expire"));
-				// Try to refresh again sooner
-				TimeSinceTURNRefresh = RefreshInterval - 30.0f; // Retry in 30 seconds
-			}
-		}
+		Stats.ConnectTime.AddSample((float)((FPlatformTime::Seconds() - ChecksStartTime) * 1000.0));
+		ChecksStartTime = 0.0;
+	}
+	if (Pair.IsRelayed())
+	{
+		++Stats.RelayedConnections;
+	}
+	else
+	{
+		++Stats.DirectConnections;
 	}
 
-	// Delegate to state-specific handlers
-	switch (ConnectionState)
+	bIsConnected = true;
+	UpdateConnectionState(EICEConnectionState::Connected);
+	UE_LOG(LogOnlineICE, Log, TEXT("ICE connection fully established - handshake complete on %s"), *Pair.ToString());
+	if (Config.bEncryptTraffic && !SecureChannel.IsEstablished())
 	{
-		case EICEConnectionState::ConnectingDirect:
-			TickConnectingDirect(DeltaTime);
-			break;
-			
-		case EICEConnectionState::ConnectingRelay:
-			TickConnectingRelay(DeltaTime);
-			break;
-			
-		case EICEConnectionState::PerformingHandshake:
-			TickPerformingHandshake(DeltaTime);
-			break;
-			
-		case EICEConnectionState::Connected:
-			// Process received data in connected state (for possible future keepalives)
-			ProcessReceivedData();
-			break;
-			
-		default:
-			break;
+		UE_LOG(LogOnlineICE, Warning, TEXT("Traffic encryption is on but no key share was exchanged (credentials not signaled?), sends will fail"));
 	}
-}
 
-void FICEAgent::TickConnectingDirect(float DeltaTime)
-{
-	// Si el tiempo de espera se cumplió y no estamos conectados, reintentar
-	if (TimeSinceLastAttempt >= RetryDelay && !bIsConnected)
+	// A relay costs RTT and TURN bandwidth: keep punching direct pairs in the background
+	if (Pair.UsesRelay())
 	{
-		UE_LOG(LogOnlineICE, Log, TEXT("Direct connection attempt timed out, retrying..."));
-		StartConnectivityChecks();
+		StartDirectUpgrade();
 	}
 }
 
-void FICEAgent::TickConnectingRelay(float DeltaTime)
+void FICEAgent::StartDirectUpgrade()
 {
-	// Si el tiempo de espera se cumplió y no estamos conectados, marcar como fallido
-	if (TimeSinceLastAttempt >= RetryDelay && !bIsConnected)
+	bDirectUpgradeInProgress = false;
+	if (Config.DirectUpgradeInterval <= 0.0f || Config.MaxDirectUpgradeRounds <= 0)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Relay connection attempt timed out"));
-		UpdateConnectionState(EICEConnectionState::Failed);
+		return;
 	}
-}
 
-void FICEAgent::TickPerformingHandshake(float DeltaTime)
-{
-	// Process received data for handshake
-	ProcessReceivedData();
-	
-	TimeSinceHandshakeStart += DeltaTime;
-	TimeSinceLastHandshakeSend += DeltaTime;
-	
-	// Check handshake timeout
-	if (TimeSinceHandshakeStart >= HandshakeTimeout)
+	bool bHasDirectPair = false;
+	bool bDirectPending = false;
+	for (FICECandidatePair& Pair : CheckList)
 	{
-		// Use handshake flags instead of bIsConnected to avoid race conditions
-		// Fail if either part of handshake is incomplete: !sent OR !received == !(sent AND received)
-		if (!bHandshakeSent || !bHandshakeReceived)
+		if (Pair.CheckToken == SelectedCheckToken)
 		{
-			UE_LOG(LogOnlineICE, Error, TEXT("Handshake timeout - no response from peer"));
-			UpdateConnectionState(EICEConnectionState::Failed);
+			continue;
+		}
+
+		if (Pair.UsesRelay())
+		{
+			// Another relay wouldn't be any better
+			if (Pair.State != EICECandidatePairState::Succeeded)
+			{
+				Pair.State = EICECandidatePairState::Failed;
+			}
+			continue;
 		}
+
+		bHasDirectPair = true;
+		bDirectPending |= Pair.State != EICECandidatePairState::Failed && Pair.State != EICECandidatePairState::Succeeded;
 	}
-	// Retry handshake send every second if we haven't received a response
-	else if (ShouldRetryHandshake())
+
+	if (!bHasDirectPair)
 	{
-		UE_LOG(LogOnlineICE, Log, TEXT("Retrying handshake (%.1f seconds elapsed)"), TimeSinceHandshakeStart);
-		SendHandshake();
-		TimeSinceLastHandshakeSend = 0.0f; // Reset retry timer
+		return;
 	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Connected through a relay, checking direct pairs in the background (%d rounds every %.1fs)"),
+		Config.MaxDirectUpgradeRounds, Config.DirectUpgradeInterval);
+
+	bDirectUpgradeInProgress = true;
+	DirectUpgradeRounds = 0;
+	TimeSinceDirectUpgradeRound = 0.0f;
+
+	// Direct checks still pending when the relay won go on, failed ones wait for the first round
+	bChecksInProgress = bDirectPending;
 }
 
-bool FICEAgent::SendHandshake()
+void FICEAgent::TickDirectUpgrade(float DeltaTime)
 {
-	if (!Socket)
+	// The peer never showed up on the direct pair: its consent checks would have, give up waiting
+	if (bTURNReleasePending)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Cannot send handshake: socket is null"));
-		return false;
+		TimeSinceDirectUpgrade += DeltaTime;
+		if (TimeSinceDirectUpgrade >= Config.ConsentTimeout)
+		{
+			ReleaseTURNAllocation();
+		}
 	}
 
-	if (!ValidateSocketSubsystem())
+	if (!bDirectUpgradeInProgress || bChecksInProgress)
 	{
-		return false;
+		return;
 	}
 
-	// Validate that we have a valid remote candidate
-	if (!SelectedRemoteCandidate.IsValid())
+	TimeSinceDirectUpgradeRound += DeltaTime;
+	if (TimeSinceDirectUpgradeRound < Config.DirectUpgradeInterval)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Cannot send handshake: selected remote candidate is invalid"));
-		return false;
+		return;
 	}
+	TimeSinceDirectUpgradeRound = 0.0f;
 
-	// Create simple handshake packet
-	// Format: [Magic Number (4 bytes)] [Type (1 byte)] [Timestamp (4 bytes)]
-	uint8 HandshakePacket[HandshakeConstants::HANDSHAKE_PACKET_SIZE];
-	
-	// Magic number "ICEH"
-	FMemory::Memcpy(HandshakePacket, HandshakeConstants::MAGIC_NUMBER, 4);
-	
-	// Type: HELLO request or HELLO response
-	HandshakePacket[4] = bHandshakeReceived ? 
-		HandshakeConstants::PACKET_TYPE_HELLO_RESPONSE : 
-		HandshakeConstants::PACKET_TYPE_HELLO_REQUEST;
-	
-	// Timestamp (simple counter for correlation)
-	uint32 Timestamp = FPlatformTime::Cycles();
-	HandshakePacket[5] = (Timestamp >> 24) & 0xFF;
-	HandshakePacket[6] = (Timestamp >> 16) & 0xFF;
-	HandshakePacket[7] = (Timestamp >> 8) & 0xFF;
-	HandshakePacket[8] = Timestamp & 0xFF;
-
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	TSharedPtr<FInternetAddr> RemoteAddr = SocketSubsystem->GetAddressFromString(SelectedRemoteCandidate.Address);
-	if (!RemoteAddr.IsValid())
+	if (DirectUpgradeRounds >= Config.MaxDirectUpgradeRounds)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Cannot send handshake: failed to parse remote address '%s'"), *SelectedRemoteCandidate.Address);
-		return false;
+		UE_LOG(LogOnlineICE, Log, TEXT("No direct pair after %d rounds, staying on the relay"), DirectUpgradeRounds);
+		bDirectUpgradeInProgress = false;
+		return;
 	}
-	RemoteAddr->SetPort(SelectedRemoteCandidate.Port);
 
-	int32 BytesSent = 0;
-	bool bSuccess = Socket->SendTo(HandshakePacket, sizeof(HandshakePacket), BytesSent, *RemoteAddr);
-	
-	if (bSuccess && BytesSent == sizeof(HandshakePacket))
+	// A few more punches: NAT bindings opened by the peer's checks may let them through now
+	int32 NumRetried = 0;
+	for (FICECandidatePair& Pair : CheckList)
 	{
-		const TCHAR* PacketType = bHandshakeReceived ? TEXT("response") : TEXT("request");
-		
-		if (!bHandshakeReceived && !bHandshakeSent)
+		if (!Pair.UsesRelay() && Pair.State == EICECandidatePairState::Failed)
 		{
-			// Only initialize timer on first send, not on retries
-			bHandshakeSent = true;
-			TimeSinceHandshakeStart = 0.0f;
-			TimeSinceLastHandshakeSend = 0.0f;
+			Pair.State = EICECandidatePairState::Waiting;
+			Pair.Transmissions = 0;
+			Pair.TimeSinceLastCheck = 0.0f;
+			++NumRetried;
 		}
-		
-		UE_LOG(LogOnlineICE, Log, TEXT("Handshake HELLO %s sent to %s:%d"), 
-			PacketType, *SelectedRemoteCandidate.Address, SelectedRemoteCandidate.Port);
-		return true;
 	}
-	
-	UE_LOG(LogOnlineICE, Warning, TEXT("Failed to send handshake packet: sent %d of %d bytes"), 
-		BytesSent, (int32)sizeof(HandshakePacket));
-	return false;
+
+	if (NumRetried == 0)
+	{
+		// Every direct pair answered but none was faster
+		bDirectUpgradeInProgress = false;
+		return;
+	}
+
+	++DirectUpgradeRounds;
+	UE_LOG(LogOnlineICE, Verbose, TEXT("Direct upgrade round %d/%d: retrying %d direct pairs"),
+		DirectUpgradeRounds, Config.MaxDirectUpgradeRounds, NumRetried);
+	bChecksInProgress = true;
 }
 
-bool FICEAgent::ProcessReceivedData()
+bool FICEAgent::ShouldUpgradeToPair(int32 PairIndex)
 {
-	if (!Socket || !ValidateSocketSubsystem())
+	FICECandidatePair& DirectPair = CheckList[PairIndex];
+	const FICECandidatePair* RelayPair = FindSelectedPair();
+
+	if (DirectPair.Stats.RTTSamples == 0)
 	{
+		// Answered after a retransmission (Karn's rule): measure it again before deciding
+		if (DirectPair.Stats.ResponsesReceived < 2)
+		{
+			DirectPair.State = EICECandidatePairState::Waiting;
+			DirectPair.Transmissions = 0;
+			TriggeredCheckQueue.AddUnique(DirectPair.CheckToken);
+		}
 		return false;
 	}
 
-	// Check if data is available
-	uint32 PendingDataSize = 0;
-	if (!Socket->HasPendingData(PendingDataSize) || PendingDataSize == 0)
+	// The relay is timed by consent checks; until the first one answers the direct pair is preferred, as in ICE
+	if (RelayPair && RelayPair->Stats.RTTSamples > 0 && DirectPair.Stats.LatestRTT >= RelayPair->Stats.SmoothedRTT)
 	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Direct pair %s is not faster than the relay (%.1fms vs %.1fms), staying relayed"),
+			*DirectPair.ToString(), DirectPair.Stats.LatestRTT, RelayPair->Stats.SmoothedRTT);
 		return false;
 	}
 
-	// Buffer to receive data
-	uint8 ReceiveBuffer[HandshakeConstants::MAX_RECEIVE_BUFFER_SIZE];
-	int32 BytesRead = 0;
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+	return true;
+}
 
-	if (!Socket->RecvFrom(ReceiveBuffer, sizeof(ReceiveBuffer), BytesRead, *FromAddr))
-	{
-		return false;
-	}
+void FICEAgent::RecordDirectUpgrade(const FICECandidatePair& NewPair)
+{
+	const FICECandidatePair* RelayPair = FindSelectedPair();
+	UE_LOG(LogOnlineICE, Log, TEXT("Upgrading from relayed pair %s:%d to direct pair %s (%.1fms vs %.1fms)"),
+		*SelectedRemoteCandidate.Address, SelectedRemoteCandidate.Port, *NewPair.ToString(),
+		NewPair.Stats.LatestRTT, RelayPair ? RelayPair->Stats.SmoothedRTT : 0.0f);
 
-	if (BytesRead < HandshakeConstants::HANDSHAKE_PACKET_SIZE)
-	{
-		return false; // Packet too small to be a valid handshake
-	}
+	++DirectUpgradeCount;
+	bDirectUpgradeInProgress = false;
 
-	// Verify magic number
-	if (!VerifyHandshakeMagicNumber(ReceiveBuffer))
+	// The relayed pair stays in the checklist (and answers the peer) until the peer moves as well
+	bTURNReleasePending = true;
+	TimeSinceDirectUpgrade = 0.0f;
+}
+
+bool FICEAgent::FollowPeerToDirectPair(const FInternetAddr& FromAddr)
+{
+	const FICECandidatePair* SelectedPair = FindSelectedPair();
+	if (!bIsConnected || !SelectedPair || !SelectedPair->UsesRelay())
 	{
 		return false;
 	}
 
-	uint8 PacketType = ReceiveBuffer[4];
-	
-	if (PacketType == HandshakeConstants::PACKET_TYPE_HELLO_REQUEST)
+	const int32 PairIndex = FindDirectPairForAddress(FromAddr);
+	if (PairIndex == INDEX_NONE || CheckList[PairIndex].UsesRelay() || CheckList[PairIndex].State != EICECandidatePairState::Succeeded)
 	{
-		UE_LOG(LogOnlineICE, Log, TEXT("Received handshake HELLO request from %s"), 
-			*FromAddr->ToString(true));
-		
-		bHandshakeReceived = true;
-		SendHandshake(); // Respond with HELLO response
-		CompleteHandshake();
-		return true;
+		return false;
 	}
-	else if (PacketType == HandshakeConstants::PACKET_TYPE_HELLO_RESPONSE)
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Peer moved its traffic to %s, following it"), *FromAddr.ToString(true));
+	RecordDirectUpgrade(CheckList[PairIndex]);
+	SelectPair(PairIndex);
+	return true;
+}
+
+void FICEAgent::ReleaseTURNAllocation()
+{
+	bTURNReleasePending = false;
+	if (!bTURNAllocationActive)
 	{
-		UE_LOG(LogOnlineICE, Log, TEXT("Received handshake HELLO response from %s"), 
-			*FromAddr->ToString(true));
-		
-		bHandshakeReceived = true;
-		CompleteHandshake();
-		return true;
+		return;
 	}
 
-	return false;
+	UE_LOG(LogOnlineICE, Log, TEXT("Releasing TURN allocation on %s, the connection no longer uses the relay"), *ActiveTURNServer);
+
+	// Not tracked: if the request is lost the allocation simply expires on the server
+	FICETURNTransaction Transaction;
+	Transaction.Type = EICETURNTransactionType::Refresh;
+	Transaction.Lifetime = 0;
+	SendTURNTransaction(Transaction);
+
+	CheckList.RemoveAll([](const FICECandidatePair& Pair) { return Pair.IsRelayed(); });
+	RemoveLocalCandidatesOfType(EICECandidateType::Relayed);
+
+	ReleaseTURNSocket();
+	TURNTransactions.Empty();
+	bTURNAllocationActive = false;
+	TimeSinceTURNRefresh = 0.0f;
+	TURNChannelNumber = 0;
+	TURNServerAddr.Reset();
+	TURNRelayAddr.Reset();
+	ActiveTURNServer.Empty();
 }
 
-void FICEAgent::Close()
+void FICEAgent::ReleaseTURNSocket()
 {
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	
-	if (Socket)
+	// A multiplexed allocation only borrows Socket
+	if (TURNSocket && !IsTURNMultiplexed())
 	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
 		if (SocketSubsystem)
 		{
-			SocketSubsystem->DestroySocket(Socket);
+			SocketSubsystem->DestroySocket(TURNSocket);
 		}
-		Socket = nullptr;
 	}
+	TURNSocket = nullptr;
+}
 
-	// Clean up TURN socket and resources
-	if (TURNSocket)
+bool FICEAgent::IsServerDatagram(const uint8* Buffer, int32 Size, const FInternetAddr& FromAddr) const
+{
+	// RFC 7983: first byte 0-3 is STUN (peers never send STUN here, HELLO starts with "I")
+	if (FSTUNMessageView::IsSTUNMessage(Buffer, Size))
 	{
-		if (SocketSubsystem)
+		return true;
+	}
+
+	// ChannelData (64-127) shares its first-byte range with the HELLO magic, so the sender decides
+	return Size >= 4 &&
+		(Buffer[0] & STUNConstants::PACKET_TYPE_MASK) == STUNConstants::PACKET_TYPE_CHANNEL_DATA &&
+		IsTURNMultiplexed() && TURNServerAddr.IsValid() && FromAddr == *TURNServerAddr;
+}
+
+bool FICEAgent::HandleServerDatagram(const uint8* Buffer, int32 Size, const FInternetAddr& FromAddr, int32& OutOffset, int32& OutSize, uint16* OutChannelNumber)
+{
+	if (IsSTUNResponse(Buffer, Size))
+	{
+		// Gathering (Binding/Allocate) first, then Refresh/CreatePermission/ChannelBind
+		if (!HandleGatherResponse(Buffer, Size))
 		{
-			SocketSubsystem->DestroySocket(TURNSocket);
+			HandleTURNResponse(Buffer, Size);
 		}
-		TURNSocket = nullptr;
+		return false;
 	}
 
+	// Relayed data (ChannelData or Data indication) is only trusted from our own TURN server
+	if (!IsTURNMultiplexed() || !TURNServerAddr.IsValid() || !(FromAddr == *TURNServerAddr))
 	{
-		FScopeLock Lock(&ConnectionLock);
-		ConnectionState = EICEConnectionState::New;
+		return false;
 	}
 
-	bIsConnected = false;
-	bHandshakeSent = false;
-	bHandshakeReceived = false;
-	bTURNAllocationActive = false;
-	DirectConnectionAttempts = 0;
-	TotalConnectionAttempts = 0;
-	TimeSinceLastAttempt = 0.0f;
-	TimeSinceHandshakeStart = 0.0f;
-	TimeSinceLastHandshakeSend = 0.0f;
-	TimeSinceTURNRefresh = 0.0f;
-	TURNServerAddr.Reset();
-	TURNRelayAddr.Reset();
-	LocalCandidates.Empty();
-	RemoteCandidates.Empty();
+	return UnwrapTURNPacket(Buffer, Size, OutOffset, OutSize, OutChannelNumber);
 }
 
-void FICEAgent::CalculateMD5(const FString& Input, uint8* OutHash)
+FICECandidatePair* FICEAgent::FindSelectedPair()
 {
-	// Calculate MD5 hash for TURN authentication using Unreal's built-in FMD5
-	// This is used to create the key for HMAC-SHA1: MD5(username:realm:password)
-	
-	// Convert FString to UTF8
-	FTCHARToUTF8 UTF8String(*Input);
-	
-	// Calculate MD5 using Unreal's secure hash implementation
-	FMD5 MD5Context;
-	MD5Context.Update((const uint8*)UTF8String.Get(), UTF8String.Length());
-	MD5Context.Final(OutHash);
+	return SelectedRemoteAddr.IsValid()
+		? CheckList.FindByPredicate([this](const FICECandidatePair& Pair) { return Pair.CheckToken == SelectedCheckToken; })
+		: nullptr;
 }
 
-bool FICEAgent::ShouldRetryHandshake() const
+const FICECandidatePair* FICEAgent::FindSelectedPair() const
 {
-	return TimeSinceLastHandshakeSend >= HANDSHAKE_RETRY_INTERVAL && 
-	       bHandshakeSent && 
-	       !bHandshakeReceived;
+	return const_cast<FICEAgent*>(this)->FindSelectedPair();
 }
 
-void FICEAgent::CompleteHandshake()
+bool FICEAgent::GetSelectedPairStats(FICEPairStats& OutStats) const
 {
-	if (bHandshakeSent && bHandshakeReceived)
+	const FICECandidatePair* Pair = FindSelectedPair();
+	if (!Pair)
 	{
-		bIsConnected = true;
-		UpdateConnectionState(EICEConnectionState::Connected);
-		UE_LOG(LogOnlineICE, Log, TEXT("ICE connection fully established - handshake complete"));
+		return false;
 	}
+
+	OutStats = Pair->Stats;
+	return true;
 }
 
-void FICEAgent::CleanupSocketOnError()
+void FICEAgent::RecordPairResponse(FICECandidatePair& Pair, bool bTimed)
 {
-	if (Socket)
+	Pair.Stats.ResponsesReceived++;
+
+	if (bTimed && Pair.LastRequestTime > 0.0)
 	{
-		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-		if (SocketSubsystem)
-		{
-			SocketSubsystem->DestroySocket(Socket);
-		}
-		Socket = nullptr;
+		Pair.Stats.AddRTTSample((float)((FPlatformTime::Seconds() - Pair.LastRequestTime) * 1000.0));
 	}
-	UpdateConnectionState(EICEConnectionState::Failed);
+	Pair.LastRequestTime = 0.0;
 }
 
-FICECandidate FICEAgent::SelectHighestPriorityCandidate(const TArray<FICECandidate>& Candidates) const
+void FICEAgent::TickConsent(float DeltaTime)
 {
-	if (Candidates.Num() == 0)
+	FICECandidatePair* Pair = FindSelectedPair();
+	if (!bIsConnected || !Pair)
 	{
-		return FICECandidate();
+		return;
 	}
 
-	const FICECandidate* BestCandidate = &Candidates[0];
-	for (int32 i = 1; i < Candidates.Num(); ++i)
+	// Without a fresh response the path may be dead (NAT binding expired, peer gone): fail fast instead of
+	// waiting for the engine's connection timeout
+	// A restart still gathering or checking may move the session to a working path, consent waits for it
+	TimeSinceConsent += DeltaTime;
+	if (TimeSinceConsent >= Config.ConsentTimeout && !(bRestartInProgress && (bChecksInProgress || bGatheringInProgress)))
 	{
-		if (Candidates[i].Priority > BestCandidate->Priority)
+		if (bConsentPending)
 		{
-			BestCandidate = &Candidates[i];
+			Pair->Stats.RequestsLost++;
 		}
+		UE_LOG(LogOnlineICE, Warning, TEXT("Consent expired on %s: no response for %.1fs (%s)"),
+			*Pair->ToString(), TimeSinceConsent, *Pair->Stats.ToString());
+
+		// The pair may come back: a check from the peer revives it like any failed pair
+		Pair->State = EICECandidatePairState::Failed;
+		bConsentPending = false;
+		bRestartInProgress = false;
+		bIsConnected = false;
+		UpdateConnectionState(EICEConnectionState::Failed);
+		return;
+	}
+
+	TimeSinceConsentCheck += DeltaTime;
+	if (TimeSinceConsentCheck < NextConsentCheckDelay)
+	{
+		return;
+	}
+
+	// The previous check is given up on; every check gets its own token so late answers aren't mistaken for new ones
+	if (bConsentPending)
+	{
+		Pair->Stats.RequestsLost++;
+		if (Config.bPaceSends)
+		{
+			SendScheduler.OnLoss();
+		}
+		if (bFECActive)
+		{
+			FECCodec.AddLossSample(true);
+		}
+	}
+
+	TimeSinceConsentCheck = 0.0f;
+	NextConsentCheckDelay = Config.ConsentCheckInterval * FMath::FRandRange(0.8f, 1.2f);
+	ConsentToken = NextCheckToken++;
+
+	// Also keeps the NAT binding alive while the game is idle
+	if (SendHandshakePacket(*Pair, GetHandshakeRequestType(), ConsentToken))
+	{
+		bConsentPending = true;
+		Pair->Stats.RequestsSent++;
+		++Stats.ConsentChecksSent;
+		Pair->LastRequestTime = FPlatformTime::Seconds();
+	}
+	else
+	{
+		bConsentPending = false;
 	}
-	
-	return *BestCandidate;
 }
 
 bool FICEAgent::ValidateSocketSubsystem() const
@@ -1540,107 +4427,52 @@ bool FICEAgent::VerifyHandshakeMagicNumber(const uint8* Buffer) const
 	return true;
 }
 
-void FICEAgent::ParseServerAddress(const FString& ServerAddress, FString& OutHost, int32& OutPort, int32 DefaultPort) const
-{
-	int32 ColonPos;
-	if (ServerAddress.FindChar(':', ColonPos))
-	{
-		OutHost = ServerAddress.Left(ColonPos);
-		OutPort = FCString::Atoi(*ServerAddress.Mid(ColonPos + 1));
-	}
-	else
-	{
-		OutHost = ServerAddress;
-		OutPort = DefaultPort;
-	}
-}
-
-void FICEAgent::BuildSTUNBindingRequest(uint8* OutBuffer) const
+EICEResolveStatus FICEAgent::ResolveServerAddress(const FString& ServerAddress, TSharedPtr<FInternetAddr>& OutAddr) const
 {
-	FMemory::Memzero(OutBuffer, 20);
-
-	// Message Type: Binding Request (0x0001)
-	OutBuffer[0] = 0x00;
-	OutBuffer[1] = 0x01;
-
-	// Message Length: 0 (no attributes for basic request)
-	OutBuffer[2] = 0x00;
-	OutBuffer[3] = 0x00;
-
-	// Magic Cookie: 0x2112A442
-	OutBuffer[4] = 0x21;
-	OutBuffer[5] = 0x12;
-	OutBuffer[6] = 0xA4;
-	OutBuffer[7] = 0x42;
+	FString Host;
+	int32 Port;
+	FICEAddressResolver::ParseServerAddress(ServerAddress, Host, Port, 3478);
 
-	// Transaction ID: Random 12 bytes
-	for (int32 i = 8; i < 20; i++)
+	// An IPv6 server is only reachable from a dual-stack agent socket
+	const bool bAllowIPv6 = Socket && Socket->GetProtocol() == FNetworkProtocolTypes::IPv6;
+	const EICEResolveStatus Status = FICEAddressResolver::Get().Resolve(Host, bAllowIPv6, OutAddr);
+	if (Status == EICEResolveStatus::Resolved)
 	{
-		OutBuffer[i] = FMath::Rand() & 0xFF;
+		OutAddr->SetPort(Port);
 	}
+	return Status;
 }
 
-bool FICEAgent::ParseSTUNResponse(const uint8* Response, int32 ResponseSize, FString& OutPublicIP, int32& OutPublicPort) const
+bool FICEAgent::IsServerResolutionPending() const
 {
-	if (ResponseSize < 20)
-	{
-		return false;
-	}
-
-	uint16 MessageType = (Response[0] << 8) | Response[1];
-	uint16 MessageLength = (Response[2] << 8) | Response[3];
-
-	// Check if it's a Binding Response (0x0101)
-	if (MessageType != 0x0101 || ResponseSize < 20 + MessageLength)
-	{
-		return false;
-	}
-
-	// Parse attributes to find XOR-MAPPED-ADDRESS (0x0020)
-	int32 Offset = 20;
-	while (Offset < ResponseSize)
+	TSharedPtr<FInternetAddr> Addr;
+	for (const TArray<FString>* Servers : { &Config.STUNServers, &Config.TURNServers })
 	{
-		if (Offset + 4 > ResponseSize) break;
-
-		uint16 AttrType = (Response[Offset] << 8) | Response[Offset + 1];
-		uint16 AttrLength = (Response[Offset + 2] << 8) | Response[Offset + 3];
-
-		if (AttrType == 0x0020 && AttrLength >= 8) // XOR-MAPPED-ADDRESS
+		for (const FString& ServerAddress : *Servers)
 		{
-			if (Offset + 4 + AttrLength > ResponseSize)
-			{
-				UE_LOG(LogOnlineICE, Warning, TEXT("Incomplete XOR-MAPPED-ADDRESS attribute"));
-				break;
-			}
-
-			uint8 Family = Response[Offset + 5];
-			if (Family == 0x01) // IPv4
+			if (ResolveServerAddress(ServerAddress, Addr) == EICEResolveStatus::Pending)
 			{
-				// XOR-ed Port (2 bytes at offset 6-7)
-				uint16 XorPort = (Response[Offset + 6] << 8) | Response[Offset + 7];
-				OutPublicPort = XorPort ^ STUNConstants::MAGIC_COOKIE_HIGH;
-
-				// XOR-ed IP (4 bytes at offset 8-11)
-				uint32 XorIP = (Response[Offset + 8] << 24) | (Response[Offset + 9] << 16) |
-				              (Response[Offset + 10] << 8) | Response[Offset + 11];
-				uint32 PublicIPValue = XorIP ^ STUNConstants::MAGIC_COOKIE;
-
-				// Convert to string
-				OutPublicIP = FString::Printf(TEXT("%d.%d.%d.%d"),
-					(PublicIPValue >> 24) & 0xFF,
-					(PublicIPValue >> 16) & 0xFF,
-					(PublicIPValue >> 8) & 0xFF,
-					PublicIPValue & 0xFF);
-
 				return true;
 			}
 		}
+	}
+	return false;
+}
 
-		// Move to next attribute (pad to 4-byte boundary)
-		Offset += 4 + ((AttrLength + 3) & ~3);
+bool FICEAgent::ParseSTUNResponse(const FSTUNMessageView& Response, FString& OutPublicIP, int32& OutPublicPort) const
+{
+	// Binding success response carrying XOR-MAPPED-ADDRESS (IPv4)
+	FSTUNAddress MappedAddress;
+	if (Response.GetMessageType() != STUNMessageType::BINDING_SUCCESS ||
+		!Response.GetXorAddress(STUNAttribute::XOR_MAPPED_ADDRESS, MappedAddress) ||
+		!MappedAddress.IsIPv4())
+	{
+		return false;
 	}
 
-	return false;
+	OutPublicIP = MappedAddress.ToString();
+	OutPublicPort = MappedAddress.Port;
+	return true;
 }
 
 FString FICEAgent::GetConnectionStateName(EICEConnectionState State) const
@@ -1666,526 +4498,555 @@ FString FICEAgent::GetConnectionStateName(EICEConnectionState State) const
 	}
 }
 
-void FICEAgent::CalculateHMACSHA1(const uint8* Data, int32 DataLen, const uint8* Key, int32 KeyLen, uint8* OutHash)
+bool FICEAgent::StartTURNRefresh()
 {
-	// HMAC-SHA1 implementation as per RFC 2104
-	const int32 BlockSize = STUNConstants::SHA1_BLOCK_SIZE;
-	const int32 HashSize = STUNConstants::HMAC_SHA1_SIZE;
-	
-	uint8 KeyPadded[BlockSize];
-	FMemory::Memzero(KeyPadded, BlockSize);
-	
-	// If key is longer than block size, hash it first
-	if (KeyLen > BlockSize)
+	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Cannot refresh TURN: allocation not active"));
+		return false;
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Refreshing TURN allocation"));
+
+	// Request the same lifetime again
+	FICETURNTransaction Transaction;
+	Transaction.Type = EICETURNTransactionType::Refresh;
+	Transaction.Lifetime = TURNAllocationLifetime;
+
+	if (!SendTURNTransaction(Transaction))
 	{
-		FSHA1 SHA1Context;
-		SHA1Context.Update(Key, KeyLen);
-		SHA1Context.Final();
-		SHA1Context.GetHash(KeyPadded);
+		return false;
 	}
-	else
+
+	TURNTransactions.Add(MoveTemp(Transaction));
+	return true;
+}
+
+bool FICEAgent::StartTURNCreatePermission(const FICECandidatePair& Pair)
+{
+	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid() || !Pair.RemoteAddr.IsValid())
 	{
-		FMemory::Memcpy(KeyPadded, Key, KeyLen);
+		UE_LOG(LogOnlineICE, Error, TEXT("Cannot create TURN permission: TURN not allocated"));
+		return false;
 	}
-	
-	// Create inner and outer padded keys
-	uint8 InnerPad[BlockSize];
-	uint8 OuterPad[BlockSize];
-	
-	for (int32 i = 0; i < BlockSize; i++)
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Creating TURN permission for peer %s"), *Pair.RemoteAddr->ToString(true));
+
+	FICETURNTransaction Transaction;
+	Transaction.Type = EICETURNTransactionType::CreatePermission;
+	Transaction.PeerAddr = Pair.RemoteAddr;
+
+	if (!SendTURNTransaction(Transaction))
 	{
-		InnerPad[i] = KeyPadded[i] ^ 0x36;
-		OuterPad[i] = KeyPadded[i] ^ 0x5C;
+		return false;
 	}
-	
-	// Calculate inner hash: SHA1(InnerPad || Data)
-	FSHA1 InnerSHA1;
-	InnerSHA1.Update(InnerPad, BlockSize);
-	InnerSHA1.Update(Data, DataLen);
-	InnerSHA1.Final();
-	
-	uint8 InnerHash[HashSize];
-	InnerSHA1.GetHash(InnerHash);
-	
-	// Calculate outer hash: SHA1(OuterPad || InnerHash)
-	FSHA1 OuterSHA1;
-	OuterSHA1.Update(OuterPad, BlockSize);
-	OuterSHA1.Update(InnerHash, HashSize);
-	OuterSHA1.Final();
-	
-	OuterSHA1.GetHash(OutHash);
+
+	TURNTransactions.Add(MoveTemp(Transaction));
+	return true;
 }
 
-bool FICEAgent::PerformTURNCreatePermission(const FString& PeerAddress, int32 PeerPort)
+bool FICEAgent::StartTURNChannelBind(const FICECandidatePair& Pair)
 {
-	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid())
+	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid() || !Pair.RemoteAddr.IsValid())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Cannot create TURN permission: TURN not allocated"));
+		UE_LOG(LogOnlineICE, Error, TEXT("Cannot bind TURN channel: TURN not allocated"));
+		return false;
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Binding TURN channel 0x%04X to peer %s"), Pair.RelayChannel, *Pair.RemoteAddr->ToString(true));
+
+	FICETURNTransaction Transaction;
+	Transaction.Type = EICETURNTransactionType::ChannelBind;
+	Transaction.PeerAddr = Pair.RemoteAddr;
+	Transaction.ChannelNumber = Pair.RelayChannel;
+
+	if (!SendTURNTransaction(Transaction))
+	{
+		return false;
+	}
+
+	TURNTransactions.Add(MoveTemp(Transaction));
+	return true;
+}
+
+bool FICEAgent::SendTURNTransaction(FICETURNTransaction& Transaction)
+{
+	if (!TURNSocket || !TURNServerAddr.IsValid())
+	{
+		return false;
+	}
+
+	uint16 MessageType = STUNMessageType::REFRESH_REQUEST; // RFC 5766 Section 7
+	if (Transaction.Type == EICETURNTransactionType::CreatePermission)
+	{
+		MessageType = STUNMessageType::CREATE_PERMISSION_REQUEST; // RFC 5766 Section 9
+	}
+	else if (Transaction.Type == EICETURNTransactionType::ChannelBind)
+	{
+		MessageType = STUNMessageType::CHANNEL_BIND_REQUEST; // RFC 5766 Section 11
+	}
+
+	// Every (re)encoding is a new transaction with a new ID
+	FSTUNMessage::GenerateTransactionID(Transaction.TransactionID);
+	FSTUNMessage Message(MessageType, Transaction.TransactionID);
+
+	if (Transaction.Type == EICETURNTransactionType::Refresh)
+	{
+		Message.AddUInt32(STUNAttribute::LIFETIME, (uint32)Transaction.Lifetime);
+	}
+	else
+	{
+		if (Transaction.Type == EICETURNTransactionType::ChannelBind)
+		{
+			// CHANNEL-NUMBER: channel + 2 reserved bytes
+			Message.AddUInt32(STUNAttribute::CHANNEL_NUMBER, (uint32)Transaction.ChannelNumber << 16);
+		}
+
+		Message.AddXorAddress(STUNAttribute::XOR_PEER_ADDRESS, *Transaction.PeerAddr);
+	}
+
+	if (!FinalizeTURNRequest(Message))
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("TURN %s request too large"), GetTURNTransactionName(Transaction.Type));
 		return false;
 	}
 
-	UE_LOG(LogOnlineICE, Log, TEXT("Creating TURN permission for peer %s:%d"), *PeerAddress, PeerPort);
+	// Keep the encoded request for retransmissions
+	Transaction.Request.Reset();
+	Transaction.Request.Append(Message.GetData(), Message.Num());
 
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	if (!SocketSubsystem)
+	Transaction.RTO = TURN_INITIAL_RTO;
+	Transaction.TimeSinceSend = 0.0f;
+	Transaction.Transmissions = 1;
+	if (Transaction.StartTime == 0.0)
 	{
-		return false;
+		Transaction.StartTime = FPlatformTime::Seconds();
 	}
 
-	// Parse peer address
-	TSharedPtr<FInternetAddr> PeerAddr = SocketSubsystem->GetAddressFromString(PeerAddress);
-	if (!PeerAddr.IsValid())
+	int32 BytesSent;
+	if (!TURNSocket->SendTo(Message.GetData(), Message.Num(), BytesSent, *TURNServerAddr))
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Invalid peer address: %s"), *PeerAddress);
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send TURN %s request"), GetTURNTransactionName(Transaction.Type));
 		return false;
 	}
-	PeerAddr->SetPort(PeerPort);
-
-	// Build TURN CreatePermission Request (RFC 5766 Section 9)
-	TArray<uint8> Request;
-	Request.SetNum(512);
-	FMemory::Memzero(Request.GetData(), Request.Num());
-
-	int32 Offset = 0;
-
-	// Message Type: CreatePermission Request (0x0008)
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x08;
 
-	// Message Length: Will be set later
-	int32 LengthOffset = Offset;
-	Offset += 2;
+	return true;
+}
 
-	// Magic Cookie
-	Request[Offset++] = 0x21;
-	Request[Offset++] = 0x12;
-	Request[Offset++] = 0xA4;
-	Request[Offset++] = 0x42;
+bool FICEAgent::FinalizeTURNRequest(FSTUNMessage& Message)
+{
+	Message.AddString(STUNAttribute::USERNAME, Config.TURNUsername);
 
-	// Transaction ID: Copy from last allocation or generate new
-	for (int32 i = 0; i < STUNConstants::TRANSACTION_ID_LENGTH; i++)
+	// Long-term credentials learnt while allocating; without them the server challenges with a 401
+	const FICETURNCredentials* Credentials = TURNCredentialCache.Find(GetTURNCredentialCacheKey(ActiveTURNServer));
+	if (Credentials)
 	{
-		TURNTransactionID[i] = FMath::Rand() & 0xFF;
-		Request[Offset++] = TURNTransactionID[i];
+		Message.AddString(STUNAttribute::REALM, Credentials->Realm);
+		Message.AddString(STUNAttribute::NONCE, Credentials->Nonce);
+		Message.AddMessageIntegrity(Credentials->Key, sizeof(Credentials->Key));
 	}
 
-	// Add XOR-PEER-ADDRESS attribute (0x0012)
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x12;
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x08; // Length = 8 for IPv4
+	return Message.IsValid();
+}
 
-	// Reserved + Family
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x01; // IPv4
+bool FICEAgent::HasPendingTURNTransaction(EICETURNTransactionType Type, uint16 ChannelNumber) const
+{
+	return TURNTransactions.ContainsByPredicate([Type, ChannelNumber](const FICETURNTransaction& Transaction)
+	{
+		return Transaction.Type == Type && Transaction.ChannelNumber == ChannelNumber;
+	});
+}
 
-	// XOR-ed Port
-	uint16 XorPort = PeerPort ^ STUNConstants::MAGIC_COOKIE_HIGH;
-	Request[Offset++] = (XorPort >> 8) & 0xFF;
-	Request[Offset++] = XorPort & 0xFF;
+void FICEAgent::TickTURNTransactions(float DeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FICEAgent::TickTURNTransactions);
 
-	// XOR-ed IP address
-	uint32 PeerIPValue = 0;
-	// Parse IP address from string
-	TArray<FString> IPParts;
-	PeerAddress.ParseIntoArray(IPParts, TEXT("."));
-	if (IPParts.Num() == 4)
+	// Walk backwards: completions may remove entries or start new transactions at the end
+	for (int32 Index = TURNTransactions.Num() - 1; Index >= 0; --Index)
 	{
-		PeerIPValue = (FCString::Atoi(*IPParts[0]) << 24) |
-		              (FCString::Atoi(*IPParts[1]) << 16) |
-		              (FCString::Atoi(*IPParts[2]) << 8) |
-		              FCString::Atoi(*IPParts[3]);
-	}
-	uint32 XorIP = PeerIPValue ^ STUNConstants::MAGIC_COOKIE;
-	Request[Offset++] = (XorIP >> 24) & 0xFF;
-	Request[Offset++] = (XorIP >> 16) & 0xFF;
-	Request[Offset++] = (XorIP >> 8) & 0xFF;
-	Request[Offset++] = XorIP & 0xFF;
-
-	// Add USERNAME attribute using helper
-	AppendTURNUsernameAttribute(Request, Offset, Config.TURNUsername);
+		FICETURNTransaction& Transaction = TURNTransactions[Index];
+		Transaction.TimeSinceSend += DeltaTime;
 
-	// Set message length
-	int32 MessageLength = Offset - 20;
-	Request[LengthOffset] = (MessageLength >> 8) & 0xFF;
-	Request[LengthOffset + 1] = MessageLength & 0xFF;
+		if (Transaction.Transmissions < TURN_MAX_TRANSMISSIONS)
+		{
+			if (Transaction.TimeSinceSend >= Transaction.RTO)
+			{
+				// Same transaction ID, the server answers retransmissions of a request idempotently
+				int32 BytesSent;
+				TURNSocket->SendTo(Transaction.Request.GetData(), Transaction.Request.Num(), BytesSent, *TURNServerAddr);
+
+				Transaction.Transmissions++;
+				Transaction.RTO *= 2.0f;
+				Transaction.TimeSinceSend = 0.0f;
+				UE_LOG(LogOnlineICE, Verbose, TEXT("Retransmitting TURN %s request (%d/%d)"),
+					GetTURNTransactionName(Transaction.Type), Transaction.Transmissions, TURN_MAX_TRANSMISSIONS);
+			}
+		}
+		else if (Transaction.TimeSinceSend >= TURN_INITIAL_RTO * TURN_FINAL_WAIT_FACTOR)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("TURN %s request timed out after %d transmissions"),
+				GetTURNTransactionName(Transaction.Type), Transaction.Transmissions);
 
-	// Resize to actual size
-	Request.SetNum(Offset);
+			FICETURNTransaction Finished = MoveTemp(Transaction);
+			TURNTransactions.RemoveAt(Index);
+			CompleteTURNTransaction(Finished, false, nullptr);
+		}
+	}
+}
 
-	// Send request
-	int32 BytesSent;
-	if (!TURNSocket->SendTo(Request.GetData(), Request.Num(), BytesSent, *TURNServerAddr))
+bool FICEAgent::HandleTURNResponse(const uint8* Buffer, int32 Size)
+{
+	FSTUNMessageView Response;
+	if (!Response.Parse(Buffer, Size) || !Response.IsResponse())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send TURN CreatePermission request"));
 		return false;
 	}
 
-	// Wait for response
-	if (!TURNSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(5.0)))
+	const int32 Index = TURNTransactions.IndexOfByPredicate([&Response](const FICETURNTransaction& Transaction)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("TURN CreatePermission timeout"));
-		return false;
+		return Response.HasTransactionID(Transaction.TransactionID);
+	});
+
+	if (Index == INDEX_NONE)
+	{
+		// Late answer to a retransmission or a transaction that already timed out
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Ignoring TURN response 0x%04X that matches no pending request"), Response.GetMessageType());
+		return true;
 	}
 
-	// Receive response
-	uint8 Response[1024];
-	int32 BytesRead = 0;
-	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+	FICETURNTransaction& Transaction = TURNTransactions[Index];
 
-	if (!TURNSocket->RecvFrom(Response, sizeof(Response), BytesRead, *FromAddr))
+	if (Response.IsSuccessResponse())
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to receive TURN CreatePermission response"));
-		return false;
+		FICETURNTransaction Finished = MoveTemp(Transaction);
+		TURNTransactions.RemoveAt(Index);
+		CompleteTURNTransaction(Finished, true, &Response);
+		return true;
 	}
 
-	// Parse response
-	if (BytesRead >= 20)
+	const int32 ErrorCode = Response.GetErrorCode();
+	FString ErrorRealm = Response.GetString(STUNAttribute::REALM);
+	const FString ErrorNonce = Response.GetString(STUNAttribute::NONCE);
+
+	// 401 Unauthorized / 438 Stale Nonce: answer the new challenge once
+	if ((ErrorCode == 401 || ErrorCode == 438) && !Transaction.bAuthRetried && !ErrorNonce.IsEmpty())
 	{
-		uint16 MessageType = (Response[0] << 8) | Response[1];
-		
-		if (MessageType == 0x0108) // CreatePermission Success Response
+		const FICETURNCredentials* CachedCredentials = TURNCredentialCache.Find(GetTURNCredentialCacheKey(ActiveTURNServer));
+		if (ErrorRealm.IsEmpty() && CachedCredentials)
 		{
-			UE_LOG(LogOnlineICE, Log, TEXT("TURN permission created successfully"));
-			return true;
+			ErrorRealm = CachedCredentials->Realm;
 		}
-		else if (MessageType == 0x0118) // CreatePermission Error Response
+
+		if (!ErrorRealm.IsEmpty())
 		{
-			UE_LOG(LogOnlineICE, Error, TEXT("TURN CreatePermission failed"));
-			return false;
+			UE_LOG(LogOnlineICE, Log, TEXT("TURN %s challenged (%d), retrying with new nonce"), GetTURNTransactionName(Transaction.Type), ErrorCode);
+			CacheTURNCredentials(ActiveTURNServer, ErrorRealm, ErrorNonce);
+
+			Transaction.bAuthRetried = true;
+			if (SendTURNTransaction(Transaction))
+			{
+				return true;
+			}
 		}
 	}
 
-	return false;
+	UE_LOG(LogOnlineICE, Warning, TEXT("TURN %s request failed with error %d"), GetTURNTransactionName(Transaction.Type), ErrorCode);
+
+	FICETURNTransaction Finished = MoveTemp(Transaction);
+	TURNTransactions.RemoveAt(Index);
+	CompleteTURNTransaction(Finished, false, &Response);
+	return true;
 }
 
-bool FICEAgent::PerformTURNChannelBind(const FString& PeerAddress, int32 PeerPort, uint16 ChannelNumber)
+void FICEAgent::CompleteTURNTransaction(const FICETURNTransaction& Transaction, bool bSucceeded, const FSTUNMessageView* Response)
 {
-	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid())
+	if (!bSucceeded)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Cannot bind TURN channel: TURN not allocated"));
-		return false;
+		++Stats.TURNFailures;
 	}
-
-	UE_LOG(LogOnlineICE, Log, TEXT("Binding TURN channel 0x%04X for peer %s:%d"), 
-		ChannelNumber, *PeerAddress, PeerPort);
-
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	if (!SocketSubsystem)
+	else if (Transaction.StartTime > 0.0)
 	{
-		return false;
+		FICELatencyHistogram& Latency = Transaction.Type == EICETURNTransactionType::Refresh ? Stats.TURNRefreshLatency : Stats.TURNBindLatency;
+		Latency.AddSample((float)((FPlatformTime::Seconds() - Transaction.StartTime) * 1000.0));
 	}
 
-	// Build TURN ChannelBind Request (RFC 5766 Section 11)
-	TArray<uint8> Request;
-	Request.SetNum(512);
-	FMemory::Memzero(Request.GetData(), Request.Num());
-
-	int32 Offset = 0;
-
-	// Message Type: ChannelBind Request (0x0009)
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x09;
-
-	// Message Length: Will be set later
-	int32 LengthOffset = Offset;
-	Offset += 2;
-
-	// Magic Cookie
-	Request[Offset++] = 0x21;
-	Request[Offset++] = 0x12;
-	Request[Offset++] = 0xA4;
-	Request[Offset++] = 0x42;
-
-	// Transaction ID
-	for (int32 i = 0; i < STUNConstants::TRANSACTION_ID_LENGTH; i++)
+	switch (Transaction.Type)
 	{
-		TURNTransactionID[i] = FMath::Rand() & 0xFF;
-		Request[Offset++] = TURNTransactionID[i];
-	}
-
-	// Add CHANNEL-NUMBER attribute (0x000C)
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x0C;
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x04; // Length = 4
-
-	Request[Offset++] = (ChannelNumber >> 8) & 0xFF;
-	Request[Offset++] = ChannelNumber & 0xFF;
-	Request[Offset++] = 0x00; // Reserved
-	Request[Offset++] = 0x00; // Reserved
-
-	// Add XOR-PEER-ADDRESS attribute (0x0012)
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x12;
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x08; // Length = 8 for IPv4
+		case EICETURNTransactionType::Refresh:
+		{
+			if (bSucceeded)
+			{
+				UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation refreshed successfully"));
+				TimeSinceTURNRefresh = 0.0f;
 
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x01; // IPv4
+				// Update lifetime from response if present
+				uint32 Lifetime = 0;
+				if (Response && Response->GetUInt32(STUNAttribute::LIFETIME, Lifetime))
+				{
+					TURNAllocationLifetime = (int32)Lifetime;
+					UE_LOG(LogOnlineICE, Log, TEXT("Updated TURN allocation lifetime: %d seconds"), TURNAllocationLifetime);
+				}
+			}
+			else if (Response)
+			{
+				// The server rejected the refresh, the allocation is gone
+				UE_LOG(LogOnlineICE, Error, TEXT("TURN Refresh failed"));
+				bTURNAllocationActive = false;
+			}
+			else
+			{
+				// Try to refresh again sooner
+				UE_LOG(LogOnlineICE, Warning, TEXT("TURN refresh failed, allocation may expire"));
+				TimeSinceTURNRefresh = FMath::Max(0.0f, TURNAllocationLifetime * 0.8f - 30.0f);
+			}
+			break;
+		}
 
-	uint16 XorPort = PeerPort ^ STUNConstants::MAGIC_COOKIE_HIGH;
-	Request[Offset++] = (XorPort >> 8) & 0xFF;
-	Request[Offset++] = XorPort & 0xFF;
+		case EICETURNTransactionType::CreatePermission:
+		case EICETURNTransactionType::ChannelBind:
+		{
+			const bool bChannelBind = Transaction.Type == EICETURNTransactionType::ChannelBind;
+			if (bSucceeded)
+			{
+				UE_LOG(LogOnlineICE, Log, TEXT("TURN %s succeeded for %s"), GetTURNTransactionName(Transaction.Type), *Transaction.PeerAddr->ToString(true));
+			}
+			else if (bChannelBind)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("TURN channel binding failed for %s, using Send indications"), *Transaction.PeerAddr->ToString(true));
+			}
+			else
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("TURN permission creation failed for %s"), *Transaction.PeerAddr->ToString(true));
+			}
 
-	// Parse and XOR IP address
-	TArray<FString> IPParts;
-	PeerAddress.ParseIntoArray(IPParts, TEXT("."));
-	uint32 PeerIPValue = 0;
-	if (IPParts.Num() == 4)
-	{
-		PeerIPValue = (FCString::Atoi(*IPParts[0]) << 24) |
-		              (FCString::Atoi(*IPParts[1]) << 16) |
-		              (FCString::Atoi(*IPParts[2]) << 8) |
-		              FCString::Atoi(*IPParts[3]);
-	}
-	uint32 XorIP = PeerIPValue ^ STUNConstants::MAGIC_COOKIE;
-	Request[Offset++] = (XorIP >> 24) & 0xFF;
-	Request[Offset++] = (XorIP >> 16) & 0xFF;
-	Request[Offset++] = (XorIP >> 8) & 0xFF;
-	Request[Offset++] = XorIP & 0xFF;
+			for (FICECandidatePair& Pair : CheckList)
+			{
+				if (!Pair.IsRelayed() || !Pair.RemoteAddr.IsValid() || !(*Pair.RemoteAddr == *Transaction.PeerAddr) ||
+					(bChannelBind && Pair.RelayChannel != Transaction.ChannelNumber))
+				{
+					continue;
+				}
 
-	// Add USERNAME attribute using helper
-	AppendTURNUsernameAttribute(Request, Offset, Config.TURNUsername);
+				if (!bSucceeded)
+				{
+					// Without a permission the relay drops everything from the peer
+					if (!bChannelBind && !Pair.bRelayBound && Pair.State != EICECandidatePairState::Succeeded)
+					{
+						Pair.State = EICECandidatePairState::Failed;
+					}
+					continue;
+				}
 
-	// Set message length
-	int32 MessageLength = Offset - 20;
-	Request[LengthOffset] = (MessageLength >> 8) & 0xFF;
-	Request[LengthOffset + 1] = MessageLength & 0xFF;
+				// A channel binding also installs the permission (RFC 5766 Section 11.2)
+				const bool bWasBound = Pair.bRelayBound;
+				Pair.bRelayBound = true;
+				if (bChannelBind)
+				{
+					Pair.bChannelBound = true;
+				}
 
-	Request.SetNum(Offset);
+				// The check was waiting for the permission, send it now
+				if (!bWasBound && Pair.State == EICECandidatePairState::InProgress && Pair.Transmissions == 0 && !SendConnectivityCheck(Pair))
+				{
+					Pair.State = EICECandidatePairState::Failed;
+				}
 
-	// Send request
-	int32 BytesSent;
-	if (!TURNSocket->SendTo(Request.GetData(), Request.Num(), BytesSent, *TURNServerAddr))
-	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send TURN ChannelBind request"));
-		return false;
+				// Promote the selected relayed pair from Send indications to ChannelData
+				if (bChannelBind && bIsConnected && TURNChannelNumber == 0 && Pair.RemoteAddr == SelectedRemoteAddr)
+				{
+					TURNChannelNumber = Pair.RelayChannel;
+					UE_LOG(LogOnlineICE, Log, TEXT("Relayed traffic promoted from Send indications to ChannelData (channel 0x%04X)"), TURNChannelNumber);
+				}
+			}
+			break;
+		}
 	}
+}
 
-	// Wait for response
-	if (!TURNSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(5.0)))
+bool FICEAgent::SendDataThroughTURN(const uint8* Data, int32 Size)
+{
+	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid())
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("TURN ChannelBind timeout"));
 		return false;
 	}
 
-	// Receive response
-	uint8 Response[1024];
-	int32 BytesRead = 0;
-	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+	// Use ChannelData if channel is bound (more efficient)
+	const bool bChannelData = TURNChannelNumber >= STUNConstants::CHANNEL_NUMBER_MIN && TURNChannelNumber <= STUNConstants::CHANNEL_NUMBER_MAX;
 
-	if (!TURNSocket->RecvFrom(Response, sizeof(Response), BytesRead, *FromAddr))
+	// A fragmented relay datagram is lost if any fragment is, drop it instead
+	const int32 MaxPayloadSize = GetMaxRelayPayloadSize(bChannelData);
+	if (Size > MaxPayloadSize)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to receive TURN ChannelBind response"));
+		UE_LOG(LogOnlineICE, Warning, TEXT("Dropping %d byte relayed datagram, path MTU %d allows %d bytes"), Size, Config.PathMTU, MaxPayloadSize);
 		return false;
 	}
 
-	// Parse response
-	if (BytesRead >= 20)
+	if (bChannelData)
 	{
-		uint16 MessageType = (Response[0] << 8) | Response[1];
-		
-		if (MessageType == 0x0109) // ChannelBind Success Response
-		{
-			UE_LOG(LogOnlineICE, Log, TEXT("TURN channel 0x%04X bound successfully"), ChannelNumber);
-			TURNChannelNumber = ChannelNumber;
-			return true;
-		}
-		else if (MessageType == 0x0119) // ChannelBind Error Response
-		{
-			UE_LOG(LogOnlineICE, Error, TEXT("TURN ChannelBind failed"));
-			return false;
-		}
+		return SendTURNChannelData(TURNChannelNumber, Data, Size);
 	}
 
-	return false;
+	// Use Send indication (RFC 5766 Section 10.1) until ChannelBind succeeds
+	return SelectedRemoteAddr.IsValid() && SendTURNSendIndication(*SelectedRemoteAddr, Data, Size);
 }
 
-bool FICEAgent::PerformTURNRefresh()
+bool FICEAgent::SendTURNSendIndication(const FInternetAddr& PeerAddr, const uint8* Data, int32 Size)
 {
-	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid())
+	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid() || Size < 0 || Size > MAX_uint16)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("Cannot refresh TURN: allocation not active"));
 		return false;
 	}
 
-	UE_LOG(LogOnlineICE, Log, TEXT("Refreshing TURN allocation"));
+	// Header(20) | XOR-PEER-ADDRESS(4 + 8 or 20) | DATA(4 + padded payload), built in the persistent scratch buffer
+	const int32 MaxMessageSize = FSTUNMessage::HEADER_SIZE + 4 + 20 + 4 + ((Size + 3) & ~3);
+	uint8* Scratch = ReserveSendScratch(RelaySendBuffer, MaxMessageSize);
+
+	// Indications get no response, the transaction ID only has to be random
+	uint8 TransactionID[FSTUNMessage::TRANSACTION_ID_LENGTH];
+	FSTUNMessage::GenerateTransactionID(TransactionID);
 
-	// Build TURN Refresh Request (RFC 5766 Section 7)
-	TArray<uint8> Request;
-	Request.SetNum(512);
-	FMemory::Memzero(Request.GetData(), Request.Num());
+	FSTUNMessage Message(STUNMessageType::SEND_INDICATION, TransactionID, Scratch, MaxMessageSize);
+	Message.AddXorAddress(STUNAttribute::XOR_PEER_ADDRESS, PeerAddr);
+	uint8* Payload = Message.AddAttributeUninitialized(STUNAttribute::DATA, Size);
+	if (!Payload)
+	{
+		return false;
+	}
+	FMemory::Memcpy(Payload, Data, Size);
 
-	int32 Offset = 0;
+	int32 BytesSent;
+	return TURNSocket->SendTo(Message.GetData(), Message.Num(), BytesSent, *TURNServerAddr) && BytesSent == Message.Num();
+}
 
-	// Message Type: Refresh Request (0x0004)
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x04;
+int32 FICEAgent::GetMaxRelayPayloadSize(bool bChannelData) const
+{
+	// IP + UDP headers towards the TURN server (an IPv4-mapped address still travels over IPv4)
+	const bool bIPv6 = TURNServerAddr.IsValid() && GetCandidateAddress(*TURNServerAddr).Contains(TEXT(":"));
+	const int32 TransportOverhead = bIPv6 ? 48 : 28;
 
-	// Message Length: Will be set later
-	int32 LengthOffset = Offset;
-	Offset += 2;
+	// ChannelData header, or STUN header + XOR-PEER-ADDRESS + DATA header + worst case padding
+	const int32 FramingOverhead = bChannelData ? SEND_HEADROOM : 20 + 12 + 4 + 3;
 
-	// Magic Cookie
-	Request[Offset++] = 0x21;
-	Request[Offset++] = 0x12;
-	Request[Offset++] = 0xA4;
-	Request[Offset++] = 0x42;
+	return FMath::Max(0, Config.PathMTU - TransportOverhead - FramingOverhead);
+}
 
-	// Transaction ID
-	for (int32 i = 0; i < STUNConstants::TRANSACTION_ID_LENGTH; i++)
+int32 FICEAgent::GetMaxPayloadSize() const
+{
+	const int32 PayloadOverhead = (Config.bEncryptTraffic ? FICESecureChannel::RECORD_OVERHEAD : 0) +
+		(Config.bCoalesceSends ? CoalesceConstants::BUNDLE_HEADER_SIZE + CoalesceConstants::MESSAGE_HEADER_SIZE : 0) +
+		(Config.bEnableFEC ? FICEFECCodec::HEADER_SIZE : 0);
+	if (SelectedLocalCandidate.Type == EICECandidateType::Relayed && bTURNAllocationActive)
 	{
-		TURNTransactionID[i] = FMath::Rand() & 0xFF;
-		Request[Offset++] = TURNTransactionID[i];
+		return FMath::Max(0, GetMaxRelayPayloadSize(TURNChannelNumber != 0) - PayloadOverhead);
 	}
 
-	// Add LIFETIME attribute (0x000D) - request same lifetime
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x0D;
-	Request[Offset++] = 0x00;
-	Request[Offset++] = 0x04; // Length = 4
-
-	Request[Offset++] = (TURNAllocationLifetime >> 24) & 0xFF;
-	Request[Offset++] = (TURNAllocationLifetime >> 16) & 0xFF;
-	Request[Offset++] = (TURNAllocationLifetime >> 8) & 0xFF;
-	Request[Offset++] = TURNAllocationLifetime & 0xFF;
-
-	// Add USERNAME attribute using helper
-	AppendTURNUsernameAttribute(Request, Offset, Config.TURNUsername);
+	const bool bIPv6 = SelectedRemoteCandidate.IsIPv6();
+	return FMath::Max(0, Config.PathMTU - (bIPv6 ? 48 : 28) - PayloadOverhead);
+}
 
-	// Set message length
-	int32 MessageLength = Offset - 20;
-	Request[LengthOffset] = (MessageLength >> 8) & 0xFF;
-	Request[LengthOffset + 1] = MessageLength & 0xFF;
+void FICEAgent::TickRelayBindings(float DeltaTime)
+{
+	if (!bIsConnected || SelectedLocalCandidate.Type != EICECandidateType::Relayed || !bTURNAllocationActive)
+	{
+		return;
+	}
 
-	Request.SetNum(Offset);
+	FICECandidatePair* SelectedPair = CheckList.FindByPredicate([this](const FICECandidatePair& Pair)
+	{
+		return Pair.IsRelayed() && Pair.State == EICECandidatePairState::Succeeded && Pair.RemoteAddr == SelectedRemoteAddr;
+	});
+	if (!SelectedPair)
+	{
+		return;
+	}
 
-	// Send request
-	int32 BytesSent;
-	if (!TURNSocket->SendTo(Request.GetData(), Request.Num(), BytesSent, *TURNServerAddr))
+	// Permissions expire after 5 minutes and channels after 10, refresh both well before (RFC 5766 Sections 8 and 11)
+	TimeSinceRelayBindRefresh += DeltaTime;
+	if (TimeSinceRelayBindRefresh >= RELAY_BIND_REFRESH_INTERVAL)
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to send TURN Refresh request"));
-		return false;
+		TimeSinceRelayBindRefresh = 0.0f;
+
+		if (!HasPendingTURNTransaction(EICETURNTransactionType::CreatePermission))
+		{
+			StartTURNCreatePermission(*SelectedPair);
+		}
+		if (SelectedPair->bChannelBound && !HasPendingTURNTransaction(EICETURNTransactionType::ChannelBind, SelectedPair->RelayChannel))
+		{
+			StartTURNChannelBind(*SelectedPair);
+		}
 	}
 
-	// Wait for response
-	if (!TURNSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(5.0)))
+	// Relayed traffic still uses Send indications: retry the bind, the response promotes it to ChannelData
+	if (TURNChannelNumber != 0)
 	{
-		UE_LOG(LogOnlineICE, Warning, TEXT("TURN Refresh timeout"));
-		return false;
+		return;
 	}
 
-	// Receive response
-	uint8 Response[1024];
-	int32 BytesRead = 0;
-	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
-	if (!SocketSubsystem)
+	TimeSinceChannelBindAttempt += DeltaTime;
+	if (TimeSinceChannelBindAttempt < CHANNEL_BIND_RETRY_INTERVAL)
 	{
-		return false;
+		return;
 	}
-	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+	TimeSinceChannelBindAttempt = 0.0f;
 
-	if (!TURNSocket->RecvFrom(Response, sizeof(Response), BytesRead, *FromAddr))
+	if (!HasPendingTURNTransaction(EICETURNTransactionType::ChannelBind, SelectedPair->RelayChannel))
 	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Failed to receive TURN Refresh response"));
-		return false;
+		StartTURNChannelBind(*SelectedPair);
 	}
+}
 
-	// Parse response
-	if (BytesRead >= 20)
+int32 FICEAgent::FindRelayedPairForPeer(uint32 PeerIP, uint16 PeerPort) const
+{
+	return CheckList.IndexOfByPredicate([PeerIP, PeerPort](const FICECandidatePair& Pair)
 	{
-		uint16 MessageType = (Response[0] << 8) | Response[1];
-		
-		if (MessageType == 0x0104) // Refresh Success Response
-		{
-			UE_LOG(LogOnlineICE, Log, TEXT("TURN allocation refreshed successfully"));
-			TimeSinceTURNRefresh = 0.0f;
-			
-			// Update lifetime from response if present
-			int32 AttrOffset = 20;
-			while (AttrOffset < BytesRead)
-			{
-				if (AttrOffset + 4 > BytesRead) break;
-				
-				uint16 AttrType = (Response[AttrOffset] << 8) | Response[AttrOffset + 1];
-				uint16 AttrLength = (Response[AttrOffset + 2] << 8) | Response[AttrOffset + 3];
-				
-				if (AttrType == 0x000D && AttrLength == 4) // LIFETIME
-				{
-					if (AttrOffset + 8 <= BytesRead)
-					{
-						TURNAllocationLifetime = (Response[AttrOffset + 4] << 24) |
-						                         (Response[AttrOffset + 5] << 16) |
-						                         (Response[AttrOffset + 6] << 8) |
-						                         Response[AttrOffset + 7];
-						UE_LOG(LogOnlineICE, Log, TEXT("Updated TURN allocation lifetime: %d seconds"), 
-							TURNAllocationLifetime);
-					}
-					break;
-				}
-				
-				AttrOffset += 4 + ((AttrLength + 3) & ~3);
-			}
-			
-			return true;
-		}
-		else if (MessageType == 0x0114) // Refresh Error Response
+		if (!Pair.IsRelayed() || !Pair.RemoteAddr.IsValid() || Pair.RemoteAddr->GetPort() != PeerPort)
 		{
-			UE_LOG(LogOnlineICE, Error, TEXT("TURN Refresh failed"));
-			bTURNAllocationActive = false;
 			return false;
 		}
-	}
 
-	return false;
+		uint32 PairIP = 0;
+		Pair.RemoteAddr->GetIp(PairIP);
+		return PairIP == PeerIP;
+	});
 }
 
-bool FICEAgent::SendDataThroughTURN(const uint8* Data, int32 Size, const FString& PeerAddress, int32 PeerPort)
+bool FICEAgent::SendTURNChannelData(uint16 ChannelNumber, const uint8* Data, int32 Size)
 {
 	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid())
 	{
 		return false;
 	}
 
-	// Use ChannelData if channel is bound (more efficient)
-	if (TURNChannelNumber >= STUNConstants::CHANNEL_NUMBER_MIN && TURNChannelNumber <= STUNConstants::CHANNEL_NUMBER_MAX)
-	{
-		// ChannelData format: Channel Number (2) | Length (2) | Application Data (variable)
-		TArray<uint8> ChannelData;
-		ChannelData.SetNum(4 + Size);
-		
-		// Channel number
-		ChannelData[0] = (TURNChannelNumber >> 8) & 0xFF;
-		ChannelData[1] = TURNChannelNumber & 0xFF;
-		
-		// Length
-		ChannelData[2] = (Size >> 8) & 0xFF;
-		ChannelData[3] = Size & 0xFF;
-		
-		// Application data
-		FMemory::Memcpy(&ChannelData[4], Data, Size);
-		
-		int32 BytesSent;
-		return TURNSocket->SendTo(ChannelData.GetData(), ChannelData.Num(), BytesSent, *TURNServerAddr);
-	}
-	else
+	// Stage the payload behind a reserved header in the persistent scratch buffer
+	uint8* Scratch = ReserveSendScratch(RelaySendBuffer, SEND_HEADROOM + Size);
+	FMemory::Memcpy(Scratch + SEND_HEADROOM, Data, Size);
+
+	return SendTURNChannelDataInPlace(ChannelNumber, Scratch, Size);
+}
+
+bool FICEAgent::SendTURNChannelDataInPlace(uint16 ChannelNumber, uint8* Buffer, int32 Size)
+{
+	if (!TURNSocket || !bTURNAllocationActive || !TURNServerAddr.IsValid() || Size < 0 || Size > MAX_uint16)
 	{
-		// Use Send indication (RFC 5766 Section 10.1)
-		// This is less efficient but works without ChannelBind
-		UE_LOG(LogOnlineICE, Verbose, TEXT("Sending data through TURN using Send indication (channel not bound)"));
-		
-		// For now, we'll skip Send indication implementation and recommend using ChannelBind
-		// In production, you should implement Send indication here
 		return false;
 	}
+
+	// ChannelData format: Channel Number (2) | Length (2) | Application Data (variable)
+	Buffer[0] = (ChannelNumber >> 8) & 0xFF;
+	Buffer[1] = ChannelNumber & 0xFF;
+	Buffer[2] = (Size >> 8) & 0xFF;
+	Buffer[3] = Size & 0xFF;
+
+	int32 BytesSent;
+	return TURNSocket->SendTo(Buffer, SEND_HEADROOM + Size, BytesSent, *TURNServerAddr) && BytesSent == SEND_HEADROOM + Size;
 }
 
-bool FICEAgent::ReceiveDataFromTURN(uint8* Data, int32 MaxSize, int32& OutSize)
+bool FICEAgent::ReceiveDataFromTURN(uint8* Data, int32 MaxSize, int32& OutSize, uint16* OutChannelNumber)
 {
+	OutSize = 0;
+
 	if (!TURNSocket)
 	{
-		OutSize = 0;
 		return false;
 	}
 
@@ -2194,135 +5055,87 @@ bool FICEAgent::ReceiveDataFromTURN(uint8* Data, int32 MaxSize, int32& OutSize)
 	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
 	if (!SocketSubsystem)
 	{
-		OutSize = 0;
 		return false;
 	}
 	TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
 
 	if (!TURNSocket->RecvFrom(ReceiveBuffer, sizeof(ReceiveBuffer), BytesRead, *FromAddr))
 	{
-		OutSize = 0;
 		return false;
 	}
 
+	// Responses to pending Refresh/CreatePermission/ChannelBind transactions carry no payload
+	if (HandleTURNResponse(ReceiveBuffer, BytesRead))
+	{
+		return false;
+	}
+
+	int32 PayloadOffset = 0;
+	int32 PayloadSize = 0;
+	if (!UnwrapTURNPacket(ReceiveBuffer, BytesRead, PayloadOffset, PayloadSize, OutChannelNumber) || PayloadSize > MaxSize)
+	{
+		return false;
+	}
+
+	FMemory::Memcpy(Data, &ReceiveBuffer[PayloadOffset], PayloadSize);
+	OutSize = PayloadSize;
+	return true;
+}
+
+bool FICEAgent::UnwrapTURNPacket(const uint8* Buffer, int32 BytesRead, int32& OutOffset, int32& OutSize, uint16* OutChannelNumber) const
+{
 	if (BytesRead < 4)
 	{
-		OutSize = 0;
 		return false;
 	}
 
 	// Check if this is ChannelData (first two bits are 01)
-	if ((ReceiveBuffer[0] & STUNConstants::PACKET_TYPE_MASK) == STUNConstants::PACKET_TYPE_CHANNEL_DATA)
+	if ((Buffer[0] & STUNConstants::PACKET_TYPE_MASK) == STUNConstants::PACKET_TYPE_CHANNEL_DATA)
 	{
-		// ChannelData format
-		uint16 ChannelNumber = (ReceiveBuffer[0] << 8) | ReceiveBuffer[1];
-		uint16 DataLength = (ReceiveBuffer[2] << 8) | ReceiveBuffer[3];
+		// ChannelData format: Channel Number (2) | Length (2) | Application Data (variable)
+		uint16 ChannelNumber = (Buffer[0] << 8) | Buffer[1];
+		uint16 DataLength = (Buffer[2] << 8) | Buffer[3];
 		
-		if (BytesRead >= 4 + DataLength && DataLength <= MaxSize)
+		if (BytesRead >= 4 + DataLength)
 		{
-			FMemory::Memcpy(Data, &ReceiveBuffer[4], DataLength);
+			OutOffset = 4;
 			OutSize = DataLength;
+			if (OutChannelNumber)
+			{
+				*OutChannelNumber = ChannelNumber;
+			}
 			return true;
 		}
 	}
 	// Check if this is a STUN message (first two bits are 00)
-	else if ((ReceiveBuffer[0] & STUNConstants::PACKET_TYPE_MASK) == STUNConstants::PACKET_TYPE_STUN)
+	else if ((Buffer[0] & STUNConstants::PACKET_TYPE_MASK) == STUNConstants::PACKET_TYPE_STUN)
 	{
-		// This could be a Data indication (0x0017)
-		uint16 MessageType = (ReceiveBuffer[0] << 8) | ReceiveBuffer[1];
-		if (MessageType == 0x0017) // Data indication
+		// This could be a Data indication, carrying the sending peer and the payload
+		FSTUNMessageView Message;
+		if (Message.Parse(Buffer, BytesRead) && Message.GetMessageType() == STUNMessageType::DATA_INDICATION)
 		{
-			// Parse DATA attribute (0x0013)
-			int32 AttrOffset = 20;
-			while (AttrOffset < BytesRead)
+			const TArrayView<const uint8> Payload = Message.FindAttribute(STUNAttribute::DATA);
+			if (Payload.Num() == 0)
 			{
-				if (AttrOffset + 4 > BytesRead) break;
-				
-				uint16 AttrType = (ReceiveBuffer[AttrOffset] << 8) | ReceiveBuffer[AttrOffset + 1];
-				uint16 AttrLength = (ReceiveBuffer[AttrOffset + 2] << 8) | ReceiveBuffer[AttrOffset + 3];
-				
-				if (AttrType == 0x0013) // DATA
-				{
-					if (AttrOffset + 4 + AttrLength <= BytesRead && AttrLength <= MaxSize)
-					{
-						FMemory::Memcpy(Data, &ReceiveBuffer[AttrOffset + 4], AttrLength);
-						OutSize = AttrLength;
-						return true;
-					}
-				}
-				
-				AttrOffset += 4 + ((AttrLength + 3) & ~3);
+				return false;
 			}
-		}
-	}
-
-	OutSize = 0;
-	return false;
-}
-
-void FICEAgent::AppendTURNUsernameAttribute(TArray<uint8>& Buffer, int32& Offset, const FString& Username)
-{
-	// Add USERNAME attribute (0x0006)
-	int32 UsernameLen = Username.Len();
-	
-	// Calculate required space: 4 bytes header + username + padding to 4-byte boundary
-	int32 PaddingBytes = (4 - (UsernameLen % 4)) % 4;
-	int32 RequiredSpace = 4 + UsernameLen + PaddingBytes;
-	
-	// Ensure buffer has enough space
-	if (Offset + RequiredSpace > Buffer.Num())
-	{
-		UE_LOG(LogOnlineICE, Error, TEXT("Buffer too small for USERNAME attribute (needs %d bytes, has %d)"), 
-			Offset + RequiredSpace, Buffer.Num());
-		return;
-	}
-	
-	// Write attribute header
-	Buffer[Offset++] = 0x00;
-	Buffer[Offset++] = 0x06;
-	Buffer[Offset++] = (UsernameLen >> 8) & 0xFF;
-	Buffer[Offset++] = UsernameLen & 0xFF;
-	
-	// Add username string (uses implicit TCHAR to uint8 conversion)
-	// Note: TURN credentials should be ASCII-compatible as per RFC 5766
-	for (int32 i = 0; i < UsernameLen; i++)
-	{
-		Buffer[Offset++] = Username[i];
-	}
-	
-	// Pad to 4-byte boundary
-	for (int32 i = 0; i < PaddingBytes; i++)
-	{
-		Buffer[Offset++] = 0x00;
-	}
-}
 
-TArray<FICECandidate> FICEAgent::FilterCandidatesByType(const TArray<FICECandidate>& Candidates, EICECandidateType Type) const
-{
-	TArray<FICECandidate> Filtered;
-	for (const FICECandidate& Candidate : Candidates)
-	{
-		if (Candidate.Type == Type)
-		{
-			Filtered.Add(Candidate);
-		}
-	}
-	return Filtered;
-}
+			OutOffset = (int32)(Payload.GetData() - Buffer);
+			OutSize = Payload.Num();
 
-TArray<FICECandidate> FICEAgent::FilterCandidatesByTypes(const TArray<FICECandidate>& Candidates, const TArray<EICECandidateType>& Types) const
-{
-	TArray<FICECandidate> Filtered;
-	for (const FICECandidate& Candidate : Candidates)
-	{
-		for (const EICECandidateType& Type : Types)
-		{
-			if (Candidate.Type == Type)
+			// Map the sending peer to its relayed pair, Data indications carry no channel
+			FSTUNAddress PeerAddress;
+			if (OutChannelNumber && Message.GetXorAddress(STUNAttribute::XOR_PEER_ADDRESS, PeerAddress) && PeerAddress.IsIPv4())
 			{
-				Filtered.Add(Candidate);
-				break; // No need to check other types once we found a match
+				const int32 PairIndex = FindRelayedPairForPeer(PeerAddress.GetIPv4(), PeerAddress.Port);
+				if (PairIndex != INDEX_NONE)
+				{
+					*OutChannelNumber = CheckList[PairIndex].RelayChannel;
+				}
 			}
+			return true;
 		}
 	}
-	return Filtered;
+
+	return false;
 }
@@ -0,0 +1,460 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICEAgentPool.h"
+#include "ICEReceiveThread.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "STUNMessage.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+
+FICEAgentPool::FICEAgentPool(const FICEAgentConfig& InConfig)
+	: Config(InConfig)
+	, Socket(nullptr)
+	, NextReceiveAgent(0)
+	, UnroutedCount(0)
+{
+}
+
+FICEAgentPool::~FICEAgentPool()
+{
+	// Agents may outlive the pool (sessions and sockets hold them), detach them before the socket goes away
+	for (const TPair<FString, TSharedPtr<FICEAgent>>& AgentPair : Agents)
+	{
+		AgentPair.Value->OnConnectionStateChanged.RemoveAll(this);
+		AgentPair.Value->Close();
+	}
+	Agents.Empty();
+	ActiveAgents.Empty();
+	Routes.Empty();
+
+	DestroySharedSocket();
+}
+
+TSharedRef<FICEAgent> FICEAgentPool::CreateAgent(const FString& PeerId)
+{
+	if (const TSharedPtr<FICEAgent>* Existing = Agents.Find(PeerId))
+	{
+		return Existing->ToSharedRef();
+	}
+
+	TSharedRef<FICEAgent> Agent = MakeShared<FICEAgent>(Config);
+
+	// Without a shared socket the agent binds its own, it just can't share the port
+	// Only the default agent may keep its TURN allocation on the shared socket (one allocation per 5-tuple)
+	if (Socket || CreateSharedSocket())
+	{
+		Agent->AttachSharedSocket(Socket, PeerId.IsEmpty());
+	}
+
+	// The pool outlives the binding: the listener is removed in RemoveAgent and in the destructor
+	Agent->OnConnectionStateChanged.AddRaw(this, &FICEAgentPool::OnAgentStateChanged, TWeakPtr<FICEAgent>(Agent));
+
+	Agents.Add(PeerId, Agent);
+	UE_LOG(LogOnlineICE, Log, TEXT("ICE agent pool: created agent for peer '%s' (%d agents)"), *PeerId, Agents.Num());
+	return Agent;
+}
+
+TSharedPtr<FICEAgent> FICEAgentPool::FindAgent(const FString& PeerId) const
+{
+	const TSharedPtr<FICEAgent>* Agent = Agents.Find(PeerId);
+	return Agent ? *Agent : nullptr;
+}
+
+bool FICEAgentPool::RemoveAgent(const FString& PeerId)
+{
+	TSharedPtr<FICEAgent> Agent;
+	if (!Agents.RemoveAndCopyValue(PeerId, Agent))
+	{
+		return false;
+	}
+
+	Agent->OnConnectionStateChanged.RemoveAll(this);
+	ActiveAgents.Remove(Agent);
+	RemoveRoutes(Agent.Get());
+	Agent->Close();
+
+	UE_LOG(LogOnlineICE, Log, TEXT("ICE agent pool: removed agent for peer '%s' (%d agents)"), *PeerId, Agents.Num());
+	return true;
+}
+
+int32 FICEAgentPool::GetNumConnectedAgents() const
+{
+	int32 NumConnected = 0;
+	for (const TSharedPtr<FICEAgent>& Agent : ActiveAgents)
+	{
+		NumConnected += Agent->IsConnected() ? 1 : 0;
+	}
+	return NumConnected;
+}
+
+void FICEAgentPool::Tick(float DeltaTime)
+{
+	const double Now = FPlatformTime::Seconds();
+	for (auto It = BindingAnswerBudgets.CreateIterator(); It; ++It)
+	{
+		if (Now - It.Value().WindowStart >= BINDING_ANSWER_WINDOW)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	DispatchSharedSocket();
+
+	// Listeners fired from an agent Tick may add or remove agents, tick a snapshot
+	TArray<TSharedPtr<FICEAgent>, TInlineAllocator<16>> AgentsToTick(ActiveAgents);
+	for (const TSharedPtr<FICEAgent>& Agent : AgentsToTick)
+	{
+		Agent->Tick(DeltaTime);
+	}
+
+	// Idle agents sleep until their state changes again
+	for (int32 Index = ActiveAgents.Num() - 1; Index >= 0; --Index)
+	{
+		if (!ActiveAgents[Index]->IsActive())
+		{
+			RemoveRoutes(ActiveAgents[Index].Get());
+			ActiveAgents.RemoveAt(Index);
+		}
+	}
+}
+
+bool FICEAgentPool::ReceiveData(uint8* Data, int32 MaxSize, int32& OutSize, FInternetAddr& OutFromAddr)
+{
+	OutSize = 0;
+
+	// Agents already holding data are served first, the socket is only read once they are drained
+	for (int32 Pass = 0; Pass < 2; ++Pass)
+	{
+		const int32 NumAgents = ActiveAgents.Num();
+		for (int32 Offset = 0; Offset < NumAgents; ++Offset)
+		{
+			const int32 Index = (NextReceiveAgent + Offset) % NumAgents;
+			const TSharedPtr<FICEAgent> Agent = ActiveAgents[Index];
+			if (!Agent->IsConnected() || !Agent->ReceiveData(Data, MaxSize, OutSize))
+			{
+				continue;
+			}
+
+			NextReceiveAgent = Index + 1;
+			const FInternetAddr& RemoteAddr = *Agent->GetPeerAddress();
+			OutFromAddr.SetRawIp(RemoteAddr.GetRawIp());
+			OutFromAddr.SetPort(RemoteAddr.GetPort());
+			return true;
+		}
+
+		if (Pass == 0)
+		{
+			DispatchSharedSocket();
+		}
+	}
+
+	return false;
+}
+
+bool FICEAgentPool::SendDataTo(const FInternetAddr& Destination, const uint8* Data, int32 Size, EICESendPriority Priority)
+{
+	TSharedPtr<FICEAgent> Agent = FindConnectedAgent(Destination);
+	if (!Agent.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("ICE agent pool: no connected agent for %s"), *Destination.ToString(true));
+		return false;
+	}
+
+	return Agent->SendData(Data, Size, Priority);
+}
+
+void FICEAgentPool::FlushSends()
+{
+	for (const TSharedPtr<FICEAgent>& Agent : ActiveAgents)
+	{
+		if (Agent->IsConnected())
+		{
+			Agent->FlushSends();
+		}
+	}
+}
+
+bool FICEAgentPool::HasPendingData(uint32& PendingDataSize)
+{
+	PendingDataSize = 0;
+
+	for (int32 Pass = 0; Pass < 2; ++Pass)
+	{
+		for (const TSharedPtr<FICEAgent>& Agent : ActiveAgents)
+		{
+			if (Agent->HasPendingData(PendingDataSize))
+			{
+				return true;
+			}
+		}
+
+		if (Pass == 0)
+		{
+			DispatchSharedSocket();
+		}
+	}
+
+	return false;
+}
+
+TSharedPtr<FICEAgent> FICEAgentPool::FindConnectedAgent(const FInternetAddr& Addr) const
+{
+	for (const TSharedPtr<FICEAgent>& Agent : ActiveAgents)
+	{
+		if (Agent->IsConnected() && Agent->GetPeerAddress().IsValid() && *Agent->GetPeerAddress() == Addr)
+		{
+			return Agent;
+		}
+	}
+	return nullptr;
+}
+
+int32 FICEAgentPool::GetLocalPort() const
+{
+	return Socket ? Socket->GetPortNo() : 0;
+}
+
+void FICEAgentPool::GetLocalAddress(FInternetAddr& OutAddr) const
+{
+	if (Socket)
+	{
+		Socket->GetAddress(OutAddr);
+	}
+}
+
+bool FICEAgentPool::CreateSharedSocket()
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
+		return false;
+	}
+
+	// Every agent uses the same port on every interface (and both address families when IPv6 is enabled)
+	Socket = FICEAgent::CreateAgentSocket(TEXT("ICEPool"), Config.bEnableIPv6);
+	if (!Socket)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to create ICE pool socket"));
+		return false;
+	}
+
+	ReceiveFromAddr = SocketSubsystem->CreateInternetAddr();
+
+	if (Config.bUseIOThread && FPlatformProcess::SupportsMultithreading())
+	{
+		ReceiveRing = MakeUnique<FICEPacketRing>(Config.IOThreadRingCapacity);
+		ReceiveThread = MakeUnique<FICEReceiveThread>(Socket, *ReceiveRing);
+		if (!ReceiveThread->IsRunning())
+		{
+			ReceiveThread.Reset();
+			ReceiveRing.Reset();
+		}
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("ICE pool socket bound to port %d%s"), Socket->GetPortNo(),
+		ReceiveThread.IsValid() ? TEXT(" (receive thread)") : TEXT(""));
+	return true;
+}
+
+void FICEAgentPool::DestroySharedSocket()
+{
+	// Joins the thread, so the socket can be destroyed safely afterwards
+	ReceiveThread.Reset();
+	ReceiveRing.Reset();
+
+	if (Socket)
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		if (SocketSubsystem)
+		{
+			SocketSubsystem->DestroySocket(Socket);
+		}
+		Socket = nullptr;
+	}
+}
+
+void FICEAgentPool::DispatchSharedSocket()
+{
+	if (!Socket)
+	{
+		return;
+	}
+
+	if (ReceiveRing.IsValid())
+	{
+		for (int32 PacketCount = 0; PacketCount < MAX_DISPATCH_PER_TICK; ++PacketCount)
+		{
+			const FICEPacketSlot* Slot = ReceiveRing->BeginRead();
+			if (!Slot)
+			{
+				break;
+			}
+			RouteDatagram(Slot->Data, Slot->Size, Slot->FromAddr.ToSharedRef());
+			ReceiveRing->EndRead();
+		}
+		return;
+	}
+
+	uint8 ReceiveBuffer[FICEPacketSlot::MAX_PACKET_SIZE];
+	for (int32 PacketCount = 0; PacketCount < MAX_DISPATCH_PER_TICK; ++PacketCount)
+	{
+		uint32 PendingDataSize = 0;
+		if (!Socket->HasPendingData(PendingDataSize) || PendingDataSize == 0)
+		{
+			break;
+		}
+
+		int32 BytesRead = 0;
+		if (!Socket->RecvFrom(ReceiveBuffer, sizeof(ReceiveBuffer), BytesRead, *ReceiveFromAddr))
+		{
+			break;
+		}
+		RouteDatagram(ReceiveBuffer, BytesRead, ReceiveFromAddr.ToSharedRef());
+	}
+}
+
+void FICEAgentPool::RouteDatagram(const uint8* Data, int32 Size, const TSharedRef<FInternetAddr>& FromAddr)
+{
+	// STUN servers answer every agent from the same address (RFC 7983 first-byte class 0-3),
+	// their responses go to the agent that owns the transaction ID and are never remembered as a route
+	if (FSTUNMessageView::IsSTUNMessage(Data, Size))
+	{
+		for (const TSharedPtr<FICEAgent>& Agent : ActiveAgents)
+		{
+			if (Agent->AcceptsDatagramFrom(*FromAddr, Data, Size))
+			{
+				Agent->DeliverPacket(Data, Size, *FromAddr);
+				return;
+			}
+		}
+
+		if (AnswerBindingRequest(Data, Size, *FromAddr))
+		{
+			return;
+		}
+
+		++UnroutedCount;
+		UE_LOG(LogOnlineICE, Verbose, TEXT("ICE agent pool: dropping STUN message from %s, no agent owns its transaction"),
+			*FromAddr->ToString(true));
+		return;
+	}
+
+	// Known sender: one hash lookup
+	if (const TWeakPtr<FICEAgent>* Route = Routes.Find(FromAddr))
+	{
+		if (TSharedPtr<FICEAgent> Agent = Route->Pin())
+		{
+			Agent->DeliverPacket(Data, Size, *FromAddr);
+			return;
+		}
+	}
+
+	// Unknown sender: ask the agents that are running, remember the one that claims it
+	TSharedPtr<FICEAgent> Owner;
+	TSharedPtr<FICEAgent> OnlyChecking;
+	int32 NumChecking = 0;
+	for (const TSharedPtr<FICEAgent>& Agent : ActiveAgents)
+	{
+		if (Agent->AcceptsDatagramFrom(*FromAddr, Data, Size))
+		{
+			Owner = Agent;
+			break;
+		}
+
+		if (Agent->AreChecksInProgress() && !Agent->IsConnected())
+		{
+			OnlyChecking = Agent;
+			++NumChecking;
+		}
+	}
+
+	if (Owner.IsValid())
+	{
+		Routes.Add(FromAddr->Clone(), Owner);
+		Owner->DeliverPacket(Data, Size, *FromAddr);
+		return;
+	}
+
+	// A check from an address nobody signaled (peer reflexive) can only be attributed when a single agent is checking;
+	// it isn't remembered, the agent learns the address and claims it from then on
+	if (NumChecking == 1)
+	{
+		OnlyChecking->DeliverPacket(Data, Size, *FromAddr);
+		return;
+	}
+
+	++UnroutedCount;
+	UE_LOG(LogOnlineICE, Verbose, TEXT("ICE agent pool: dropping %d byte datagram from %s, it matches no agent (%d checking)"),
+		Size, *FromAddr->ToString(true), NumChecking);
+}
+
+bool FICEAgentPool::AnswerBindingRequest(const uint8* Data, int32 Size, const FInternetAddr& FromAddr)
+{
+	// Session pings (FICESessionPinger) are plain Binding requests, authenticated ones (USERNAME) are not for us
+	FSTUNMessageView Request;
+	if (!Request.Parse(Data, Size) || Request.GetMessageType() != STUNMessageType::BINDING_REQUEST
+		|| Request.HasAttribute(STUNAttribute::USERNAME))
+	{
+		return false;
+	}
+
+	// Budgeted per source IP, so a flood spoofing one victim can't crowd out genuine searchers
+	const FString Source = FromAddr.ToString(false);
+	FBindingAnswerBudget* Budget = BindingAnswerBudgets.Find(Source);
+	if (!Budget)
+	{
+		if (BindingAnswerBudgets.Num() >= MAX_BINDING_ANSWER_SOURCES)
+		{
+			return false;
+		}
+		Budget = &BindingAnswerBudgets.Add(Source);
+		Budget->WindowStart = FPlatformTime::Seconds();
+	}
+	if (Budget->NumAnswers >= MAX_BINDING_ANSWERS_PER_SOURCE)
+	{
+		return false;
+	}
+
+	FSTUNMessage Response(STUNMessageType::BINDING_SUCCESS, Request.GetTransactionID());
+	Response.AddXorAddress(STUNAttribute::XOR_MAPPED_ADDRESS, FromAddr);
+
+	int32 BytesSent = 0;
+	Socket->SendTo(Response.GetData(), Response.Num(), BytesSent, FromAddr);
+	++Budget->NumAnswers;
+	return true;
+}
+
+void FICEAgentPool::RemoveRoutes(const FICEAgent* Agent)
+{
+	for (auto It = Routes.CreateIterator(); It; ++It)
+	{
+		const TSharedPtr<FICEAgent> RouteAgent = It.Value().Pin();
+		if (!RouteAgent.IsValid() || RouteAgent.Get() == Agent)
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FICEAgentPool::MarkActive(const TSharedPtr<FICEAgent>& Agent)
+{
+	ActiveAgents.AddUnique(Agent);
+}
+
+void FICEAgentPool::OnAgentStateChanged(EICEConnectionState NewState, TWeakPtr<FICEAgent> WeakAgent)
+{
+	TSharedPtr<FICEAgent> Agent = WeakAgent.Pin();
+	if (!Agent.IsValid())
+	{
+		return;
+	}
+
+	// A new gathering pass serves a new peer, addresses learnt for the previous one no longer apply
+	if (NewState == EICEConnectionState::Gathering)
+	{
+		RemoveRoutes(Agent.Get());
+	}
+
+	MarkActive(Agent);
+}
@@ -0,0 +1,435 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICEBenchmark.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Policies/CondensedJsonPrintPolicy.h"
+#include "Policies/PrettyJsonPrintPolicy.h"
+
+namespace ICEBenchmarkRun
+{
+	/** Version of the JSON layout, bumped when fields change meaning */
+	constexpr int32 JSON_VERSION = 1;
+
+	/** Sleep between pumps, a fast frame; the simulated delays are far longer */
+	constexpr float PUMP_INTERVAL = 0.001f;
+
+	/** Receive buffer of the transfer, larger than any datagram */
+	constexpr int32 RECEIVE_BUFFER_SIZE = 65536;
+
+	/** Time after the transfer for datagrams still in flight to arrive, on top of two hops of delay (seconds) */
+	constexpr double DRAIN_MARGIN = 0.1;
+
+	/** Nearest-rank percentile of sorted samples */
+	float GetPercentile(const TArray<float>& Sorted, float Percentile)
+	{
+		if (Sorted.Num() == 0)
+		{
+			return 0.0f;
+		}
+		const int32 Rank = FMath::CeilToInt(Percentile / 100.0f * Sorted.Num()) - 1;
+		return Sorted[FMath::Clamp(Rank, 0, Sorted.Num() - 1)];
+	}
+
+	/** Count, mean and percentiles of samples */
+	TSharedRef<FJsonObject> MakeDistribution(const TArray<float>& Samples)
+	{
+		TArray<float> Sorted = Samples;
+		Sorted.Sort();
+
+		double Sum = 0.0;
+		for (const float Sample : Sorted)
+		{
+			Sum += Sample;
+		}
+
+		TSharedRef<FJsonObject> Json = MakeShared<FJsonObject>();
+		Json->SetNumberField(TEXT("count"), Sorted.Num());
+		Json->SetNumberField(TEXT("mean"), Sorted.Num() > 0 ? Sum / Sorted.Num() : 0.0);
+		Json->SetNumberField(TEXT("min"), Sorted.Num() > 0 ? Sorted[0] : 0.0f);
+		Json->SetNumberField(TEXT("p50"), GetPercentile(Sorted, 50.0f));
+		Json->SetNumberField(TEXT("p90"), GetPercentile(Sorted, 90.0f));
+		Json->SetNumberField(TEXT("p99"), GetPercentile(Sorted, 99.0f));
+		Json->SetNumberField(TEXT("max"), Sorted.Num() > 0 ? Sorted.Last() : 0.0f);
+		return Json;
+	}
+
+	/** Percentiles of samples on one line */
+	FString FormatDistribution(const TArray<float>& Samples)
+	{
+		TArray<float> Sorted = Samples;
+		Sorted.Sort();
+		return FString::Printf(TEXT("p50 %.1f, p90 %.1f, p99 %.1f, max %.1f"),
+			GetPercentile(Sorted, 50.0f), GetPercentile(Sorted, 90.0f), GetPercentile(Sorted, 99.0f), Sorted.Num() > 0 ? Sorted.Last() : 0.0f);
+	}
+
+	/** Signal an agent's server reflexive and relayed candidates to its peer, host candidates would bypass the NATs */
+	void SignalCandidates(const FICEAgent& From, FICEAgent& To)
+	{
+		for (const EICECandidateType Type : { EICECandidateType::ServerReflexive, EICECandidateType::Relayed })
+		{
+			for (const FICECandidate& Candidate : From.GetLocalCandidatesOfType(Type))
+			{
+				To.AddRemoteCandidate(Candidate);
+			}
+		}
+	}
+
+	/** Whether an agent's selected pair goes through a relay, on either side */
+	bool IsRelayed(const FICEAgent& Agent)
+	{
+		return Agent.GetSelectedLocalCandidate().Type == EICECandidateType::Relayed ||
+			Agent.GetSelectedRemoteCandidate().Type == EICECandidateType::Relayed;
+	}
+}
+
+float FICEBenchmarkResult::GetConnectTimePercentile(float Percentile) const
+{
+	TArray<float> Sorted = ConnectTimes;
+	Sorted.Sort();
+	return ICEBenchmarkRun::GetPercentile(Sorted, Percentile);
+}
+
+FString FICEBenchmarkScenario::GetName() const
+{
+	return FString::Printf(TEXT("%s-%s"), LexToString(ControllingNAT), LexToString(ControlledNAT));
+}
+
+TArray<FICEBenchmarkScenario> FICEBenchmarkSettings::GetDefaultScenarios()
+{
+	return {
+		FICEBenchmarkScenario(EICENATType::FullCone, EICENATType::FullCone),
+		FICEBenchmarkScenario(EICENATType::PortRestricted, EICENATType::PortRestricted),
+		FICEBenchmarkScenario(EICENATType::Symmetric, EICENATType::FullCone),
+		FICEBenchmarkScenario(EICENATType::Symmetric, EICENATType::PortRestricted),
+		FICEBenchmarkScenario(EICENATType::Symmetric, EICENATType::Symmetric)
+	};
+}
+
+FICEBenchmark::FICEBenchmark(const FICEBenchmarkSettings& InSettings)
+	: Settings(InSettings)
+	, LastPumpTime(0.0)
+{
+	if (Settings.Scenarios.Num() == 0)
+	{
+		Settings.Scenarios = FICEBenchmarkSettings::GetDefaultScenarios();
+	}
+	Settings.Trials = FMath::Max(Settings.Trials, 1);
+	Settings.TransferRate = FMath::Max(Settings.TransferRate, 1000.0f);
+	Settings.PayloadSize = FMath::Max(Settings.PayloadSize, 1);
+
+	// Ticked inline: a receive thread would add its scheduling to the measured times
+	Settings.AgentConfig.bUseIOThread = false;
+}
+
+bool FICEBenchmark::Run()
+{
+	UE_LOG(LogOnlineICE, Display, TEXT("ICE benchmark: %d scenarios x %d trials, latency %.0f ms +/- %.0f ms, loss %.1f%%"),
+		Settings.Scenarios.Num(), Settings.Trials, Settings.Conditions.Latency, Settings.Conditions.Jitter, Settings.Conditions.LossRate * 100.0f);
+
+	Results.Reset();
+	for (const FICEBenchmarkScenario& Scenario : Settings.Scenarios)
+	{
+		FICEBenchmarkResult& Result = Results.AddDefaulted_GetRef();
+		Result.Scenario = Scenario;
+
+		for (int32 Trial = 0; Trial < Settings.Trials; ++Trial)
+		{
+			// The first trial that connects carries the transfer
+			const bool bMeasureTransfer = !Result.bTransferred && Settings.TransferDuration > 0.0f;
+			if (!RunTrial(Trial, bMeasureTransfer, Result))
+			{
+				UE_LOG(LogOnlineICE, Error, TEXT("ICE benchmark: failed to start the network simulator"));
+				return false;
+			}
+		}
+
+		UE_LOG(LogOnlineICE, Display, TEXT("ICE benchmark: %s connected %d/%d"), *Scenario.GetName(),
+			Result.DirectConnections + Result.RelayedConnections, Result.Trials);
+	}
+	return true;
+}
+
+bool FICEBenchmark::RunTrial(int32 Trial, bool bMeasureTransfer, FICEBenchmarkResult& Result)
+{
+	FICENetworkSimulator Simulator(Settings.Conditions, Settings.Seed + Trial);
+	if (!Simulator.Start())
+	{
+		return false;
+	}
+
+	FICEAgentConfig Config = Settings.AgentConfig;
+	Config.STUNServers = { Simulator.GetServerAddress() };
+	Config.TURNServers = Config.STUNServers;
+	Config.TURNUsername = TEXT("benchmark");
+	Config.TURNCredential = TEXT("benchmark");
+
+	// Declared after the simulator: the agents release their allocations before its sockets close
+	TSharedRef<FICEAgent> ControllingAgent = MakeShared<FICEAgent>(Config);
+	TSharedRef<FICEAgent> ControlledAgent = MakeShared<FICEAgent>(Config);
+	FICEAgent& Controlling = *ControllingAgent;
+	FICEAgent& Controlled = *ControlledAgent;
+	Controlling.SetControlling(true);
+	Controlled.SetControlling(false);
+	++Result.Trials;
+
+	const double StartTime = FPlatformTime::Seconds();
+	LastPumpTime = StartTime;
+	if (!Controlling.GatherCandidates() || !Controlled.GatherCandidates())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("ICE benchmark: %s trial %d failed to start gathering"), *Result.Scenario.GetName(), Trial);
+		return true;
+	}
+
+	// The server requests already sent wait in the simulator's sockets until its first Tick
+	Simulator.AddHost(Controlling.GetLocalPort(), Result.Scenario.ControllingNAT);
+	Simulator.AddHost(Controlled.GetLocalPort(), Result.Scenario.ControlledNAT);
+
+	// Credentials travel in the offer, ahead of the candidates
+	Controlling.SetRemoteCredentials(Controlled.GetLocalUfrag(), Controlled.GetLocalPassword());
+	Controlled.SetRemoteCredentials(Controlling.GetLocalUfrag(), Controlling.GetLocalPassword());
+
+	bool bChecking = false;
+	bool bConnected = false;
+	while (FPlatformTime::Seconds() - StartTime < Settings.ConnectTimeout)
+	{
+		Pump(Simulator, Controlling, Controlled, Result.ConnectTickTimes);
+
+		if (!bChecking && !Controlling.IsGathering() && !Controlled.IsGathering())
+		{
+			Result.GatherTimes.Add((float)((FPlatformTime::Seconds() - StartTime) * 1000.0));
+			ICEBenchmarkRun::SignalCandidates(Controlling, Controlled);
+			ICEBenchmarkRun::SignalCandidates(Controlled, Controlling);
+
+			bChecking = Controlling.StartConnectivityChecks() && Controlled.StartConnectivityChecks();
+			if (!bChecking)
+			{
+				break;
+			}
+		}
+
+		if (Controlling.IsConnected() && Controlled.IsConnected())
+		{
+			bConnected = true;
+			break;
+		}
+	}
+
+	if (bConnected)
+	{
+		Result.ConnectTimes.Add((float)((FPlatformTime::Seconds() - StartTime) * 1000.0));
+
+		const bool bRelayed = ICEBenchmarkRun::IsRelayed(Controlling);
+		if (bRelayed)
+		{
+			++Result.RelayedConnections;
+		}
+		else
+		{
+			++Result.DirectConnections;
+		}
+
+		if (bMeasureTransfer)
+		{
+			Result.bTransferRelayed = bRelayed;
+			MeasureTransfer(Simulator, Controlling, Controlled, Result);
+		}
+	}
+	else
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("ICE benchmark: %s trial %d did not connect within %.0f seconds (%s)"),
+			*Result.Scenario.GetName(), Trial, Settings.ConnectTimeout, bChecking ? TEXT("checks failed") : TEXT("gathering did not finish"));
+	}
+
+	Result.LostDatagrams += Simulator.GetLostCount();
+	Result.FilteredDatagrams += Simulator.GetFilteredCount();
+	Result.RelayedDatagrams += Simulator.GetRelayedCount();
+	return true;
+}
+
+void FICEBenchmark::Pump(FICENetworkSimulator& Simulator, FICEAgent& Controlling, FICEAgent& Controlled, TArray<float>& TickTimes)
+{
+	Simulator.Tick();
+
+	const double Now = FPlatformTime::Seconds();
+	const float DeltaTime = (float)(Now - LastPumpTime);
+	LastPumpTime = Now;
+
+	for (FICEAgent* Agent : { &Controlling, &Controlled })
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		Agent->Tick(DeltaTime);
+		TickTimes.Add((float)(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1000.0));
+	}
+
+	FPlatformProcess::Sleep(ICEBenchmarkRun::PUMP_INTERVAL);
+}
+
+void FICEBenchmark::MeasureTransfer(FICENetworkSimulator& Simulator, FICEAgent& Controlling, FICEAgent& Controlled, FICEBenchmarkResult& Result)
+{
+	const int32 PayloadSize = FMath::Min(Settings.PayloadSize, Controlling.GetMaxPayloadSize());
+	TArray<uint8> Payload;
+	Payload.SetNumUninitialized(PayloadSize);
+	for (int32 Index = 0; Index < PayloadSize; ++Index)
+	{
+		Payload[Index] = (uint8)Index;
+	}
+
+	TArray<uint8> ReceiveBuffer;
+	ReceiveBuffer.SetNumUninitialized(ICEBenchmarkRun::RECEIVE_BUFFER_SIZE);
+	auto DrainReceived = [&Controlled, &ReceiveBuffer, &Result]()
+	{
+		int32 ReceivedSize;
+		while (Controlled.ReceiveData(ReceiveBuffer.GetData(), ReceiveBuffer.Num(), ReceivedSize))
+		{
+			++Result.ReceivedPackets;
+			Result.ReceivedBytes += ReceivedSize;
+		}
+	};
+
+	const uint32 StartAllocations = Controlling.GetSendAllocationCount() + Controlled.GetSendAllocationCount();
+	const double StartTime = FPlatformTime::Seconds();
+	const double EndTime = StartTime + Settings.TransferDuration;
+
+	for (double Now = StartTime; Now < EndTime; Now = FPlatformTime::Seconds())
+	{
+		// A steady offered rate, sent in bursts of whatever fell due since the last pump
+		const uint64 DuePackets = (uint64)((Now - StartTime) * Settings.TransferRate / PayloadSize);
+		while (Result.OfferedPackets < DuePackets)
+		{
+			++Result.OfferedPackets;
+			if (Controlling.SendData(Payload.GetData(), PayloadSize))
+			{
+				++Result.SentPackets;
+			}
+		}
+
+		Pump(Simulator, Controlling, Controlled, Result.TransferTickTimes);
+		DrainReceived();
+	}
+	Result.TransferTime = FPlatformTime::Seconds() - StartTime;
+
+	// Datagrams still in flight count once they had time to arrive (two hops through a relay)
+	const double DrainTime = 2.0 * (Settings.Conditions.Latency + Settings.Conditions.Jitter) / 1000.0 + ICEBenchmarkRun::DRAIN_MARGIN;
+	const double DrainEndTime = FPlatformTime::Seconds() + DrainTime;
+	while (FPlatformTime::Seconds() < DrainEndTime)
+	{
+		Pump(Simulator, Controlling, Controlled, Result.TransferTickTimes);
+		DrainReceived();
+	}
+
+	Result.SendAllocations = Controlling.GetSendAllocationCount() + Controlled.GetSendAllocationCount() - StartAllocations;
+	Result.bTransferred = true;
+}
+
+FString FICEBenchmark::ToJson(bool bPretty) const
+{
+	TSharedRef<FJsonObject> Json = MakeShared<FJsonObject>();
+	Json->SetNumberField(TEXT("version"), ICEBenchmarkRun::JSON_VERSION);
+	Json->SetStringField(TEXT("time"), FDateTime::UtcNow().ToIso8601());
+
+	TSharedRef<FJsonObject> SettingsJson = MakeShared<FJsonObject>();
+	SettingsJson->SetNumberField(TEXT("trials"), Settings.Trials);
+	SettingsJson->SetNumberField(TEXT("latencyMs"), Settings.Conditions.Latency);
+	SettingsJson->SetNumberField(TEXT("jitterMs"), Settings.Conditions.Jitter);
+	SettingsJson->SetNumberField(TEXT("loss"), Settings.Conditions.LossRate);
+	SettingsJson->SetNumberField(TEXT("seed"), Settings.Seed);
+	SettingsJson->SetNumberField(TEXT("connectTimeout"), Settings.ConnectTimeout);
+	SettingsJson->SetNumberField(TEXT("transferDuration"), Settings.TransferDuration);
+	SettingsJson->SetNumberField(TEXT("transferRate"), Settings.TransferRate);
+	SettingsJson->SetNumberField(TEXT("payloadSize"), Settings.PayloadSize);
+	SettingsJson->SetBoolField(TEXT("encrypt"), Settings.AgentConfig.bEncryptTraffic);
+	SettingsJson->SetBoolField(TEXT("coalesce"), Settings.AgentConfig.bCoalesceSends);
+	SettingsJson->SetBoolField(TEXT("pace"), Settings.AgentConfig.bPaceSends);
+	SettingsJson->SetBoolField(TEXT("fec"), Settings.AgentConfig.bEnableFEC);
+	Json->SetObjectField(TEXT("settings"), SettingsJson);
+
+	TArray<TSharedPtr<FJsonValue>> Scenarios;
+	for (const FICEBenchmarkResult& Result : Results)
+	{
+		TSharedRef<FJsonObject> ScenarioJson = MakeShared<FJsonObject>();
+		ScenarioJson->SetStringField(TEXT("name"), Result.Scenario.GetName());
+		ScenarioJson->SetStringField(TEXT("controllingNat"), LexToString(Result.Scenario.ControllingNAT));
+		ScenarioJson->SetStringField(TEXT("controlledNat"), LexToString(Result.Scenario.ControlledNAT));
+		ScenarioJson->SetNumberField(TEXT("trials"), Result.Trials);
+		ScenarioJson->SetNumberField(TEXT("connected"), Result.DirectConnections + Result.RelayedConnections);
+		ScenarioJson->SetNumberField(TEXT("direct"), Result.DirectConnections);
+		ScenarioJson->SetNumberField(TEXT("relayed"), Result.RelayedConnections);
+		ScenarioJson->SetObjectField(TEXT("gatherMs"), ICEBenchmarkRun::MakeDistribution(Result.GatherTimes));
+		ScenarioJson->SetObjectField(TEXT("connectMs"), ICEBenchmarkRun::MakeDistribution(Result.ConnectTimes));
+
+		TSharedRef<FJsonObject> TickJson = MakeShared<FJsonObject>();
+		TickJson->SetObjectField(TEXT("connecting"), ICEBenchmarkRun::MakeDistribution(Result.ConnectTickTimes));
+		TickJson->SetObjectField(TEXT("transfer"), ICEBenchmarkRun::MakeDistribution(Result.TransferTickTimes));
+		ScenarioJson->SetObjectField(TEXT("tickUs"), TickJson);
+
+		if (Result.bTransferred)
+		{
+			TSharedRef<FJsonObject> TransferJson = MakeShared<FJsonObject>();
+			TransferJson->SetStringField(TEXT("path"), Result.bTransferRelayed ? TEXT("relay") : TEXT("direct"));
+			TransferJson->SetNumberField(TEXT("seconds"), Result.TransferTime);
+			TransferJson->SetNumberField(TEXT("offeredPackets"), (double)Result.OfferedPackets);
+			TransferJson->SetNumberField(TEXT("sentPackets"), (double)Result.SentPackets);
+			TransferJson->SetNumberField(TEXT("receivedPackets"), (double)Result.ReceivedPackets);
+			TransferJson->SetNumberField(TEXT("receivedBytes"), (double)Result.ReceivedBytes);
+			TransferJson->SetNumberField(TEXT("goodputBytesPerSecond"), Result.GetGoodput());
+			TransferJson->SetNumberField(TEXT("allocationsPerPacket"), Result.GetAllocationsPerPacket());
+			ScenarioJson->SetObjectField(TEXT("transfer"), TransferJson);
+		}
+
+		TSharedRef<FJsonObject> NetworkJson = MakeShared<FJsonObject>();
+		NetworkJson->SetNumberField(TEXT("lost"), Result.LostDatagrams);
+		NetworkJson->SetNumberField(TEXT("filtered"), Result.FilteredDatagrams);
+		NetworkJson->SetNumberField(TEXT("relayed"), Result.RelayedDatagrams);
+		ScenarioJson->SetObjectField(TEXT("network"), NetworkJson);
+
+		Scenarios.Add(MakeShared<FJsonValueObject>(ScenarioJson));
+	}
+	Json->SetArrayField(TEXT("scenarios"), Scenarios);
+
+	FString Text;
+	if (bPretty)
+	{
+		const TSharedRef<TJsonWriter<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create(&Text);
+		FJsonSerializer::Serialize(Json, Writer);
+	}
+	else
+	{
+		const TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Text);
+		FJsonSerializer::Serialize(Json, Writer);
+	}
+	return Text;
+}
+
+bool FICEBenchmark::SaveJson(const FString& Path) const
+{
+	return FFileHelper::SaveStringToFile(ToJson(true), *Path);
+}
+
+FString FICEBenchmark::MakeOutputPath(const FString& Name)
+{
+	return FPaths::ProjectSavedDir() / TEXT("ICEBenchmark") / FString::Printf(TEXT("%s-%s.json"), *Name, *FDateTime::Now().ToString());
+}
+
+void FICEBenchmark::Dump(FOutputDevice& Ar) const
+{
+	for (const FICEBenchmarkResult& Result : Results)
+	{
+		Ar.Logf(TEXT("%s: connected %d/%d (%d direct, %d relayed)"), *Result.Scenario.GetName(),
+			Result.DirectConnections + Result.RelayedConnections, Result.Trials, Result.DirectConnections, Result.RelayedConnections);
+		Ar.Logf(TEXT("  Connect ms: %s"), *ICEBenchmarkRun::FormatDistribution(Result.ConnectTimes));
+		Ar.Logf(TEXT("  Tick us: connecting %s"), *ICEBenchmarkRun::FormatDistribution(Result.ConnectTickTimes));
+		if (Result.bTransferred)
+		{
+			Ar.Logf(TEXT("  Tick us: transfer %s"), *ICEBenchmarkRun::FormatDistribution(Result.TransferTickTimes));
+			Ar.Logf(TEXT("  Transfer (%s): %.0f B/s, %llu of %llu datagrams received, %.3f allocations per datagram"),
+				Result.bTransferRelayed ? TEXT("relay") : TEXT("direct"), Result.GetGoodput(),
+				Result.ReceivedPackets, Result.OfferedPackets, Result.GetAllocationsPerPacket());
+		}
+		Ar.Logf(TEXT("  Network: %u lost, %u filtered, %u relayed"), Result.LostDatagrams, Result.FilteredDatagrams, Result.RelayedDatagrams);
+	}
+}
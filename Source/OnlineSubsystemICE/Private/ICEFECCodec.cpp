@@ -0,0 +1,305 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICEFECCodec.h"
+#include "OnlineSubsystemICEPackage.h"
+
+namespace FECFlags
+{
+	/** The group ends with a parity packet */
+	constexpr uint8 HAS_PARITY = 0x01;
+}
+
+FICEFECCodec::FICEFECCodec(float InMinLossRate, int32 InMaxGroupSize)
+	: MinLossRate(FMath::Max(InMinLossRate, 0.0f))
+	, MaxGroupSize(FMath::Clamp(InMaxGroupSize, MIN_GROUP_SIZE, MAX_GROUP_SIZE))
+	, SendParitySize(0)
+	, SendLengthXOR(0)
+	, SendGroup(0)
+	, SendGroupSize(0)
+	, SendIndex(0)
+	, bSendParity(false)
+	, RecoveredSize(0)
+	, bHasRecovered(false)
+	, PathLossEstimate(0.0f)
+	, ReceiveLossEstimate(0.0f)
+	, ParitySentCount(0)
+	, RecoveredCount(0)
+	, UnrecoveredCount(0)
+{
+	Reset();
+}
+
+void FICEFECCodec::StartSendGroup()
+{
+	const float LossEstimate = GetLossEstimate();
+	const bool bPreviousParity = bSendParity;
+	const int32 PreviousGroupSize = SendGroupSize;
+
+	bSendParity = LossEstimate >= MinLossRate && LossEstimate > 0.0f;
+	SendGroupSize = bSendParity ? FMath::Clamp(FMath::FloorToInt(REDUNDANCY_SCALE / LossEstimate), MIN_GROUP_SIZE, MaxGroupSize) : MaxGroupSize;
+	SendIndex = 0;
+	SendParitySize = 0;
+	SendLengthXOR = 0;
+
+	if (bSendParity != bPreviousParity || (bSendParity && SendGroupSize != PreviousGroupSize))
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("FEC: loss estimate %.1f%%, %s"), LossEstimate * 100.0f,
+			bSendParity ? *FString::Printf(TEXT("one parity packet per %d datagrams"), SendGroupSize) : TEXT("no parity"));
+	}
+}
+
+bool FICEFECCodec::EncodePacket(const uint8* Payload, int32 Size, uint8* OutHeader)
+{
+	OutHeader[0] = DATA_MARKER;
+
+	// Too large to fold into parity, sent outside the groups
+	if (Size > MAX_PROTECTED_SIZE)
+	{
+		FMemory::Memzero(OutHeader + 1, HEADER_SIZE - 1);
+		return false;
+	}
+
+	if (SendIndex == 0)
+	{
+		StartSendGroup();
+	}
+
+	OutHeader[1] = (SendGroup >> 8) & 0xFF;
+	OutHeader[2] = SendGroup & 0xFF;
+	OutHeader[3] = (uint8)SendIndex;
+	OutHeader[4] = (uint8)SendGroupSize;
+	OutHeader[5] = bSendParity ? FECFlags::HAS_PARITY : 0;
+
+	if (bSendParity)
+	{
+		FoldPayload(SendAccumulator, SendParitySize, Payload, Size);
+		SendLengthXOR ^= (uint16)Size;
+	}
+
+	if (++SendIndex < SendGroupSize)
+	{
+		return false;
+	}
+	if (bSendParity)
+	{
+		return true;
+	}
+
+	++SendGroup;
+	SendIndex = 0;
+	return false;
+}
+
+int32 FICEFECCodec::BuildParity(uint8* OutPacket)
+{
+	OutPacket[0] = PARITY_MARKER;
+	OutPacket[1] = (SendGroup >> 8) & 0xFF;
+	OutPacket[2] = SendGroup & 0xFF;
+	OutPacket[3] = (uint8)SendGroupSize;
+	OutPacket[4] = (SendLengthXOR >> 8) & 0xFF;
+	OutPacket[5] = SendLengthXOR & 0xFF;
+	FMemory::Memcpy(OutPacket + HEADER_SIZE, SendAccumulator, SendParitySize);
+
+	const int32 PacketSize = HEADER_SIZE + SendParitySize;
+	++ParitySentCount;
+	++SendGroup;
+	SendIndex = 0;
+	return PacketSize;
+}
+
+EICEFECResult FICEFECCodec::Receive(const uint8* Datagram, int32 Size)
+{
+	if (Size < HEADER_SIZE || (Datagram[0] != DATA_MARKER && Datagram[0] != PARITY_MARKER))
+	{
+		return EICEFECResult::Invalid;
+	}
+
+	const uint16 Group = (uint16)((Datagram[1] << 8) | Datagram[2]);
+	const uint8* Payload = Datagram + HEADER_SIZE;
+	const int32 PayloadSize = Size - HEADER_SIZE;
+
+	if (Datagram[0] == DATA_MARKER)
+	{
+		const uint8 Index = Datagram[3];
+		const uint8 Count = Datagram[4];
+		const bool bHasParity = (Datagram[5] & FECFlags::HAS_PARITY) != 0;
+		if (Count == 0)
+		{
+			return EICEFECResult::Data;
+		}
+		if (Count > MAX_GROUP_SIZE || Index >= Count || PayloadSize > MAX_PROTECTED_SIZE)
+		{
+			return EICEFECResult::Invalid;
+		}
+
+		FReceiveGroup* Slot = FindReceiveGroup(Group, Count, bHasParity);
+		if (!Slot)
+		{
+			return EICEFECResult::Data;
+		}
+		if (Slot->Count != Count)
+		{
+			return EICEFECResult::Invalid;
+		}
+
+		// Already received, or already rebuilt from parity
+		const uint32 Bit = 1u << Index;
+		if (Slot->ReceivedMask & Bit)
+		{
+			return EICEFECResult::Consumed;
+		}
+		Slot->ReceivedMask |= Bit;
+		++Slot->ReceivedCount;
+
+		if (Slot->bHasParity)
+		{
+			FoldPayload(Slot->Accumulator, Slot->AccumulatedSize, Payload, PayloadSize);
+			Slot->LengthXOR ^= (uint16)PayloadSize;
+			TryRecover(*Slot);
+		}
+		return EICEFECResult::Data;
+	}
+
+	const uint8 Count = Datagram[3];
+	if (Count < MIN_GROUP_SIZE || Count > MAX_GROUP_SIZE || PayloadSize > MAX_PROTECTED_SIZE)
+	{
+		return EICEFECResult::Invalid;
+	}
+
+	FReceiveGroup* Slot = FindReceiveGroup(Group, Count, true);
+	if (!Slot || Slot->bParityReceived || !Slot->bHasParity || Slot->Count != Count)
+	{
+		return EICEFECResult::Consumed;
+	}
+	Slot->bParityReceived = true;
+	FoldPayload(Slot->Accumulator, Slot->AccumulatedSize, Payload, PayloadSize);
+	Slot->LengthXOR ^= (uint16)((Datagram[4] << 8) | Datagram[5]);
+	TryRecover(*Slot);
+	return EICEFECResult::Consumed;
+}
+
+FICEFECCodec::FReceiveGroup* FICEFECCodec::FindReceiveGroup(uint16 Group, uint8 Count, bool bHasParity)
+{
+	FReceiveGroup& Slot = ReceiveGroups[Group % RECEIVE_GROUPS];
+	if (Slot.bActive)
+	{
+		if (Slot.Group == Group)
+		{
+			return &Slot;
+		}
+		// Group ids wrap, a slot only moves forward
+		if ((int16)(Group - Slot.Group) < 0)
+		{
+			return nullptr;
+		}
+		FinishReceiveGroup(Slot);
+	}
+
+	Slot.AccumulatedSize = 0;
+	Slot.LengthXOR = 0;
+	Slot.Group = Group;
+	Slot.Count = Count;
+	Slot.ReceivedCount = 0;
+	Slot.ReceivedMask = 0;
+	Slot.bActive = true;
+	Slot.bHasParity = bHasParity;
+	Slot.bParityReceived = false;
+	Slot.bRecovered = false;
+	return &Slot;
+}
+
+void FICEFECCodec::FinishReceiveGroup(FReceiveGroup& Slot)
+{
+	const int32 Lost = Slot.Count - Slot.ReceivedCount;
+	const int32 Unrecovered = Lost - (Slot.bRecovered ? 1 : 0);
+	UnrecoveredCount += Unrecovered;
+	ReceiveLossEstimate += ((float)Lost / Slot.Count - ReceiveLossEstimate) * RECEIVE_LOSS_GAIN;
+	Slot.bActive = false;
+}
+
+void FICEFECCodec::FoldPayload(uint8* Accumulator, int32& AccumulatedSize, const uint8* Payload, int32 Size)
+{
+	if (Size > AccumulatedSize)
+	{
+		FMemory::Memzero(Accumulator + AccumulatedSize, Size - AccumulatedSize);
+		AccumulatedSize = Size;
+	}
+	for (int32 Index = 0; Index < Size; ++Index)
+	{
+		Accumulator[Index] ^= Payload[Index];
+	}
+}
+
+void FICEFECCodec::TryRecover(FReceiveGroup& Slot)
+{
+	if (!Slot.bParityReceived || Slot.bRecovered || Slot.ReceivedCount != Slot.Count - 1)
+	{
+		return;
+	}
+
+	// Everything but the missing datagram cancels out of the accumulator
+	const int32 Size = Slot.LengthXOR;
+	if (Size > Slot.AccumulatedSize)
+	{
+		UE_LOG(LogOnlineICE, VeryVerbose, TEXT("FEC: group %d parity doesn't match its datagrams"), Slot.Group);
+		return;
+	}
+
+	const uint32 Missing = ~Slot.ReceivedMask & ((Slot.Count < 32 ? (1u << Slot.Count) : 0u) - 1u);
+	Slot.ReceivedMask |= Missing;
+	Slot.bRecovered = true;
+
+	if (bHasRecovered)
+	{
+		UE_LOG(LogOnlineICE, VeryVerbose, TEXT("FEC: dropping rebuilt datagram that was never read"));
+	}
+	FMemory::Memcpy(Recovered, Slot.Accumulator, Size);
+	RecoveredSize = Size;
+	bHasRecovered = true;
+	++RecoveredCount;
+	UE_LOG(LogOnlineICE, VeryVerbose, TEXT("FEC: rebuilt a %d byte datagram of group %d"), Size, Slot.Group);
+}
+
+bool FICEFECCodec::PopRecovered(uint8* OutData, int32 Capacity, int32& OutSize)
+{
+	if (!bHasRecovered)
+	{
+		return false;
+	}
+	bHasRecovered = false;
+
+	if (!OutData || RecoveredSize > Capacity)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Dropping %d byte rebuilt datagram, receive buffer holds %d"), RecoveredSize, Capacity);
+		return false;
+	}
+
+	FMemory::Memcpy(OutData, Recovered, RecoveredSize);
+	OutSize = RecoveredSize;
+	return true;
+}
+
+void FICEFECCodec::AddLossSample(bool bLost)
+{
+	PathLossEstimate += ((bLost ? 1.0f : 0.0f) - PathLossEstimate) * PATH_LOSS_GAIN;
+}
+
+void FICEFECCodec::Reset()
+{
+	SendParitySize = 0;
+	SendLengthXOR = 0;
+	SendGroup = 0;
+	SendGroupSize = 0;
+	SendIndex = 0;
+	bSendParity = false;
+
+	for (FReceiveGroup& Slot : ReceiveGroups)
+	{
+		Slot.bActive = false;
+	}
+	RecoveredSize = 0;
+	bHasRecovered = false;
+
+	PathLossEstimate = 0.0f;
+	ReceiveLossEstimate = 0.0f;
+}
@@ -0,0 +1,96 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICENetDriver.h"
+#include "ICEAgent.h"
+#include "ICEAgentPool.h"
+#include "SocketICE.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "OnlineSessionInterfaceICE.h"
+#include "OnlineSubsystem.h"
+#include "SocketSubsystem.h"
+
+bool UICENetDriver::InitListen(FNetworkNotify* InNotify, FURL& LocalURL, bool bReuseAddressAndPort, FString& Error)
+{
+	// Peers of a hosted session connect after the listen socket is created
+	bListening = true;
+	return Super::InitListen(InNotify, LocalURL, bReuseAddressAndPort, Error);
+}
+
+FUniqueSocket UICENetDriver::CreateAndBindSocket(TSharedRef<FInternetAddr> BindAddr, int32 Port, bool bReuseAddressAndPort, int32 DesiredRecvSize, int32 DesiredSendSize, FString& Error)
+{
+	// A listen server serves every agent still running, a client needs its connection to be up already
+	TSharedPtr<FICEAgentPool> Pool = FindAgentPool();
+	const bool bUsePool = Pool.IsValid() && (bListening ? Pool->GetNumActiveAgents() > 0 : Pool->GetNumConnectedAgents() > 0);
+	if (!bUsePool)
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("ICENetDriver: no %s ICE agent, using a regular UDP socket"), bListening ? TEXT("active") : TEXT("connected"));
+		return Super::CreateAndBindSocket(BindAddr, Port, bReuseAddressAndPort, DesiredRecvSize, DesiredSendSize, Error);
+	}
+
+	// The platform socket subsystem deletes the facade; the pool keeps its socket
+	ISocketSubsystem* SocketSubsystem = GetSocketSubsystem();
+	if (!SocketSubsystem)
+	{
+		Error = TEXT("Unable to find socket subsystem");
+		return FUniqueSocket();
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("ICENetDriver: routing %s traffic through the ICE agent pool (port %d, %d agents connected)"),
+		*NetDriverName.ToString(), Pool->GetLocalPort(), Pool->GetNumConnectedAgents());
+	AgentPool = Pool;
+
+	FSocketICE* Socket = new FSocketICE(Pool.ToSharedRef(), TEXT("ICENetDriver"));
+	if (SendPriorityOverride.IsSet())
+	{
+		Socket->SetSendPriority(SendPriorityOverride.GetValue());
+	}
+	return FUniqueSocket(Socket, FSocketDeleter(SocketSubsystem));
+}
+
+void UICENetDriver::SetSendPriority(EICESendPriority Priority)
+{
+	SendPriorityOverride = Priority;
+	// AgentPool is only set once the socket is an FSocketICE
+	if (AgentPool.IsValid() && GetSocket())
+	{
+		static_cast<FSocketICE*>(GetSocket())->SetSendPriority(Priority);
+	}
+}
+
+void UICENetDriver::ClearSendPriority()
+{
+	SendPriorityOverride.Reset();
+	if (AgentPool.IsValid() && GetSocket())
+	{
+		static_cast<FSocketICE*>(GetSocket())->ClearSendPriority();
+	}
+}
+
+void UICENetDriver::TickFlush(float DeltaSeconds)
+{
+	Super::TickFlush(DeltaSeconds);
+
+	// The frame's replication is sent: coalesced datagrams leave now rather than on the next subsystem tick
+	if (TSharedPtr<FICEAgentPool> Pool = AgentPool.Pin())
+	{
+		Pool->FlushSends();
+	}
+}
+
+TSharedPtr<FICEAgentPool> UICENetDriver::FindAgentPool() const
+{
+	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get(FName(TEXT("ICE")));
+	if (!OnlineSub)
+	{
+		return nullptr;
+	}
+
+	IOnlineSessionPtr Sessions = OnlineSub->GetSessionInterface();
+	if (!Sessions.IsValid())
+	{
+		return nullptr;
+	}
+
+	FOnlineSessionICE* ICESession = static_cast<FOnlineSessionICE*>(Sessions.Get());
+	return ICESession->GetAgentPool();
+}
@@ -0,0 +1,504 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICENetworkSimulator.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "STUNMessage.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "IPAddress.h"
+
+namespace ICESimulator
+{
+	/** Lifetime granted to TURN allocations (seconds, RFC 5766 default) */
+	constexpr uint32 ALLOCATION_LIFETIME = 600;
+
+	/** Address of every simulated endpoint, host byte order */
+	constexpr uint32 LOOPBACK_IP = 0x7F000001;
+
+	/** Class bits of responses to a request (RFC 5389 Section 6) */
+	constexpr uint16 SUCCESS_CLASS = 0x0100;
+	constexpr uint16 ERROR_CLASS = 0x0110;
+
+	/** TURN channel numbers (RFC 5766 Section 11) */
+	constexpr uint16 CHANNEL_NUMBER_MIN = 0x4000;
+	constexpr uint16 CHANNEL_NUMBER_MAX = 0x7FFF;
+
+	/** Largest datagram read from a public socket */
+	constexpr int32 MAX_DATAGRAM_SIZE = 65536;
+
+	/** Receive buffer of the public sockets, a throughput run bursts many datagrams between two Ticks */
+	constexpr int32 SOCKET_BUFFER_SIZE = 4 * 1024 * 1024;
+
+	/** Orders the in-flight heap, earliest delivery on top */
+	struct FDeliveryOrder
+	{
+		template <typename DatagramType>
+		bool operator()(const DatagramType& A, const DatagramType& B) const
+		{
+			return A.DeliveryTime < B.DeliveryTime;
+		}
+	};
+}
+
+const TCHAR* LexToString(EICENATType NATType)
+{
+	switch (NATType)
+	{
+	case EICENATType::FullCone:
+		return TEXT("FullCone");
+	case EICENATType::PortRestricted:
+		return TEXT("PortRestricted");
+	case EICENATType::Symmetric:
+		return TEXT("Symmetric");
+	}
+	return TEXT("Unknown");
+}
+
+bool ParseNATType(const FString& Name, EICENATType& OutNATType)
+{
+	for (const EICENATType NATType : { EICENATType::FullCone, EICENATType::PortRestricted, EICENATType::Symmetric })
+	{
+		if (Name.Equals(LexToString(NATType), ESearchCase::IgnoreCase))
+		{
+			OutNATType = NATType;
+			return true;
+		}
+	}
+	return false;
+}
+
+FICENetworkSimulator::FICENetworkSimulator(const FICENetworkConditions& InConditions, int32 Seed)
+	: Conditions(InConditions)
+	, Random(Seed)
+	, ServerPort(0)
+	, DeliveredCount(0)
+	, LostCount(0)
+	, FilteredCount(0)
+	, RelayedCount(0)
+{
+	Conditions.Latency = FMath::Max(Conditions.Latency, 0.0f);
+	Conditions.Jitter = FMath::Max(Conditions.Jitter, 0.0f);
+	Conditions.LossRate = FMath::Clamp(Conditions.LossRate, 0.0f, 1.0f);
+	ReceiveBuffer.SetNumUninitialized(ICESimulator::MAX_DATAGRAM_SIZE);
+}
+
+FICENetworkSimulator::~FICENetworkSimulator()
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (SocketSubsystem)
+	{
+		for (const TPair<int32, FEndpoint>& Endpoint : Endpoints)
+		{
+			SocketSubsystem->DestroySocket(Endpoint.Value.Socket);
+		}
+	}
+	Endpoints.Reset();
+}
+
+bool FICENetworkSimulator::Start()
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to get socket subsystem"));
+		return false;
+	}
+
+	ScratchAddr = SocketSubsystem->CreateInternetAddr(FNetworkProtocolTypes::IPv4);
+	FromAddr = SocketSubsystem->CreateInternetAddr(FNetworkProtocolTypes::IPv4);
+	ServerPort = OpenEndpoint(EEndpointKind::Server, INDEX_NONE);
+	return ServerPort != 0;
+}
+
+FString FICENetworkSimulator::GetServerAddress() const
+{
+	return FString::Printf(TEXT("127.0.0.1:%d"), ServerPort);
+}
+
+void FICENetworkSimulator::AddHost(int32 PrivatePort, EICENATType NATType)
+{
+	FHost& Host = Hosts.AddDefaulted_GetRef();
+	Host.PrivatePort = PrivatePort;
+	Host.NATType = NATType;
+	HostsByPort.Add(PrivatePort, Hosts.Num() - 1);
+}
+
+FInternetAddr& FICENetworkSimulator::GetLoopbackAddr(int32 Port)
+{
+	ScratchAddr->SetLoopbackAddress();
+	ScratchAddr->SetPort(Port);
+	return *ScratchAddr;
+}
+
+int32 FICENetworkSimulator::OpenEndpoint(EEndpointKind Kind, int32 Index)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	FSocket* Socket = SocketSubsystem ? SocketSubsystem->CreateSocket(NAME_DGram, TEXT("ICESimulator"), FNetworkProtocolTypes::IPv4) : nullptr;
+	if (!Socket)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to create a simulated endpoint socket"));
+		return 0;
+	}
+
+	// Loopback only, nothing outside the process reaches the simulated network
+	if (!Socket->Bind(GetLoopbackAddr(0)))
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to bind a simulated endpoint socket"));
+		SocketSubsystem->DestroySocket(Socket);
+		return 0;
+	}
+	Socket->SetNonBlocking(true);
+
+	int32 ActualSize;
+	Socket->SetReceiveBufferSize(ICESimulator::SOCKET_BUFFER_SIZE, ActualSize);
+	Socket->SetSendBufferSize(ICESimulator::SOCKET_BUFFER_SIZE, ActualSize);
+
+	const int32 Port = Socket->GetPortNo();
+	FEndpoint& Endpoint = Endpoints.Add(Port);
+	Endpoint.Socket = Socket;
+	Endpoint.Kind = Kind;
+	Endpoint.Index = Index;
+	return Port;
+}
+
+int32 FICENetworkSimulator::GetMappingPort(int32 HostIndex, int32 RemotePort)
+{
+	// Only a symmetric NAT keys its mappings by destination
+	const FHost& Host = Hosts[HostIndex];
+	const int32 MappingRemotePort = Host.NATType == EICENATType::Symmetric ? RemotePort : 0;
+
+	for (const FMapping& Mapping : Mappings)
+	{
+		if (Mapping.HostIndex == HostIndex && Mapping.RemotePort == MappingRemotePort)
+		{
+			return Mapping.PublicPort;
+		}
+	}
+
+	const int32 PublicPort = OpenEndpoint(EEndpointKind::Mapping, Mappings.Num());
+	if (PublicPort == 0)
+	{
+		return 0;
+	}
+
+	FMapping& Mapping = Mappings.AddDefaulted_GetRef();
+	Mapping.HostIndex = HostIndex;
+	Mapping.PublicPort = PublicPort;
+	Mapping.RemotePort = MappingRemotePort;
+	UE_LOG(LogOnlineICE, Verbose, TEXT("Simulator: %s NAT maps port %d to %d"), LexToString(Host.NATType), Host.PrivatePort, PublicPort);
+	return PublicPort;
+}
+
+void FICENetworkSimulator::Tick()
+{
+	// Datagrams the agents sent since the last Tick
+	ReadPorts.Reset();
+	Endpoints.GetKeys(ReadPorts);
+	for (const int32 Port : ReadPorts)
+	{
+		FSocket* Socket = Endpoints[Port].Socket;
+		int32 BytesRead;
+		while (Socket->RecvFrom(ReceiveBuffer.GetData(), ReceiveBuffer.Num(), BytesRead, *FromAddr) && BytesRead > 0)
+		{
+			HandlePrivateDatagram(Port, FromAddr->GetPort(), ReceiveBuffer.GetData(), BytesRead);
+		}
+	}
+
+	// Deliveries may put new datagrams on the network (server responses, relayed data), due ones go out in this loop
+	const double Now = FPlatformTime::Seconds();
+	FInFlightDatagram Datagram;
+	while (InFlight.Num() > 0 && InFlight.HeapTop().DeliveryTime <= Now)
+	{
+		InFlight.HeapPop(Datagram, ICESimulator::FDeliveryOrder(), EAllowShrinking::No);
+		Deliver(Datagram.ToPort, Datagram.FromPort, Datagram.Data.GetData(), Datagram.Data.Num());
+	}
+}
+
+void FICENetworkSimulator::HandlePrivateDatagram(int32 ToPort, int32 SourcePort, const uint8* Data, int32 Size)
+{
+	const int32* HostIndex = HostsByPort.Find(SourcePort);
+	if (!HostIndex)
+	{
+		UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Simulator: dropping a datagram from unknown port %d"), SourcePort);
+		return;
+	}
+
+	const int32 PublicPort = GetMappingPort(*HostIndex, ToPort);
+	if (PublicPort == 0)
+	{
+		return;
+	}
+
+	// The destination may now answer through a filtering NAT
+	Mappings[Endpoints[PublicPort].Index].Contacted.Add(ToPort);
+	Send(ToPort, PublicPort, Data, Size);
+}
+
+void FICENetworkSimulator::Send(int32 ToPort, int32 FromPort, const uint8* Data, int32 Size)
+{
+	if (Conditions.LossRate > 0.0f && Random.GetFraction() < Conditions.LossRate)
+	{
+		++LostCount;
+		return;
+	}
+
+	const float Delay = Conditions.Jitter > 0.0f
+		? FMath::Max(0.0f, Conditions.Latency + Random.FRandRange(-Conditions.Jitter, Conditions.Jitter))
+		: Conditions.Latency;
+
+	FInFlightDatagram Datagram;
+	Datagram.DeliveryTime = FPlatformTime::Seconds() + Delay / 1000.0f;
+	Datagram.ToPort = ToPort;
+	Datagram.FromPort = FromPort;
+	Datagram.Data.Append(Data, Size);
+	InFlight.HeapPush(MoveTemp(Datagram), ICESimulator::FDeliveryOrder());
+}
+
+void FICENetworkSimulator::Deliver(int32 ToPort, int32 FromPort, const uint8* Data, int32 Size)
+{
+	const FEndpoint* Endpoint = Endpoints.Find(ToPort);
+	if (!Endpoint)
+	{
+		return;
+	}
+
+	if (Endpoint->Kind == EEndpointKind::Server)
+	{
+		HandleServerDatagram(FromPort, Data, Size);
+		return;
+	}
+	if (Endpoint->Kind == EEndpointKind::Relay)
+	{
+		HandleRelayDatagram(Allocations[Endpoint->Index], FromPort, Data, Size);
+		return;
+	}
+
+	const FMapping& Mapping = Mappings[Endpoint->Index];
+	const FHost& Host = Hosts[Mapping.HostIndex];
+	if (Host.NATType != EICENATType::FullCone && !Mapping.Contacted.Contains(FromPort))
+	{
+		++FilteredCount;
+		UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Simulator: %s NAT filtered a datagram from %d to %d"), LexToString(Host.NATType), FromPort, ToPort);
+		return;
+	}
+
+	// Sent from the socket of the public source, the address the agent would see
+	const FEndpoint* Source = Endpoints.Find(FromPort);
+	int32 BytesSent;
+	if (Source && Source->Socket->SendTo(Data, Size, BytesSent, GetLoopbackAddr(Host.PrivatePort)))
+	{
+		++DeliveredCount;
+	}
+}
+
+void FICENetworkSimulator::HandleServerDatagram(int32 FromPort, const uint8* Data, int32 Size)
+{
+	// ChannelData (first bits 01): the payload goes to the channel's peer
+	if (Size >= 4 && (Data[0] & 0xC0) == 0x40)
+	{
+		const int32* AllocationIndex = AllocationsByClient.Find(FromPort);
+		const uint16 Channel = (uint16)((Data[0] << 8) | Data[1]);
+		const int32 Length = (Data[2] << 8) | Data[3];
+		const int32* PeerPort = AllocationIndex ? Allocations[*AllocationIndex].Channels.Find(Channel) : nullptr;
+		if (!PeerPort || Length > Size - 4)
+		{
+			++FilteredCount;
+			return;
+		}
+
+		++RelayedCount;
+		Send(*PeerPort, Allocations[*AllocationIndex].RelayPort, Data + 4, Length);
+		return;
+	}
+
+	FSTUNMessageView Message;
+	if (!Message.Parse(Data, Size))
+	{
+		return;
+	}
+
+	switch (Message.GetMessageType())
+	{
+	case STUNMessageType::BINDING_REQUEST:
+	{
+		FSTUNMessage Response(STUNMessageType::BINDING_SUCCESS, Message.GetTransactionID());
+		Response.AddXorAddress(STUNAttribute::XOR_MAPPED_ADDRESS, GetLoopbackAddr(FromPort));
+		SendServerMessage(FromPort, Response);
+		break;
+	}
+
+	case STUNMessageType::ALLOCATE_REQUEST:
+	{
+		// A retransmitted Allocate gets the relay it already has
+		int32 AllocationIndex = INDEX_NONE;
+		if (const int32* Existing = AllocationsByClient.Find(FromPort))
+		{
+			AllocationIndex = *Existing;
+		}
+		else
+		{
+			const int32 RelayPort = OpenEndpoint(EEndpointKind::Relay, Allocations.Num());
+			if (RelayPort == 0)
+			{
+				SendErrorResponse(FromPort, Message, 508);
+				return;
+			}
+
+			AllocationIndex = Allocations.Num();
+			FAllocation& Allocation = Allocations.AddDefaulted_GetRef();
+			Allocation.ClientPort = FromPort;
+			Allocation.RelayPort = RelayPort;
+			AllocationsByClient.Add(FromPort, AllocationIndex);
+			UE_LOG(LogOnlineICE, Verbose, TEXT("Simulator: allocated relay port %d for client %d"), RelayPort, FromPort);
+		}
+
+		FSTUNMessage Response(STUNMessageType::ALLOCATE_SUCCESS, Message.GetTransactionID());
+		Response.AddXorAddress(STUNAttribute::XOR_RELAYED_ADDRESS, GetLoopbackAddr(Allocations[AllocationIndex].RelayPort));
+		Response.AddXorAddress(STUNAttribute::XOR_MAPPED_ADDRESS, GetLoopbackAddr(FromPort));
+		Response.AddUInt32(STUNAttribute::LIFETIME, ICESimulator::ALLOCATION_LIFETIME);
+		SendServerMessage(FromPort, Response);
+		break;
+	}
+
+	case STUNMessageType::REFRESH_REQUEST:
+	case STUNMessageType::CREATE_PERMISSION_REQUEST:
+	case STUNMessageType::CHANNEL_BIND_REQUEST:
+		HandleAllocationRequest(FromPort, Message);
+		break;
+
+	case STUNMessageType::SEND_INDICATION:
+	{
+		// Indications get no error response, anything unexpected is dropped (RFC 5766 Section 10.2)
+		const int32* AllocationIndex = AllocationsByClient.Find(FromPort);
+		FSTUNAddress PeerAddress;
+		if (!AllocationIndex || !Message.GetXorAddress(STUNAttribute::XOR_PEER_ADDRESS, PeerAddress) ||
+			!Allocations[*AllocationIndex].Permissions.Contains(PeerAddress.GetIPv4()))
+		{
+			++FilteredCount;
+			return;
+		}
+
+		const TArrayView<const uint8> Payload = Message.FindAttribute(STUNAttribute::DATA);
+		++RelayedCount;
+		Send(PeerAddress.Port, Allocations[*AllocationIndex].RelayPort, Payload.GetData(), Payload.Num());
+		break;
+	}
+
+	default:
+		if (Message.IsRequest())
+		{
+			SendErrorResponse(FromPort, Message, 400);
+		}
+		break;
+	}
+}
+
+void FICENetworkSimulator::HandleAllocationRequest(int32 FromPort, const FSTUNMessageView& Request)
+{
+	const int32* AllocationIndex = AllocationsByClient.Find(FromPort);
+	if (!AllocationIndex)
+	{
+		SendErrorResponse(FromPort, Request, 437);
+		return;
+	}
+	FAllocation& Allocation = Allocations[*AllocationIndex];
+
+	FSTUNMessage Response((uint16)(Request.GetMessageType() | ICESimulator::SUCCESS_CLASS), Request.GetTransactionID());
+	if (Request.GetMessageType() == STUNMessageType::REFRESH_REQUEST)
+	{
+		uint32 Lifetime = ICESimulator::ALLOCATION_LIFETIME;
+		Request.GetUInt32(STUNAttribute::LIFETIME, Lifetime);
+		Lifetime = FMath::Min(Lifetime, ICESimulator::ALLOCATION_LIFETIME);
+
+		// A zero lifetime releases the allocation (RFC 5766 Section 7.3)
+		if (Lifetime == 0)
+		{
+			Allocation.bActive = false;
+			AllocationsByClient.Remove(FromPort);
+			UE_LOG(LogOnlineICE, Verbose, TEXT("Simulator: released relay port %d"), Allocation.RelayPort);
+		}
+		Response.AddUInt32(STUNAttribute::LIFETIME, Lifetime);
+		SendServerMessage(FromPort, Response);
+		return;
+	}
+
+	FSTUNAddress PeerAddress;
+	if (!Request.GetXorAddress(STUNAttribute::XOR_PEER_ADDRESS, PeerAddress) || !PeerAddress.IsIPv4())
+	{
+		SendErrorResponse(FromPort, Request, 400);
+		return;
+	}
+
+	if (Request.GetMessageType() == STUNMessageType::CHANNEL_BIND_REQUEST)
+	{
+		// CHANNEL-NUMBER: channel + 2 reserved bytes
+		uint32 ChannelNumber = 0;
+		Request.GetUInt32(STUNAttribute::CHANNEL_NUMBER, ChannelNumber);
+		const uint16 Channel = (uint16)(ChannelNumber >> 16);
+		if (Channel < ICESimulator::CHANNEL_NUMBER_MIN || Channel > ICESimulator::CHANNEL_NUMBER_MAX)
+		{
+			SendErrorResponse(FromPort, Request, 400);
+			return;
+		}
+		Allocation.Channels.Add(Channel, PeerAddress.Port);
+		Allocation.PeerChannels.Add(PeerAddress.Port, Channel);
+	}
+
+	// Permissions are per IP, a channel binding installs one too
+	Allocation.Permissions.Add(PeerAddress.GetIPv4());
+	SendServerMessage(FromPort, Response);
+}
+
+void FICENetworkSimulator::HandleRelayDatagram(FAllocation& Allocation, int32 FromPort, const uint8* Data, int32 Size)
+{
+	// Every endpoint is 127.0.0.1: the first permission admits every peer
+	if (!Allocation.bActive || !Allocation.Permissions.Contains(ICESimulator::LOOPBACK_IP))
+	{
+		++FilteredCount;
+		return;
+	}
+	++RelayedCount;
+
+	// ChannelData if the peer has a channel: Channel Number (2) | Length (2) | Application Data
+	if (const uint16* Channel = Allocation.PeerChannels.Find(FromPort))
+	{
+		RelayBuffer.SetNumUninitialized(4 + Size, EAllowShrinking::No);
+		uint8* Buffer = RelayBuffer.GetData();
+		Buffer[0] = (*Channel >> 8) & 0xFF;
+		Buffer[1] = *Channel & 0xFF;
+		Buffer[2] = (Size >> 8) & 0xFF;
+		Buffer[3] = Size & 0xFF;
+		FMemory::Memcpy(Buffer + 4, Data, Size);
+		Send(Allocation.ClientPort, ServerPort, Buffer, RelayBuffer.Num());
+		return;
+	}
+
+	// Data indication otherwise: Header(20) | XOR-PEER-ADDRESS(4 + 8) | DATA(4 + padded payload)
+	const int32 MaxMessageSize = FSTUNMessage::HEADER_SIZE + 12 + 4 + ((Size + 3) & ~3);
+	RelayBuffer.SetNumUninitialized(MaxMessageSize, EAllowShrinking::No);
+
+	uint8 TransactionID[FSTUNMessage::TRANSACTION_ID_LENGTH];
+	FSTUNMessage::GenerateTransactionID(TransactionID);
+	FSTUNMessage Indication(STUNMessageType::DATA_INDICATION, TransactionID, RelayBuffer.GetData(), MaxMessageSize);
+	Indication.AddXorAddress(STUNAttribute::XOR_PEER_ADDRESS, GetLoopbackAddr(FromPort));
+	Indication.AddAttribute(STUNAttribute::DATA, Data, Size);
+	if (Indication.IsValid())
+	{
+		Send(Allocation.ClientPort, ServerPort, Indication.GetData(), Indication.Num());
+	}
+}
+
+void FICENetworkSimulator::SendServerMessage(int32 ToPort, const FSTUNMessage& Message)
+{
+	Send(ToPort, ServerPort, Message.GetData(), Message.Num());
+}
+
+void FICENetworkSimulator::SendErrorResponse(int32 ToPort, const FSTUNMessageView& Request, int32 ErrorCode)
+{
+	// ERROR-CODE: 21 reserved bits, class, number (RFC 5389 Section 15.6)
+	const uint8 Value[4] = { 0, 0, (uint8)(ErrorCode / 100), (uint8)(ErrorCode % 100) };
+
+	FSTUNMessage Response((uint16)(Request.GetMessageType() | ICESimulator::ERROR_CLASS), Request.GetTransactionID());
+	Response.AddAttribute(STUNAttribute::ERROR_CODE, Value, sizeof(Value));
+	SendServerMessage(ToPort, Response);
+}
@@ -0,0 +1,126 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICEOffer.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "Misc/Base64.h"
+
+namespace ICEOfferFormat
+{
+	constexpr uint8 MAGIC[2] = { 'I', 'O' };
+
+	/** Append a string as one length byte and its UTF-8 bytes */
+	bool WriteString(const FString& Value, TArray<uint8>& Out)
+	{
+		const FTCHARToUTF8 UTF8(*Value);
+		if (UTF8.Length() > 255)
+		{
+			return false;
+		}
+		Out.Add((uint8)UTF8.Length());
+		Out.Append((const uint8*)UTF8.Get(), UTF8.Length());
+		return true;
+	}
+
+	/** Read a string written by WriteString */
+	bool ReadString(const uint8* Data, int32 Size, int32& Offset, FString& OutValue)
+	{
+		if (Offset >= Size || Offset + 1 + Data[Offset] > Size)
+		{
+			return false;
+		}
+		const int32 Length = Data[Offset];
+		const FUTF8ToTCHAR TCHARValue((const ANSICHAR*)(Data + Offset + 1), Length);
+		OutValue = FString(TCHARValue.Length(), TCHARValue.Get());
+		Offset += 1 + Length;
+		return true;
+	}
+}
+
+FICEOffer FICEOffer::FromAgent(const FICEAgent& Agent)
+{
+	FICEOffer Offer;
+	Offer.Ufrag = Agent.GetLocalUfrag();
+	Offer.Password = Agent.GetLocalPassword();
+	Offer.Candidates = Agent.GetLocalCandidates();
+	return Offer;
+}
+
+bool FICEOffer::ToBinary(TArray<uint8>& Out) const
+{
+	Out.Reset();
+	Out.Append(ICEOfferFormat::MAGIC, UE_ARRAY_COUNT(ICEOfferFormat::MAGIC));
+	Out.Add(VERSION);
+	if (!ICEOfferFormat::WriteString(Ufrag, Out) || !ICEOfferFormat::WriteString(Password, Out))
+	{
+		Out.Reset();
+		return false;
+	}
+
+	const int32 CountOffset = Out.Num();
+	Out.Add(0);
+	int32 NumWritten = 0;
+	for (const FICECandidate& Candidate : Candidates)
+	{
+		if (NumWritten == MAX_CANDIDATES)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Offer full, %d candidates left out"), Candidates.Num() - NumWritten);
+			break;
+		}
+		if (Candidate.ToBinary(Out))
+		{
+			++NumWritten;
+		}
+		else
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Candidate left out of the offer: %s"), *Candidate.ToString());
+		}
+	}
+	Out[CountOffset] = (uint8)NumWritten;
+	return true;
+}
+
+bool FICEOffer::FromBinary(const uint8* Data, int32 Size, FICEOffer& OutOffer)
+{
+	const int32 HeaderSize = UE_ARRAY_COUNT(ICEOfferFormat::MAGIC) + 1;
+	if (!Data || Size < HeaderSize ||
+		FMemory::Memcmp(Data, ICEOfferFormat::MAGIC, UE_ARRAY_COUNT(ICEOfferFormat::MAGIC)) != 0 ||
+		Data[HeaderSize - 1] != VERSION)
+	{
+		return false;
+	}
+
+	FICEOffer Offer;
+	int32 Offset = HeaderSize;
+	if (!ICEOfferFormat::ReadString(Data, Size, Offset, Offer.Ufrag) ||
+		!ICEOfferFormat::ReadString(Data, Size, Offset, Offer.Password) ||
+		Offset >= Size)
+	{
+		return false;
+	}
+
+	const int32 NumCandidates = Data[Offset++];
+	Offer.Candidates.Reserve(NumCandidates);
+	for (int32 i = 0; i < NumCandidates; ++i)
+	{
+		FICECandidate& Candidate = Offer.Candidates.AddDefaulted_GetRef();
+		if (!FICECandidate::FromBinary(Data, Size, Offset, Candidate))
+		{
+			return false;
+		}
+	}
+
+	OutOffer = MoveTemp(Offer);
+	return true;
+}
+
+FString FICEOffer::ToBase64() const
+{
+	TArray<uint8> Binary;
+	return ToBinary(Binary) ? FBase64::Encode(Binary) : FString();
+}
+
+bool FICEOffer::FromBase64(const FString& Blob, FICEOffer& OutOffer)
+{
+	TArray<uint8> Binary;
+	return FBase64::Decode(Blob.TrimStartAndEnd(), Binary) && FromBinary(Binary.GetData(), Binary.Num(), OutOffer);
+}
@@ -0,0 +1,127 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICEReceiveThread.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "HAL/RunnableThread.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "IPAddress.h"
+
+FICEPacketRing::FICEPacketRing(int32 Capacity)
+	: Head(0)
+	, Tail(0)
+	, DroppedCount(0)
+{
+	const uint32 SlotCount = FMath::RoundUpToPowerOfTwo(FMath::Max(Capacity, 2));
+	Mask = SlotCount - 1;
+	Slots.SetNum(SlotCount);
+
+	// Sender addresses are allocated up front so the I/O thread never allocates
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (SocketSubsystem)
+	{
+		for (FICEPacketSlot& Slot : Slots)
+		{
+			Slot.FromAddr = SocketSubsystem->CreateInternetAddr();
+		}
+	}
+}
+
+FICEPacketSlot* FICEPacketRing::BeginWrite()
+{
+	const uint32 CurrentHead = Head.load(std::memory_order_relaxed);
+	if (CurrentHead - Tail.load(std::memory_order_acquire) > Mask)
+	{
+		return nullptr; // Full
+	}
+	return &Slots[CurrentHead & Mask];
+}
+
+void FICEPacketRing::EndWrite()
+{
+	Head.store(Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const FICEPacketSlot* FICEPacketRing::BeginRead() const
+{
+	const uint32 CurrentTail = Tail.load(std::memory_order_relaxed);
+	if (CurrentTail == Head.load(std::memory_order_acquire))
+	{
+		return nullptr; // Empty
+	}
+	return &Slots[CurrentTail & Mask];
+}
+
+void FICEPacketRing::EndRead()
+{
+	Tail.store(Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+FICEReceiveThread::FICEReceiveThread(FSocket* InSocket, FICEPacketRing& InRing)
+	: Socket(InSocket)
+	, Ring(InRing)
+	, Thread(nullptr)
+	, bStopping(false)
+{
+	Thread = FRunnableThread::Create(this, TEXT("ICEReceiveThread"), 0, TPri_AboveNormal);
+	if (!Thread)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Failed to create ICE receive thread, falling back to polling from Tick"));
+	}
+}
+
+FICEReceiveThread::~FICEReceiveThread()
+{
+	if (Thread)
+	{
+		// Kill calls Stop() and waits for Run() to return
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+}
+
+uint32 FICEReceiveThread::Run()
+{
+	// Scratch buffer used to drain datagrams that don't fit in a full ring
+	uint8 DiscardBuffer[FICEPacketSlot::MAX_PACKET_SIZE];
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	TSharedRef<FInternetAddr> DiscardAddr = SocketSubsystem->CreateInternetAddr();
+
+	while (!bStopping.load(std::memory_order_relaxed))
+	{
+		if (!Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(WAIT_TIME_MS)))
+		{
+			continue;
+		}
+
+		// Drain everything the kernel has queued
+		while (!bStopping.load(std::memory_order_relaxed))
+		{
+			FICEPacketSlot* Slot = Ring.BeginWrite();
+			if (!Slot)
+			{
+				int32 DiscardedBytes = 0;
+				if (!Socket->RecvFrom(DiscardBuffer, sizeof(DiscardBuffer), DiscardedBytes, *DiscardAddr))
+				{
+					break;
+				}
+				Ring.AddDropped();
+				continue;
+			}
+
+			if (!Socket->RecvFrom(Slot->Data, FICEPacketSlot::MAX_PACKET_SIZE, Slot->Size, *Slot->FromAddr) || Slot->Size <= 0)
+			{
+				break;
+			}
+			Ring.EndWrite();
+		}
+	}
+
+	return 0;
+}
+
+void FICEReceiveThread::Stop()
+{
+	bStopping.store(true, std::memory_order_relaxed);
+}
@@ -0,0 +1,344 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICESecureChannel.h"
+#include "OnlineSubsystemICEPackage.h"
+
+#define UI UI_ST
+THIRD_PARTY_INCLUDES_START
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+THIRD_PARTY_INCLUDES_END
+#undef UI
+
+namespace ICESecureChannel
+{
+	constexpr int32 HASH_SIZE = 32;
+
+	/** HMAC-SHA256 over the concatenation of up to three inputs */
+	bool HMACSHA256(const uint8* Key, int32 KeyLength, TArrayView<const TArrayView<const uint8>> Inputs, uint8* OutHash)
+	{
+		TArray<uint8, TInlineAllocator<128>> Data;
+		for (const TArrayView<const uint8>& Input : Inputs)
+		{
+			Data.Append(Input.GetData(), Input.Num());
+		}
+
+		unsigned int HashLength = 0;
+		return HMAC(EVP_sha256(), Key, KeyLength, Data.GetData(), Data.Num(), OutHash, &HashLength) != nullptr && HashLength == HASH_SIZE;
+	}
+
+	/** HKDF-Expand (RFC 5869) of one block, enough for a key or an IV */
+	bool ExpandLabel(const uint8* PRK, const char* Label, uint8* Out, int32 OutLength)
+	{
+		check(OutLength <= HASH_SIZE);
+		const uint8 Counter = 1;
+		const TArrayView<const uint8> Inputs[] =
+		{
+			TArrayView<const uint8>((const uint8*)Label, FCStringAnsi::Strlen(Label)),
+			TArrayView<const uint8>(&Counter, 1)
+		};
+
+		uint8 Block[HASH_SIZE];
+		if (!HMACSHA256(PRK, HASH_SIZE, Inputs, Block))
+		{
+			return false;
+		}
+		FMemory::Memcpy(Out, Block, OutLength);
+		FMemory::Memzero(Block, HASH_SIZE);
+		return true;
+	}
+
+	/** Create an AES-256-GCM context with its key schedule */
+	EVP_CIPHER_CTX* CreateCipher(const uint8* Key, int32 IVLength, bool bEncrypt)
+	{
+		EVP_CIPHER_CTX* Context = EVP_CIPHER_CTX_new();
+		if (!Context)
+		{
+			return nullptr;
+		}
+
+		const bool bReady = bEncrypt
+			? EVP_EncryptInit_ex(Context, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) == 1 &&
+			  EVP_CIPHER_CTX_ctrl(Context, EVP_CTRL_GCM_SET_IVLEN, IVLength, nullptr) == 1 &&
+			  EVP_EncryptInit_ex(Context, nullptr, nullptr, Key, nullptr) == 1
+			: EVP_DecryptInit_ex(Context, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) == 1 &&
+			  EVP_CIPHER_CTX_ctrl(Context, EVP_CTRL_GCM_SET_IVLEN, IVLength, nullptr) == 1 &&
+			  EVP_DecryptInit_ex(Context, nullptr, nullptr, Key, nullptr) == 1;
+		if (!bReady)
+		{
+			EVP_CIPHER_CTX_free(Context);
+			return nullptr;
+		}
+		return Context;
+	}
+}
+
+FICESecureChannel::FICESecureChannel()
+	: KeyPair(nullptr)
+	, SendContext(nullptr)
+	, ReceiveContext(nullptr)
+	, SendSequence(0)
+	, ReceiveSequenceMax(0)
+	, ReceiveWindow(0)
+	, bReceivedAny(false)
+	, bKeysControlling(false)
+	, bEstablished(false)
+	, RejectedRecordCount(0)
+{
+	FMemory::Memzero(LocalKeyShare, KEY_SHARE_SIZE);
+	FMemory::Memzero(RemoteKeyShare, KEY_SHARE_SIZE);
+}
+
+FICESecureChannel::~FICESecureChannel()
+{
+	Reset();
+}
+
+bool FICESecureChannel::EnsureKeyShare()
+{
+	if (KeyPair)
+	{
+		return true;
+	}
+
+	EVP_PKEY_CTX* Context = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, nullptr);
+	EVP_PKEY* NewKeyPair = nullptr;
+	const bool bGenerated = Context && EVP_PKEY_keygen_init(Context) == 1 && EVP_PKEY_keygen(Context, &NewKeyPair) == 1;
+	EVP_PKEY_CTX_free(Context);
+
+	size_t ShareLength = KEY_SHARE_SIZE;
+	if (!bGenerated || EVP_PKEY_get_raw_public_key(NewKeyPair, LocalKeyShare, &ShareLength) != 1 || ShareLength != KEY_SHARE_SIZE)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Failed to generate the X25519 key share of the secure channel"));
+		EVP_PKEY_free(NewKeyPair);
+		return false;
+	}
+
+	KeyPair = NewKeyPair;
+	return true;
+}
+
+bool FICESecureChannel::Establish(const uint8* InRemoteKeyShare, bool bControlling, const FString& LocalPassword, const FString& RemotePassword)
+{
+	if (bEstablished && bKeysControlling == bControlling && FMemory::Memcmp(RemoteKeyShare, InRemoteKeyShare, KEY_SHARE_SIZE) == 0)
+	{
+		return true;
+	}
+	if (!KeyPair || RemotePassword.IsEmpty())
+	{
+		return false;
+	}
+
+	// X25519 with the peer's share
+	uint8 SharedSecret[KEY_SHARE_SIZE] = {};
+	size_t SecretLength = KEY_SHARE_SIZE;
+	EVP_PKEY* PeerKey = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr, InRemoteKeyShare, KEY_SHARE_SIZE);
+	EVP_PKEY_CTX* DeriveContext = PeerKey ? EVP_PKEY_CTX_new(KeyPair, nullptr) : nullptr;
+	const bool bDerived = DeriveContext && EVP_PKEY_derive_init(DeriveContext) == 1 &&
+		EVP_PKEY_derive_set_peer(DeriveContext, PeerKey) == 1 &&
+		EVP_PKEY_derive(DeriveContext, SharedSecret, &SecretLength) == 1 && SecretLength == KEY_SHARE_SIZE;
+	EVP_PKEY_CTX_free(DeriveContext);
+	EVP_PKEY_free(PeerKey);
+
+	// A low-order share yields an all-zero secret (RFC 7748 Section 6.1)
+	uint8 SecretBits = 0;
+	for (int32 i = 0; i < KEY_SHARE_SIZE; ++i)
+	{
+		SecretBits |= SharedSecret[i];
+	}
+	if (!bDerived || SecretBits == 0)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Secure channel: invalid key share from the peer"));
+		return false;
+	}
+
+	// HKDF-Extract, the ICE passwords bind the keys to the credentials that signed the shares
+	const FTCHARToUTF8 LocalPasswordUTF8(*LocalPassword);
+	const FTCHARToUTF8 RemotePasswordUTF8(*RemotePassword);
+	const TArrayView<const uint8> LocalPasswordBytes((const uint8*)LocalPasswordUTF8.Get(), LocalPasswordUTF8.Length());
+	const TArrayView<const uint8> RemotePasswordBytes((const uint8*)RemotePasswordUTF8.Get(), RemotePasswordUTF8.Length());
+	const TArrayView<const uint8> Inputs[] =
+	{
+		TArrayView<const uint8>(SharedSecret, KEY_SHARE_SIZE),
+		bControlling ? LocalPasswordBytes : RemotePasswordBytes,
+		bControlling ? RemotePasswordBytes : LocalPasswordBytes
+	};
+	static const char Salt[] = "ICE secure channel";
+	uint8 PRK[ICESecureChannel::HASH_SIZE];
+	const bool bExtracted = ICESecureChannel::HMACSHA256((const uint8*)Salt, sizeof(Salt) - 1, Inputs, PRK);
+	FMemory::Memzero(SharedSecret, KEY_SHARE_SIZE);
+
+	// HKDF-Expand: one key and IV per direction, named after the role of the sender
+	uint8 SendKey[KEY_SIZE];
+	uint8 ReceiveKey[KEY_SIZE];
+	const bool bExpanded = bExtracted &&
+		ICESecureChannel::ExpandLabel(PRK, bControlling ? "controlling key" : "controlled key", SendKey, KEY_SIZE) &&
+		ICESecureChannel::ExpandLabel(PRK, bControlling ? "controlling iv" : "controlled iv", SendIV, IV_SIZE) &&
+		ICESecureChannel::ExpandLabel(PRK, bControlling ? "controlled key" : "controlling key", ReceiveKey, KEY_SIZE) &&
+		ICESecureChannel::ExpandLabel(PRK, bControlling ? "controlled iv" : "controlling iv", ReceiveIV, IV_SIZE);
+	FMemory::Memzero(PRK, sizeof(PRK));
+
+	ReleaseCiphers();
+	if (bExpanded)
+	{
+		SendContext = ICESecureChannel::CreateCipher(SendKey, IV_SIZE, true);
+		ReceiveContext = ICESecureChannel::CreateCipher(ReceiveKey, IV_SIZE, false);
+	}
+	FMemory::Memzero(SendKey, KEY_SIZE);
+	FMemory::Memzero(ReceiveKey, KEY_SIZE);
+
+	if (!SendContext || !ReceiveContext)
+	{
+		UE_LOG(LogOnlineICE, Error, TEXT("Secure channel: key derivation failed"));
+		ReleaseCiphers();
+		return false;
+	}
+
+	FMemory::Memcpy(RemoteKeyShare, InRemoteKeyShare, KEY_SHARE_SIZE);
+	SendSequence = 0;
+	ReceiveSequenceMax = 0;
+	ReceiveWindow = 0;
+	bReceivedAny = false;
+	bKeysControlling = bControlling;
+	bEstablished = true;
+	UE_LOG(LogOnlineICE, Log, TEXT("Secure channel established (AES-256-GCM, %s)"), bControlling ? TEXT("controlling") : TEXT("controlled"));
+	return true;
+}
+
+void FICESecureChannel::Reset()
+{
+	ReleaseCiphers();
+	if (KeyPair)
+	{
+		EVP_PKEY_free(KeyPair);
+		KeyPair = nullptr;
+	}
+	FMemory::Memzero(LocalKeyShare, KEY_SHARE_SIZE);
+	FMemory::Memzero(RemoteKeyShare, KEY_SHARE_SIZE);
+	SendSequence = 0;
+	ReceiveSequenceMax = 0;
+	ReceiveWindow = 0;
+	bReceivedAny = false;
+}
+
+void FICESecureChannel::ReleaseCiphers()
+{
+	EVP_CIPHER_CTX_free(SendContext);
+	EVP_CIPHER_CTX_free(ReceiveContext);
+	SendContext = nullptr;
+	ReceiveContext = nullptr;
+	FMemory::Memzero(SendIV, IV_SIZE);
+	FMemory::Memzero(ReceiveIV, IV_SIZE);
+	bEstablished = false;
+}
+
+void FICESecureChannel::MakeNonce(const uint8* IV, uint64 Sequence, uint8* OutNonce)
+{
+	FMemory::Memcpy(OutNonce, IV, IV_SIZE);
+	for (int32 i = 0; i < 8; ++i)
+	{
+		OutNonce[IV_SIZE - 1 - i] ^= (uint8)(Sequence >> (8 * i));
+	}
+}
+
+bool FICESecureChannel::GenerateRandomBytes(uint8* OutBytes, int32 Size)
+{
+	return RAND_bytes(OutBytes, Size) == 1;
+}
+
+bool FICESecureChannel::IsRecord(const uint8* Data, int32 Size)
+{
+	return Size >= RECORD_OVERHEAD && Data[0] == RECORD_TYPE;
+}
+
+int32 FICESecureChannel::Seal(uint8* Record, int32 PayloadSize)
+{
+	if (!bEstablished)
+	{
+		return 0;
+	}
+
+	const uint64 Sequence = SendSequence++;
+	Record[0] = RECORD_TYPE;
+	for (int32 i = 0; i < 8; ++i)
+	{
+		Record[1 + i] = (uint8)(Sequence >> (56 - 8 * i));
+	}
+
+	uint8 Nonce[IV_SIZE];
+	MakeNonce(SendIV, Sequence, Nonce);
+
+	uint8* Payload = Record + RECORD_HEADER_SIZE;
+	int32 Length = 0;
+	int32 FinalLength = 0;
+	if (EVP_EncryptInit_ex(SendContext, nullptr, nullptr, nullptr, Nonce) != 1 ||
+		EVP_EncryptUpdate(SendContext, nullptr, &Length, Record, RECORD_HEADER_SIZE) != 1 ||
+		EVP_EncryptUpdate(SendContext, Payload, &Length, Payload, PayloadSize) != 1 ||
+		EVP_EncryptFinal_ex(SendContext, Payload + Length, &FinalLength) != 1 ||
+		EVP_CIPHER_CTX_ctrl(SendContext, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, Payload + PayloadSize) != 1)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Secure channel: failed to seal record %llu"), Sequence);
+		return 0;
+	}
+
+	return PayloadSize + RECORD_OVERHEAD;
+}
+
+bool FICESecureChannel::Open(uint8* Record, int32 Size, int32& OutPayloadSize)
+{
+	OutPayloadSize = 0;
+	if (!bEstablished || !IsRecord(Record, Size))
+	{
+		++RejectedRecordCount;
+		return false;
+	}
+
+	uint64 Sequence = 0;
+	for (int32 i = 0; i < 8; ++i)
+	{
+		Sequence = (Sequence << 8) | Record[1 + i];
+	}
+
+	// Replays are dropped before any decryption work
+	const bool bNewer = !bReceivedAny || Sequence > ReceiveSequenceMax;
+	const uint64 Age = bNewer ? 0 : ReceiveSequenceMax - Sequence;
+	if (!bNewer && (Age >= REPLAY_WINDOW_SIZE || (ReceiveWindow & (1ull << Age)) != 0))
+	{
+		++RejectedRecordCount;
+		return false;
+	}
+
+	uint8 Nonce[IV_SIZE];
+	MakeNonce(ReceiveIV, Sequence, Nonce);
+
+	uint8* Payload = Record + RECORD_HEADER_SIZE;
+	const int32 PayloadSize = Size - RECORD_OVERHEAD;
+	int32 Length = 0;
+	int32 FinalLength = 0;
+	if (EVP_DecryptInit_ex(ReceiveContext, nullptr, nullptr, nullptr, Nonce) != 1 ||
+		EVP_DecryptUpdate(ReceiveContext, nullptr, &Length, Record, RECORD_HEADER_SIZE) != 1 ||
+		EVP_DecryptUpdate(ReceiveContext, Payload, &Length, Payload, PayloadSize) != 1 ||
+		EVP_CIPHER_CTX_ctrl(ReceiveContext, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, Payload + PayloadSize) != 1 ||
+		EVP_DecryptFinal_ex(ReceiveContext, Payload + Length, &FinalLength) != 1)
+	{
+		++RejectedRecordCount;
+		return false;
+	}
+
+	if (bNewer)
+	{
+		const uint64 Shift = bReceivedAny ? Sequence - ReceiveSequenceMax : 0;
+		ReceiveWindow = Shift >= REPLAY_WINDOW_SIZE ? 0 : ReceiveWindow << Shift;
+		ReceiveWindow |= 1;
+		ReceiveSequenceMax = Sequence;
+		bReceivedAny = true;
+	}
+	else
+	{
+		ReceiveWindow |= 1ull << Age;
+	}
+
+	OutPayloadSize = PayloadSize;
+	return true;
+}
@@ -0,0 +1,209 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICESendScheduler.h"
+#include "OnlineSubsystemICEPackage.h"
+
+namespace ICESendPacing
+{
+	/** Rate kept when the queuing delay is over target */
+	constexpr float DECREASE_FACTOR = 0.85f;
+
+	/** Largest growth per RTT sample, scaled down as the queuing delay nears the target */
+	constexpr float MAX_INCREASE_FACTOR = 0.25f;
+}
+
+FICESendScheduler::FICESendScheduler(float InInitialRate, float InMinRate, float InMaxRate, int32 InBurstSize, int32 InQueueLimit, float InTargetQueuingDelay)
+	: InitialRate(0.0f)
+	, MinRate(FMath::Max(InMinRate, 1000.0f))
+	, MaxRate(0.0f)
+	, BurstSize(FMath::Max(InBurstSize, 1500))
+	, QueueLimit(FMath::Max(InQueueLimit, 0))
+	, TargetQueuingDelay(FMath::Max(InTargetQueuingDelay, 0.001f))
+	, Rate(0.0f)
+	, Tokens(0.0)
+	, LastRefillTime(0.0)
+	, bRateLimited(false)
+	, CurrentWindowMinRTT(MAX_flt)
+	, PreviousWindowMinRTT(MAX_flt)
+	, WindowStartTime(0.0)
+	, QueuingDelay(0.0f)
+	, NumQueued(0)
+	, DelayedCount(0)
+	, DroppedCount(0)
+{
+	MaxRate = FMath::Max(InMaxRate, MinRate);
+	InitialRate = FMath::Clamp(InInitialRate, MinRate, MaxRate);
+	Reset();
+}
+
+void FICESendScheduler::Refill(double Now)
+{
+	Tokens = FMath::Min((double)BurstSize, Tokens + Rate * (Now - LastRefillTime));
+	LastRefillTime = Now;
+}
+
+bool FICESendScheduler::TryConsume(int32 WireSize, EICESendPriority Priority)
+{
+	// A datagram never overtakes one of its class, nor goes ahead of a higher class
+	for (int32 Class = 0; Class <= (int32)Priority; ++Class)
+	{
+		if (Queues[Class].Entries.Num() > Queues[Class].Head)
+		{
+			bRateLimited = true;
+			return false;
+		}
+	}
+
+	Refill(FPlatformTime::Seconds());
+	if (Tokens < 0.0)
+	{
+		bRateLimited = true;
+		return false;
+	}
+
+	Tokens -= WireSize;
+	return true;
+}
+
+bool FICESendScheduler::Enqueue(TArrayView<const TArrayView<const uint8>> Buffers, int32 WireSize, EICESendPriority Priority)
+{
+	FClassQueue& Queue = Queues[(int32)Priority];
+
+	int32 Size = 0;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		Size += Buffer.Num();
+	}
+	if (Queue.QueuedBytes + Size > QueueLimit)
+	{
+		++DroppedCount;
+		UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Pacer dropped a %d byte datagram of class %d, %d bytes queued"), Size, (int32)Priority, Queue.QueuedBytes);
+		return false;
+	}
+
+	FEntry& Entry = Queue.Entries.AddDefaulted_GetRef();
+	Entry.Offset = Queue.Storage.Num();
+	Entry.Size = Size;
+	Entry.WireSize = WireSize;
+	for (const TArrayView<const uint8>& Buffer : Buffers)
+	{
+		Queue.Storage.Append(Buffer.GetData(), Buffer.Num());
+	}
+
+	Queue.QueuedBytes += Size;
+	++NumQueued;
+	return true;
+}
+
+int32 FICESendScheduler::Drain(TFunctionRef<bool(TArrayView<const uint8>)> Send)
+{
+	if (NumQueued == 0)
+	{
+		return 0;
+	}
+
+	Refill(FPlatformTime::Seconds());
+
+	int32 NumSent = 0;
+	for (FClassQueue& Queue : Queues)
+	{
+		while (Queue.Head < Queue.Entries.Num() && Tokens >= 0.0)
+		{
+			const FEntry& Entry = Queue.Entries[Queue.Head++];
+			Tokens -= Entry.WireSize;
+			Queue.QueuedBytes -= Entry.Size;
+			--NumQueued;
+			++DelayedCount;
+			Send(TArrayView<const uint8>(Queue.Storage.GetData() + Entry.Offset, Entry.Size));
+			++NumSent;
+		}
+
+		// Storage and entries keep their allocation for the next burst
+		if (Queue.Head == Queue.Entries.Num())
+		{
+			Queue.Storage.Reset();
+			Queue.Entries.Reset();
+			Queue.Head = 0;
+		}
+		else if (Queue.Head > Queue.Entries.Num() / 2)
+		{
+			const int32 ConsumedBytes = Queue.Entries[Queue.Head].Offset;
+			Queue.Storage.RemoveAt(0, ConsumedBytes, EAllowShrinking::No);
+			Queue.Entries.RemoveAt(0, Queue.Head, EAllowShrinking::No);
+			for (FEntry& Entry : Queue.Entries)
+			{
+				Entry.Offset -= ConsumedBytes;
+			}
+			Queue.Head = 0;
+		}
+
+		if (Tokens < 0.0)
+		{
+			break;
+		}
+	}
+	return NumSent;
+}
+
+void FICESendScheduler::AddRTTSample(float RTT)
+{
+	const float RTTSeconds = RTT / 1000.0f;
+	const double Now = FPlatformTime::Seconds();
+
+	// Two rolling windows: a longer route after a path change becomes the base within BASE_RTT_WINDOW
+	if (Now - WindowStartTime >= BASE_RTT_WINDOW)
+	{
+		PreviousWindowMinRTT = CurrentWindowMinRTT;
+		CurrentWindowMinRTT = RTTSeconds;
+		WindowStartTime = Now;
+	}
+	else
+	{
+		CurrentWindowMinRTT = FMath::Min(CurrentWindowMinRTT, RTTSeconds);
+	}
+
+	const float BaseRTT = FMath::Min(CurrentWindowMinRTT, PreviousWindowMinRTT);
+	QueuingDelay = FMath::Max(0.0f, RTTSeconds - BaseRTT);
+
+	const float PreviousRate = Rate;
+	if (QueuingDelay > TargetQueuingDelay)
+	{
+		Rate = FMath::Max(MinRate, Rate * ICESendPacing::DECREASE_FACTOR);
+	}
+	else if (bRateLimited)
+	{
+		const float Headroom = 1.0f - QueuingDelay / TargetQueuingDelay;
+		Rate = FMath::Min(MaxRate, Rate * (1.0f + ICESendPacing::MAX_INCREASE_FACTOR * Headroom));
+	}
+	bRateLimited = false;
+
+	UE_LOG(LogOnlineICE, VeryVerbose, TEXT("Pacer: RTT %.1f ms, queuing delay %.1f ms, rate %.0f -> %.0f B/s"),
+		RTT, QueuingDelay * 1000.0f, PreviousRate, Rate);
+}
+
+void FICESendScheduler::OnLoss()
+{
+	Rate = FMath::Max(MinRate, Rate * 0.5f);
+	UE_LOG(LogOnlineICE, Verbose, TEXT("Pacer: consent check lost, rate down to %.0f B/s"), Rate);
+}
+
+void FICESendScheduler::Reset()
+{
+	for (FClassQueue& Queue : Queues)
+	{
+		Queue.Storage.Reset();
+		Queue.Entries.Reset();
+		Queue.Head = 0;
+		Queue.QueuedBytes = 0;
+	}
+	NumQueued = 0;
+
+	Rate = InitialRate;
+	Tokens = BurstSize;
+	LastRefillTime = FPlatformTime::Seconds();
+	bRateLimited = false;
+	CurrentWindowMinRTT = MAX_flt;
+	PreviousWindowMinRTT = MAX_flt;
+	WindowStartTime = LastRefillTime;
+	QueuingDelay = 0.0f;
+}
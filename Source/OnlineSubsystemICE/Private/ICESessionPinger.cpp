@@ -0,0 +1,325 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICESessionPinger.h"
+#include "ICEAgent.h"
+#include "ICEAddressResolver.h"
+#include "OnlineSessionInterfaceICE.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "STUNMessage.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "IPAddress.h"
+
+namespace ICESessionPing
+{
+	/** Key of a probe in the in-flight map */
+	uint32 GetKey(const uint8* TransactionID)
+	{
+		return ((uint32)TransactionID[0] << 24) | ((uint32)TransactionID[1] << 16) | ((uint32)TransactionID[2] << 8) | (uint32)TransactionID[3];
+	}
+}
+
+FICESessionPinger::FICESessionPinger(int32 InMaxInFlight, float InTimeout, bool bInDualStack)
+	: MaxInFlight(FMath::Max(InMaxInFlight, 1))
+	, Timeout(FMath::Max(InTimeout, 0.1f))
+	, bDualStack(bInDualStack)
+	, Socket(nullptr)
+	, QueueHead(0)
+{
+}
+
+FICESessionPinger::~FICESessionPinger()
+{
+	if (Socket)
+	{
+		if (ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM))
+		{
+			SocketSubsystem->DestroySocket(Socket);
+		}
+		Socket = nullptr;
+	}
+}
+
+bool FICESessionPinger::EnsureSocket()
+{
+	if (Socket)
+	{
+		return true;
+	}
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	Socket = SocketSubsystem ? FICEAgent::CreateAgentSocket(TEXT("ICEPing"), bDualStack) : nullptr;
+	if (!Socket)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Failed to create the session ping socket"));
+		return false;
+	}
+	ReceiveFromAddr = SocketSubsystem->CreateInternetAddr();
+	return true;
+}
+
+int32 FICESessionPinger::PingResults(const TSharedRef<FOnlineSessionSearch>& Search, int32 FirstResult, int32 NumResults)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem || !EnsureSocket())
+	{
+		return 0;
+	}
+
+	// IPv4 hosts are reached through IPv4-mapped addresses on a dual-stack socket
+	const bool bMapIPv4 = Socket->GetProtocol() == FNetworkProtocolTypes::IPv6;
+
+	int32 NumProbed = 0;
+	const int32 LastResult = FMath::Min(FirstResult + NumResults, Search->SearchResults.Num());
+	for (int32 ResultIndex = FMath::Max(FirstResult, 0); ResultIndex < LastResult; ++ResultIndex)
+	{
+		const FOnlineSession& Session = Search->SearchResults[ResultIndex].Session;
+		const FOnlineSessionInfoICE* SessionInfo = static_cast<const FOnlineSessionInfoICE*>(Session.SessionInfo.Get());
+		if (!SessionInfo || SessionInfo->GetPingAddresses().Num() == 0)
+		{
+			continue;
+		}
+
+		TSharedPtr<FTarget> Target = MakeShared<FTarget>();
+		Target->Search = Search;
+		Target->SessionId = SessionInfo->ToString();
+		Target->ResultIndex = ResultIndex;
+
+		for (const FString& Address : SessionInfo->GetPingAddresses())
+		{
+			FString Host;
+			int32 Port = 0;
+			FICEAddressResolver::ParseServerAddress(Address, Host, Port);
+			if (bMapIPv4 && !Host.Contains(TEXT(":")))
+			{
+				Host = TEXT("::ffff:") + Host;
+			}
+			TSharedPtr<FInternetAddr> Addr = SocketSubsystem->GetAddressFromString(Host);
+			if (!Addr.IsValid() || !Addr->IsValid() || (!bMapIPv4 && Addr->GetProtocolType() != FNetworkProtocolTypes::IPv4))
+			{
+				continue;
+			}
+			Addr->SetPort(Port);
+
+			FProbe& Probe = Queue.AddDefaulted_GetRef();
+			Probe.Target = Target;
+			Probe.Addr = Addr;
+			++Target->NumOutstanding;
+		}
+
+		if (Target->NumOutstanding > 0)
+		{
+			++NumProbed;
+		}
+	}
+
+	SendQueued();
+	return NumProbed;
+}
+
+void FICESessionPinger::CancelSearch(const FOnlineSessionSearch& Search)
+{
+	auto IsOfSearch = [&Search](const FProbe& Probe)
+	{
+		const TSharedPtr<FOnlineSessionSearch> ProbeSearch = Probe.Target->Search.Pin();
+		return !ProbeSearch.IsValid() || ProbeSearch.Get() == &Search;
+	};
+
+	for (auto It = InFlight.CreateIterator(); It; ++It)
+	{
+		if (IsOfSearch(It.Value()))
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	Queue.RemoveAt(0, QueueHead);
+	QueueHead = 0;
+	Queue.RemoveAll(IsOfSearch);
+}
+
+bool FICESessionPinger::IsPinging(const FOnlineSessionSearch& Search) const
+{
+	auto IsOfSearch = [&Search](const FProbe& Probe)
+	{
+		return Probe.Target->Search.Pin().Get() == &Search;
+	};
+
+	for (const TPair<uint32, FProbe>& Pair : InFlight)
+	{
+		if (IsOfSearch(Pair.Value))
+		{
+			return true;
+		}
+	}
+	for (int32 Index = QueueHead; Index < Queue.Num(); ++Index)
+	{
+		if (IsOfSearch(Queue[Index]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void FICESessionPinger::Tick(float DeltaTime)
+{
+	if (!Socket || (InFlight.Num() == 0 && GetNumQueued() == 0))
+	{
+		return;
+	}
+
+	// Answers first, so their RTT doesn't include the sends below
+	uint8 Buffer[512];
+	for (int32 Count = 0; Count < MAX_RECEIVE_PER_TICK; ++Count)
+	{
+		uint32 PendingDataSize = 0;
+		int32 BytesRead = 0;
+		if (!Socket->HasPendingData(PendingDataSize) || !Socket->RecvFrom(Buffer, sizeof(Buffer), BytesRead, *ReceiveFromAddr))
+		{
+			break;
+		}
+		HandleAnswer(Buffer, BytesRead, *ReceiveFromAddr);
+	}
+
+	// Timed out probes are resent once, then given up
+	const double Now = FPlatformTime::Seconds();
+	TArray<FProbe, TInlineAllocator<16>> Expired;
+	for (auto It = InFlight.CreateIterator(); It; ++It)
+	{
+		if (Now - It.Value().SentTime >= Timeout)
+		{
+			Expired.Add(MoveTemp(It.Value()));
+			It.RemoveCurrent();
+		}
+	}
+	for (FProbe& Probe : Expired)
+	{
+		if (Probe.Attempt < MAX_ATTEMPTS && !Probe.Target->bAnswered && Probe.Target->Search.IsValid())
+		{
+			if (SendProbe(MoveTemp(Probe)))
+			{
+				continue;
+			}
+		}
+		FinishProbe(Probe, -1.0);
+	}
+
+	SendQueued();
+}
+
+void FICESessionPinger::SendQueued()
+{
+	while (InFlight.Num() < MaxInFlight && QueueHead < Queue.Num())
+	{
+		FProbe Probe = MoveTemp(Queue[QueueHead++]);
+
+		// Another address of the result already answered
+		if (Probe.Target->bAnswered || !Probe.Target->Search.IsValid() || !SendProbe(MoveTemp(Probe)))
+		{
+			FinishProbe(Probe, -1.0);
+		}
+	}
+
+	if (QueueHead == Queue.Num())
+	{
+		Queue.Reset();
+		QueueHead = 0;
+	}
+}
+
+bool FICESessionPinger::SendProbe(FProbe&& Probe)
+{
+	// Keys must be unique among the probes in flight
+	do
+	{
+		FSTUNMessage::GenerateTransactionID(Probe.TransactionID);
+	}
+	while (InFlight.Contains(ICESessionPing::GetKey(Probe.TransactionID)));
+
+	FSTUNMessage Request(STUNMessageType::BINDING_REQUEST, Probe.TransactionID);
+	int32 BytesSent = 0;
+	if (!Socket->SendTo(Request.GetData(), Request.Num(), BytesSent, *Probe.Addr))
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Ping to %s could not be sent"), *Probe.Addr->ToString(true));
+		return false;
+	}
+
+	Probe.SentTime = FPlatformTime::Seconds();
+	++Probe.Attempt;
+	InFlight.Add(ICESessionPing::GetKey(Probe.TransactionID), MoveTemp(Probe));
+	return true;
+}
+
+void FICESessionPinger::HandleAnswer(const uint8* Data, int32 Size, const FInternetAddr& FromAddr)
+{
+	FSTUNMessageView Message;
+	if (!Message.Parse(Data, Size) || Message.GetMessageType() != STUNMessageType::BINDING_SUCCESS)
+	{
+		return;
+	}
+
+	// The transaction ID and the address it was sent to must both match
+	const uint32 Key = ICESessionPing::GetKey(Message.GetTransactionID());
+	FProbe* Probe = InFlight.Find(Key);
+	if (!Probe || !Message.HasTransactionID(Probe->TransactionID) || !(*Probe->Addr == FromAddr))
+	{
+		return;
+	}
+
+	FProbe Answered = MoveTemp(*Probe);
+	InFlight.Remove(Key);
+	FinishProbe(Answered, FPlatformTime::Seconds() - Answered.SentTime);
+}
+
+void FICESessionPinger::FinishProbe(const FProbe& Probe, double RTT)
+{
+	FTarget& Target = *Probe.Target;
+	--Target.NumOutstanding;
+
+	const TSharedPtr<FOnlineSessionSearch> Search = Target.Search.Pin();
+	if (!Search.IsValid())
+	{
+		return;
+	}
+
+	const bool bFirstAnswer = RTT >= 0.0 && !Target.bAnswered;
+	if (!bFirstAnswer && (Target.bAnswered || Target.NumOutstanding > 0))
+	{
+		return;
+	}
+
+	const int32 ResultIndex = FindResultIndex(*Search, Target);
+	if (ResultIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	if (bFirstAnswer)
+	{
+		Target.bAnswered = true;
+		Target.ResultIndex = ResultIndex;
+		Search->SearchResults[ResultIndex].PingInMs = FMath::Clamp(FMath::RoundToInt(RTT * 1000.0), 0, MAX_QUERY_PING - 1);
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Session %s answered in %d ms"), *Target.SessionId, Search->SearchResults[ResultIndex].PingInMs);
+	}
+	else
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Session %s did not answer any ping"), *Target.SessionId);
+	}
+
+	OnResultPinged.ExecuteIfBound(Search.ToSharedRef(), ResultIndex, bFirstAnswer);
+}
+
+int32 FICESessionPinger::FindResultIndex(const FOnlineSessionSearch& Search, const FTarget& Target)
+{
+	auto IsTarget = [&Target](const FOnlineSessionSearchResult& Result)
+	{
+		return Result.Session.SessionInfo.IsValid() && Result.Session.SessionInfo->ToString() == Target.SessionId;
+	};
+
+	if (Search.SearchResults.IsValidIndex(Target.ResultIndex) && IsTarget(Search.SearchResults[Target.ResultIndex]))
+	{
+		return Target.ResultIndex;
+	}
+	return Search.SearchResults.IndexOfByPredicate(IsTarget);
+}
@@ -0,0 +1,499 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICESessionRegistry.h"
+#include "OnlineSessionInterfaceICE.h"
+#include "OnlineIdentityInterfaceICE.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "HttpModule.h"
+#include "Interfaces/IHttpResponse.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Policies/CondensedJsonPrintPolicy.h"
+
+namespace ICESessionQuery
+{
+	/** SEARCH_PRESENCE, spelled out: the macro is deprecated in favour of SEARCH_LOBBIES but still sent by many games */
+	const FName PresenceSearchKey(TEXT("PRESENCESEARCH"));
+
+	/** Read any numeric (or bool) value as a double */
+	bool ToNumber(const FVariantData& Data, double& OutValue)
+	{
+		switch (Data.GetType())
+		{
+			case EOnlineKeyValuePairDataType::Int32: { int32 Value; Data.GetValue(Value); OutValue = Value; return true; }
+			case EOnlineKeyValuePairDataType::UInt32: { uint32 Value; Data.GetValue(Value); OutValue = Value; return true; }
+			case EOnlineKeyValuePairDataType::Int64: { int64 Value; Data.GetValue(Value); OutValue = (double)Value; return true; }
+			case EOnlineKeyValuePairDataType::UInt64: { uint64 Value; Data.GetValue(Value); OutValue = (double)Value; return true; }
+			case EOnlineKeyValuePairDataType::Float: { float Value; Data.GetValue(Value); OutValue = Value; return true; }
+			case EOnlineKeyValuePairDataType::Double: { Data.GetValue(OutValue); return true; }
+			case EOnlineKeyValuePairDataType::Bool: { bool Value; Data.GetValue(Value); OutValue = Value ? 1.0 : 0.0; return true; }
+			default: return false;
+		}
+	}
+
+	/** Wire name of a comparison operator */
+	const TCHAR* GetOpName(EOnlineComparisonOp::Type Op)
+	{
+		switch (Op)
+		{
+			case EOnlineComparisonOp::Equals: return TEXT("eq");
+			case EOnlineComparisonOp::NotEquals: return TEXT("ne");
+			case EOnlineComparisonOp::GreaterThan: return TEXT("gt");
+			case EOnlineComparisonOp::GreaterThanEquals: return TEXT("gte");
+			case EOnlineComparisonOp::LessThan: return TEXT("lt");
+			case EOnlineComparisonOp::LessThanEquals: return TEXT("lte");
+			case EOnlineComparisonOp::Near: return TEXT("near");
+			case EOnlineComparisonOp::In: return TEXT("in");
+			case EOnlineComparisonOp::NotIn: return TEXT("notin");
+			default: return TEXT("eq");
+		}
+	}
+
+	/** Compare a session value with a search parameter value */
+	bool Compare(const FVariantData& Value, const FVariantData& Param, EOnlineComparisonOp::Type Op)
+	{
+		// Near only orders results, it never excludes one
+		if (Op == EOnlineComparisonOp::Near)
+		{
+			return true;
+		}
+
+		// In/NotIn take a comma-separated list of values
+		if (Op == EOnlineComparisonOp::In || Op == EOnlineComparisonOp::NotIn)
+		{
+			TArray<FString> Values;
+			Param.ToString().ParseIntoArray(Values, TEXT(","));
+			const FString ValueString = Value.ToString();
+			const bool bFound = Values.ContainsByPredicate([&ValueString](const FString& Candidate)
+			{
+				return Candidate.TrimStartAndEnd() == ValueString;
+			});
+			return bFound == (Op == EOnlineComparisonOp::In);
+		}
+
+		int32 Order = 0;
+		double A, B;
+		if (ToNumber(Value, A) && ToNumber(Param, B))
+		{
+			Order = A < B ? -1 : (A > B ? 1 : 0);
+		}
+		else
+		{
+			Order = Value.ToString().Compare(Param.ToString(), ESearchCase::IgnoreCase);
+		}
+
+		switch (Op)
+		{
+			case EOnlineComparisonOp::Equals: return Order == 0;
+			case EOnlineComparisonOp::NotEquals: return Order != 0;
+			case EOnlineComparisonOp::GreaterThan: return Order > 0;
+			case EOnlineComparisonOp::GreaterThanEquals: return Order >= 0;
+			case EOnlineComparisonOp::LessThan: return Order < 0;
+			case EOnlineComparisonOp::LessThanEquals: return Order <= 0;
+			default: return false;
+		}
+	}
+
+	/** Whether a bool search parameter holds for a session flag */
+	bool MatchesFlag(bool bSessionValue, const FOnlineSessionSearchParam& Param)
+	{
+		return Compare(FVariantData(bSessionValue), Param.Data, Param.ComparisonOp);
+	}
+}
+
+FICESessionRegistry::FICESessionRegistry(const FString& InURL, int32 InPageSize, float InHeartbeatInterval)
+	: URL(InURL)
+	, PageSize(FMath::Clamp(InPageSize, 1, MAX_PAGE_SIZE))
+	, HeartbeatInterval(FMath::Max(InHeartbeatInterval, 1.0f))
+{
+	URL.RemoveFromEnd(TEXT("/"));
+	UE_LOG(LogOnlineICE, Log, TEXT("Session registry at %s (%d sessions per page)"), *URL, PageSize);
+}
+
+FICESessionRegistry::~FICESessionRegistry()
+{
+	CancelSearch();
+
+	// Sessions still advertised would linger on the registry until they expire
+	TArray<FString> SessionIds;
+	Advertised.GetKeys(SessionIds);
+	for (const FString& SessionId : SessionIds)
+	{
+		Withdraw(SessionId);
+	}
+}
+
+void FICESessionRegistry::Tick(float DeltaTime)
+{
+	for (TPair<FString, FAdvertisement>& Pair : Advertised)
+	{
+		Pair.Value.TimeToHeartbeat -= DeltaTime;
+		if (Pair.Value.TimeToHeartbeat <= 0.0f)
+		{
+			SendAdvertisement(Pair.Key, Pair.Value);
+		}
+	}
+}
+
+void FICESessionRegistry::Advertise(const FString& SessionId, const FOnlineSession& Session, const FString& HostPeerId, const TArray<FString>& PingAddresses)
+{
+	FAdvertisement& Advertisement = Advertised.FindOrAdd(SessionId);
+	Advertisement.Body = MakeAdvertisement(SessionId, Session, HostPeerId, PingAddresses);
+	SendAdvertisement(SessionId, Advertisement);
+}
+
+void FICESessionRegistry::Withdraw(const FString& SessionId)
+{
+	if (!Advertised.Remove(SessionId))
+	{
+		return;
+	}
+
+	// Fire and forget, the registry expires it after a missed heartbeat anyway
+	FHttpRequestRef Request = FHttpModule::Get().CreateRequest();
+	Request->SetVerb(TEXT("DELETE"));
+	Request->SetURL(FString::Printf(TEXT("%s/sessions/%s"), *URL, *FGenericPlatformHttp::UrlEncode(SessionId)));
+	Request->ProcessRequest();
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Registry: session %s withdrawn"), *SessionId);
+}
+
+void FICESessionRegistry::SendAdvertisement(const FString& SessionId, FAdvertisement& Advertisement)
+{
+	Advertisement.TimeToHeartbeat = HeartbeatInterval;
+
+	FHttpRequestRef Request = FHttpModule::Get().CreateRequest();
+	Request->SetVerb(TEXT("PUT"));
+	Request->SetURL(FString::Printf(TEXT("%s/sessions/%s"), *URL, *FGenericPlatformHttp::UrlEncode(SessionId)));
+	Request->SetHeader(TEXT("Content-Type"), TEXT("application/json"));
+	Request->SetContentAsString(Advertisement.Body);
+	Request->OnProcessRequestComplete().BindLambda([SessionId](FHttpRequestPtr, FHttpResponsePtr Response, bool bSucceeded)
+	{
+		if (!bSucceeded || !Response.IsValid() || !EHttpResponseCodes::IsOk(Response->GetResponseCode()))
+		{
+			// Retried with the next heartbeat
+			UE_LOG(LogOnlineICE, Warning, TEXT("Registry: advertising session %s failed (%d)"), *SessionId, Response.IsValid() ? Response->GetResponseCode() : 0);
+		}
+	});
+	Request->ProcessRequest();
+}
+
+bool FICESessionRegistry::Search(const TSharedRef<FOnlineSessionSearch>& SearchSettings, const FOnICERegistrySearchPage& OnPage, const FOnICERegistrySearchComplete& OnComplete)
+{
+	CancelSearch();
+
+	CurrentSearch = MakeUnique<FSearch>();
+	CurrentSearch->SearchSettings = SearchSettings;
+	CurrentSearch->OnPage = OnPage;
+	CurrentSearch->OnComplete = OnComplete;
+	CurrentSearch->Query = MakeQueryString(SearchSettings->QuerySettings);
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Registry: searching sessions%s%s"), CurrentSearch->Query.IsEmpty() ? TEXT("") : TEXT(" where "), *CurrentSearch->Query);
+	RequestPage(FString());
+	return true;
+}
+
+void FICESessionRegistry::CancelSearch()
+{
+	if (!CurrentSearch.IsValid())
+	{
+		return;
+	}
+
+	if (CurrentSearch->Request.IsValid())
+	{
+		CurrentSearch->Request->OnProcessRequestComplete().Unbind();
+		CurrentSearch->Request->CancelRequest();
+	}
+	CurrentSearch.Reset();
+}
+
+void FICESessionRegistry::RequestPage(const FString& Cursor)
+{
+	// Never ask for more than the search still has room for
+	int32 Limit = PageSize;
+	const int32 MaxResults = CurrentSearch->SearchSettings->MaxSearchResults;
+	if (MaxResults > 0)
+	{
+		Limit = FMath::Clamp(MaxResults - CurrentSearch->SearchSettings->SearchResults.Num(), 1, PageSize);
+	}
+
+	FString PageURL = FString::Printf(TEXT("%s/sessions?limit=%d"), *URL, Limit);
+	if (!Cursor.IsEmpty())
+	{
+		PageURL += FString::Printf(TEXT("&cursor=%s"), *FGenericPlatformHttp::UrlEncode(Cursor));
+	}
+	PageURL += CurrentSearch->Query;
+
+	FHttpRequestRef Request = FHttpModule::Get().CreateRequest();
+	Request->SetVerb(TEXT("GET"));
+	Request->SetURL(PageURL);
+	Request->SetHeader(TEXT("Accept"), TEXT("application/json"));
+	Request->OnProcessRequestComplete().BindRaw(this, &FICESessionRegistry::OnPageComplete);
+	CurrentSearch->Request = Request;
+	Request->ProcessRequest();
+}
+
+void FICESessionRegistry::OnPageComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSucceeded)
+{
+	if (!CurrentSearch.IsValid() || CurrentSearch->Request != Request)
+	{
+		return;
+	}
+	CurrentSearch->Request.Reset();
+
+	TSharedPtr<FJsonObject> Json;
+	if (!bSucceeded || !Response.IsValid() || !EHttpResponseCodes::IsOk(Response->GetResponseCode()) ||
+		!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Response->GetContentAsString()), Json) || !Json.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Registry: search page failed (%d)"), Response.IsValid() ? Response->GetResponseCode() : 0);
+		CompleteSearch(false);
+		return;
+	}
+
+	FOnlineSessionSearch& SearchSettings = *CurrentSearch->SearchSettings;
+	const int32 FirstNewResult = SearchSettings.SearchResults.Num();
+
+	const TArray<TSharedPtr<FJsonValue>>* Sessions = nullptr;
+	if (Json->TryGetArrayField(TEXT("sessions"), Sessions))
+	{
+		for (const TSharedPtr<FJsonValue>& Value : *Sessions)
+		{
+			if (SearchSettings.MaxSearchResults > 0 && SearchSettings.SearchResults.Num() >= SearchSettings.MaxSearchResults)
+			{
+				break;
+			}
+
+			const TSharedPtr<FJsonObject>* Entry = nullptr;
+			FOnlineSessionSearchResult Result;
+			if (!Value.IsValid() || !Value->TryGetObject(Entry) || !ParseSession(**Entry, Result))
+			{
+				continue;
+			}
+
+			// Keys the registry doesn't index come back unfiltered
+			if (MatchesQuery(Result.Session, SearchSettings.QuerySettings))
+			{
+				SearchSettings.SearchResults.Add(MoveTemp(Result));
+			}
+		}
+	}
+
+	const int32 NumNewResults = SearchSettings.SearchResults.Num() - FirstNewResult;
+	UE_LOG(LogOnlineICE, Verbose, TEXT("Registry: page of %d sessions"), NumNewResults);
+	CurrentSearch->OnPage.ExecuteIfBound(FirstNewResult, NumNewResults);
+
+	// The page delegate may have cancelled the search
+	if (!CurrentSearch.IsValid())
+	{
+		return;
+	}
+
+	FString NextCursor;
+	const bool bFull = SearchSettings.MaxSearchResults > 0 && SearchSettings.SearchResults.Num() >= SearchSettings.MaxSearchResults;
+	if (!bFull && Json->TryGetStringField(TEXT("next"), NextCursor) && !NextCursor.IsEmpty())
+	{
+		RequestPage(NextCursor);
+	}
+	else
+	{
+		CompleteSearch(true);
+	}
+}
+
+void FICESessionRegistry::CompleteSearch(bool bWasSuccessful)
+{
+	// The delegate may start another search
+	TUniquePtr<FSearch> Search = MoveTemp(CurrentSearch);
+	Search->OnComplete.ExecuteIfBound(bWasSuccessful);
+}
+
+FString FICESessionRegistry::MakeQueryString(const FOnlineSearchSettings& QuerySettings)
+{
+	FString Query;
+	for (const TPair<FName, FOnlineSessionSearchParam>& Param : QuerySettings.SearchParams)
+	{
+		const FString Filter = FString::Printf(TEXT("%s:%s:%s"), *Param.Key.ToString(),
+			ICESessionQuery::GetOpName(Param.Value.ComparisonOp), *Param.Value.Data.ToString());
+		Query += TEXT("&q=") + FGenericPlatformHttp::UrlEncode(Filter);
+	}
+	return Query;
+}
+
+FString FICESessionRegistry::MakeAdvertisement(const FString& SessionId, const FOnlineSession& Session, const FString& HostPeerId, const TArray<FString>& PingAddresses)
+{
+	const FOnlineSessionSettings& Settings = Session.SessionSettings;
+
+	TSharedRef<FJsonObject> Json = MakeShared<FJsonObject>();
+	Json->SetStringField(TEXT("id"), SessionId);
+	Json->SetStringField(TEXT("name"), Session.OwningUserName);
+	Json->SetStringField(TEXT("host"), HostPeerId);
+	Json->SetStringField(TEXT("owner"), Session.OwningUserId.IsValid() ? Session.OwningUserId->ToString() : FString());
+	Json->SetNumberField(TEXT("slots"), Settings.NumPublicConnections);
+	Json->SetNumberField(TEXT("open"), Session.NumOpenPublicConnections);
+	Json->SetBoolField(TEXT("dedicated"), Settings.bIsDedicated);
+	Json->SetBoolField(TEXT("lobby"), Settings.bUseLobbiesIfAvailable);
+	Json->SetBoolField(TEXT("presence"), Settings.bUsesPresence);
+	Json->SetBoolField(TEXT("joinInProgress"), Settings.bAllowJoinInProgress);
+
+	TArray<TSharedPtr<FJsonValue>> Ping;
+	for (const FString& Address : PingAddresses)
+	{
+		Ping.Add(MakeShared<FJsonValueString>(Address));
+	}
+	Json->SetArrayField(TEXT("ping"), Ping);
+
+	TSharedRef<FJsonObject> Values = MakeShared<FJsonObject>();
+	for (const TPair<FName, FOnlineSessionSetting>& Setting : Settings.Settings)
+	{
+		if (Setting.Value.AdvertisementType < EOnlineDataAdvertisementType::ViaOnlineService)
+		{
+			continue;
+		}
+
+		const FVariantData& Data = Setting.Value.Data;
+		double Number;
+		if (Data.GetType() == EOnlineKeyValuePairDataType::Bool)
+		{
+			bool bValue;
+			Data.GetValue(bValue);
+			Values->SetBoolField(Setting.Key.ToString(), bValue);
+		}
+		else if (ICESessionQuery::ToNumber(Data, Number))
+		{
+			Values->SetNumberField(Setting.Key.ToString(), Number);
+		}
+		else if (Data.GetType() == EOnlineKeyValuePairDataType::String)
+		{
+			Values->SetStringField(Setting.Key.ToString(), Data.ToString());
+		}
+	}
+	Json->SetObjectField(TEXT("settings"), Values);
+
+	FString Body;
+	const TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Body);
+	FJsonSerializer::Serialize(Json, Writer);
+	return Body;
+}
+
+bool FICESessionRegistry::ParseSession(const FJsonObject& Json, FOnlineSessionSearchResult& OutResult)
+{
+	FString SessionId;
+	if (!Json.TryGetStringField(TEXT("id"), SessionId) || SessionId.IsEmpty())
+	{
+		return false;
+	}
+
+	TArray<FString> PingAddresses;
+	Json.TryGetStringArrayField(TEXT("ping"), PingAddresses);
+
+	FOnlineSession& Session = OutResult.Session;
+	FOnlineSessionSettings& Settings = Session.SessionSettings;
+	Session.SessionInfo = MakeShared<FOnlineSessionInfoICE>(SessionId, Json.GetStringField(TEXT("host")), PingAddresses);
+	Session.OwningUserName = Json.GetStringField(TEXT("name"));
+
+	FString Owner;
+	if (Json.TryGetStringField(TEXT("owner"), Owner) && !Owner.IsEmpty())
+	{
+		Session.OwningUserId = MakeShared<FUniqueNetIdICE>(Owner);
+	}
+
+	Json.TryGetNumberField(TEXT("slots"), Settings.NumPublicConnections);
+	if (!Json.TryGetNumberField(TEXT("open"), Session.NumOpenPublicConnections))
+	{
+		Session.NumOpenPublicConnections = Settings.NumPublicConnections;
+	}
+	Json.TryGetBoolField(TEXT("dedicated"), Settings.bIsDedicated);
+	Json.TryGetBoolField(TEXT("lobby"), Settings.bUseLobbiesIfAvailable);
+	Json.TryGetBoolField(TEXT("presence"), Settings.bUsesPresence);
+	Json.TryGetBoolField(TEXT("joinInProgress"), Settings.bAllowJoinInProgress);
+	Settings.bShouldAdvertise = true;
+
+	const TSharedPtr<FJsonObject>* Values = nullptr;
+	if (Json.TryGetObjectField(TEXT("settings"), Values))
+	{
+		for (const TPair<FString, TSharedPtr<FJsonValue>>& Value : (*Values)->Values)
+		{
+			const FName Key(*Value.Key);
+			switch (Value.Value->Type)
+			{
+				case EJson::Boolean:
+					Settings.Set(Key, Value.Value->AsBool(), EOnlineDataAdvertisementType::ViaOnlineService);
+					break;
+				case EJson::Number:
+				{
+					// Integral values come back as int32, as games usually set them
+					const double Number = Value.Value->AsNumber();
+					if (FMath::IsNearlyEqual(Number, FMath::RoundToDouble(Number)) && FMath::Abs(Number) <= (double)MAX_int32)
+					{
+						Settings.Set(Key, (int32)Number, EOnlineDataAdvertisementType::ViaOnlineService);
+					}
+					else
+					{
+						Settings.Set(Key, Number, EOnlineDataAdvertisementType::ViaOnlineService);
+					}
+					break;
+				}
+				case EJson::String:
+					Settings.Set(Key, Value.Value->AsString(), EOnlineDataAdvertisementType::ViaOnlineService);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	// Round trip time is measured by FICESessionPinger
+	OutResult.PingInMs = MAX_QUERY_PING;
+	return true;
+}
+
+bool FICESessionRegistry::MatchesQuery(const FOnlineSession& Session, const FOnlineSearchSettings& QuerySettings)
+{
+	const FOnlineSessionSettings& Settings = Session.SessionSettings;
+
+	for (const TPair<FName, FOnlineSessionSearchParam>& Param : QuerySettings.SearchParams)
+	{
+		const FName Key = Param.Key;
+		bool bMatches = true;
+
+		if (Key == SEARCH_LOBBIES)
+		{
+			bMatches = ICESessionQuery::MatchesFlag(Settings.bUseLobbiesIfAvailable, Param.Value);
+		}
+		else if (Key == ICESessionQuery::PresenceSearchKey)
+		{
+			bMatches = ICESessionQuery::MatchesFlag(Settings.bUsesPresence, Param.Value);
+		}
+		else if (Key == SEARCH_DEDICATED_ONLY)
+		{
+			bMatches = ICESessionQuery::MatchesFlag(Settings.bIsDedicated, Param.Value);
+		}
+		else if (Key == SEARCH_EMPTY_SERVERS_ONLY)
+		{
+			bMatches = ICESessionQuery::MatchesFlag(Session.NumOpenPublicConnections >= Settings.NumPublicConnections, Param.Value);
+		}
+		else if (Key == SEARCH_NONEMPTY_SERVERS_ONLY)
+		{
+			bMatches = ICESessionQuery::MatchesFlag(Session.NumOpenPublicConnections < Settings.NumPublicConnections, Param.Value);
+		}
+		else if (Key == SEARCH_MINSLOTSAVAILABLE)
+		{
+			double MinSlots = 0.0;
+			bMatches = !ICESessionQuery::ToNumber(Param.Value.Data, MinSlots) || Session.NumOpenPublicConnections >= MinSlots;
+		}
+		else
+		{
+			const FOnlineSessionSetting* Setting = Settings.Settings.Find(Key);
+			bMatches = Setting && ICESessionQuery::Compare(Setting->Data, Param.Value.Data, Param.Value.ComparisonOp);
+		}
+
+		if (!bMatches)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,373 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICESignalingClient.h"
+#include "ICESignalingTransport.h"
+#include "ICEOffer.h"
+#include "OnlineSessionInterfaceICE.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Policies/CondensedJsonPrintPolicy.h"
+
+FICESignalingClient::FICESignalingClient(FOnlineSessionICE& InSession, const FString& InURL, float InBatchInterval)
+	: Session(InSession)
+	, URL(InURL)
+	, BatchInterval(FMath::Max(InBatchInterval, 0.0f))
+	, bUsingLongPoll(false)
+	, bTransportClosed(false)
+	, bTransportEverConnected(false)
+	, ReconnectDelay(0.0f)
+	, NumOffersSent(0)
+	, NumOffersReceived(0)
+{
+	LocalPeerId = FGuid::NewGuid().ToString(EGuidFormats::Digits);
+
+	// Session and client live and die together, the client is owned by the session interface
+	LocalCandidatesHandle = Session.OnLocalCandidatesReady.AddRaw(this, &FICESignalingClient::OnLocalCandidatesReady);
+	PeerLocalCandidatesHandle = Session.OnPeerLocalCandidatesReady.AddRaw(this, &FICESignalingClient::OnPeerLocalCandidatesReady);
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Signaling client %s using %s"), *LocalPeerId, *URL);
+	CreateTransport(URL.StartsWith(TEXT("http://")) || URL.StartsWith(TEXT("https://")));
+}
+
+FICESignalingClient::~FICESignalingClient()
+{
+	Session.OnLocalCandidatesReady.Remove(LocalCandidatesHandle);
+	Session.OnPeerLocalCandidatesReady.Remove(PeerLocalCandidatesHandle);
+
+	if (Transport.IsValid())
+	{
+		Transport->Close();
+	}
+}
+
+void FICESignalingClient::CreateTransport(bool bLongPoll)
+{
+	if (Transport.IsValid())
+	{
+		Transport->Close();
+	}
+
+	if (bLongPoll)
+	{
+		// Long-polling the same server: ws:// becomes http://, wss:// becomes https://
+		FString HttpURL = URL;
+		if (HttpURL.StartsWith(TEXT("ws")))
+		{
+			HttpURL = TEXT("http") + HttpURL.RightChop(2);
+		}
+		Transport = MakeUnique<FICEHttpSignaling>(HttpURL, LocalPeerId);
+	}
+	else
+	{
+		Transport = MakeUnique<FICEWebSocketSignaling>(URL);
+	}
+
+	Transport->OnConnected.BindRaw(this, &FICESignalingClient::OnTransportConnected);
+	Transport->OnClosed.BindRaw(this, &FICESignalingClient::OnTransportClosed);
+	Transport->OnMessage.BindRaw(this, &FICESignalingClient::OnTransportMessage);
+
+	bUsingLongPoll = bLongPoll;
+	bTransportClosed = false;
+	bTransportEverConnected = false;
+	Transport->Connect();
+}
+
+void FICESignalingClient::Tick(float DeltaTime)
+{
+	if (bTransportClosed)
+	{
+		bTransportClosed = false;
+
+		// A WebSocket that never connected is likely blocked on this network, keep going over HTTP
+		if (!bUsingLongPoll && !bTransportEverConnected)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Signaling WebSocket unavailable, falling back to HTTP long-poll"));
+			CreateTransport(true);
+		}
+		else
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Signaling server lost, reconnecting in %.0fs"), RECONNECT_DELAY);
+			ReconnectDelay = RECONNECT_DELAY;
+		}
+	}
+
+	if (ReconnectDelay > 0.0f)
+	{
+		ReconnectDelay -= DeltaTime;
+		if (ReconnectDelay <= 0.0f)
+		{
+			ReconnectDelay = 0.0f;
+			Transport->Connect();
+		}
+	}
+
+	// Candidates trickled close together leave in one offer
+	for (auto It = PendingOffers.CreateIterator(); It; ++It)
+	{
+		FPendingOffer& Pending = It.Value();
+		Pending.Age += DeltaTime;
+		if (Pending.Age >= BatchInterval)
+		{
+			SendOffer(It.Key(), Pending);
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FICESignalingClient::JoinRoom(FName SessionName, const FString& RoomId, bool bHost)
+{
+	FRoom& Room = Rooms.Add(SessionName);
+	Room.RoomId = RoomId;
+	Room.bHost = bHost;
+	UE_LOG(LogOnlineICE, Log, TEXT("Signaling: %s room '%s' for session '%s'"), bHost ? TEXT("hosting") : TEXT("joining"), *RoomId, *SessionName.ToString());
+
+	// Rooms are (re)joined by OnTransportConnected otherwise
+	if (IsConnected())
+	{
+		SendMessage(MakeJoinMessage(Room));
+	}
+}
+
+void FICESignalingClient::LeaveRoom(FName SessionName)
+{
+	FRoom Room;
+	if (!Rooms.RemoveAndCopyValue(SessionName, Room))
+	{
+		return;
+	}
+
+	for (auto It = PendingOffers.CreateIterator(); It; ++It)
+	{
+		if (It.Value().SessionName == SessionName)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	if (IsConnected())
+	{
+		TSharedRef<FJsonObject> Message = MakeShared<FJsonObject>();
+		Message->SetStringField(TEXT("type"), TEXT("leave"));
+		Message->SetStringField(TEXT("session"), Room.RoomId);
+		Message->SetStringField(TEXT("peer"), LocalPeerId);
+		SendMessage(Message);
+	}
+}
+
+bool FICESignalingClient::IsConnected() const
+{
+	return Transport.IsValid() && Transport->IsConnected();
+}
+
+const TCHAR* FICESignalingClient::GetTransportName() const
+{
+	return Transport.IsValid() ? Transport->GetName() : TEXT("None");
+}
+
+void FICESignalingClient::OnTransportConnected()
+{
+	bTransportEverConnected = true;
+
+	for (const TPair<FName, FRoom>& Room : Rooms)
+	{
+		SendMessage(MakeJoinMessage(Room.Value));
+	}
+
+	// Offers produced while disconnected, oldest first
+	TArray<FString> Queued = MoveTemp(OutgoingQueue);
+	for (const FString& Message : Queued)
+	{
+		Transport->Send(Message);
+	}
+}
+
+void FICESignalingClient::OnTransportClosed(bool bWasConnected)
+{
+	bTransportClosed = true;
+	bTransportEverConnected = bTransportEverConnected || bWasConnected;
+}
+
+void FICESignalingClient::OnTransportMessage(const FString& Message)
+{
+	TSharedPtr<FJsonObject> Json;
+	const TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(Message);
+	if (!FJsonSerializer::Deserialize(Reader, Json) || !Json.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Signaling: malformed message ignored"));
+		return;
+	}
+
+	const FString Type = Json->GetStringField(TEXT("type"));
+	if (Type == TEXT("offer"))
+	{
+		HandleRemoteOffer(Json->GetStringField(TEXT("session")), Json->GetStringField(TEXT("from")), Json->GetStringField(TEXT("offer")));
+	}
+	else if (Type == TEXT("leave"))
+	{
+		HandleRemoteLeave(Json->GetStringField(TEXT("session")), Json->GetStringField(TEXT("peer")));
+	}
+	else if (Type == TEXT("error"))
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Signaling server error: %s"), *Json->GetStringField(TEXT("message")));
+	}
+	else
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Signaling: '%s' message ignored"), *Type);
+	}
+}
+
+void FICESignalingClient::OnLocalCandidatesReady(FName SessionName, const TArray<FICECandidate>& Candidates)
+{
+	// The default agent of a host has no signaled peer, every peer gets its own agent from its first offer
+	const FRoom* Room = Rooms.Find(SessionName);
+	if (Room && !Room->bHost)
+	{
+		QueueCandidates(SessionName, FString(), Candidates);
+	}
+}
+
+void FICESignalingClient::OnPeerLocalCandidatesReady(FName SessionName, const FString& PeerId, const TArray<FICECandidate>& Candidates)
+{
+	if (Rooms.Contains(SessionName))
+	{
+		QueueCandidates(SessionName, PeerId, Candidates);
+	}
+}
+
+void FICESignalingClient::QueueCandidates(FName SessionName, const FString& AgentPeerId, const TArray<FICECandidate>& Candidates)
+{
+	FPendingOffer& Pending = PendingOffers.FindOrAdd(AgentPeerId);
+	if (Pending.SessionName != SessionName)
+	{
+		Pending.SessionName = SessionName;
+		Pending.Candidates.Reset();
+		Pending.Age = 0.0f;
+	}
+	Pending.Candidates.Append(Candidates);
+}
+
+void FICESignalingClient::SendOffer(const FString& AgentPeerId, FPendingOffer& Pending)
+{
+	TSharedPtr<FICEAgent> Agent = Session.GetICEAgent(AgentPeerId);
+	const FRoom* Room = Rooms.Find(Pending.SessionName);
+	if (!Agent.IsValid() || !Room)
+	{
+		return;
+	}
+
+	// Credentials travel with every batch, they change on ICE restart
+	FICEOffer Offer;
+	Offer.Ufrag = Agent->GetLocalUfrag();
+	Offer.Password = Agent->GetLocalPassword();
+	Offer.Candidates = MoveTemp(Pending.Candidates);
+
+	TSharedRef<FJsonObject> Message = MakeShared<FJsonObject>();
+	Message->SetStringField(TEXT("type"), TEXT("offer"));
+	Message->SetStringField(TEXT("session"), Room->RoomId);
+	Message->SetStringField(TEXT("from"), LocalPeerId);
+	Message->SetStringField(TEXT("to"), AgentPeerId);
+	Message->SetStringField(TEXT("offer"), Offer.ToBase64());
+	SendMessage(Message);
+
+	++NumOffersSent;
+	UE_LOG(LogOnlineICE, Verbose, TEXT("Signaling: sent %d candidates to %s"),
+		Offer.Candidates.Num(), AgentPeerId.IsEmpty() ? TEXT("host") : *AgentPeerId);
+}
+
+void FICESignalingClient::HandleRemoteOffer(const FString& RoomId, const FString& FromPeer, const FString& Offer)
+{
+	const FName* SessionName = nullptr;
+	bool bHost = false;
+	for (const TPair<FName, FRoom>& Room : Rooms)
+	{
+		if (Room.Value.RoomId == RoomId)
+		{
+			SessionName = &Room.Key;
+			bHost = Room.Value.bHost;
+			break;
+		}
+	}
+	if (!SessionName || FromPeer.IsEmpty())
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Signaling: offer for unknown room '%s' ignored"), *RoomId);
+		return;
+	}
+
+	// A host runs one agent per signaled peer, a joining peer only talks to the host through its default agent
+	const FString AgentPeerId = bHost ? FromPeer : FString();
+	if (bHost && !Session.GetICEAgent(AgentPeerId).IsValid() && !Session.AddSessionPeer(*SessionName, AgentPeerId))
+	{
+		return;
+	}
+
+	++NumOffersReceived;
+	if (!Session.AddRemoteICEOffer(Offer, AgentPeerId))
+	{
+		return;
+	}
+
+	// Checks start with the first offer; later batches are trickled into the running checklist
+	TSharedPtr<FICEAgent> Agent = Session.GetICEAgent(AgentPeerId);
+	if (Agent.IsValid() && !Agent->IsChecking() && (!Agent->IsConnected() || Agent->IsRestarting()))
+	{
+		Session.StartICEConnectivityChecks(AgentPeerId);
+	}
+}
+
+void FICESignalingClient::HandleRemoteLeave(const FString& RoomId, const FString& Peer)
+{
+	// Only a host has an agent per peer; a joining peer keeps its default agent for the next session
+	bool bHostedRoom = false;
+	for (const TPair<FName, FRoom>& Room : Rooms)
+	{
+		if (Room.Value.RoomId == RoomId)
+		{
+			bHostedRoom = Room.Value.bHost;
+			break;
+		}
+	}
+	if (!bHostedRoom || Peer.IsEmpty())
+	{
+		return;
+	}
+
+	PendingOffers.Remove(Peer);
+	if (Session.RemoveSessionPeer(Peer))
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Signaling: peer %s left"), *Peer);
+	}
+}
+
+void FICESignalingClient::SendMessage(const TSharedRef<FJsonObject>& Message)
+{
+	FString Text;
+	const TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Text);
+	FJsonSerializer::Serialize(Message, Writer);
+
+	if (Transport.IsValid() && Transport->Send(Text))
+	{
+		return;
+	}
+
+	// Joins are resent on connection, anything else waits for it
+	if (Message->GetStringField(TEXT("type")) != TEXT("join"))
+	{
+		if (OutgoingQueue.Num() >= MAX_QUEUED_MESSAGES)
+		{
+			OutgoingQueue.RemoveAt(0);
+		}
+		OutgoingQueue.Add(MoveTemp(Text));
+	}
+}
+
+TSharedRef<FJsonObject> FICESignalingClient::MakeJoinMessage(const FRoom& Room) const
+{
+	TSharedRef<FJsonObject> Message = MakeShared<FJsonObject>();
+	Message->SetStringField(TEXT("type"), TEXT("join"));
+	Message->SetStringField(TEXT("session"), Room.RoomId);
+	Message->SetStringField(TEXT("peer"), LocalPeerId);
+	Message->SetBoolField(TEXT("host"), Room.bHost);
+	return Message;
+}
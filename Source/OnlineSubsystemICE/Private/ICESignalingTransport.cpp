@@ -0,0 +1,233 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICESignalingTransport.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "HttpModule.h"
+#include "Interfaces/IHttpResponse.h"
+#include "IWebSocket.h"
+#include "WebSocketsModule.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+
+FICEWebSocketSignaling::FICEWebSocketSignaling(const FString& InURL)
+	: URL(InURL)
+	, bWasConnected(false)
+{
+}
+
+FICEWebSocketSignaling::~FICEWebSocketSignaling()
+{
+	Close();
+}
+
+void FICEWebSocketSignaling::Connect()
+{
+	Close();
+
+	WebSocket = FModuleManager::LoadModuleChecked<FWebSocketsModule>(TEXT("WebSockets")).CreateWebSocket(URL);
+	bWasConnected = false;
+
+	// Callbacks run on the game thread; Close unbinds them before the socket goes away
+	WebSocket->OnConnected().AddLambda([this]()
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Signaling WebSocket connected to %s"), *URL);
+		bWasConnected = true;
+		OnConnected.ExecuteIfBound();
+	});
+
+	WebSocket->OnConnectionError().AddLambda([this](const FString& Error)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Signaling WebSocket error on %s: %s"), *URL, *Error);
+		OnClosed.ExecuteIfBound(bWasConnected);
+	});
+
+	WebSocket->OnClosed().AddLambda([this](int32 StatusCode, const FString& Reason, bool bWasClean)
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Signaling WebSocket closed (%d %s)"), StatusCode, *Reason);
+		OnClosed.ExecuteIfBound(bWasConnected);
+	});
+
+	WebSocket->OnMessage().AddLambda([this](const FString& Message)
+	{
+		OnMessage.ExecuteIfBound(Message);
+	});
+
+	WebSocket->Connect();
+}
+
+void FICEWebSocketSignaling::Close()
+{
+	if (!WebSocket.IsValid())
+	{
+		return;
+	}
+
+	WebSocket->OnConnected().Clear();
+	WebSocket->OnConnectionError().Clear();
+	WebSocket->OnClosed().Clear();
+	WebSocket->OnMessage().Clear();
+	if (WebSocket->IsConnected())
+	{
+		WebSocket->Close();
+	}
+	WebSocket.Reset();
+}
+
+bool FICEWebSocketSignaling::IsConnected() const
+{
+	return WebSocket.IsValid() && WebSocket->IsConnected();
+}
+
+bool FICEWebSocketSignaling::Send(const FString& Message)
+{
+	if (!IsConnected())
+	{
+		return false;
+	}
+	WebSocket->Send(Message);
+	return true;
+}
+
+FICEHttpSignaling::FICEHttpSignaling(const FString& InURL, const FString& InPeerId)
+	: URL(InURL)
+	, PeerId(InPeerId)
+	, bConnected(false)
+	, bActive(false)
+{
+	URL.RemoveFromEnd(TEXT("/"));
+}
+
+FICEHttpSignaling::~FICEHttpSignaling()
+{
+	Close();
+}
+
+void FICEHttpSignaling::Connect()
+{
+	Close();
+	bActive = true;
+	StartPoll();
+}
+
+void FICEHttpSignaling::Close()
+{
+	bActive = false;
+	bConnected = false;
+	SendQueue.Empty();
+
+	for (FHttpRequestPtr* Request : { &PollRequest, &SendRequest })
+	{
+		if (Request->IsValid())
+		{
+			(*Request)->OnProcessRequestComplete().Unbind();
+			(*Request)->CancelRequest();
+			Request->Reset();
+		}
+	}
+}
+
+bool FICEHttpSignaling::Send(const FString& Message)
+{
+	if (!bConnected)
+	{
+		return false;
+	}
+	SendQueue.Add(Message);
+	FlushSendQueue();
+	return true;
+}
+
+void FICEHttpSignaling::StartPoll()
+{
+	// The first poll returns at once and tells whether the server is reachable, the next ones are held
+	const int32 WaitSeconds = bConnected ? POLL_WAIT_SECONDS : 0;
+
+	PollRequest = FHttpModule::Get().CreateRequest();
+	PollRequest->SetVerb(TEXT("GET"));
+	PollRequest->SetURL(FString::Printf(TEXT("%s/messages?peer=%s&wait=%d"), *URL, *FGenericPlatformHttp::UrlEncode(PeerId), WaitSeconds));
+	PollRequest->SetTimeout((float)WaitSeconds + 10.0f);
+	PollRequest->OnProcessRequestComplete().BindRaw(this, &FICEHttpSignaling::OnPollComplete);
+	PollRequest->ProcessRequest();
+}
+
+void FICEHttpSignaling::OnPollComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSucceeded)
+{
+	PollRequest.Reset();
+	if (!bActive)
+	{
+		return;
+	}
+
+	if (!bSucceeded || !Response.IsValid() || !EHttpResponseCodes::IsOk(Response->GetResponseCode()))
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Signaling poll to %s failed (%d)"), *URL, Response.IsValid() ? Response->GetResponseCode() : 0);
+		HandleFailure();
+		return;
+	}
+
+	if (!bConnected)
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Signaling long-poll connected to %s"), *URL);
+		bConnected = true;
+		OnConnected.ExecuteIfBound();
+		if (!bActive)
+		{
+			return;
+		}
+	}
+
+	// One message per line
+	TArray<FString> Messages;
+	Response->GetContentAsString().ParseIntoArrayLines(Messages);
+	for (const FString& Message : Messages)
+	{
+		OnMessage.ExecuteIfBound(Message);
+		if (!bActive)
+		{
+			return;
+		}
+	}
+
+	StartPoll();
+}
+
+void FICEHttpSignaling::FlushSendQueue()
+{
+	if (SendRequest.IsValid() || SendQueue.Num() == 0)
+	{
+		return;
+	}
+
+	SendRequest = FHttpModule::Get().CreateRequest();
+	SendRequest->SetVerb(TEXT("POST"));
+	SendRequest->SetURL(FString::Printf(TEXT("%s/messages?peer=%s"), *URL, *FGenericPlatformHttp::UrlEncode(PeerId)));
+	SendRequest->SetHeader(TEXT("Content-Type"), TEXT("application/x-ndjson"));
+	SendRequest->SetContentAsString(FString::Join(SendQueue, TEXT("\n")));
+	SendRequest->OnProcessRequestComplete().BindRaw(this, &FICEHttpSignaling::OnSendComplete);
+	SendQueue.Reset();
+	SendRequest->ProcessRequest();
+}
+
+void FICEHttpSignaling::OnSendComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSucceeded)
+{
+	SendRequest.Reset();
+	if (!bActive)
+	{
+		return;
+	}
+
+	if (!bSucceeded || !Response.IsValid() || !EHttpResponseCodes::IsOk(Response->GetResponseCode()))
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Signaling send to %s failed (%d)"), *URL, Response.IsValid() ? Response->GetResponseCode() : 0);
+		HandleFailure();
+		return;
+	}
+
+	FlushSendQueue();
+}
+
+void FICEHttpSignaling::HandleFailure()
+{
+	const bool bWasConnected = bConnected;
+	Close();
+	OnClosed.ExecuteIfBound(bWasConnected);
+}
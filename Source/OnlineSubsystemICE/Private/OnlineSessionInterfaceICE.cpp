@@ -4,6 +4,12 @@
 #include "OnlineSubsystemICE.h"
 #include "OnlineSubsystemUtils.h"
 #include "ICEAgent.h"
+#include "ICEAgentPool.h"
+#include "ICEOffer.h"
+#include "ICESignalingClient.h"
+#include "ICESessionRegistry.h"
+#include "ICESessionPinger.h"
+#include "OnlineIdentityInterfaceICE.h"
 
 namespace
 {
@@ -25,8 +31,22 @@ namespace
 	}
 }
 
+FOnlineSessionInfoICE::FOnlineSessionInfoICE(const FString& InSessionId, const FString& InHostPeerId, const TArray<FString>& InPingAddresses)
+	: SessionId(MakeShared<FUniqueNetIdICE>(InSessionId))
+	, HostPeerId(InHostPeerId)
+	, PingAddresses(InPingAddresses)
+{
+}
+
+FString FOnlineSessionInfoICE::ToDebugString() const
+{
+	return FString::Printf(TEXT("SessionId: %s Host: %s"), *SessionId->ToDebugString(), HostPeerId.IsEmpty() ? TEXT("unknown") : *HostPeerId);
+}
+
 FOnlineSessionICE::FOnlineSessionICE(FOnlineSubsystemICE* InSubsystem)
 	: Subsystem(InSubsystem)
+	, bFindSessionsAwaitingPings(false)
+	, bFindSessionsSucceeded(false)
 	, RemotePeerPort(0)
 {
 	// Create ICE agent with config from subsystem
@@ -34,19 +54,52 @@ FOnlineSessionICE::FOnlineSessionICE(FOnlineSubsystemICE* InSubsystem)
 	
 	if (Subsystem)
 	{
-		// Add STUN server
-		if (!Subsystem->GetSTUNServerAddress().IsEmpty())
+		// Add STUN/TURN servers (comma-separated lists, every server is queried in parallel)
+		auto AddServers = [](const FString& ServerList, TArray<FString>& OutServers)
 		{
-			Config.STUNServers.Add(Subsystem->GetSTUNServerAddress());
-		}
-		
-		// Add TURN server
-		if (!Subsystem->GetTURNServerAddress().IsEmpty())
+			TArray<FString> Servers;
+			ServerList.ParseIntoArray(Servers, TEXT(","));
+			for (FString& Server : Servers)
+			{
+				Server.TrimStartAndEndInline();
+				if (!Server.IsEmpty())
+				{
+					OutServers.AddUnique(Server);
+				}
+			}
+		};
+		AddServers(Subsystem->GetSTUNServerAddress(), Config.STUNServers);
+		AddServers(Subsystem->GetTURNServerAddress(), Config.TURNServers);
+		if (Config.TURNServers.Num() > 0)
 		{
-			Config.TURNServers.Add(Subsystem->GetTURNServerAddress());
 			Config.TURNUsername = Subsystem->GetTURNUsername();
 			Config.TURNCredential = Subsystem->GetTURNCredential();
 		}
+
+		Config.GatheringTimeout = Subsystem->GetGatheringTimeout();
+		Config.ConnectivityCheckInterval = Subsystem->GetConnectivityCheckInterval();
+		Config.bUseIOThread = Subsystem->IsIOThreadEnabled();
+		Config.PathMTU = Subsystem->GetPathMTU();
+		Config.bEnableIPv6 = Subsystem->IsIPv6Enabled();
+		Config.ConsentCheckInterval = Subsystem->GetConsentCheckInterval();
+		Config.ConsentTimeout = Subsystem->GetConsentTimeout();
+		Config.DirectUpgradeInterval = Subsystem->GetDirectUpgradeInterval();
+		Config.MaxDirectUpgradeRounds = Subsystem->GetMaxDirectUpgradeRounds();
+		Config.ServerSelectionTTL = Subsystem->GetServerSelectionTTL();
+		Config.bEncryptTraffic = Subsystem->IsTrafficEncryptionEnabled();
+		Config.bAllowUnsignedHandshake = Subsystem->IsUnsignedHandshakeAllowed();
+		Config.bCoalesceSends = Subsystem->IsSendCoalescingEnabled();
+		Config.CoalesceWindow = Subsystem->GetCoalesceWindow();
+		Config.bPaceSends = Subsystem->IsSendPacingEnabled();
+		Config.PacingInitialRate = Subsystem->GetPacingInitialRate();
+		Config.PacingMinRate = Subsystem->GetPacingMinRate();
+		Config.PacingMaxRate = Subsystem->GetPacingMaxRate();
+		Config.PacingBurstSize = Subsystem->GetPacingBurstSize();
+		Config.PacingQueueLimit = Subsystem->GetPacingQueueLimit();
+		Config.PacingTargetDelay = Subsystem->GetPacingTargetDelay();
+		Config.bEnableFEC = Subsystem->IsFECEnabled();
+		Config.FECMinLossRate = Subsystem->GetFECMinLossRate();
+		Config.FECMaxGroupSize = Subsystem->GetFECMaxGroupSize();
 	}
 	
 	// Default STUN server if none configured
@@ -55,26 +108,66 @@ FOnlineSessionICE::FOnlineSessionICE(FOnlineSubsystemICE* InSubsystem)
 		Config.STUNServers.Add(TEXT("stun.l.google.com:19302"));
 	}
 	
-	ICEAgent = MakeShared<FICEAgent>(Config);
+	// Every agent (the default one and one per session peer) shares the pool socket
+	AgentPool = MakeShared<FICEAgentPool>(Config);
+	ICEAgent = AgentPool->CreateAgent(FString());
 	
 	// Bind to ICE agent's connection state changes to forward them with session context
 	// We need to capture 'this' to access session information, but we must be careful about lifetime
-	// The ICEAgent is owned by this object, so it's safe
+	// The agent pool is owned by this object, so it's safe
 	ICEAgent->OnConnectionStateChanged.AddLambda([this](EICEConnectionState NewState)
 	{
-		// Find which session this connection state change is for
-		// For simplicity, we'll broadcast for all sessions since we typically have one active session at a time
-		// In a more complex scenario, you'd track which session is using which connection
-		for (const auto& SessionPair : Sessions)
+		// The default agent serves the session that last gathered with it
+		if (Sessions.Contains(GatheringSessionName))
 		{
-			OnICEConnectionStateChanged.Broadcast(SessionPair.Key, NewState);
+			OnICEConnectionStateChanged.Broadcast(GatheringSessionName, NewState);
 		}
 	});
+
+	// Trickle each local candidate to listeners as soon as the agent gathers it
+	ICEAgent->OnLocalCandidateGathered.AddLambda([this](const FICECandidate& Candidate)
+	{
+		UE_LOG(LogOnlineICE, Verbose, TEXT("Local candidate ready for session '%s': %s"),
+			*GatheringSessionName.ToString(), *Candidate.ToString());
+
+		TArray<FICECandidate> Candidates;
+		Candidates.Add(Candidate);
+		OnLocalCandidatesReady.Broadcast(GatheringSessionName, Candidates);
+	});
+
+	ICEAgent->OnGatheringComplete.AddLambda([this]()
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("ICE candidate gathering complete for session '%s'"), *GatheringSessionName.ToString());
+
+		// Server reflexive candidates are known now, searching peers can ping them
+		UpdateRegistryAdvertisement(GatheringSessionName);
+	});
+	
+	// Candidates are exchanged through the signaling server when one is configured
+	if (Subsystem && !Subsystem->GetSignalingURL().IsEmpty())
+	{
+		SignalingClient = MakeUnique<FICESignalingClient>(*this, Subsystem->GetSignalingURL(), Subsystem->GetSignalingBatchInterval());
+	}
+
+	// Sessions are advertised on and searched through the registry when one is configured
+	if (Subsystem && !Subsystem->GetRegistryURL().IsEmpty())
+	{
+		SessionRegistry = MakeUnique<FICESessionRegistry>(Subsystem->GetRegistryURL(), Subsystem->GetRegistryPageSize(), Subsystem->GetRegistryHeartbeatInterval());
+
+		SessionPinger = MakeUnique<FICESessionPinger>(Subsystem->GetPingMaxInFlight(), Subsystem->GetPingTimeout(), Config.bEnableIPv6);
+		SessionPinger->OnResultPinged.BindRaw(this, &FOnlineSessionICE::OnSearchResultPingComplete);
+	}
 	
 	UE_LOG(LogOnlineICE, Log, TEXT("OnlineSessionICE initialized"));
 }
 
-FOnlineSessionICE::~FOnlineSessionICE() = default;
+FOnlineSessionICE::~FOnlineSessionICE()
+{
+	// The client unbinds from our delegates, release it first
+	SignalingClient.Reset();
+	SessionRegistry.Reset();
+	SessionPinger.Reset();
+}
 
 bool FOnlineSessionICE::CreateSession(int32 HostingPlayerNum, FName SessionName, const FOnlineSessionSettings& NewSessionSettings)
 {
@@ -91,27 +184,44 @@ bool FOnlineSessionICE::CreateSession(int32 HostingPlayerNum, FName SessionName,
 	// Create a new session
 	FNamedOnlineSession& NewSession = Sessions.Add(SessionName, FNamedOnlineSession(SessionName, NewSessionSettings));
 	NewSession.HostingPlayerNum = HostingPlayerNum;
+	NewSession.bHosting = true;
 	NewSession.SessionState = EOnlineSessionState::Creating;
 
+	// Owner as advertised to searching players
+	if (Subsystem && Subsystem->GetIdentityInterface().IsValid())
+	{
+		NewSession.OwningUserId = Subsystem->GetIdentityInterface()->GetUniquePlayerId(HostingPlayerNum);
+		NewSession.OwningUserName = Subsystem->GetIdentityInterface()->GetPlayerNickname(HostingPlayerNum);
+	}
+
+	// A registry id names the session for searches and its signaling room for joining peers
+	if (SessionRegistry.IsValid())
+	{
+		NewSession.SessionInfo = MakeShared<FOnlineSessionInfoICE>(FGuid::NewGuid().ToString(EGuidFormats::Digits),
+			SignalingClient.IsValid() ? SignalingClient->GetLocalPeerId() : FString());
+	}
+
 	// Gather ICE candidates for this session
 	if (ICEAgent.IsValid())
 	{
 		UE_LOG(LogOnlineICE, Log, TEXT("Gathering ICE candidates for session '%s'"), *SessionName.ToString());
+
+		// The host is the controlling agent
+		ICEAgent->SetControlling(true);
+
+		// Peers reach the host through its signaling room, each one gets an agent with its first offer
+		if (SignalingClient.IsValid())
+		{
+			SignalingClient->JoinRoom(SessionName, GetSignalingRoomId(SessionName), true);
+		}
+
+		// Candidates are trickled through OnLocalCandidatesReady as they are gathered
+		GatheringSessionName = SessionName;
 		bool bGathered = ICEAgent->GatherCandidates();
 		
 		if (bGathered)
 		{
-			TArray<FICECandidate> LocalCandidates = ICEAgent->GetLocalCandidates();
-			UE_LOG(LogOnlineICE, Log, TEXT("Gathered %d ICE candidates for session"), LocalCandidates.Num());
-			
-			// Log candidates for debugging
-			for (const FICECandidate& Candidate : LocalCandidates)
-			{
-				UE_LOG(LogOnlineICE, Verbose, TEXT("  %s"), *Candidate.ToString());
-			}
-			
-			// Notify listeners that local candidates are ready
-			OnLocalCandidatesReady.Broadcast(SessionName, LocalCandidates);
+			UE_LOG(LogOnlineICE, Log, TEXT("ICE gathering started for session (%d candidates ready)"), ICEAgent->GetLocalCandidates().Num());
 		}
 		else
 		{
@@ -124,6 +234,7 @@ bool FOnlineSessionICE::CreateSession(int32 HostingPlayerNum, FName SessionName,
 	if (Session)
 	{
 		Session->SessionState = EOnlineSessionState::Pending;
+		UpdateRegistryAdvertisement(SessionName);
 		TriggerOnCreateSessionCompleteDelegates(SessionName, true);
 		return true;
 	}
@@ -179,6 +290,10 @@ bool FOnlineSessionICE::UpdateSession(FName SessionName, FOnlineSessionSettings&
 
 	// Update session settings
 	Session->SessionSettings = UpdatedSessionSettings;
+	if (bShouldRefreshOnlineData)
+	{
+		UpdateRegistryAdvertisement(SessionName);
+	}
 	
 	UE_LOG(LogOnlineICE, Log, TEXT("Session '%s' updated successfully"), *SessionName.ToString());
 	TriggerOnUpdateSessionCompleteDelegates(SessionName, true);
@@ -214,8 +329,37 @@ bool FOnlineSessionICE::DestroySession(FName SessionName, const FOnDestroySessio
 	}
 
 	Session->SessionState = EOnlineSessionState::Destroying;
+	if (SessionRegistry.IsValid() && Session->SessionInfo.IsValid())
+	{
+		SessionRegistry->Withdraw(Session->SessionInfo->GetSessionId().ToString());
+	}
 	RemoveNamedSession(SessionName);
 
+	if (SignalingClient.IsValid())
+	{
+		SignalingClient->LeaveRoom(SessionName);
+	}
+
+	// Peers added to this session lose their agents
+	TArray<FString> SessionPeers;
+	for (const TPair<FString, FName>& PeerPair : PeerSessions)
+	{
+		if (PeerPair.Value == SessionName)
+		{
+			SessionPeers.Add(PeerPair.Key);
+		}
+	}
+	for (const FString& PeerId : SessionPeers)
+	{
+		RemoveSessionPeer(PeerId);
+	}
+
+	// Drop the peer connection but keep a live TURN allocation for the next session
+	if (ICEAgent.IsValid())
+	{
+		ICEAgent->ResetConnection();
+	}
+
 	CompletionDelegate.ExecuteIfBound(SessionName, true);
 	TriggerOnDestroySessionCompleteDelegates(SessionName, true);
 	return true;
@@ -358,16 +502,47 @@ bool FOnlineSessionICE::FindSessions(int32 SearchingPlayerNum, const TSharedRef<
 {
 	UE_LOG(LogOnlineICE, Log, TEXT("FindSessions for player %d"), SearchingPlayerNum);
 
+	// Pings of the previous search are of no use anymore
+	if (SessionPinger.IsValid() && CurrentSessionSearch.IsValid())
+	{
+		SessionPinger->CancelSearch(*CurrentSessionSearch);
+	}
+	PendingPingRequests.Reset();
+	bFindSessionsAwaitingPings = false;
+
 	CurrentSessionSearch = SearchSettings;
 	SearchSettings->SearchState = EOnlineAsyncTaskState::InProgress;
 
 	// Clear previous results
 	SearchSettings->SearchResults.Empty();
 
-	// In a production environment, this would query a signaling/matchmaking server
-	// For local/testing purposes, we can return local sessions that are advertised
-	// This allows for basic testing of the session system
-	
+	// The registry filters on its side and answers page by page, results are appended as they come
+	// and pinged right away; the search completes once its last page is in and every result is measured
+	if (SessionRegistry.IsValid())
+	{
+		TWeakPtr<FOnlineSessionSearch> WeakSearch = SearchSettings;
+		FOnICERegistrySearchPage OnPage = FOnICERegistrySearchPage::CreateLambda([this, WeakSearch](int32 FirstNewResult, int32 NumNewResults)
+		{
+			TSharedPtr<FOnlineSessionSearch> Search = WeakSearch.Pin();
+			if (Search.IsValid() && NumNewResults > 0)
+			{
+				if (SessionPinger.IsValid())
+				{
+					SessionPinger->PingResults(Search.ToSharedRef(), FirstNewResult, NumNewResults);
+				}
+				OnFindSessionsPageReceived.Broadcast(Search.ToSharedRef(), FirstNewResult, NumNewResults);
+			}
+		});
+		FOnICERegistrySearchComplete OnComplete = FOnICERegistrySearchComplete::CreateLambda([this](bool bWasSuccessful)
+		{
+			bFindSessionsAwaitingPings = true;
+			bFindSessionsSucceeded = bWasSuccessful;
+			TryCompleteFindSessions();
+		});
+		return SessionRegistry->Search(SearchSettings, OnPage, OnComplete);
+	}
+
+	// Without a registry only the sessions of this process can be found (local/testing)
 	int32 ResultsFound = 0;
 	
 	// Check all local sessions that are advertised and in the right state
@@ -380,7 +555,10 @@ bool FOnlineSessionICE::FindSessions(int32 SearchingPlayerNum, const TSharedRef<
 		    (Session.SessionState == EOnlineSessionState::InProgress || Session.SessionState == EOnlineSessionState::Pending))
 		{
 			// Check if session meets search criteria
-			bool bMatchesCriteria = true;
+			if (!FICESessionRegistry::MatchesQuery(Session, SearchSettings->QuerySettings))
+			{
+				continue;
+			}
 			
 			// Apply max search results limit
 			if (SearchSettings->MaxSearchResults > 0 && ResultsFound >= SearchSettings->MaxSearchResults)
@@ -402,6 +580,7 @@ bool FOnlineSessionICE::FindSessions(int32 SearchingPlayerNum, const TSharedRef<
 
 	// Mark search as complete
 	SearchSettings->SearchState = EOnlineAsyncTaskState::Done;
+	CurrentSessionSearch = nullptr;
 	
 	UE_LOG(LogOnlineICE, Log, TEXT("FindSessions completed: %d results found"), ResultsFound);
 	TriggerOnFindSessionsCompleteDelegates(true);
@@ -465,11 +644,22 @@ bool FOnlineSessionICE::CancelFindSessions()
 {
 	UE_LOG(LogOnlineICE, Log, TEXT("CancelFindSessions"));
 
+	if (SessionRegistry.IsValid())
+	{
+		SessionRegistry->CancelSearch();
+	}
+
 	if (CurrentSessionSearch.IsValid())
 	{
+		if (SessionPinger.IsValid())
+		{
+			SessionPinger->CancelSearch(*CurrentSessionSearch);
+		}
 		CurrentSessionSearch->SearchState = EOnlineAsyncTaskState::Failed;
 		CurrentSessionSearch = nullptr;
 	}
+	PendingPingRequests.Reset();
+	bFindSessionsAwaitingPings = false;
 
 	TriggerOnCancelFindSessionsCompleteDelegates(true);
 	return true;
@@ -477,11 +667,62 @@ bool FOnlineSessionICE::CancelFindSessions()
 
 bool FOnlineSessionICE::PingSearchResults(const FOnlineSessionSearchResult& SearchResult)
 {
-	// Ping functionality not implemented for ICE subsystem
-	// ICE connections are peer-to-peer and don't support traditional server pinging
-	// For P2P connection quality, use ICE connectivity checks and monitor the connection state
-	// via OnICEConnectionStateChanged delegate instead
-	return false;
+	// Only results of the current registry search can be pinged, they carry the host's addresses
+	if (!SessionPinger.IsValid() || !CurrentSessionSearch.IsValid() || !SearchResult.Session.SessionInfo.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("PingSearchResults: not a result of a registry search"));
+		return false;
+	}
+
+	const FString SessionId = SearchResult.Session.SessionInfo->GetSessionId().ToString();
+	const int32 ResultIndex = CurrentSessionSearch->SearchResults.IndexOfByPredicate([&SessionId](const FOnlineSessionSearchResult& Result)
+	{
+		return Result.Session.SessionInfo.IsValid() && Result.Session.SessionInfo->GetSessionId().ToString() == SessionId;
+	});
+	if (ResultIndex == INDEX_NONE || SessionPinger->PingResults(CurrentSessionSearch.ToSharedRef(), ResultIndex, 1) == 0)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("PingSearchResults: session %s cannot be pinged"), *SessionId);
+		return false;
+	}
+
+	PendingPingRequests.Add(SessionId);
+	return true;
+}
+
+void FOnlineSessionICE::OnSearchResultPingComplete(const TSharedRef<FOnlineSessionSearch>& Search, int32 ResultIndex, bool bReachable)
+{
+	OnSearchResultPinged.Broadcast(Search, ResultIndex, bReachable);
+
+	const FOnlineSessionInfo* SessionInfo = Search->SearchResults[ResultIndex].Session.SessionInfo.Get();
+	if (SessionInfo && PendingPingRequests.Remove(SessionInfo->GetSessionId().ToString()) > 0)
+	{
+		TriggerOnPingSearchResultsCompleteDelegates(bReachable);
+	}
+
+	TryCompleteFindSessions();
+}
+
+void FOnlineSessionICE::TryCompleteFindSessions()
+{
+	if (!bFindSessionsAwaitingPings)
+	{
+		return;
+	}
+
+	// Completion delegates fire once every result of the search is measured
+	if (CurrentSessionSearch.IsValid() && SessionPinger.IsValid() && SessionPinger->IsPinging(*CurrentSessionSearch))
+	{
+		return;
+	}
+
+	bFindSessionsAwaitingPings = false;
+	if (CurrentSessionSearch.IsValid())
+	{
+		// The search is kept as current so PingSearchResults can refresh its results
+		CurrentSessionSearch->SearchState = bFindSessionsSucceeded ? EOnlineAsyncTaskState::Done : EOnlineAsyncTaskState::Failed;
+		UE_LOG(LogOnlineICE, Log, TEXT("FindSessions completed: %d results found"), CurrentSessionSearch->SearchResults.Num());
+	}
+	TriggerOnFindSessionsCompleteDelegates(bFindSessionsSucceeded);
 }
 
 bool FOnlineSessionICE::JoinSession(int32 PlayerNum, FName SessionName, const FOnlineSessionSearchResult& DesiredSession)
@@ -496,8 +737,8 @@ bool FOnlineSessionICE::JoinSession(int32 PlayerNum, FName SessionName, const FO
 		return false;
 	}
 
-	// Create a new session based on the search result
-	FNamedOnlineSession& NewSession = Sessions.Add(SessionName, FNamedOnlineSession(SessionName, DesiredSession.Session.SessionSettings));
+	// Create a new session based on the search result (its session info names the host's signaling room)
+	FNamedOnlineSession& NewSession = Sessions.Add(SessionName, FNamedOnlineSession(SessionName, DesiredSession.Session));
 	NewSession.HostingPlayerNum = PlayerNum;
 	NewSession.SessionState = EOnlineSessionState::Pending;
 
@@ -505,21 +746,23 @@ bool FOnlineSessionICE::JoinSession(int32 PlayerNum, FName SessionName, const FO
 	if (ICEAgent.IsValid())
 	{
 		UE_LOG(LogOnlineICE, Log, TEXT("Gathering ICE candidates for joining session '%s'"), *SessionName.ToString());
+
+		// The joining peer is the controlled agent
+		ICEAgent->SetControlling(false);
+
+		// Join the room first so the candidates gathered below are signaled to the host
+		if (SignalingClient.IsValid())
+		{
+			SignalingClient->JoinRoom(SessionName, GetSignalingRoomId(SessionName), false);
+		}
+
+		// Candidates are trickled through OnLocalCandidatesReady as they are gathered
+		GatheringSessionName = SessionName;
 		bool bGathered = ICEAgent->GatherCandidates();
 		
 		if (bGathered)
 		{
-			TArray<FICECandidate> LocalCandidates = ICEAgent->GetLocalCandidates();
-			UE_LOG(LogOnlineICE, Log, TEXT("Gathered %d ICE candidates for joining"), LocalCandidates.Num());
-			
-			// Log candidates for debugging
-			for (const FICECandidate& Candidate : LocalCandidates)
-			{
-				UE_LOG(LogOnlineICE, Verbose, TEXT("  %s"), *Candidate.ToString());
-			}
-			
-			// Notify listeners that local candidates are ready
-			OnLocalCandidatesReady.Broadcast(SessionName, LocalCandidates);
+			UE_LOG(LogOnlineICE, Log, TEXT("ICE gathering started for joining (%d candidates ready)"), ICEAgent->GetLocalCandidates().Num());
 		}
 		else
 		{
@@ -733,13 +976,12 @@ bool FOnlineSessionICE::GetResolvedConnectString(FName SessionName, FString& Con
 	// Build connection string with ICE information
 	if (ICEAgent.IsValid() && ICEAgent->IsConnected())
 	{
-		// If ICE is connected, provide connection details
-		TArray<FICECandidate> LocalCandidates = ICEAgent->GetLocalCandidates();
-		if (LocalCandidates.Num() > 0)
+		// Plain host:port of the selected remote candidate, so ClientTravel can use it directly and
+		// it matches the source address UICENetDriver reports for incoming packets
+		TSharedPtr<const FInternetAddr> RemoteAddr = ICEAgent->GetPeerAddress();
+		if (RemoteAddr.IsValid())
 		{
-			// Use the first candidate for the connection string
-			const FICECandidate& Candidate = LocalCandidates[0];
-			ConnectInfo = FString::Printf(TEXT("ice://%s:%d"), *Candidate.Address, Candidate.Port);
+			ConnectInfo = RemoteAddr->ToString(true);
 			UE_LOG(LogOnlineICE, Verbose, TEXT("Connect string for session '%s': %s"), *SessionName.ToString(), *ConnectInfo);
 			return true;
 		}
@@ -998,10 +1240,49 @@ FUniqueNetIdPtr FOnlineSessionICE::CreateSessionIdFromString(const FString& Sess
 void FOnlineSessionICE::Tick(float DeltaTime)
 {
 	// Periodic processing for sessions
-	// Handle ICE keepalives, timeouts, etc.
-	if (ICEAgent.IsValid())
+	// Handle ICE keepalives, timeouts, etc. (only agents with work left are ticked)
+	if (AgentPool.IsValid())
+	{
+		AgentPool->Tick(DeltaTime);
+	}
+
+	// Peers whose agent stays Failed (consent expired, every pair failed) are removed with their TURN allocation
+	TArray<FString, TInlineAllocator<4>> FailedPeers;
+	for (const TPair<FString, FName>& PeerPair : PeerSessions)
+	{
+		TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerPair.Key);
+		if (!Agent.IsValid() || Agent->GetConnectionState() != EICEConnectionState::Failed)
+		{
+			FailedPeerTimes.Remove(PeerPair.Key);
+			continue;
+		}
+
+		float& FailedTime = FailedPeerTimes.FindOrAdd(PeerPair.Key);
+		FailedTime += DeltaTime;
+		if (FailedTime >= FAILED_PEER_TIMEOUT)
+		{
+			FailedPeers.Add(PeerPair.Key);
+		}
+	}
+	for (const FString& PeerId : FailedPeers)
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Peer '%s' failed for %.0f seconds, removing it"), *PeerId, FAILED_PEER_TIMEOUT);
+		RemoveSessionPeer(PeerId);
+	}
+
+	if (SignalingClient.IsValid())
+	{
+		SignalingClient->Tick(DeltaTime);
+	}
+
+	if (SessionRegistry.IsValid())
 	{
-		ICEAgent->Tick(DeltaTime);
+		SessionRegistry->Tick(DeltaTime);
+	}
+
+	if (SessionPinger.IsValid())
+	{
+		SessionPinger->Tick(DeltaTime);
 	}
 }
 
@@ -1017,7 +1298,7 @@ void FOnlineSessionICE::SetRemotePeer(const FString& IPAddress, int32 Port)
 		FICECandidate RemoteCandidate;
 		RemoteCandidate.Foundation = TEXT("remote");
 		RemoteCandidate.ComponentId = 1;
-		RemoteCandidate.Transport = TEXT("UDP");
+		RemoteCandidate.Transport = EICETransport::UDP;
 		RemoteCandidate.Priority = 1000;
 		RemoteCandidate.Address = IPAddress;
 		RemoteCandidate.Port = Port;
@@ -1028,43 +1309,48 @@ void FOnlineSessionICE::SetRemotePeer(const FString& IPAddress, int32 Port)
 	}
 }
 
-void FOnlineSessionICE::AddRemoteICECandidate(const FString& CandidateString)
+void FOnlineSessionICE::AddRemoteICECandidate(const FString& CandidateString, const FString& PeerId)
 {
 	UE_LOG(LogOnlineICE, Log, TEXT("Adding remote ICE candidate: %s"), *CandidateString);
 
-	if (ICEAgent.IsValid())
+	TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerId);
+	if (Agent.IsValid())
 	{
 		FICECandidate Candidate = FICECandidate::FromString(CandidateString);
 		if (!Candidate.Address.IsEmpty())
 		{
-			ICEAgent->AddRemoteCandidate(Candidate);
+			Agent->AddRemoteCandidate(Candidate);
 			UE_LOG(LogOnlineICE, Log, TEXT("Remote candidate added successfully"));
 			
-			// Notify listeners - Use first session name if available, otherwise NAME_None
-			FName SessionName = NAME_None;
-			if (Sessions.Num() > 0)
-			{
-				SessionName = Sessions.CreateConstIterator().Key();
-			}
-			OnRemoteCandidateReceived.Broadcast(SessionName, Candidate);
+			// Notify listeners - Use the peer's session, else the first session name if available, otherwise NAME_None
+			OnRemoteCandidateReceived.Broadcast(GetNotificationSessionName(PeerId), Candidate);
 		}
 		else
 		{
 			UE_LOG(LogOnlineICE, Warning, TEXT("Failed to parse candidate string"));
 		}
 	}
+	else
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("No ICE agent for peer '%s'"), *PeerId);
+	}
 }
 
-TArray<FString> FOnlineSessionICE::GetLocalICECandidates()
+TArray<FString> FOnlineSessionICE::GetLocalICECandidates(const FString& PeerId)
 {
 	TArray<FString> CandidateStrings;
 
-	if (ICEAgent.IsValid())
+	TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerId);
+	if (Agent.IsValid())
 	{
-		// Gather candidates if not already done
-		ICEAgent->GatherCandidates();
+		// Gather candidates if not already done (gathered ones are reused, a pass still in flight isn't restarted)
+		if (!Agent->IsGathering() && Agent->GetLocalCandidates().Num() == 0)
+		{
+			Agent->GatherCandidates();
+		}
 
-		TArray<FICECandidate> Candidates = ICEAgent->GetLocalCandidates();
+		const TArray<FICECandidate>& Candidates = Agent->GetLocalCandidates();
+		CandidateStrings.Reserve(Candidates.Num());
 		for (const FICECandidate& Candidate : Candidates)
 		{
 			CandidateStrings.Add(Candidate.ToString());
@@ -1074,27 +1360,347 @@ TArray<FString> FOnlineSessionICE::GetLocalICECandidates()
 	return CandidateStrings;
 }
 
-bool FOnlineSessionICE::StartICEConnectivityChecks()
+FString FOnlineSessionICE::GetLocalICEOffer(const FString& PeerId)
 {
-	UE_LOG(LogOnlineICE, Log, TEXT("Starting ICE connectivity checks"));
+	TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerId);
+	if (!Agent.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("No ICE agent for peer '%s'"), *PeerId);
+		return FString();
+	}
 
-	if (ICEAgent.IsValid())
+	// Gather candidates if not already done (don't restart a gathering pass still in flight)
+	if (!Agent->IsGathering() && Agent->GetLocalCandidates().Num() == 0)
+	{
+		Agent->GatherCandidates();
+	}
+
+	return FICEOffer::FromAgent(*Agent).ToBase64();
+}
+
+bool FOnlineSessionICE::AddRemoteICEOffer(const FString& Offer, const FString& PeerId)
+{
+	TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerId);
+	if (!Agent.IsValid())
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("No ICE agent for peer '%s'"), *PeerId);
+		return false;
+	}
+
+	FICEOffer RemoteOffer;
+	if (!FICEOffer::FromBase64(Offer, RemoteOffer))
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Failed to parse ICE offer (%d characters)"), Offer.Len());
+		return false;
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Adding remote ICE offer: ufrag %s, %d candidates"), *RemoteOffer.Ufrag, RemoteOffer.Candidates.Num());
+
+	// New credentials from a peer we are connected to mean it restarted ICE (RFC 8445 Section 9): restart too
+	if (Agent->IsConnected() && !Agent->IsRestarting() && !Agent->GetRemoteUfrag().IsEmpty() && Agent->GetRemoteUfrag() != RemoteOffer.Ufrag)
+	{
+		UE_LOG(LogOnlineICE, Log, TEXT("Remote peer restarted ICE, restarting%s"),
+			PeerId.IsEmpty() ? TEXT("") : *FString::Printf(TEXT(" with peer '%s'"), *PeerId));
+		Agent->RestartICE();
+	}
+	if (!Agent->SetRemoteCredentials(RemoteOffer.Ufrag, RemoteOffer.Password))
+	{
+		return false;
+	}
+
+	const FName SessionName = GetNotificationSessionName(PeerId);
+	for (const FICECandidate& Candidate : RemoteOffer.Candidates)
+	{
+		Agent->AddRemoteCandidate(Candidate);
+		OnRemoteCandidateReceived.Broadcast(SessionName, Candidate);
+	}
+	return true;
+}
+
+FName FOnlineSessionICE::GetNotificationSessionName(const FString& PeerId) const
+{
+	if (const FName* PeerSession = PeerSessions.Find(PeerId))
+	{
+		return *PeerSession;
+	}
+	return Sessions.Num() > 0 ? Sessions.CreateConstIterator().Key() : NAME_None;
+}
+
+FString FOnlineSessionICE::GetSignalingRoomId(FName SessionName) const
+{
+	const FNamedOnlineSession* Session = Sessions.Find(SessionName);
+	if (Session && Session->SessionInfo.IsValid() && Session->SessionInfo->IsValid())
+	{
+		return Session->SessionInfo->GetSessionId().ToString();
+	}
+	return SessionName.ToString();
+}
+
+void FOnlineSessionICE::UpdateRegistryAdvertisement(FName SessionName)
+{
+	const FNamedOnlineSession* Session = Sessions.Find(SessionName);
+	if (!SessionRegistry.IsValid() || !Session || !Session->bHosting || !Session->SessionInfo.IsValid())
+	{
+		return;
+	}
+
+	const FString SessionId = Session->SessionInfo->GetSessionId().ToString();
+	if (Session->SessionSettings.bShouldAdvertise)
+	{
+		const FString HostPeerId = SignalingClient.IsValid() ? SignalingClient->GetLocalPeerId() : FString();
+
+		// Server reflexive candidates share the pool socket, which answers pings; relays would drop them
+		TArray<FString> PingAddresses;
+		if (ICEAgent.IsValid())
+		{
+			for (const FICECandidate& Candidate : ICEAgent->GetLocalCandidatesOfType(EICECandidateType::ServerReflexive))
+			{
+				PingAddresses.AddUnique(Candidate.IsIPv6()
+					? FString::Printf(TEXT("[%s]:%d"), *Candidate.Address, Candidate.Port)
+					: FString::Printf(TEXT("%s:%d"), *Candidate.Address, Candidate.Port));
+			}
+		}
+		SessionRegistry->Advertise(SessionId, *Session, HostPeerId, PingAddresses);
+	}
+	else
+	{
+		SessionRegistry->Withdraw(SessionId);
+	}
+}
+
+bool FOnlineSessionICE::StartICEConnectivityChecks(const FString& PeerId)
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Starting ICE connectivity checks%s"),
+		PeerId.IsEmpty() ? TEXT("") : *FString::Printf(TEXT(" with peer '%s'"), *PeerId));
+
+	TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerId);
+	if (Agent.IsValid())
 	{
-		return ICEAgent->StartConnectivityChecks();
+		return Agent->StartConnectivityChecks();
 	}
 
 	return false;
 }
 
+bool FOnlineSessionICE::RestartICEConnection(const FString& PeerId)
+{
+	UE_LOG(LogOnlineICE, Log, TEXT("Restarting ICE%s"),
+		PeerId.IsEmpty() ? TEXT("") : *FString::Printf(TEXT(" with peer '%s'"), *PeerId));
+
+	TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerId);
+	if (Agent.IsValid())
+	{
+		return Agent->RestartICE();
+	}
+
+	return false;
+}
+
+bool FOnlineSessionICE::AddSessionPeer(FName SessionName, const FString& PeerId)
+{
+	if (PeerId.IsEmpty() || !AgentPool.IsValid())
+	{
+		return false;
+	}
+
+	const FNamedOnlineSession* Session = GetNamedSession(SessionName);
+	if (!Session)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Cannot add peer '%s': session '%s' does not exist"), *PeerId, *SessionName.ToString());
+		return false;
+	}
+
+	const FName* ExistingSession = PeerSessions.Find(PeerId);
+	if (ExistingSession && *ExistingSession != SessionName)
+	{
+		UE_LOG(LogOnlineICE, Warning, TEXT("Cannot add peer '%s' to session '%s': already in session '%s'"),
+			*PeerId, *SessionName.ToString(), *ExistingSession->ToString());
+		return false;
+	}
+
+	// Every peer costs an agent, its gathering and a TURN allocation: no more than the session has connections
+	const bool bNewPeer = !ExistingSession;
+	if (bNewPeer)
+	{
+		const int32 MaxPeers = Session->SessionSettings.NumPublicConnections + Session->SessionSettings.NumPrivateConnections;
+		int32 NumPeers = 0;
+		for (const TPair<FString, FName>& PeerPair : PeerSessions)
+		{
+			NumPeers += PeerPair.Value == SessionName ? 1 : 0;
+		}
+		if (NumPeers >= MaxPeers)
+		{
+			UE_LOG(LogOnlineICE, Warning, TEXT("Cannot add peer '%s': session '%s' is full (%d peers)"), *PeerId, *SessionName.ToString(), NumPeers);
+			return false;
+		}
+	}
+
+	TSharedRef<FICEAgent> Agent = AgentPool->CreateAgent(PeerId);
+	PeerSessions.Add(PeerId, SessionName);
+
+	if (bNewPeer)
+	{
+		// Listeners capture the peer, the agent is released with it in RemoveSessionPeer
+		Agent->OnConnectionStateChanged.AddLambda([this, SessionName, PeerId](EICEConnectionState NewState)
+		{
+			OnICEPeerConnectionStateChanged.Broadcast(SessionName, PeerId, NewState);
+			OnICEConnectionStateChanged.Broadcast(SessionName, NewState);
+		});
+
+		Agent->OnLocalCandidateGathered.AddLambda([this, SessionName, PeerId](const FICECandidate& Candidate)
+		{
+			UE_LOG(LogOnlineICE, Verbose, TEXT("Local candidate ready for peer '%s' of session '%s': %s"),
+				*PeerId, *SessionName.ToString(), *Candidate.ToString());
+
+			TArray<FICECandidate> Candidates;
+			Candidates.Add(Candidate);
+			OnPeerLocalCandidatesReady.Broadcast(SessionName, PeerId, Candidates);
+		});
+	}
+
+	// The host is the controlling agent of every peer
+	Agent->SetControlling(true);
+
+	const bool bGathered = Agent->GatherCandidates();
+	UE_LOG(LogOnlineICE, Log, TEXT("Peer '%s' added to session '%s' (%d agents, %d active)"),
+		*PeerId, *SessionName.ToString(), AgentPool->GetAgents().Num(), AgentPool->GetNumActiveAgents());
+	return bGathered;
+}
+
+bool FOnlineSessionICE::RemoveSessionPeer(const FString& PeerId)
+{
+	if (PeerId.IsEmpty() || !PeerSessions.Remove(PeerId))
+	{
+		return false;
+	}
+	FailedPeerTimes.Remove(PeerId);
+
+	TSharedPtr<FICEAgent> Agent = GetICEAgent(PeerId);
+	if (Agent.IsValid())
+	{
+		AgentPool->RemoveAgent(PeerId);
+
+		// Whoever still holds the agent must not report on behalf of the removed peer
+		Agent->OnConnectionStateChanged.Clear();
+		Agent->OnLocalCandidateGathered.Clear();
+	}
+
+	UE_LOG(LogOnlineICE, Log, TEXT("Peer '%s' removed"), *PeerId);
+	return true;
+}
+
+TSharedPtr<FICEAgent> FOnlineSessionICE::GetICEAgent(const FString& PeerId) const
+{
+	if (PeerId.IsEmpty())
+	{
+		return ICEAgent;
+	}
+
+	return AgentPool.IsValid() ? AgentPool->FindAgent(PeerId) : nullptr;
+}
+
+void FOnlineSessionICE::DumpICEStats(FOutputDevice& Ar)
+{
+	Ar.Logf(TEXT("=== ICE Stats ==="));
+
+	if (!AgentPool.IsValid())
+	{
+		Ar.Logf(TEXT("No ICE agent"));
+		return;
+	}
+
+	for (const TPair<FString, TSharedPtr<FICEAgent>>& Entry : AgentPool->GetAgents())
+	{
+		if (!Entry.Value.IsValid())
+		{
+			continue;
+		}
+		Ar.Logf(TEXT("--- Agent %s (%s) ---"), Entry.Key.IsEmpty() ? TEXT("default") : *Entry.Key,
+			Entry.Value->IsConnected() ? TEXT("connected") : TEXT("not connected"));
+		Entry.Value->GetStats().Dump(Ar);
+	}
+}
+
+void FOnlineSessionICE::ResetICEStats()
+{
+	if (AgentPool.IsValid())
+	{
+		for (const TPair<FString, TSharedPtr<FICEAgent>>& Entry : AgentPool->GetAgents())
+		{
+			if (Entry.Value.IsValid())
+			{
+				Entry.Value->ResetStats();
+			}
+		}
+	}
+}
+
 void FOnlineSessionICE::DumpICEStatus(FOutputDevice& Ar)
 {
 	Ar.Logf(TEXT("=== ICE Connection Status ==="));
 
+	if (SignalingClient.IsValid())
+	{
+		Ar.Logf(TEXT("Signaling: %s via %s (peer %s, %d offers sent, %d received)"),
+			SignalingClient->IsConnected() ? TEXT("connected") : TEXT("disconnected"), SignalingClient->GetTransportName(),
+			*SignalingClient->GetLocalPeerId(), SignalingClient->GetNumOffersSent(), SignalingClient->GetNumOffersReceived());
+	}
+
+	if (SessionRegistry.IsValid())
+	{
+		Ar.Logf(TEXT("Registry: %s (%d sessions advertised%s)"), *SessionRegistry->GetURL(),
+			SessionRegistry->GetNumAdvertised(), SessionRegistry->IsSearching() ? TEXT(", search running") : TEXT(""));
+	}
+
+	if (SessionPinger.IsValid())
+	{
+		Ar.Logf(TEXT("Pings: %d in flight, %d queued"), SessionPinger->GetNumInFlight(), SessionPinger->GetNumQueued());
+	}
+
 	if (ICEAgent.IsValid())
 	{
 		Ar.Logf(TEXT("Connected: %s"), ICEAgent->IsConnected() ? TEXT("Yes") : TEXT("No"));
+		Ar.Logf(TEXT("Handshake: %s (%u packets rejected)"), ICEAgent->GetRemoteUfrag().IsEmpty() ? TEXT("unsigned, no remote credentials") : TEXT("signed"),
+			ICEAgent->GetRejectedHandshakeCount());
+		Ar.Logf(TEXT("Encryption: %s (%u records rejected)"),
+			!ICEAgent->IsTrafficEncrypted() ? TEXT("off") : ICEAgent->IsSecureChannelEstablished() ? TEXT("AES-256-GCM") : TEXT("pending key exchange"),
+			ICEAgent->GetRejectedRecordCount());
+		if (ICEAgent->IsCoalescingSends())
+		{
+			const uint32 NumDatagrams = ICEAgent->GetCoalescedDatagramCount();
+			Ar.Logf(TEXT("Coalescing: %u messages in %u datagrams (%.1f per datagram)"), ICEAgent->GetCoalescedMessageCount(), NumDatagrams,
+				NumDatagrams > 0 ? (float)ICEAgent->GetCoalescedMessageCount() / NumDatagrams : 0.0f);
+		}
+		else
+		{
+			Ar.Logf(TEXT("Coalescing: off"));
+		}
+		if (ICEAgent->IsPacingSends())
+		{
+			const FICESendScheduler& Pacer = ICEAgent->GetSendScheduler();
+			Ar.Logf(TEXT("Pacing: %.0f kbit/s, queuing delay %.1f ms, queued %d/%d/%d/%d bytes, %u delayed, %u dropped"),
+				Pacer.GetRate() * 8.0f / 1000.0f, Pacer.GetQueuingDelay() * 1000.0f,
+				Pacer.GetQueuedBytes(EICESendPriority::Realtime), Pacer.GetQueuedBytes(EICESendPriority::Interactive),
+				Pacer.GetQueuedBytes(EICESendPriority::Normal), Pacer.GetQueuedBytes(EICESendPriority::Bulk),
+				Pacer.GetDelayedCount(), Pacer.GetDroppedCount());
+		}
+		else
+		{
+			Ar.Logf(TEXT("Pacing: off"));
+		}
+		if (ICEAgent->IsFECActive())
+		{
+			const FICEFECCodec& FEC = ICEAgent->GetFECCodec();
+			Ar.Logf(TEXT("FEC: loss estimate %.1f%%, group size %d, %u parity sent, %u recovered, %u unrecovered"),
+				FEC.GetLossEstimate() * 100.0f, FEC.GetGroupSize(), FEC.GetParitySentCount(),
+				FEC.GetRecoveredCount(), FEC.GetUnrecoveredCount());
+		}
+		else
+		{
+			Ar.Logf(TEXT("FEC: off"));
+		}
 
-		TArray<FICECandidate> LocalCandidates = ICEAgent->GetLocalCandidates();
+		const TArray<FICECandidate>& LocalCandidates = ICEAgent->GetLocalCandidates();
 		Ar.Logf(TEXT("Local Candidates: %d"), LocalCandidates.Num());
 		for (const FICECandidate& Candidate : LocalCandidates)
 		{
@@ -1109,11 +1715,62 @@ void FOnlineSessionICE::DumpICEStatus(FOutputDevice& Ar)
 		{
 			Ar.Logf(TEXT("Remote Peer: Not set"));
 		}
+
+		const TArray<FICECandidatePair>& CandidatePairs = ICEAgent->GetCandidatePairs();
+		Ar.Logf(TEXT("Candidate Pairs: %d (%s)"), CandidatePairs.Num(), ICEAgent->IsControlling() ? TEXT("controlling") : TEXT("controlled"));
+		for (const FICECandidatePair& Pair : CandidatePairs)
+		{
+			Ar.Logf(TEXT("  %s"), *Pair.ToString());
+		}
+
+		FICEPairStats PairStats;
+		if (ICEAgent->GetSelectedPairStats(PairStats))
+		{
+			Ar.Logf(TEXT("Selected Pair: %s, consent %.1fs ago"), *PairStats.ToString(), ICEAgent->GetTimeSinceConsent());
+		}
+
+		Ar.Logf(TEXT("Relay To Direct Upgrades: %u%s"), ICEAgent->GetDirectUpgradeCount(),
+			ICEAgent->IsUpgradingToDirect() ? TEXT(" (checking direct pairs)") : TEXT(""));
+
+		const double Now = FPlatformTime::Seconds();
+		for (const TPair<FString, FICEServerRTT>& Server : FICEAgent::GetServerRTTs())
+		{
+			if (Server.Value.bReachable)
+			{
+				Ar.Logf(TEXT("Server %s: rtt=%.1fms (%.0fs ago)"), *Server.Key, Server.Value.RTT, Now - Server.Value.MeasuredTime);
+			}
+			else
+			{
+				Ar.Logf(TEXT("Server %s: unreachable (%.0fs ago)"), *Server.Key, Now - Server.Value.MeasuredTime);
+			}
+		}
+
+		Ar.Logf(TEXT("Send Path Allocations: %u"), ICEAgent->GetSendAllocationCount());
 	}
 	else
 	{
 		Ar.Logf(TEXT("ICE Agent not initialized"));
 	}
 
+	if (AgentPool.IsValid())
+	{
+		Ar.Logf(TEXT("Agent Pool: port %d, %d agents, %d active, %d connected, %u unrouted datagrams"),
+			AgentPool->GetLocalPort(), AgentPool->GetAgents().Num(), AgentPool->GetNumActiveAgents(),
+			AgentPool->GetNumConnectedAgents(), AgentPool->GetUnroutedCount());
+
+		for (const TPair<FString, FName>& PeerPair : PeerSessions)
+		{
+			TSharedPtr<FICEAgent> Agent = AgentPool->FindAgent(PeerPair.Key);
+			if (!Agent.IsValid())
+			{
+				continue;
+			}
+
+			Ar.Logf(TEXT("  Peer '%s' (session '%s'): %s, %d pairs%s"), *PeerPair.Key, *PeerPair.Value.ToString(),
+				Agent->IsConnected() ? TEXT("connected") : TEXT("not connected"), Agent->GetCandidatePairs().Num(),
+				Agent->IsConnected() ? *FString::Printf(TEXT(" via %s"), *Agent->GetSelectedRemoteCandidate().ToString()) : TEXT(""));
+		}
+	}
+
 	Ar.Logf(TEXT("============================="));
 }
@@ -3,12 +3,43 @@
 #include "OnlineSubsystemICE.h"
 #include "OnlineSessionInterfaceICE.h"
 #include "OnlineIdentityInterfaceICE.h"
+#include "ICEAddressResolver.h"
 #include "Misc/ConfigCacheIni.h"
 
 FOnlineSubsystemICE::FOnlineSubsystemICE(FName InInstanceName)
 	: FOnlineSubsystemImpl(TEXT("ICE"), InInstanceName)
 	, SessionInterface(nullptr)
 	, IdentityInterface(nullptr)
+	, GatheringTimeout(5.0f)
+	, ConnectivityCheckInterval(0.05f)
+	, bUseIOThread(false)
+	, PathMTU(1280)
+	, bEnableIPv6(false)
+	, ConsentCheckInterval(1.0f)
+	, ConsentTimeout(5.0f)
+	, DirectUpgradeInterval(2.0f)
+	, MaxDirectUpgradeRounds(5)
+	, ServerSelectionTTL(300.0f)
+	, DNSCacheTTL(300.0f)
+	, SignalingBatchInterval(0.05f)
+	, RegistryPageSize(50)
+	, RegistryHeartbeatInterval(30.0f)
+	, PingMaxInFlight(256)
+	, PingTimeout(1.0f)
+	, bEncryptTraffic(false)
+	, bAllowUnsignedHandshake(false)
+	, bCoalesceSends(false)
+	, CoalesceWindow(0.001f)
+	, bPaceSends(false)
+	, PacingInitialRate(250000.0f)
+	, PacingMinRate(16000.0f)
+	, PacingMaxRate(12500000.0f)
+	, PacingBurstSize(16384)
+	, PacingQueueLimit(262144)
+	, PacingTargetDelay(0.025f)
+	, bEnableFEC(false)
+	, FECMinLossRate(0.005f)
+	, FECMaxGroupSize(16)
 {
 }
 
@@ -21,6 +52,38 @@ bool FOnlineSubsystemICE::Init()
 	GConfig->GetString(TEXT("OnlineSubsystemICE"), TEXT("TURNServer"), TURNServerAddress, GEngineIni);
 	GConfig->GetString(TEXT("OnlineSubsystemICE"), TEXT("TURNUsername"), TURNUsername, GEngineIni);
 	GConfig->GetString(TEXT("OnlineSubsystemICE"), TEXT("TURNCredential"), TURNCredential, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("GatheringTimeout"), GatheringTimeout, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("ConnectivityCheckInterval"), ConnectivityCheckInterval, GEngineIni);
+	GConfig->GetBool(TEXT("OnlineSubsystemICE"), TEXT("bUseIOThread"), bUseIOThread, GEngineIni);
+	GConfig->GetInt(TEXT("OnlineSubsystemICE"), TEXT("PathMTU"), PathMTU, GEngineIni);
+	GConfig->GetBool(TEXT("OnlineSubsystemICE"), TEXT("bEnableIPv6"), bEnableIPv6, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("ConsentCheckInterval"), ConsentCheckInterval, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("ConsentTimeout"), ConsentTimeout, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("DirectUpgradeInterval"), DirectUpgradeInterval, GEngineIni);
+	GConfig->GetInt(TEXT("OnlineSubsystemICE"), TEXT("MaxDirectUpgradeRounds"), MaxDirectUpgradeRounds, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("ServerSelectionTTL"), ServerSelectionTTL, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("DNSCacheTTL"), DNSCacheTTL, GEngineIni);
+	GConfig->GetString(TEXT("OnlineSubsystemICE"), TEXT("SignalingURL"), SignalingURL, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("SignalingBatchInterval"), SignalingBatchInterval, GEngineIni);
+	GConfig->GetString(TEXT("OnlineSubsystemICE"), TEXT("RegistryURL"), RegistryURL, GEngineIni);
+	GConfig->GetInt(TEXT("OnlineSubsystemICE"), TEXT("RegistryPageSize"), RegistryPageSize, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("RegistryHeartbeatInterval"), RegistryHeartbeatInterval, GEngineIni);
+	GConfig->GetInt(TEXT("OnlineSubsystemICE"), TEXT("PingMaxInFlight"), PingMaxInFlight, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("PingTimeout"), PingTimeout, GEngineIni);
+	GConfig->GetBool(TEXT("OnlineSubsystemICE"), TEXT("bEncryptTraffic"), bEncryptTraffic, GEngineIni);
+	GConfig->GetBool(TEXT("OnlineSubsystemICE"), TEXT("bAllowUnsignedHandshake"), bAllowUnsignedHandshake, GEngineIni);
+	GConfig->GetBool(TEXT("OnlineSubsystemICE"), TEXT("bCoalesceSends"), bCoalesceSends, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("CoalesceWindow"), CoalesceWindow, GEngineIni);
+	GConfig->GetBool(TEXT("OnlineSubsystemICE"), TEXT("bPaceSends"), bPaceSends, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("PacingInitialRate"), PacingInitialRate, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("PacingMinRate"), PacingMinRate, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("PacingMaxRate"), PacingMaxRate, GEngineIni);
+	GConfig->GetInt(TEXT("OnlineSubsystemICE"), TEXT("PacingBurstSize"), PacingBurstSize, GEngineIni);
+	GConfig->GetInt(TEXT("OnlineSubsystemICE"), TEXT("PacingQueueLimit"), PacingQueueLimit, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("PacingTargetDelay"), PacingTargetDelay, GEngineIni);
+	GConfig->GetBool(TEXT("OnlineSubsystemICE"), TEXT("bEnableFEC"), bEnableFEC, GEngineIni);
+	GConfig->GetFloat(TEXT("OnlineSubsystemICE"), TEXT("FECMinLossRate"), FECMinLossRate, GEngineIni);
+	GConfig->GetInt(TEXT("OnlineSubsystemICE"), TEXT("FECMaxGroupSize"), FECMaxGroupSize, GEngineIni);
 
 	// Set default values if not configured
 	if (STUNServerAddress.IsEmpty())
@@ -31,6 +94,15 @@ bool FOnlineSubsystemICE::Init()
 	UE_LOG(LogOnlineICE, Log, TEXT("STUN Server: %s"), *STUNServerAddress);
 	UE_LOG(LogOnlineICE, Log, TEXT("TURN Server: %s"), *TURNServerAddress);
 
+	// Look server hostnames up now, so the first gathering finds them cached
+	TArray<FString> ServerAddresses;
+	STUNServerAddress.ParseIntoArray(ServerAddresses, TEXT(","));
+	TArray<FString> TURNServerAddresses;
+	TURNServerAddress.ParseIntoArray(TURNServerAddresses, TEXT(","));
+	ServerAddresses.Append(TURNServerAddresses);
+	FICEAddressResolver::Get().SetCacheTTL(DNSCacheTTL);
+	FICEAddressResolver::Get().Prewarm(ServerAddresses);
+
 	// Create interfaces
 	SessionInterface = MakeShared<FOnlineSessionICE, ESPMode::ThreadSafe>(this);
 	IdentityInterface = MakeShared<FOnlineIdentityICE, ESPMode::ThreadSafe>(this);
@@ -13,6 +13,8 @@
 #include "Engine/World.h"
 #include "GameFramework/PlayerController.h"
 #include "ICEAgent.h"
+#include "ICEBenchmark.h"
+#include "Misc/Parse.h"
 
 IMPLEMENT_MODULE(FOnlineSubsystemICEModule, OnlineSubsystemICE);
 
@@ -75,6 +77,16 @@ namespace
 		}
 		return nullptr;
 	}
+
+	/** Output device that forwards every line to the ICE log (console command output) */
+	class FICELogOutputDevice : public FOutputDevice
+	{
+	public:
+		virtual void Serialize(const TCHAR* V, ELogVerbosity::Type Verbosity, const FName& Category) override
+		{
+			UE_LOG(LogOnlineICE, Display, TEXT("%s"), V);
+		}
+	};
 }
 
 /**
@@ -134,12 +146,22 @@ void FOnlineSubsystemICEModule::StartupModule()
 		{
 			UE_LOG(LogOnlineICE, Display, TEXT("Available ICE commands:"));
 			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.HOST [sessionName] - Host a new game session (simplified)"));
-			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.JOIN <sessionName> - Join an existing game session (simplified)"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.JOIN <sessionName> [sessionId] - Join an existing game session (simplified), by registry id if given"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.FIND [KEY=VALUE ...] - Search sessions and list them"));
 			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.SETREMOTEPEER <ip> <port> - Set remote peer address"));
 			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.ADDCANDIDATE <candidate> - Add remote ICE candidate"));
 			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.LISTCANDIDATES - List local ICE candidates"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.OFFER [peerId] - Print the local offer (credentials and every candidate in one blob)"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.ADDOFFER <offer> [peerId] - Add the offer of the remote peer"));
 			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.STARTCHECKS - Start connectivity checks"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.ADDPEER <sessionName> <peerId> - Start ICE with one more peer of a hosted session"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.PEERCANDIDATE <peerId> <candidate> - Add remote ICE candidate of a session peer"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.PEERCHECKS <peerId> - Start connectivity checks with a session peer"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.REMOVEPEER <peerId> - Drop a session peer"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.RESTART [peerId] - Gather new candidates and migrate the connection without dropping it"));
 			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.STATUS - Show connection status"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.STATS [interval|0|RESET] - Show traffic counters and latency histograms, every interval seconds if given"));
+			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.BENCH [Key=Value...] - Benchmark connections across simulated NATs, results saved as JSON"));
 			UE_LOG(LogOnlineICE, Display, TEXT("  ICE.HELP - Show this help"));
 		}),
 		ECVF_Default
@@ -309,12 +331,12 @@ void FOnlineSubsystemICEModule::StartupModule()
 	// ICE JOIN
 	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
 		TEXT("ICE.JOIN"),
-		TEXT("Join an existing game session. Usage: ICE.JOIN <sessionName>"),
+		TEXT("Join an existing game session. Usage: ICE.JOIN <sessionName> [sessionId]"),
 		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
 		{
 			if (Args.Num() < 1)
 			{
-				UE_LOG(LogOnlineICE, Warning, TEXT("Usage: ICE.JOIN <sessionName>"));
+				UE_LOG(LogOnlineICE, Warning, TEXT("Usage: ICE.JOIN <sessionName> [sessionId]"));
 				return;
 			}
 			
@@ -338,6 +360,12 @@ void FOnlineSubsystemICEModule::StartupModule()
 					// In a real scenario, this would come from FindSessions
 					FOnlineSessionSearchResult SearchResult;
 					SearchResult.Session.SessionSettings = CreateDefaultSessionSettings();
+
+					// A registry id (from ICE.FIND) names the host's signaling room
+					if (Args.Num() > 1)
+					{
+						SearchResult.Session.SessionInfo = MakeShared<FOnlineSessionInfoICE>(Args[1], FString());
+					}
 					
 					// Bind to completion delegate with self-cleanup
 					// Note: Capturing SessionName by value to ensure it outlives the async callback
@@ -469,6 +497,67 @@ void FOnlineSubsystemICEModule::StartupModule()
 		ECVF_Default
 	));
 
+	// ICE FIND
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.FIND"),
+		TEXT("Search sessions and list them. Usage: ICE.FIND [KEY=VALUE ...]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			// Every argument is an equality filter, integral values are compared as numbers
+			TSharedRef<FOnlineSessionSearch> Search = MakeShared<FOnlineSessionSearch>();
+			Search->MaxSearchResults = 100;
+			for (const FString& Arg : Args)
+			{
+				FString Key, Value;
+				if (!Arg.Split(TEXT("="), &Key, &Value) || Key.IsEmpty())
+				{
+					UE_LOG(LogOnlineICE, Warning, TEXT("ICE.FIND: '%s' ignored, expected KEY=VALUE"), *Arg);
+					continue;
+				}
+				if (Value.IsNumeric() && !Value.Contains(TEXT(".")))
+				{
+					Search->QuerySettings.Set(FName(*Key), FCString::Atoi(*Value), EOnlineComparisonOp::Equals);
+				}
+				else
+				{
+					Search->QuerySettings.Set(FName(*Key), Value, EOnlineComparisonOp::Equals);
+				}
+			}
+
+			TSharedPtr<FDelegateHandle> DelegateHandlePtr = MakeShared<FDelegateHandle>();
+			*DelegateHandlePtr = ICESession->OnFindSessionsCompleteDelegates.AddLambda([Search, DelegateHandlePtr](bool bWasSuccessful)
+			{
+				UE_LOG(LogOnlineICE, Display, TEXT("ICE.FIND: %s, %d sessions"), bWasSuccessful ? TEXT("done") : TEXT("failed"), Search->SearchResults.Num());
+				for (const FOnlineSessionSearchResult& Result : Search->SearchResults)
+				{
+					UE_LOG(LogOnlineICE, Display, TEXT("  %s - owner '%s', %d/%d slots open, %s"),
+						Result.Session.SessionInfo.IsValid() ? *Result.Session.SessionInfo->ToString() : TEXT("(local)"),
+						*Result.Session.OwningUserName, Result.Session.NumOpenPublicConnections, Result.Session.SessionSettings.NumPublicConnections,
+						Result.PingInMs < MAX_QUERY_PING ? *FString::Printf(TEXT("%d ms"), Result.PingInMs) : TEXT("unreachable"));
+				}
+
+				if (FOnlineSessionICE* Session = GetICESessionInterface())
+				{
+					Session->ClearOnFindSessionsCompleteDelegate_Handle(*DelegateHandlePtr);
+				}
+			});
+
+			if (!ICESession->FindSessions(0, Search))
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE.FIND: Failed to start the search"));
+				ICESession->ClearOnFindSessionsCompleteDelegate_Handle(*DelegateHandlePtr);
+			}
+		}),
+		ECVF_Default
+	));
+
 	// ICE SETREMOTEPEER
 	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
 		TEXT("ICE.SETREMOTEPEER"),
@@ -579,6 +668,51 @@ void FOnlineSubsystemICEModule::StartupModule()
 		ECVF_Default
 	));
 
+	// ICE OFFER
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.OFFER"),
+		TEXT("Print the local ICE offer. Usage: ICE.OFFER [peerId]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			const FString Offer = ICESession->GetLocalICEOffer(Args.Num() > 0 ? Args[0] : FString());
+			UE_LOG(LogOnlineICE, Display, TEXT("ICE: Local offer (%d characters):"), Offer.Len());
+			UE_LOG(LogOnlineICE, Display, TEXT("  %s"), *Offer);
+		}),
+		ECVF_Default
+	));
+
+	// ICE ADDOFFER
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.ADDOFFER"),
+		TEXT("Add the ICE offer of the remote peer. Usage: ICE.ADDOFFER <offer> [peerId]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 1)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("Usage: ICE.ADDOFFER <offer> [peerId]"));
+				return;
+			}
+
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			const bool bSuccess = ICESession->AddRemoteICEOffer(Args[0], Args.Num() > 1 ? Args[1] : FString());
+			UE_LOG(LogOnlineICE, Display, TEXT("ICE: Remote offer %s"), bSuccess ? TEXT("added") : TEXT("rejected"));
+		}),
+		ECVF_Default
+	));
+
 	// ICE STARTCHECKS
 	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
 		TEXT("ICE.STARTCHECKS"),
@@ -608,6 +742,141 @@ void FOnlineSubsystemICEModule::StartupModule()
 		ECVF_Default
 	));
 
+	// ICE ADDPEER
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.ADDPEER"),
+		TEXT("Start ICE with one more peer of a hosted session. Usage: ICE.ADDPEER <sessionName> <peerId>"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 2)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("Usage: ICE.ADDPEER <sessionName> <peerId>"));
+				return;
+			}
+
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			const FString& PeerId = Args[1];
+			if (ICESession->AddSessionPeer(FName(*Args[0]), PeerId))
+			{
+				UE_LOG(LogOnlineICE, Display, TEXT("ICE.ADDPEER: Gathering candidates for peer '%s'"), *PeerId);
+				for (const FString& Candidate : ICESession->GetLocalICECandidates(PeerId))
+				{
+					UE_LOG(LogOnlineICE, Display, TEXT("  %s"), *Candidate);
+				}
+				UE_LOG(LogOnlineICE, Display, TEXT("ICE.ADDPEER: Share them with the peer, then use ICE.PEERCANDIDATE and ICE.PEERCHECKS"));
+			}
+			else
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE.ADDPEER: Failed to add peer '%s' to session '%s'"), *PeerId, *Args[0]);
+			}
+		}),
+		ECVF_Default
+	));
+
+	// ICE PEERCANDIDATE
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.PEERCANDIDATE"),
+		TEXT("Add remote ICE candidate of a session peer. Usage: ICE.PEERCANDIDATE <peerId> <candidate_string>"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 2)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("Usage: ICE.PEERCANDIDATE <peerId> <candidate_string>"));
+				return;
+			}
+
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			TArray<FString> CandidateArgs(Args);
+			CandidateArgs.RemoveAt(0);
+			const FString CandidateStr = FString::Join(CandidateArgs, TEXT(" "));
+			ICESession->AddRemoteICECandidate(CandidateStr, Args[0]);
+			UE_LOG(LogOnlineICE, Display, TEXT("ICE: Added remote candidate for peer '%s': %s"), *Args[0], *CandidateStr);
+		}),
+		ECVF_Default
+	));
+
+	// ICE PEERCHECKS
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.PEERCHECKS"),
+		TEXT("Start connectivity checks with a session peer. Usage: ICE.PEERCHECKS <peerId>"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 1)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("Usage: ICE.PEERCHECKS <peerId>"));
+				return;
+			}
+
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			const bool bSuccess = ICESession->StartICEConnectivityChecks(Args[0]);
+			UE_LOG(LogOnlineICE, Display, TEXT("ICE: Connectivity checks with peer '%s' %s"), *Args[0], bSuccess ? TEXT("started") : TEXT("failed"));
+		}),
+		ECVF_Default
+	));
+
+	// ICE REMOVEPEER
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.REMOVEPEER"),
+		TEXT("Drop a session peer. Usage: ICE.REMOVEPEER <peerId>"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 1)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("Usage: ICE.REMOVEPEER <peerId>"));
+				return;
+			}
+
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			const bool bRemoved = ICESession->RemoveSessionPeer(Args[0]);
+			UE_LOG(LogOnlineICE, Display, TEXT("ICE: Peer '%s' %s"), *Args[0], bRemoved ? TEXT("removed") : TEXT("not found"));
+		}),
+		ECVF_Default
+	));
+
+	// ICE RESTART
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.RESTART"),
+		TEXT("Gather new candidates and migrate the connection without dropping it. Usage: ICE.RESTART [peerId]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			const FString PeerId = Args.Num() > 0 ? Args[0] : FString();
+			const bool bSuccess = ICESession->RestartICEConnection(PeerId);
+			UE_LOG(LogOnlineICE, Display, TEXT("ICE: Restart %s"), bSuccess ? TEXT("started, exchange the new candidates then start checks") : TEXT("failed"));
+		}),
+		ECVF_Default
+	));
+
 	// ICE STATUS
 	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
 		TEXT("ICE.STATUS"),
@@ -621,16 +890,7 @@ void FOnlineSubsystemICEModule::StartupModule()
 				if (SessionInterface.IsValid())
 				{
 					FOnlineSessionICE* ICESession = static_cast<FOnlineSessionICE*>(SessionInterface.Get());
-					// Create a temporary output device that logs to console
-					class FLogOutputDevice : public FOutputDevice
-					{
-					public:
-						virtual void Serialize(const TCHAR* V, ELogVerbosity::Type Verbosity, const FName& Category) override
-						{
-							UE_LOG(LogOnlineICE, Display, TEXT("%s"), V);
-						}
-					};
-					FLogOutputDevice LogDevice;
+					FICELogOutputDevice LogDevice;
 					ICESession->DumpICEStatus(LogDevice);
 				}
 				else
@@ -646,6 +906,140 @@ void FOnlineSubsystemICEModule::StartupModule()
 		ECVF_Default
 	));
 	
+	// ICE STATS
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.STATS"),
+		TEXT("Show traffic counters and latency histograms of every agent. Usage: ICE.STATS [interval seconds, 0 stops | RESET]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([this](const TArray<FString>& Args)
+		{
+			FOnlineSessionICE* ICESession = GetICESessionInterface();
+			if (!ICESession)
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE: OnlineSubsystemICE not initialized"));
+				return;
+			}
+
+			if (Args.Num() > 0 && Args[0].Equals(TEXT("RESET"), ESearchCase::IgnoreCase))
+			{
+				ICESession->ResetICEStats();
+				UE_LOG(LogOnlineICE, Display, TEXT("ICE: Stats reset"));
+				return;
+			}
+
+			FICELogOutputDevice LogDevice;
+			ICESession->DumpICEStats(LogDevice);
+			if (Args.Num() == 0)
+			{
+				return;
+			}
+
+			// A new interval replaces the running dump, 0 only stops it
+			if (StatsTickerHandle.IsValid())
+			{
+				FTSTicker::GetCoreTicker().RemoveTicker(StatsTickerHandle);
+				StatsTickerHandle.Reset();
+			}
+
+			const float Interval = FCString::Atof(*Args[0]);
+			if (Interval > 0.0f)
+			{
+				StatsTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([](float DeltaTime)
+				{
+					FOnlineSessionICE* Session = GetICESessionInterface();
+					if (Session)
+					{
+						FICELogOutputDevice TickLogDevice;
+						Session->DumpICEStats(TickLogDevice);
+					}
+					return true;
+				}), Interval);
+				UE_LOG(LogOnlineICE, Display, TEXT("ICE: Dumping stats every %.1f seconds, ICE.STATS 0 stops"), Interval);
+			}
+		}),
+		ECVF_Default
+	));
+
+	// ICE BENCH
+	ConsoleCommands.Add(ConsoleManager.RegisterConsoleCommand(
+		TEXT("ICE.BENCH"),
+		TEXT("Connect agent pairs across simulated NATs and measure connect time, goodput, allocations and Tick cost. ")
+		TEXT("Usage: ICE.BENCH [Trials=5] [NAT=Symmetric-FullCone+...] [Latency=ms] [Jitter=ms] [Loss=percent] [Seed=1] ")
+		TEXT("[Timeout=s] [Duration=s] [Rate=bytes/s] [Size=bytes] [Encrypt=1] [Coalesce=1] [Pace=1] [FEC=1] [Output=path]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			const FString Cmd = FString::Join(Args, TEXT(" "));
+
+			FICEBenchmarkSettings Settings;
+			FParse::Value(*Cmd, TEXT("Trials="), Settings.Trials);
+			FParse::Value(*Cmd, TEXT("Latency="), Settings.Conditions.Latency);
+			FParse::Value(*Cmd, TEXT("Jitter="), Settings.Conditions.Jitter);
+			FParse::Value(*Cmd, TEXT("Seed="), Settings.Seed);
+			FParse::Value(*Cmd, TEXT("Timeout="), Settings.ConnectTimeout);
+			FParse::Value(*Cmd, TEXT("Duration="), Settings.TransferDuration);
+			FParse::Value(*Cmd, TEXT("Rate="), Settings.TransferRate);
+			FParse::Value(*Cmd, TEXT("Size="), Settings.PayloadSize);
+			FParse::Bool(*Cmd, TEXT("Encrypt="), Settings.AgentConfig.bEncryptTraffic);
+			FParse::Bool(*Cmd, TEXT("Coalesce="), Settings.AgentConfig.bCoalesceSends);
+			FParse::Bool(*Cmd, TEXT("Pace="), Settings.AgentConfig.bPaceSends);
+			FParse::Bool(*Cmd, TEXT("FEC="), Settings.AgentConfig.bEnableFEC);
+
+			float LossPercent;
+			if (FParse::Value(*Cmd, TEXT("Loss="), LossPercent))
+			{
+				Settings.Conditions.LossRate = LossPercent / 100.0f;
+			}
+
+			// Scenarios as Controlling-Controlled NAT pairs, joined with '+'
+			FString NATPairs;
+			if (FParse::Value(*Cmd, TEXT("NAT="), NATPairs))
+			{
+				TArray<FString> Pairs;
+				NATPairs.ParseIntoArray(Pairs, TEXT("+"));
+				for (const FString& Pair : Pairs)
+				{
+					FString ControllingName;
+					FString ControlledName;
+					FICEBenchmarkScenario Scenario;
+					if (!Pair.Split(TEXT("-"), &ControllingName, &ControlledName) ||
+						!ParseNATType(ControllingName, Scenario.ControllingNAT) || !ParseNATType(ControlledName, Scenario.ControlledNAT))
+					{
+						UE_LOG(LogOnlineICE, Warning, TEXT("ICE.BENCH: Unknown NAT pair '%s', use FullCone, PortRestricted or Symmetric"), *Pair);
+						return;
+					}
+					Settings.Scenarios.Add(Scenario);
+				}
+			}
+
+			UE_LOG(LogOnlineICE, Display, TEXT("ICE.BENCH: Running, the game thread is blocked until the benchmark finishes"));
+			FICEBenchmark Benchmark(Settings);
+			if (!Benchmark.Run())
+			{
+				return;
+			}
+
+			FICELogOutputDevice LogDevice;
+			Benchmark.Dump(LogDevice);
+
+			// One line for log scrapers, and a file per run for tracking across builds
+			UE_LOG(LogOnlineICE, Display, TEXT("ICEBENCH %s"), *Benchmark.ToJson(false));
+
+			FString OutputPath;
+			if (!FParse::Value(*Cmd, TEXT("Output="), OutputPath))
+			{
+				OutputPath = FICEBenchmark::MakeOutputPath(TEXT("ICEBenchmark"));
+			}
+			if (Benchmark.SaveJson(OutputPath))
+			{
+				UE_LOG(LogOnlineICE, Display, TEXT("ICE.BENCH: Results written to %s"), *OutputPath);
+			}
+			else
+			{
+				UE_LOG(LogOnlineICE, Warning, TEXT("ICE.BENCH: Failed to write %s"), *OutputPath);
+			}
+		}),
+		ECVF_Default
+	));
+
 	UE_LOG(LogOnlineICE, Log, TEXT("OnlineSubsystemICE Module Started"));
 }
 
@@ -653,6 +1047,12 @@ void FOnlineSubsystemICEModule::ShutdownModule()
 {
 	UE_LOG(LogOnlineICE, Log, TEXT("OnlineSubsystemICE Module Shutting Down"));
 
+	if (StatsTickerHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(StatsTickerHandle);
+		StatsTickerHandle.Reset();
+	}
+
 	// Unregister console commands
 	IConsoleManager& ConsoleManager = IConsoleManager::Get();
 	for (IConsoleObject* Command : ConsoleCommands)
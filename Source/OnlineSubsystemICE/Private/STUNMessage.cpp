@@ -0,0 +1,526 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "STUNMessage.h"
+#include "ICESecureChannel.h"
+#include "IPAddress.h"
+#include "Misc/SecureHash.h"
+
+namespace
+{
+	constexpr int32 ATTRIBUTE_HEADER_SIZE = 4;
+	constexpr int32 MESSAGE_INTEGRITY_SIZE = 20;
+
+	FORCEINLINE uint16 ReadUInt16(const uint8* Data)
+	{
+		return (uint16)((Data[0] << 8) | Data[1]);
+	}
+
+	FORCEINLINE uint32 ReadUInt32(const uint8* Data)
+	{
+		return ((uint32)Data[0] << 24) | ((uint32)Data[1] << 16) | ((uint32)Data[2] << 8) | (uint32)Data[3];
+	}
+
+	FORCEINLINE void WriteUInt16(uint8* Data, uint16 Value)
+	{
+		Data[0] = (Value >> 8) & 0xFF;
+		Data[1] = Value & 0xFF;
+	}
+
+	FORCEINLINE void WriteUInt32(uint8* Data, uint32 Value)
+	{
+		Data[0] = (Value >> 24) & 0xFF;
+		Data[1] = (Value >> 16) & 0xFF;
+		Data[2] = (Value >> 8) & 0xFF;
+		Data[3] = Value & 0xFF;
+	}
+
+	FORCEINLINE int32 PadTo4(int32 Length)
+	{
+		return (Length + 3) & ~3;
+	}
+}
+
+uint32 FSTUNAddress::GetIPv4() const
+{
+	return IsIPv4() ? ReadUInt32(Address) : 0;
+}
+
+FString FSTUNAddress::ToString() const
+{
+	if (IsIPv4())
+	{
+		return FString::Printf(TEXT("%d.%d.%d.%d"), Address[0], Address[1], Address[2], Address[3]);
+	}
+
+	if (!IsIPv6())
+	{
+		return FString();
+	}
+
+	uint16 Groups[8];
+	for (int32 i = 0; i < 8; i++)
+	{
+		Groups[i] = ReadUInt16(&Address[i * 2]);
+	}
+
+	// Collapse the longest run of two or more zero groups (RFC 5952 Section 4.2)
+	int32 BestStart = INDEX_NONE;
+	int32 BestLength = 1;
+	for (int32 i = 0; i < 8;)
+	{
+		int32 RunLength = 0;
+		while (i + RunLength < 8 && Groups[i + RunLength] == 0)
+		{
+			RunLength++;
+		}
+
+		if (RunLength > BestLength)
+		{
+			BestStart = i;
+			BestLength = RunLength;
+		}
+		i += FMath::Max(RunLength, 1);
+	}
+
+	FString Result;
+	for (int32 i = 0; i < 8; i++)
+	{
+		if (i == BestStart)
+		{
+			Result += TEXT("::");
+			i += BestLength - 1;
+			continue;
+		}
+
+		if (!Result.IsEmpty() && !Result.EndsWith(TEXT(":")))
+		{
+			Result += TEXT(":");
+		}
+		Result += FString::Printf(TEXT("%x"), Groups[i]);
+	}
+	return Result;
+}
+
+FSTUNMessage::FSTUNMessage(uint16 MessageType, const uint8* TransactionID)
+	: FSTUNMessage(MessageType, TransactionID, InlineBuffer, INLINE_CAPACITY)
+{
+}
+
+FSTUNMessage::FSTUNMessage(uint16 MessageType, const uint8* TransactionID, uint8* InBuffer, int32 InCapacity)
+	: Buffer(InBuffer)
+	, Capacity(InCapacity)
+	, Size(HEADER_SIZE)
+	, bOverflow(InCapacity < HEADER_SIZE)
+{
+	if (bOverflow)
+	{
+		Size = 0;
+		return;
+	}
+
+	// Type (2) | Length (2) | Magic Cookie (4) | Transaction ID (12)
+	WriteUInt16(Buffer, MessageType);
+	WriteUInt16(Buffer + 2, 0);
+	WriteUInt32(Buffer + 4, MAGIC_COOKIE);
+	FMemory::Memcpy(Buffer + 8, TransactionID, TRANSACTION_ID_LENGTH);
+}
+
+uint8* FSTUNMessage::Reserve(uint16 Type, int32 Length)
+{
+	const int32 PaddedLength = PadTo4(Length);
+	if (bOverflow || Length < 0 || Length > MAX_uint16 || Size + ATTRIBUTE_HEADER_SIZE + PaddedLength > Capacity)
+	{
+		bOverflow = true;
+		return nullptr;
+	}
+
+	uint8* Attribute = Buffer + Size;
+	WriteUInt16(Attribute, Type);
+	WriteUInt16(Attribute + 2, (uint16)Length);
+	FMemory::Memzero(Attribute + ATTRIBUTE_HEADER_SIZE + Length, PaddedLength - Length);
+
+	Size += ATTRIBUTE_HEADER_SIZE + PaddedLength;
+	UpdateLength();
+	return Attribute + ATTRIBUTE_HEADER_SIZE;
+}
+
+void FSTUNMessage::UpdateLength()
+{
+	WriteUInt16(Buffer + 2, (uint16)(Size - HEADER_SIZE));
+}
+
+bool FSTUNMessage::AddAttribute(uint16 Type, const uint8* Value, int32 Length)
+{
+	uint8* Destination = Reserve(Type, Length);
+	if (!Destination)
+	{
+		return false;
+	}
+
+	FMemory::Memcpy(Destination, Value, Length);
+	return true;
+}
+
+uint8* FSTUNMessage::AddAttributeUninitialized(uint16 Type, int32 Length)
+{
+	return Reserve(Type, Length);
+}
+
+bool FSTUNMessage::AddUInt32(uint16 Type, uint32 Value)
+{
+	uint8* Destination = Reserve(Type, 4);
+	if (!Destination)
+	{
+		return false;
+	}
+
+	WriteUInt32(Destination, Value);
+	return true;
+}
+
+bool FSTUNMessage::AddString(uint16 Type, const FString& Value)
+{
+	uint8* Destination = Reserve(Type, Value.Len());
+	if (!Destination)
+	{
+		return false;
+	}
+
+	for (int32 i = 0; i < Value.Len(); i++)
+	{
+		Destination[i] = (uint8)Value[i];
+	}
+	return true;
+}
+
+bool FSTUNMessage::AddXorAddress(uint16 Type, const FInternetAddr& Addr)
+{
+	const bool bIPv6 = Addr.GetProtocolType() == FNetworkProtocolTypes::IPv6;
+	const int32 AddressLength = bIPv6 ? 16 : 4;
+
+	uint8* Destination = Reserve(Type, 4 + AddressLength);
+	if (!Destination)
+	{
+		return false;
+	}
+
+	// Reserved (1) | Family (1) | X-Port (2) | X-Address (4 or 16)
+	Destination[0] = 0x00;
+	Destination[1] = bIPv6 ? 0x02 : 0x01;
+	WriteUInt16(Destination + 2, (uint16)Addr.GetPort() ^ (uint16)(MAGIC_COOKIE >> 16));
+
+	if (bIPv6)
+	{
+		// IPv6 is XOR-ed with the magic cookie followed by the transaction ID
+		const TArray<uint8> RawIp = Addr.GetRawIp();
+		for (int32 i = 0; i < 16; i++)
+		{
+			const uint8 Mask = Buffer[4 + i];
+			Destination[4 + i] = (RawIp.IsValidIndex(i) ? RawIp[i] : 0) ^ Mask;
+		}
+	}
+	else
+	{
+		uint32 IP = 0;
+		Addr.GetIp(IP);
+		WriteUInt32(Destination + 4, IP ^ MAGIC_COOKIE);
+	}
+	return true;
+}
+
+bool FSTUNMessage::AddMessageIntegrity(const uint8* Key, int32 KeyLength)
+{
+	// The HMAC covers the header with the length already counting MESSAGE-INTEGRITY (RFC 5389 Section 15.4)
+	const int32 IntegrityOffset = Size;
+	uint8* Destination = Reserve(STUNAttribute::MESSAGE_INTEGRITY, MESSAGE_INTEGRITY_SIZE);
+	if (!Destination)
+	{
+		return false;
+	}
+
+	CalculateHMACSHA1(Buffer, IntegrityOffset, Key, KeyLength, Destination);
+	return true;
+}
+
+void FSTUNMessage::GenerateTransactionID(uint8* OutTransactionID)
+{
+	// Unpredictable IDs, so an off-path attacker can't forge a response (RFC 5389 Section 6)
+	if (FICESecureChannel::GenerateRandomBytes(OutTransactionID, TRANSACTION_ID_LENGTH))
+	{
+		return;
+	}
+
+	// CSPRNG unavailable: fall back to the platform GUID, also drawn from the OS random source
+	const FGuid Guid = FGuid::NewGuid();
+	const uint32 Words[3] = { Guid.A, Guid.B, Guid.C ^ Guid.D };
+	FMemory::Memcpy(OutTransactionID, Words, TRANSACTION_ID_LENGTH);
+}
+
+void FSTUNMessage::CalculateHMACSHA1(const uint8* Data, int32 DataLen, const uint8* Key, int32 KeyLen, uint8* OutHash)
+{
+	FSTUNHMACKey(Key, KeyLen).Calculate(Data, DataLen, OutHash);
+}
+
+FSTUNHMACKey::FSTUNHMACKey()
+	: bSet(false)
+{
+}
+
+FSTUNHMACKey::FSTUNHMACKey(const uint8* Key, int32 KeyLength)
+	: bSet(false)
+{
+	SetKey(Key, KeyLength);
+}
+
+void FSTUNHMACKey::SetKey(const uint8* Key, int32 KeyLength)
+{
+	// HMAC-SHA1 implementation as per RFC 2104
+	uint8 KeyPadded[BLOCK_SIZE];
+	FMemory::Memzero(KeyPadded, BLOCK_SIZE);
+
+	// If key is longer than block size, hash it first
+	if (KeyLength > BLOCK_SIZE)
+	{
+		FSHA1 SHA1Context;
+		SHA1Context.Update(Key, KeyLength);
+		SHA1Context.Final();
+		SHA1Context.GetHash(KeyPadded);
+	}
+	else if (KeyLength > 0)
+	{
+		FMemory::Memcpy(KeyPadded, Key, KeyLength);
+	}
+
+	// Create inner and outer padded keys, absorbed once into the contexts every message starts from
+	uint8 InnerPad[BLOCK_SIZE];
+	uint8 OuterPad[BLOCK_SIZE];
+	for (int32 i = 0; i < BLOCK_SIZE; i++)
+	{
+		InnerPad[i] = KeyPadded[i] ^ 0x36;
+		OuterPad[i] = KeyPadded[i] ^ 0x5C;
+	}
+
+	InnerContext.Reset();
+	InnerContext.Update(InnerPad, BLOCK_SIZE);
+	OuterContext.Reset();
+	OuterContext.Update(OuterPad, BLOCK_SIZE);
+
+	FMemory::Memzero(KeyPadded, BLOCK_SIZE);
+	FMemory::Memzero(InnerPad, BLOCK_SIZE);
+	FMemory::Memzero(OuterPad, BLOCK_SIZE);
+	bSet = true;
+}
+
+void FSTUNHMACKey::SetKey(const FString& Password)
+{
+	FTCHARToUTF8 PasswordUTF8(*Password);
+	SetKey((const uint8*)PasswordUTF8.Get(), PasswordUTF8.Length());
+}
+
+void FSTUNHMACKey::Reset()
+{
+	InnerContext.Reset();
+	OuterContext.Reset();
+	bSet = false;
+}
+
+void FSTUNHMACKey::Calculate(const uint8* Data, int32 DataLength, uint8* OutHash) const
+{
+	// Calculate inner hash: SHA1(InnerPad || Data), the pad block already absorbed
+	FSHA1 InnerSHA1 = InnerContext;
+	InnerSHA1.Update(Data, DataLength);
+	InnerSHA1.Final();
+
+	uint8 InnerHash[HASH_SIZE];
+	InnerSHA1.GetHash(InnerHash);
+
+	// Calculate outer hash: SHA1(OuterPad || InnerHash)
+	FSHA1 OuterSHA1 = OuterContext;
+	OuterSHA1.Update(InnerHash, HASH_SIZE);
+	OuterSHA1.Final();
+
+	OuterSHA1.GetHash(OutHash);
+}
+
+bool FSTUNHMACKey::Verify(const uint8* Data, int32 DataLength, const uint8* Hash) const
+{
+	if (!bSet)
+	{
+		return false;
+	}
+
+	uint8 Expected[HASH_SIZE];
+	Calculate(Data, DataLength, Expected);
+
+	// No early exit, the time taken must not tell how many bytes matched
+	uint8 Difference = 0;
+	for (int32 i = 0; i < HASH_SIZE; i++)
+	{
+		Difference |= Expected[i] ^ Hash[i];
+	}
+	return Difference == 0;
+}
+
+bool FSTUNMessageView::IsSTUNMessage(const uint8* Data, int32 DataSize)
+{
+	if (!Data || DataSize < FSTUNMessage::HEADER_SIZE || (Data[0] & 0xC0) != 0)
+	{
+		return false;
+	}
+
+	const int32 Length = ReadUInt16(Data + 2);
+	return (Length & 3) == 0 &&
+		FSTUNMessage::HEADER_SIZE + Length <= DataSize &&
+		ReadUInt32(Data + 4) == FSTUNMessage::MAGIC_COOKIE;
+}
+
+bool FSTUNMessageView::Parse(const uint8* InData, int32 DataSize)
+{
+	Data = nullptr;
+	Size = 0;
+	MessageType = 0;
+	NumAttributes = 0;
+
+	if (!IsSTUNMessage(InData, DataSize))
+	{
+		return false;
+	}
+
+	const int32 MessageSize = FSTUNMessage::HEADER_SIZE + ReadUInt16(InData + 2);
+
+	// Index every attribute in one pass, rejecting anything that runs past the message
+	int32 Offset = FSTUNMessage::HEADER_SIZE;
+	while (Offset < MessageSize)
+	{
+		if (Offset + ATTRIBUTE_HEADER_SIZE > MessageSize)
+		{
+			return false;
+		}
+
+		const uint16 AttrType = ReadUInt16(InData + Offset);
+		const uint16 AttrLength = ReadUInt16(InData + Offset + 2);
+		const int32 ValueOffset = Offset + ATTRIBUTE_HEADER_SIZE;
+		if (ValueOffset + AttrLength > MessageSize)
+		{
+			return false;
+		}
+
+		if (NumAttributes < MAX_ATTRIBUTES)
+		{
+			Attributes[NumAttributes++] = { AttrType, AttrLength, ValueOffset };
+		}
+
+		Offset = ValueOffset + PadTo4(AttrLength);
+	}
+
+	Data = InData;
+	Size = MessageSize;
+	MessageType = ReadUInt16(InData);
+	return true;
+}
+
+bool FSTUNMessageView::HasTransactionID(const uint8* TransactionID) const
+{
+	return Data && FMemory::Memcmp(Data + 8, TransactionID, FSTUNMessage::TRANSACTION_ID_LENGTH) == 0;
+}
+
+TArrayView<const uint8> FSTUNMessageView::FindAttribute(uint16 Type) const
+{
+	for (int32 Index = 0; Index < NumAttributes; ++Index)
+	{
+		if (Attributes[Index].Type == Type)
+		{
+			return TArrayView<const uint8>(Data + Attributes[Index].Offset, Attributes[Index].Length);
+		}
+	}
+	return TArrayView<const uint8>();
+}
+
+bool FSTUNMessageView::HasAttribute(uint16 Type) const
+{
+	for (int32 Index = 0; Index < NumAttributes; ++Index)
+	{
+		if (Attributes[Index].Type == Type)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FSTUNMessageView::GetUInt32(uint16 Type, uint32& OutValue) const
+{
+	const TArrayView<const uint8> Value = FindAttribute(Type);
+	if (Value.Num() != 4)
+	{
+		return false;
+	}
+
+	OutValue = ReadUInt32(Value.GetData());
+	return true;
+}
+
+FString FSTUNMessageView::GetString(uint16 Type) const
+{
+	const TArrayView<const uint8> Value = FindAttribute(Type);
+
+	FString Result;
+	Result.Reserve(Value.Num());
+	for (uint8 Char : Value)
+	{
+		Result.AppendChar((TCHAR)Char);
+	}
+	return Result;
+}
+
+bool FSTUNMessageView::GetXorAddress(uint16 Type, FSTUNAddress& OutAddress) const
+{
+	const TArrayView<const uint8> Value = FindAttribute(Type);
+	if (Value.Num() < 8)
+	{
+		return false;
+	}
+
+	// Reserved (1) | Family (1) | X-Port (2) | X-Address (4 or 16)
+	const uint8 Family = Value[1];
+	if (Family == 0x01)
+	{
+		WriteUInt32(OutAddress.Address, ReadUInt32(&Value[4]) ^ FSTUNMessage::MAGIC_COOKIE);
+	}
+	else if (Family == 0x02 && Value.Num() >= 20)
+	{
+		// IPv6 is XOR-ed with the magic cookie followed by the transaction ID
+		for (int32 i = 0; i < 16; i++)
+		{
+			OutAddress.Address[i] = Value[4 + i] ^ Data[4 + i];
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	OutAddress.Family = Family;
+	OutAddress.Port = ReadUInt16(&Value[2]) ^ (uint16)(FSTUNMessage::MAGIC_COOKIE >> 16);
+	return true;
+}
+
+int32 FSTUNMessageView::GetErrorCode(FString* OutReason) const
+{
+	const TArrayView<const uint8> Value = FindAttribute(STUNAttribute::ERROR_CODE);
+	if (Value.Num() < 4)
+	{
+		return 0;
+	}
+
+	// 21 bits reserved, 3 bits class, 8 bits number, then the reason phrase (RFC 5389 Section 15.6)
+	if (OutReason)
+	{
+		OutReason->Reset(Value.Num() - 4);
+		for (int32 i = 4; i < Value.Num(); i++)
+		{
+			OutReason->AppendChar((TCHAR)Value[i]);
+		}
+	}
+	return (Value[2] & 0x07) * 100 + Value[3];
+}
@@ -0,0 +1,307 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "SocketICE.h"
+#include "ICEAgent.h"
+#include "ICEAgentPool.h"
+#include "OnlineSubsystemICEPackage.h"
+#include "IPAddress.h"
+
+FSocketICE::FSocketICE(const TSharedRef<FICEAgent>& InAgent, const FString& InSocketDescription)
+	: FSocket(SOCKTYPE_Datagram, InSocketDescription, NAME_None)
+	, Agent(InAgent)
+{
+}
+
+FSocketICE::FSocketICE(const TSharedRef<FICEAgentPool>& InPool, const FString& InSocketDescription)
+	: FSocket(SOCKTYPE_Datagram, InSocketDescription, NAME_None)
+	, Pool(InPool)
+{
+}
+
+bool FSocketICE::Shutdown(ESocketShutdownMode Mode)
+{
+	return true;
+}
+
+bool FSocketICE::Close()
+{
+	// The agent owns the real socket, it stays open for the ICE session
+	Agent.Reset();
+	Pool.Reset();
+	return true;
+}
+
+bool FSocketICE::Bind(const FInternetAddr& Addr)
+{
+	// Already bound by the agent
+	return true;
+}
+
+bool FSocketICE::Connect(const FInternetAddr& Addr)
+{
+	return true;
+}
+
+bool FSocketICE::Listen(int32 MaxBacklog)
+{
+	return false;
+}
+
+bool FSocketICE::WaitForPendingConnection(bool& bHasPendingConnection, const FTimespan& WaitTime)
+{
+	bHasPendingConnection = false;
+	return false;
+}
+
+bool FSocketICE::HasPendingData(uint32& PendingDataSize)
+{
+	if (TSharedPtr<FICEAgentPool> PinnedPool = Pool.Pin())
+	{
+		return PinnedPool->HasPendingData(PendingDataSize);
+	}
+
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	return PinnedAgent.IsValid() && PinnedAgent->HasPendingData(PendingDataSize);
+}
+
+FSocket* FSocketICE::Accept(const FString& InSocketDescription)
+{
+	return nullptr;
+}
+
+FSocket* FSocketICE::Accept(FInternetAddr& OutAddr, const FString& InSocketDescription)
+{
+	return nullptr;
+}
+
+bool FSocketICE::SendTo(const uint8* Data, int32 Count, int32& BytesSent, const FInternetAddr& Destination)
+{
+	BytesSent = 0;
+
+	if (TSharedPtr<FICEAgentPool> PinnedPool = Pool.Pin())
+	{
+		// Each client connection of the net driver is addressed to the peer address of its agent
+		if (!PinnedPool->SendDataTo(Destination, Data, Count, GetSendPriority(Count)))
+		{
+			return false;
+		}
+		BytesSent = Count;
+		return true;
+	}
+
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	if (!PinnedAgent.IsValid() || !PinnedAgent->SendData(Data, Count, GetSendPriority(Count)))
+	{
+		return false;
+	}
+
+	BytesSent = Count;
+	return true;
+}
+
+EICESendPriority FSocketICE::GetSendPriority(int32 Size) const
+{
+	if (SendPriorityOverride.IsSet())
+	{
+		return SendPriorityOverride.GetValue();
+	}
+
+	if (Size <= INTERACTIVE_DATAGRAM_SIZE)
+	{
+		return EICESendPriority::Interactive;
+	}
+	return Size >= BULK_DATAGRAM_SIZE ? EICESendPriority::Bulk : EICESendPriority::Normal;
+}
+
+bool FSocketICE::Send(const uint8* Data, int32 Count, int32& BytesSent)
+{
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	if (!PinnedAgent.IsValid() || !PinnedAgent->GetPeerAddress().IsValid())
+	{
+		BytesSent = 0;
+		return false;
+	}
+
+	return SendTo(Data, Count, BytesSent, *PinnedAgent->GetPeerAddress());
+}
+
+bool FSocketICE::RecvFrom(uint8* Data, int32 BufferSize, int32& BytesRead, FInternetAddr& Source, ESocketReceiveFlags::Type Flags)
+{
+	BytesRead = 0;
+
+	// Game datagrams are consumed when read, peeking isn't supported through the agent
+	if (Flags != ESocketReceiveFlags::None)
+	{
+		return false;
+	}
+
+	if (TSharedPtr<FICEAgentPool> PinnedPool = Pool.Pin())
+	{
+		return PinnedPool->ReceiveData(Data, BufferSize, BytesRead, Source);
+	}
+
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	if (!PinnedAgent.IsValid() || !PinnedAgent->ReceiveData(Data, BufferSize, BytesRead))
+	{
+		return false;
+	}
+
+	// Every datagram is reported from the peer address (stable across ICE restarts)
+	GetPeerAddress(Source);
+	return true;
+}
+
+bool FSocketICE::Recv(uint8* Data, int32 BufferSize, int32& BytesRead, ESocketReceiveFlags::Type Flags)
+{
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	if (!PinnedAgent.IsValid() || !PinnedAgent->GetPeerAddress().IsValid())
+	{
+		BytesRead = 0;
+		return false;
+	}
+
+	TSharedRef<FInternetAddr> Source = PinnedAgent->GetPeerAddress()->Clone();
+	return RecvFrom(Data, BufferSize, BytesRead, *Source, Flags);
+}
+
+bool FSocketICE::Wait(ESocketWaitConditions::Type Condition, FTimespan WaitTime)
+{
+	// Never blocks: datagrams are pumped by the agent Tick
+	if (Condition == ESocketWaitConditions::WaitForWrite)
+	{
+		return Agent.IsValid() || Pool.IsValid();
+	}
+
+	uint32 PendingDataSize = 0;
+	return HasPendingData(PendingDataSize);
+}
+
+ESocketConnectionState FSocketICE::GetConnectionState()
+{
+	if (TSharedPtr<FICEAgentPool> PinnedPool = Pool.Pin())
+	{
+		return PinnedPool->GetNumConnectedAgents() > 0 ? SCS_Connected : SCS_NotConnected;
+	}
+
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	return PinnedAgent.IsValid() && PinnedAgent->IsConnected() ? SCS_Connected : SCS_NotConnected;
+}
+
+void FSocketICE::GetAddress(FInternetAddr& OutAddr)
+{
+	if (TSharedPtr<FICEAgentPool> PinnedPool = Pool.Pin())
+	{
+		PinnedPool->GetLocalAddress(OutAddr);
+		return;
+	}
+
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	if (PinnedAgent.IsValid())
+	{
+		PinnedAgent->GetLocalAddress(OutAddr);
+	}
+}
+
+bool FSocketICE::GetPeerAddress(FInternetAddr& OutAddr)
+{
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	if (!PinnedAgent.IsValid() || !PinnedAgent->GetPeerAddress().IsValid())
+	{
+		return false;
+	}
+
+	const FInternetAddr& RemoteAddr = *PinnedAgent->GetPeerAddress();
+	OutAddr.SetRawIp(RemoteAddr.GetRawIp());
+	OutAddr.SetPort(RemoteAddr.GetPort());
+	return true;
+}
+
+bool FSocketICE::SetNonBlocking(bool bIsNonBlocking)
+{
+	// The agent socket is always non-blocking
+	return bIsNonBlocking;
+}
+
+bool FSocketICE::SetBroadcast(bool bAllowBroadcast)
+{
+	return !bAllowBroadcast;
+}
+
+bool FSocketICE::SetNoDelay(bool bIsNoDelay)
+{
+	return true;
+}
+
+bool FSocketICE::JoinMulticastGroup(const FInternetAddr& GroupAddress)
+{
+	return false;
+}
+
+bool FSocketICE::JoinMulticastGroup(const FInternetAddr& GroupAddress, const FInternetAddr& InterfaceAddress)
+{
+	return false;
+}
+
+bool FSocketICE::LeaveMulticastGroup(const FInternetAddr& GroupAddress)
+{
+	return false;
+}
+
+bool FSocketICE::LeaveMulticastGroup(const FInternetAddr& GroupAddress, const FInternetAddr& InterfaceAddress)
+{
+	return false;
+}
+
+bool FSocketICE::SetMulticastLoopback(bool bLoopback)
+{
+	return false;
+}
+
+bool FSocketICE::SetMulticastTtl(uint8 TimeToLive)
+{
+	return false;
+}
+
+bool FSocketICE::SetMulticastInterface(const FInternetAddr& InterfaceAddress)
+{
+	return false;
+}
+
+bool FSocketICE::SetReuseAddr(bool bAllowReuse)
+{
+	return true;
+}
+
+bool FSocketICE::SetLinger(bool bShouldLinger, int32 Timeout)
+{
+	return true;
+}
+
+bool FSocketICE::SetRecvErr(bool bUseErrorQueue)
+{
+	return true;
+}
+
+bool FSocketICE::SetSendBufferSize(int32 Size, int32& NewSize)
+{
+	// Buffer sizes belong to the agent socket
+	NewSize = Size;
+	return true;
+}
+
+bool FSocketICE::SetReceiveBufferSize(int32 Size, int32& NewSize)
+{
+	NewSize = Size;
+	return true;
+}
+
+int32 FSocketICE::GetPortNo()
+{
+	if (TSharedPtr<FICEAgentPool> PinnedPool = Pool.Pin())
+	{
+		return PinnedPool->GetLocalPort();
+	}
+
+	TSharedPtr<FICEAgent> PinnedAgent = Agent.Pin();
+	return PinnedAgent.IsValid() ? PinnedAgent->GetLocalPort() : 0;
+}
@@ -0,0 +1,89 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "ICEBenchmark.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace ICEBenchmarkTest
+{
+	/** Send scratch buffers are sized up front, growing them at all while sending is a regression */
+	constexpr double MAX_ALLOCATIONS_PER_PACKET = 0.0;
+}
+
+/**
+ * One test per NAT pairing of FICEBenchmarkSettings::GetDefaultScenarios, on the default simulated network
+ * Run with "Automation RunTests OnlineSubsystemICE.Benchmark"; each test fails if a trial doesn't connect, the transfer
+ * delivers nothing or sending allocates, and writes its results to Saved/ICEBenchmark. Connect times and delivery
+ * depend on the machine's wall clock and load, so they are reported rather than asserted.
+ */
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FICEBenchmarkTest, "OnlineSubsystemICE.Benchmark",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+void FICEBenchmarkTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	for (const FICEBenchmarkScenario& Scenario : FICEBenchmarkSettings::GetDefaultScenarios())
+	{
+		OutBeautifiedNames.Add(Scenario.GetName());
+		OutTestCommands.Add(Scenario.GetName());
+	}
+}
+
+bool FICEBenchmarkTest::RunTest(const FString& Parameters)
+{
+	FString ControllingName;
+	FString ControlledName;
+	FICEBenchmarkScenario Scenario;
+	if (!Parameters.Split(TEXT("-"), &ControllingName, &ControlledName) ||
+		!ParseNATType(ControllingName, Scenario.ControllingNAT) || !ParseNATType(ControlledName, Scenario.ControlledNAT))
+	{
+		AddError(FString::Printf(TEXT("Unknown NAT pair '%s'"), *Parameters));
+		return false;
+	}
+
+	FICEBenchmarkSettings Settings;
+	Settings.Scenarios.Add(Scenario);
+
+	FICEBenchmark Benchmark(Settings);
+	if (!TestTrue(TEXT("Network simulator started"), Benchmark.Run()))
+	{
+		return false;
+	}
+
+	const FICEBenchmarkResult& Result = Benchmark.GetResults()[0];
+	AddInfo(FString::Printf(TEXT("Connected %d/%d (%d direct, %d relayed), connect p50 %.1f ms, p90 %.1f ms"),
+		Result.DirectConnections + Result.RelayedConnections, Result.Trials, Result.DirectConnections, Result.RelayedConnections,
+		Result.GetConnectTimePercentile(50.0f), Result.GetConnectTimePercentile(90.0f)));
+	AddInfo(FString::Printf(TEXT("Transfer: %.0f B/s, %llu of %llu datagrams received, %.3f allocations per datagram"),
+		Result.GetGoodput(), Result.ReceivedPackets, Result.SentPackets, Result.GetAllocationsPerPacket()));
+
+	TestEqual(TEXT("Trials connected"), Result.DirectConnections + Result.RelayedConnections, Result.Trials);
+
+	// Two symmetric NATs never let a direct pair through
+	if (Scenario.ControllingNAT == EICENATType::Symmetric && Scenario.ControlledNAT == EICENATType::Symmetric)
+	{
+		TestEqual(TEXT("Direct connections across two symmetric NATs"), Result.DirectConnections, 0);
+	}
+
+	if (TestTrue(TEXT("Transfer measured"), Result.bTransferred))
+	{
+		TestTrue(TEXT("Transfer datagrams received"), Result.ReceivedPackets > 0);
+		TestTrue(FString::Printf(TEXT("Allocations per datagram (%.3f) at most %.3f"), Result.GetAllocationsPerPacket(), ICEBenchmarkTest::MAX_ALLOCATIONS_PER_PACKET),
+			Result.GetAllocationsPerPacket() <= ICEBenchmarkTest::MAX_ALLOCATIONS_PER_PACKET);
+	}
+
+	// Tracked across builds alongside the pass/fail result
+	const FString OutputPath = FICEBenchmark::MakeOutputPath(FString::Printf(TEXT("ICEBenchmark-%s"), *Scenario.GetName()));
+	if (!Benchmark.SaveJson(OutputPath))
+	{
+		AddWarning(FString::Printf(TEXT("Failed to write %s"), *OutputPath));
+	}
+	else
+	{
+		AddInfo(FString::Printf(TEXT("Results written to %s"), *OutputPath));
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
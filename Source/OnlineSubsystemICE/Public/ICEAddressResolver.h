@@ -0,0 +1,100 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+class FInternetAddr;
+
+/** Outcome of a non-blocking host lookup */
+enum class EICEResolveStatus : uint8
+{
+	/** Address available (numeric host or cached lookup) */
+	Resolved,
+	/** First lookup still running, ask again on a later tick */
+	Pending,
+	/** The host couldn't be resolved */
+	Failed
+};
+
+/**
+ * Hostname resolution for STUN/TURN servers, shared by every ICE agent
+ * Lookups run in the background (ISocketSubsystem::GetAddressInfoAsync) and stay cached for a TTL. An expired
+ * entry keeps being served while it is refreshed, so only the very first lookup of a host is ever waited for.
+ * Thread-safe: async results are written from a worker thread.
+ */
+class FICEAddressResolver
+{
+public:
+	/** Resolver shared by the module */
+	static FICEAddressResolver& Get();
+
+	/**
+	 * Look up a host without blocking
+	 * @param Host - Hostname or numeric address (no port)
+	 * @param bAllowIPv6 - Whether an IPv6 address may be returned (IPv4 is preferred when the host has both)
+	 * @param OutAddr - Receives a copy of the address when Resolved, port unset
+	 * @return Resolved, Pending while the first lookup runs, or Failed
+	 */
+	EICEResolveStatus Resolve(const FString& Host, bool bAllowIPv6, TSharedPtr<FInternetAddr>& OutAddr);
+
+	/**
+	 * Start the lookups of server addresses ahead of the first gathering
+	 * @param ServerAddresses - Addresses as configured (host or host:port)
+	 */
+	void Prewarm(const TArray<FString>& ServerAddresses);
+
+	/**
+	 * Set how long a successful lookup stays fresh
+	 * @param InCacheTTL - Seconds (failed lookups are retried after FAILED_LOOKUP_TTL at most)
+	 */
+	void SetCacheTTL(float InCacheTTL);
+
+	/**
+	 * Parse server address into host and port
+	 * @param ServerAddress - Server address string (host:port, just host, or [IPv6]:port)
+	 * @param OutHost - Parsed host name
+	 * @param OutPort - Parsed port (or default if not specified)
+	 * @param DefaultPort - Default port to use if not in address
+	 */
+	static void ParseServerAddress(const FString& ServerAddress, FString& OutHost, int32& OutPort, int32 DefaultPort = 3478);
+
+private:
+	FICEAddressResolver();
+
+	/** Cached lookup of one host */
+	struct FCacheEntry
+	{
+		/** Every address returned by the last successful lookup */
+		TArray<TSharedPtr<FInternetAddr>> Addresses;
+
+		/** When the last lookup completed (0 until the first one does) */
+		double ResolvedTime = 0.0;
+
+		/** Whether a lookup is running */
+		bool bPending = false;
+
+		/** Whether the last lookup failed with nothing cached */
+		bool bFailed = false;
+	};
+
+	/**
+	 * Start the background lookup of a host (CacheLock held)
+	 * @param Host - Hostname
+	 * @param Entry - Cache entry of the host
+	 */
+	void StartLookup(const FString& Host, FCacheEntry& Entry);
+
+	/** Lookups by hostname */
+	TMap<FString, FCacheEntry> Cache;
+
+	/** Guards Cache and CacheTTL */
+	FCriticalSection CacheLock;
+
+	/** How long a successful lookup stays fresh (seconds) */
+	float CacheTTL;
+
+	/** How long a failed lookup is remembered before being retried (seconds) */
+	static constexpr float FAILED_LOOKUP_TTL = 10.0f;
+};
@@ -4,9 +4,19 @@
 
 #include "CoreMinimal.h"
 #include "OnlineSubsystemICEPackage.h"
+#include "STUNMessage.h"
+#include "ICESecureChannel.h"
+#include "ICESendScheduler.h"
+#include "ICEFECCodec.h"
 #include "Delegates/Delegate.h"
 
 class FSocket;
+class FInternetAddr;
+class FICEPacketRing;
+class FICEReceiveThread;
+class FSTUNMessage;
+class FSTUNMessageView;
+enum class EICEResolveStatus : uint8;
 
 /**
  * Estados de conexión ICE
@@ -36,7 +46,16 @@ enum class EICECandidateType : uint8
 {
 	Host,        // Local network interface
 	ServerReflexive,  // STUN-discovered public address
-	Relayed      // TURN relay address
+	Relayed,     // TURN relay address
+	PeerReflexive // Address learned from an incoming connectivity check
+};
+
+/**
+ * Transport protocol of a candidate (only UDP candidates are gathered or checked)
+ */
+enum class EICETransport : uint8
+{
+	UDP
 };
 
 /**
@@ -46,7 +65,7 @@ struct FICECandidate
 {
 	FString Foundation;
 	int32 ComponentId;
-	FString Transport;
+	EICETransport Transport;
 	int32 Priority;
 	FString Address;
 	int32 Port;
@@ -56,7 +75,7 @@ struct FICECandidate
 
 	FICECandidate()
 		: ComponentId(0)
-		, Transport(TEXT("UDP"))
+		, Transport(EICETransport::UDP)
 		, Priority(0)
 		, Port(0)
 		, Type(EICECandidateType::Host)
@@ -65,6 +84,23 @@ struct FICECandidate
 
 	FString ToString() const;
 	static FICECandidate FromString(const FString& CandidateString);
+
+	/**
+	 * Append the compact binary form of the candidate (raw address bytes, see FICEOffer)
+	 * @param Out - Buffer the candidate is appended to
+	 * @return False if the address is not a numeric IPv4/IPv6 address (nothing is appended)
+	 */
+	bool ToBinary(TArray<uint8>& Out) const;
+
+	/**
+	 * Read a candidate written by ToBinary
+	 * @param Data - Buffer
+	 * @param Size - Buffer size
+	 * @param Offset - Read position, advanced past the candidate
+	 * @param OutCandidate - Decoded candidate
+	 * @return False if the buffer is truncated or malformed
+	 */
+	static bool FromBinary(const uint8* Data, int32 Size, int32& Offset, FICECandidate& OutCandidate);
 	
 	/**
 	 * Check if this candidate is valid (has non-empty address and valid port)
@@ -74,6 +110,12 @@ struct FICECandidate
 	{
 		return !Address.IsEmpty() && Port > 0 && Port <= 65535;
 	}
+
+	/** Check if the candidate address is an IPv6 literal (pairs are only formed within one address family) */
+	bool IsIPv6() const
+	{
+		return Address.Contains(TEXT(":"));
+	}
 };
 
 /**
@@ -87,9 +129,553 @@ struct FICEAgentConfig
 	FString TURNCredential;
 	bool bEnableIPv6;
 
+	/** Total time allowed for STUN/TURN gathering before pending requests are abandoned (seconds) */
+	float GatheringTimeout;
+
+	/** Pacing interval (Ta) between new connectivity checks (seconds) */
+	float ConnectivityCheckInterval;
+
+	/** Drain the agent socket from a dedicated receive thread instead of polling from Tick */
+	bool bUseIOThread;
+
+	/** Number of datagrams buffered between the receive thread and the game thread */
+	int32 IOThreadRingCapacity;
+
+	/** Path MTU (bytes, IP/UDP headers included); relayed datagrams that exceed it are dropped, not fragmented */
+	int32 PathMTU;
+
+	/** Mean interval between consent checks on the selected pair, randomized by +/-20% (seconds, RFC 7675) */
+	float ConsentCheckInterval;
+
+	/** Time without a consent response before the connection is considered lost (seconds) */
+	float ConsentTimeout;
+
+	/** Delay between rounds of direct checks while connected through a relay (seconds, 0 disables the upgrade) */
+	float DirectUpgradeInterval;
+
+	/** Rounds of direct checks tried after a relayed connection before staying on the relay */
+	int32 MaxDirectUpgradeRounds;
+
+	/** How long measured STUN/TURN server RTTs (and so the choice of TURN server) stay valid (seconds, 0 probes every time) */
+	float ServerSelectionTTL;
+
+	/** Encrypt game datagrams with AES-256-GCM, keyed from the signed handshake (requires signaled credentials) */
+	bool bEncryptTraffic;
+
+	/**
+	 * Exchange unsigned HELLOs while the peer's credentials are unknown, for peers whose candidates are exchanged by
+	 * hand or that predate signed checks; anyone who can reach the socket may then start or reset a handshake
+	 */
+	bool bAllowUnsignedHandshake;
+
+	/** Pack small game datagrams into one MTU-sized datagram per flush (both peers must enable it) */
+	bool bCoalesceSends;
+
+	/** Longest a coalesced message waits for more before its datagram is sent (seconds, 0 waits for the end of Tick) */
+	float CoalesceWindow;
+
+	/** Pace game datagrams to a delay-based bandwidth estimate, serving EICESendPriority classes in order */
+	bool bPaceSends;
+
+	/** Send rate before the first estimate, and the range the estimate stays in (bytes per second) */
+	float PacingInitialRate;
+	float PacingMinRate;
+	float PacingMaxRate;
+
+	/** Bytes sent back to back after an idle period */
+	int32 PacingBurstSize;
+
+	/** Bytes each priority class may hold back before new datagrams are dropped */
+	int32 PacingQueueLimit;
+
+	/** Queuing delay the bandwidth estimate steers to (seconds) */
+	float PacingTargetDelay;
+
+	/** Protect game datagrams with XOR parity sized to the measured loss (used if both peers enable it) */
+	bool bEnableFEC;
+
+	/** Loss rate under which no parity is sent */
+	float FECMinLossRate;
+
+	/** Datagrams per parity packet at the lowest loss rate (2 to 32) */
+	int32 FECMaxGroupSize;
+
 	FICEAgentConfig()
 		: bEnableIPv6(false)
+		, GatheringTimeout(5.0f)
+		, ConnectivityCheckInterval(0.05f)
+		, bUseIOThread(false)
+		, IOThreadRingCapacity(256)
+		, PathMTU(1280)
+		, ConsentCheckInterval(1.0f)
+		, ConsentTimeout(5.0f)
+		, DirectUpgradeInterval(2.0f)
+		, MaxDirectUpgradeRounds(5)
+		, ServerSelectionTTL(300.0f)
+		, bEncryptTraffic(false)
+		, bAllowUnsignedHandshake(false)
+		, bCoalesceSends(false)
+		, CoalesceWindow(0.001f)
+		, bPaceSends(false)
+		, PacingInitialRate(250000.0f)
+		, PacingMinRate(16000.0f)
+		, PacingMaxRate(12500000.0f)
+		, PacingBurstSize(16384)
+		, PacingQueueLimit(262144)
+		, PacingTargetDelay(0.025f)
+		, bEnableFEC(false)
+		, FECMinLossRate(0.005f)
+		, FECMaxGroupSize(16)
+	{}
+};
+
+/**
+ * States of a candidate pair in the checklist (RFC 8445 Section 6.1.2.6)
+ */
+enum class EICECandidatePairState : uint8
+{
+	/** Waiting for a pair with the same foundation to be checked first */
+	Frozen,
+	/** Ready to be checked as soon as pacing allows */
+	Waiting,
+	/** Check sent, waiting for the response */
+	InProgress,
+	/** Response received, the pair works in both directions */
+	Succeeded,
+	/** No response after every retransmission */
+	Failed
+};
+
+/**
+ * Round-trip time and loss measured on a candidate pair
+ * Fed by connectivity checks (first transmissions only, Karn's rule) and by consent checks once selected
+ */
+struct FICEPairStats
+{
+	/** Latest round-trip time sample (ms) */
+	float LatestRTT;
+
+	/** Smoothed round-trip time, RFC 6298 (ms) */
+	float SmoothedRTT;
+
+	/** Smoothed variation between consecutive RTT samples, RFC 3550 style (ms) */
+	float Jitter;
+
+	/** Number of RTT samples taken */
+	uint32 RTTSamples;
+
+	/** Requests sent (connectivity and consent checks, retransmissions included) */
+	uint32 RequestsSent;
+
+	/** Responses received */
+	uint32 ResponsesReceived;
+
+	/** Requests given up on without a response (retransmitted, superseded or timed out) */
+	uint32 RequestsLost;
+
+	FICEPairStats()
+		: LatestRTT(0.0f)
+		, SmoothedRTT(0.0f)
+		, Jitter(0.0f)
+		, RTTSamples(0)
+		, RequestsSent(0)
+		, ResponsesReceived(0)
+		, RequestsLost(0)
+	{}
+
+	/**
+	 * Fold a round-trip time sample into the smoothed values
+	 * @param RTT - Measured round-trip time (ms)
+	 */
+	void AddRTTSample(float RTT);
+
+	/** Fraction of settled requests that got no response [0, 1] */
+	float GetLossRate() const
+	{
+		const uint32 Settled = ResponsesReceived + RequestsLost;
+		return Settled > 0 ? (float)RequestsLost / (float)Settled : 0.0f;
+	}
+
+	FString ToString() const;
+};
+
+/**
+ * Distribution of latency samples over fixed buckets, cheap enough to feed per packet
+ */
+struct FICELatencyHistogram
+{
+	/** Buckets end at 1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500 and 5000 ms, the last one is open */
+	static constexpr int32 NUM_BUCKETS = 13;
+
+	/** Samples per bucket */
+	uint32 Buckets[NUM_BUCKETS];
+
+	/** Number of samples */
+	uint32 Count;
+
+	/** Smallest, largest and summed samples (ms) */
+	float Min;
+	float Max;
+	double Sum;
+
+	FICELatencyHistogram()
+	{
+		Reset();
+	}
+
+	/**
+	 * Add a sample
+	 * @param Milliseconds - Measured latency (ms)
+	 */
+	void AddSample(float Milliseconds);
+
+	/** Forget every sample */
+	void Reset();
+
+	/** Mean of the samples (ms), 0 without samples */
+	float GetMean() const { return Count > 0 ? (float)(Sum / Count) : 0.0f; }
+
+	/**
+	 * Upper bound of the bucket holding a percentile, the largest sample when it falls in the open bucket
+	 * @param Percentile - Percentile [0, 100]
+	 * @return Latency (ms), 0 without samples
+	 */
+	float GetPercentile(float Percentile) const;
+
+	FString ToString() const;
+};
+
+/**
+ * Counters and latency histograms of an agent, kept over its lifetime (see ICE.STATS)
+ * Game traffic is counted on the wire side of the send path, FEC, record and bundle framing included
+ */
+struct FICEAgentStats
+{
+	/** Gathering runs, start to the last candidate or the timeout (ms) */
+	FICELatencyHistogram GatheringTime;
+
+	/** Answers to each server's gathering requests (STUN Binding, TURN probe and Allocate), by "host:port" (ms) */
+	TMap<FString, FICELatencyHistogram> ServerResponseTimes;
+
+	/** Start of the connectivity checks to the selected pair (ms) */
+	FICELatencyHistogram ConnectTime;
+
+	/** Connectivity check and consent check transmissions, retransmissions included */
+	uint32 ConnectivityChecksSent;
+	uint32 ConsentChecksSent;
+
+	/** Pairs selected, direct and relayed (restarts and relay-to-direct upgrades included) */
+	uint32 DirectConnections;
+	uint32 RelayedConnections;
+
+	/** Game datagrams sent and received on the selected path */
+	uint64 PacketsSent;
+	uint64 BytesSent;
+	uint64 PacketsReceived;
+	uint64 BytesReceived;
+
+	/** Part of the game traffic that went through the TURN relay */
+	uint64 RelayedBytesSent;
+	uint64 RelayedBytesReceived;
+
+	/** Game datagrams the socket or the relay refused */
+	uint32 SendFailures;
+
+	/** TURN Refresh, and CreatePermission/ChannelBind, first transmission to final answer (ms) */
+	FICELatencyHistogram TURNRefreshLatency;
+	FICELatencyHistogram TURNBindLatency;
+
+	/** TURN transactions that failed or timed out */
+	uint32 TURNFailures;
+
+	FICEAgentStats()
+	{
+		Reset();
+	}
+
+	/** Zero every counter and histogram */
+	void Reset();
+
+	/**
+	 * Print the counters and histograms
+	 * @param Ar - Output device, one line per group of counters
+	 */
+	void Dump(FOutputDevice& Ar) const;
+};
+
+/**
+ * Local/remote candidate pair checked during connectivity establishment
+ */
+struct FICECandidatePair
+{
+	FICECandidate Local;
+	FICECandidate Remote;
+
+	/** Pair priority: 2^32*MIN(G,D) + 2*MAX(G,D) + (G>D ? 1 : 0) */
+	uint64 Priority;
+
+	/** Pair foundation (local foundation + remote foundation) */
+	FString Foundation;
+
+	EICECandidatePairState State;
+
+	/** Correlation token carried by the HELLO request and echoed in the response */
+	uint32 CheckToken;
+
+	/** Number of checks sent for this pair */
+	int32 Transmissions;
+
+	/** Time since the last check was sent (seconds) */
+	float TimeSinceLastCheck;
+
+	/** TURN channel used to reach the remote candidate (relayed pairs only) */
+	uint16 RelayChannel;
+
+	/** Whether the TURN permission for this pair has been created */
+	bool bRelayBound;
+
+	/** Whether RelayChannel is bound; until then the pair uses Send/Data indications */
+	bool bChannelBound;
+
+	/** Whether CreatePermission/ChannelBind have been sent for this pair */
+	bool bRelaySetupStarted;
+
+	/** Resolved remote address */
+	TSharedPtr<FInternetAddr> RemoteAddr;
+
+	/** Round-trip time and loss measured on this pair */
+	FICEPairStats Stats;
+
+	/** FPlatformTime::Seconds() when the last request was sent, 0 when nothing can be timed */
+	double LastRequestTime;
+
+	FICECandidatePair()
+		: Priority(0)
+		, State(EICECandidatePairState::Frozen)
+		, CheckToken(0)
+		, Transmissions(0)
+		, TimeSinceLastCheck(0.0f)
+		, RelayChannel(0)
+		, bRelayBound(false)
+		, bChannelBound(false)
+		, bRelaySetupStarted(false)
+		, LastRequestTime(0.0)
 	{}
+
+	/** Check if traffic for this pair goes through the TURN relay */
+	bool IsRelayed() const
+	{
+		return Local.Type == EICECandidateType::Relayed;
+	}
+
+	/** Check if either end of the pair is a relay (ours or the peer's allocation) */
+	bool UsesRelay() const
+	{
+		return Local.Type == EICECandidateType::Relayed || Remote.Type == EICECandidateType::Relayed;
+	}
+
+	FString ToString() const;
+};
+
+/**
+ * In-flight STUN/TURN request issued while gathering candidates
+ * Polled from Tick so gathering never blocks the game thread
+ */
+struct FICEGatherRequest
+{
+	/** Candidate type produced by this request (ServerReflexive or Relayed) */
+	EICECandidateType Type;
+
+	/** Server address as configured (host:port) */
+	FString ServerAddress;
+
+	/** Index of the server in Config.TURNServers for probes, position in the TURN failover order for allocations */
+	int32 ServerIndex;
+
+	/** Resolved server address */
+	TSharedPtr<FInternetAddr> ServerAddr;
+
+	/** Socket the request was sent from (the agent socket, or the dedicated TURN socket of a pool agent) */
+	FSocket* RequestSocket;
+
+	/** Transaction ID of the outstanding request */
+	uint8 TransactionID[12];
+
+	/** Time since the outstanding request was sent (seconds) */
+	float Elapsed;
+
+	/** FPlatformTime::Seconds() when the first transmission was sent (RTT measurement) */
+	double SentTime;
+
+	/** Whether this is a Binding request measuring the RTT to a TURN server before choosing one (TURN only) */
+	bool bProbe;
+
+	/** Whether the authenticated TURN Allocate has been sent (TURN only) */
+	bool bAuthenticated;
+
+	/** Whether the authenticated Allocate used cached realm/nonce; a fresh challenge may still be answered once (TURN only) */
+	bool bCachedCredentials;
+
+	/** Whether the request finished (success, error or timeout) */
+	bool bDone;
+
+	/** Whether the request produced a candidate */
+	bool bSucceeded;
+
+	FICEGatherRequest()
+		: Type(EICECandidateType::ServerReflexive)
+		, ServerIndex(0)
+		, RequestSocket(nullptr)
+		, Elapsed(0.0f)
+		, SentTime(0.0)
+		, bProbe(false)
+		, bAuthenticated(false)
+		, bCachedCredentials(false)
+		, bDone(false)
+		, bSucceeded(false)
+	{
+		FMemory::Memzero(TransactionID, sizeof(TransactionID));
+	}
+};
+
+/**
+ * Kinds of TURN requests issued on a live allocation
+ */
+enum class EICETURNTransactionType : uint8
+{
+	Refresh,
+	CreatePermission,
+	ChannelBind
+};
+
+/**
+ * Outstanding TURN request on the allocation (RFC 5389 Section 7.2.1)
+ * Retransmitted from Tick with a doubling RTO; the response is matched by transaction ID on the receive path
+ */
+struct FICETURNTransaction
+{
+	EICETURNTransactionType Type;
+
+	/** Transaction ID of the encoded request */
+	uint8 TransactionID[12];
+
+	/** FPlatformTime::Seconds() of the first transmission, challenge retries included in the latency */
+	double StartTime;
+
+	/** Encoded request, resent as-is on retransmission */
+	TArray<uint8> Request;
+
+	/** Peer the permission or channel is for (CreatePermission/ChannelBind) */
+	TSharedPtr<FInternetAddr> PeerAddr;
+
+	/** Channel being bound (ChannelBind) */
+	uint16 ChannelNumber;
+
+	/** Lifetime requested (Refresh, seconds) */
+	int32 Lifetime;
+
+	/** Current retransmission timeout (seconds) */
+	float RTO;
+
+	/** Time since the request was last sent (seconds) */
+	float TimeSinceSend;
+
+	/** Number of times the request was sent */
+	int32 Transmissions;
+
+	/** Whether the request was already re-sent after a 401/438 challenge */
+	bool bAuthRetried;
+
+	FICETURNTransaction()
+		: Type(EICETURNTransactionType::Refresh)
+		, StartTime(0.0)
+		, ChannelNumber(0)
+		, Lifetime(0)
+		, RTO(0.0f)
+		, TimeSinceSend(0.0f)
+		, Transmissions(0)
+		, bAuthRetried(false)
+	{
+		FMemory::Memzero(TransactionID, sizeof(TransactionID));
+	}
+};
+
+/**
+ * Round-trip time measured to a STUN/TURN server, shared by every agent
+ */
+struct FICEServerRTT
+{
+	/** Round-trip time of the last answered request (ms) */
+	float RTT;
+
+	/** Whether the server answered; unreachable servers are tried last */
+	bool bReachable;
+
+	/** FPlatformTime::Seconds() of the measurement */
+	double MeasuredTime;
+
+	FICEServerRTT()
+		: RTT(0.0f)
+		, bReachable(false)
+		, MeasuredTime(0.0)
+	{}
+};
+
+/**
+ * Long-term credential state learnt from a TURN server (RFC 5389 Section 10.2)
+ * Cached per server and username so later allocations skip the 401 challenge round trip
+ */
+struct FICETURNCredentials
+{
+	/** Realm from the server challenge */
+	FString Realm;
+
+	/** Last nonce handed out by the server */
+	FString Nonce;
+
+	/** Long-term key, MD5(username:realm:password) */
+	uint8 Key[16];
+
+	FICETURNCredentials()
+	{
+		FMemory::Memzero(Key, sizeof(Key));
+	}
+};
+
+/**
+ * Datagram buffer owned by the caller of FICEAgent::ReceiveBatch
+ * The payload is received in place; relayed datagrams keep their TURN framing in front of it (see Offset)
+ */
+struct FICEPacket
+{
+	/** Caller-owned storage */
+	uint8* Data;
+
+	/** Size of Data in bytes */
+	int32 Capacity;
+
+	/** Payload size in bytes (0 when nothing was received) */
+	int32 Size;
+
+	/** Payload start within Data */
+	int32 Offset;
+
+	FICEPacket()
+		: Data(nullptr)
+		, Capacity(0)
+		, Size(0)
+		, Offset(0)
+	{}
+
+	FICEPacket(uint8* InData, int32 InCapacity)
+		: Data(InData)
+		, Capacity(InCapacity)
+		, Size(0)
+		, Offset(0)
+	{}
+
+	/** Start of the received payload */
+	const uint8* GetPayload() const { return Data + Offset; }
 };
 
 /**
@@ -97,6 +683,16 @@ struct FICEAgentConfig
  */
 DECLARE_MULTICAST_DELEGATE_OneParam(FOnConnectionStateChanged, EICEConnectionState);
 
+/**
+ * Delegate fired for every local candidate as soon as it is gathered (trickle ICE)
+ */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnLocalCandidateGathered, const FICECandidate&);
+
+/**
+ * Delegate fired once candidate gathering finished or hit its deadline
+ */
+DECLARE_MULTICAST_DELEGATE(FOnCandidateGatheringComplete);
+
 /**
  * ICE Agent implementation
  * Handles candidate gathering, connectivity checks, and connection establishment
@@ -109,236 +705,1031 @@ public:
 
 	/**
 	 * Start gathering ICE candidates
+	 * Host candidates are emitted immediately; STUN/TURN requests are sent in parallel and
+	 * completed from Tick, each candidate being reported through OnLocalCandidateGathered
 	 * @return True if gathering process started successfully
 	 */
-	bool GatherCandidates();
+	bool GatherCandidates();
+
+	/**
+	 * Check if STUN/TURN gathering requests are still pending
+	 * @return True while gathering is in progress
+	 */
+	bool IsGathering() const;
+
+	/**
+	 * Get all gathered candidates, grouped by type (host, server reflexive, relayed, peer reflexive)
+	 * @return Gathered ICE candidates, valid until the next candidate is gathered
+	 */
+	const TArray<FICECandidate>& GetLocalCandidates() const { return LocalCandidates; }
+
+	/**
+	 * Get the gathered candidates of one type without copying them
+	 * @param Type - Candidate type
+	 * @return View into GetLocalCandidates, valid until the next candidate is gathered
+	 */
+	TArrayView<const FICECandidate> GetLocalCandidatesOfType(EICECandidateType Type) const;
+
+	/**
+	 * Add a remote candidate received from peer
+	 * @param Candidate - The remote candidate to add
+	 */
+	void AddRemoteCandidate(const FICECandidate& Candidate);
+
+	/**
+	 * Start connectivity checks with remote candidates
+	 * Forms every local/remote candidate pair and checks them concurrently on one socket,
+	 * paced by ConnectivityCheckInterval; the first pair that succeeds is selected
+	 * @return True if the process started successfully
+	 */
+	bool StartConnectivityChecks();
+
+	/**
+	 * Restart ICE without dropping the connection (RFC 8445 Section 2.4)
+	 * Candidates are gathered again on the same socket and the previous remote candidates are forgotten; once the
+	 * peer's new candidates are added, StartConnectivityChecks checks them in the background while the selected
+	 * pair keeps carrying traffic, and the first new pair that succeeds replaces it in one step.
+	 * Both peers restart and exchange their candidates, as for the initial connection.
+	 * @return True if gathering started
+	 */
+	bool RestartICE();
+
+	/** Check if an ICE restart is looking for a new pair while the selected one still carries traffic */
+	bool IsRestarting() const { return bRestartInProgress; }
+
+	/** Check if connectivity checks are running (first checks, restart or direct upgrade) */
+	bool IsChecking() const { return bChecksInProgress; }
+
+	/** Check if direct pairs are still being checked in the background of a relayed connection */
+	bool IsUpgradingToDirect() const { return bDirectUpgradeInProgress; }
+
+	/** Number of times a relayed connection moved to a faster direct pair */
+	uint32 GetDirectUpgradeCount() const { return DirectUpgradeCount; }
+
+	/** RTT measured to each STUN/TURN server (host:port), shared by every agent */
+	static const TMap<FString, FICEServerRTT>& GetServerRTTs() { return ServerRTTCache; }
+
+	/** Username fragment of this agent, sent to the peer with the candidates (changes on ICE restart) */
+	const FString& GetLocalUfrag() const { return LocalUfrag; }
+
+	/** Password of this agent, sent to the peer with the candidates (changes on ICE restart) */
+	const FString& GetLocalPassword() const { return LocalPassword; }
+
+	/**
+	 * Set the credentials the peer sent with its candidates
+	 * A ufrag too long for the signed HELLO username fails the agent instead of leaving the checks unsigned
+	 * @param Ufrag - Remote username fragment
+	 * @param Password - Remote password
+	 * @return False if the credentials were rejected
+	 */
+	bool SetRemoteCredentials(const FString& Ufrag, const FString& Password);
+
+	/** Username fragment received from the peer (empty until signaled) */
+	const FString& GetRemoteUfrag() const { return RemoteUfrag; }
+
+	/** Handshake packets dropped because they were unsigned, badly signed, addressed to another ufrag or replayed */
+	uint32 GetRejectedHandshakeCount() const { return RejectedHandshakeCount; }
+
+	/** Whether game datagrams are encrypted (FICEAgentConfig::bEncryptTraffic) */
+	bool IsTrafficEncrypted() const { return Config.bEncryptTraffic; }
+
+	/** Whether the traffic keys are derived, encrypted sends fail until then */
+	bool IsSecureChannelEstablished() const { return SecureChannel.IsEstablished(); }
+
+	/** Encrypted datagrams dropped because they were replayed, forged or arrived before the keys */
+	uint32 GetRejectedRecordCount() const { return SecureChannel.GetRejectedRecordCount(); }
+
+	/**
+	 * Set the ICE role used to compute candidate pair priorities
+	 * The session host is controlling, the joining peer is controlled
+	 * @param bInControlling - True for the controlling role
+	 */
+	void SetControlling(bool bInControlling);
+
+	/**
+	 * Check if this agent has the controlling role
+	 * @return True if controlling
+	 */
+	bool IsControlling() const { return bControlling; }
+
+	/**
+	 * Get the current connectivity checklist
+	 * @return Candidate pairs ordered by priority
+	 */
+	const TArray<FICECandidatePair>& GetCandidatePairs() const { return CheckList; }
+
+	/**
+	 * Check if connection is established
+	 * @return True if connected
+	 */
+	bool IsConnected() const;
+
+	/**
+	 * Tick function for periodic processing
+	 * Handles connection retries and timeouts
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void Tick(float DeltaTime);
+
+	/**
+	 * Get current connection state
+	 * @return Current state of the ICE connection
+	 */
+	EICEConnectionState GetConnectionState() const 
+	{
+		FScopeLock Lock(&ConnectionLock);
+		return ConnectionState;
+	}
+
+	/** Event that fires when connection state changes */
+	FOnConnectionStateChanged OnConnectionStateChanged;
+
+	/** Event that fires for each local candidate as soon as it is gathered */
+	FOnLocalCandidateGathered OnLocalCandidateGathered;
+
+	/** Event that fires when candidate gathering is complete */
+	FOnCandidateGatheringComplete OnGatheringComplete;
+
+	/**
+	 * Bind to connection state changes
+	 * @param InDelegate - The delegate to call when connection state changes
+	 * @return Handle to the bound delegate
+	 */
+	FDelegateHandle OnConnectionStateChanged_Handle(const FOnConnectionStateChanged::FDelegate& InDelegate)
+	{
+		return OnConnectionStateChanged.Add(InDelegate);
+	}
+
+	/**
+	 * Send a datagram through the established connection (direct socket or TURN relay)
+	 * With traffic encryption the datagram is sealed into a reused scratch buffer first; with coalescing it is
+	 * appended to the pending datagram, sent by FlushSends; with pacing it may wait in the queue of its class
+	 * @param Data - The data to send
+	 * @param Size - Size of the data in bytes
+	 * @param Priority - Pacing class (FICEAgentConfig::bPaceSends)
+	 * @return True if send was successful (or the datagram was queued)
+	 */
+	bool SendData(const uint8* Data, int32 Size, EICESendPriority Priority = EICESendPriority::Normal);
+
+	/**
+	 * Send several buffers as a single datagram
+	 * A single buffer is sent without copying; several are concatenated into a reused scratch buffer
+	 * @param Buffers - Buffers sent back to back
+	 * @param Priority - Pacing class (FICEAgentConfig::bPaceSends)
+	 * @return True if send was successful (or the datagram was queued)
+	 */
+	bool SendDataGather(TArrayView<const TArrayView<const uint8>> Buffers, EICESendPriority Priority = EICESendPriority::Normal);
+
+	/** Bytes callers of SendDataInPlace must reserve in front of the payload (TURN ChannelData header) */
+	static constexpr int32 SEND_HEADROOM = 4;
+
+	/**
+	 * Send a datagram whose payload starts SEND_HEADROOM bytes into Buffer
+	 * Relayed sends write the ChannelData header into the reserved prefix, so nothing is copied or allocated
+	 * (encrypted sends still copy once, into the scratch buffer the record is sealed in)
+	 * @param Buffer - SEND_HEADROOM reserved bytes followed by the payload; the prefix may be overwritten
+	 * @param PayloadSize - Size of the payload in bytes (not counting the headroom)
+	 * @param Priority - Pacing class (FICEAgentConfig::bPaceSends), a queued datagram is copied
+	 * @return True if send was successful (or the datagram was queued)
+	 */
+	bool SendDataInPlace(uint8* Buffer, int32 PayloadSize, EICESendPriority Priority = EICESendPriority::Normal);
+
+	/**
+	 * Number of heap allocations made by the send path since the agent was created
+	 * Stays at 0 once the scratch buffers have reached their working size
+	 */
+	uint32 GetSendAllocationCount() const { return SendAllocationCount; }
+
+	/**
+	 * Send the datagram of coalesced messages now (FICEAgentConfig::bCoalesceSends)
+	 * Called at the end of Tick and by the net driver after it flushed its connections
+	 * @return False if there were messages and they could not be sent
+	 */
+	bool FlushSends();
+
+	/** Whether game datagrams are coalesced (FICEAgentConfig::bCoalesceSends) */
+	bool IsCoalescingSends() const { return Config.bCoalesceSends; }
+
+	/** Messages sent through the coalescing layer */
+	uint32 GetCoalescedMessageCount() const { return CoalescedMessageCount; }
+
+	/** Datagrams the coalesced messages were packed into */
+	uint32 GetCoalescedDatagramCount() const { return CoalescedDatagramCount; }
+
+	/** Whether game datagrams are paced (FICEAgentConfig::bPaceSends) */
+	bool IsPacingSends() const { return Config.bPaceSends; }
+
+	/** Pacer of the game datagrams: rate estimate, queues and drop counters */
+	const FICESendScheduler& GetSendScheduler() const { return SendScheduler; }
+
+	/** Whether game datagrams carry FEC, negotiated by the FEC flag of the peer's HELLOs (FICEAgentConfig::bEnableFEC) */
+	bool IsFECActive() const { return bFECActive; }
+
+	/** Forward error correction of the game datagrams: group size, loss estimate and recovery counters */
+	const FICEFECCodec& GetFECCodec() const { return FECCodec; }
+
+	/** Traffic counters and latency histograms since the agent was created or ResetStats */
+	const FICEAgentStats& GetStats() const { return Stats; }
+
+	/** Start the counters and histograms over */
+	void ResetStats() { Stats.Reset(); }
+
+	/**
+	 * Largest payload that fits the configured path MTU on the selected path, framing, encryption, coalescing and FEC included
+	 * Relayed sends above this size are dropped rather than fragmented
+	 * @return Maximum payload size in bytes
+	 */
+	int32 GetMaxPayloadSize() const;
+
+	/**
+	 * Drop the current connection, checklist and candidates so the agent can serve a new session
+	 * A live TURN allocation is kept (and refreshed from Tick) so the next gathering reuses it
+	 */
+	void ResetConnection();
+
+	/**
+	 * Receive one datagram from the connection
+	 * Handshake packets are answered internally and never returned; with traffic encryption, records are opened in
+	 * place and the ones failing authentication dropped; with coalescing, each message of a datagram is returned
+	 * by its own call
+	 * @param Data - Buffer to receive data into
+	 * @param MaxSize - Maximum size of the buffer
+	 * @param OutSize - Number of bytes actually received
+	 * @return True if a datagram was received
+	 */
+	bool ReceiveData(uint8* Data, int32 MaxSize, int32& OutSize);
+
+	/**
+	 * Drain every pending datagram in one call, directly into caller-owned buffers
+	 * @param Packets - Buffers to fill; Size/Offset of each filled packet are updated
+	 * @return Number of packets filled (the first N entries of Packets)
+	 */
+	int32 ReceiveBatch(TArrayView<FICEPacket> Packets);
+
+	/**
+	 * Check whether a datagram is waiting (IO thread ring, direct socket or TURN socket)
+	 * Handshake packets at the head of the queue are counted too; ReceiveData skips them
+	 * @param PendingDataSize - Size of the pending data, 0 when unknown
+	 * @return True if there is data to read
+	 */
+	bool HasPendingData(uint32& PendingDataSize) const;
+
+	/** Local candidate of the selected pair (valid once connected) */
+	const FICECandidate& GetSelectedLocalCandidate() const { return SelectedLocalCandidate; }
+
+	/** Remote candidate of the selected pair (valid once connected) */
+	const FICECandidate& GetSelectedRemoteCandidate() const { return SelectedRemoteCandidate; }
+
+	/**
+	 * Address of the selected remote candidate, as reported as the source of received datagrams
+	 * @return Address, or null if not connected
+	 */
+	TSharedPtr<const FInternetAddr> GetSelectedRemoteAddress() const { return SelectedRemoteAddr; }
+
+	/**
+	 * Address the peer is known by to the net driver: the first selected remote address of the connection,
+	 * kept when an ICE restart migrates the traffic to another pair
+	 * @return Address, or null if never connected
+	 */
+	TSharedPtr<const FInternetAddr> GetPeerAddress() const { return PeerAddr; }
+
+	/**
+	 * Get the round-trip time and loss measured on the selected pair
+	 * @param OutStats - Receives the statistics
+	 * @return False if no pair has been selected
+	 */
+	bool GetSelectedPairStats(FICEPairStats& OutStats) const;
+
+	/**
+	 * Time since the peer last answered a consent check on the selected pair
+	 * @return Seconds, 0 when not connected
+	 */
+	float GetTimeSinceConsent() const { return bIsConnected ? TimeSinceConsent : 0.0f; }
+
+	/**
+	 * Get the address the agent socket is bound to
+	 * @param OutAddr - Receives the local address
+	 */
+	void GetLocalAddress(FInternetAddr& OutAddr) const;
+
+	/**
+	 * Get the port the agent socket is bound to
+	 * @return Local port, 0 if there is no socket
+	 */
+	int32 GetLocalPort() const;
+
+	/**
+	 * Use a socket owned by FICEAgentPool instead of binding one per agent
+	 * The pool reads the socket and hands each datagram routed to this agent over through DeliverPacket
+	 * @param InSocket - Bound, non-blocking socket shared with the other agents of the pool
+	 * @param bInMultiplexTURN - Whether the TURN allocation may live on the pool socket (one agent per pool,
+	 *                           a 5-tuple holds a single allocation per server); otherwise a dedicated TURN socket is bound
+	 */
+	void AttachSharedSocket(FSocket* InSocket, bool bInMultiplexTURN = false);
+
+	/**
+	 * Create a bound, non-blocking UDP socket on every interface, as used by an agent or an agent pool
+	 * With bDualStack an IPv6 socket that also carries IPv4 (as IPv4-mapped addresses) is tried first,
+	 * falling back to IPv4 when the platform has no IPv6
+	 * @param Description - Socket description for debugging
+	 * @param bDualStack - Whether IPv6 host candidates should be reachable on the socket (FICEAgentConfig::bEnableIPv6)
+	 * @return The socket, or null if none could be bound
+	 */
+	static FSocket* CreateAgentSocket(const FString& Description, bool bDualStack);
+
+	/** Check if the agent runs on a pool socket */
+	bool IsUsingSharedSocket() const { return bSharedSocket; }
+
+	/**
+	 * Queue a datagram the pool read from the shared socket
+	 * @param Data - Datagram
+	 * @param Size - Datagram size
+	 * @param FromAddr - Sender address
+	 * @return False if the datagram was dropped (no shared socket or receive ring full)
+	 */
+	bool DeliverPacket(const uint8* Data, int32 Size, const FInternetAddr& FromAddr);
+
+	/**
+	 * Check if a datagram from an address the pool hasn't routed yet belongs to this agent
+	 * Matches the addresses of the checklist and remote candidates, HELLO responses echoing one of this agent's tokens
+	 * STUN responses to this agent's gathering requests and traffic of a TURN server multiplexed on the pool socket
+	 * @param FromAddr - Sender address
+	 * @param Data - Datagram
+	 * @param Size - Datagram size
+	 * @return True if the agent expects traffic from this sender
+	 */
+	bool AcceptsDatagramFrom(const FInternetAddr& FromAddr, const uint8* Data, int32 Size) const;
+
+	/**
+	 * Check if the agent still has work for Tick (gathering, checks, connection or TURN allocation)
+	 * @return False once the agent is idle and can be skipped until its state changes
+	 */
+	bool IsActive() const;
+
+	/** Check if connectivity checks are running */
+	bool AreChecksInProgress() const { return bChecksInProgress; }
+
+	/**
+	 * Detach from the peer and release every resource, the TURN allocation included
+	 * A shared socket is left to its pool
+	 */
+	void Close();
+
+private:
+
+	/**
+	 * Send a HELLO connectivity check for a candidate pair
+	 * @param Pair - The pair to check
+	 * @return True if the check was sent successfully
+	 */
+	bool SendConnectivityCheck(FICECandidatePair& Pair);
+
+	/**
+	 * Process received data and handle handshake packets
+	 * @return True if data was processed successfully
+	 */
+	bool ProcessReceivedData();
+
+private:
+	/** Agent configuration */
+	FICEAgentConfig Config;
+
+	/** Number of EICECandidateType values */
+	static constexpr int32 NUM_CANDIDATE_TYPES = 4;
+
+	/**
+	 * Local candidates, grouped by type in EICECandidateType order so each type is one contiguous range
+	 * (selection and filtering by type are a slice, no scan or temporary array)
+	 */
+	TArray<FICECandidate> LocalCandidates;
+
+	/** End of the range of each candidate type in LocalCandidates */
+	int32 LocalCandidateTypeEnd[NUM_CANDIDATE_TYPES];
+
+	/** Remote candidates */
+	TArray<FICECandidate> RemoteCandidates;
+
+	/**
+	 * Socket for communication, bound once when gathering starts and kept until Close
+	 * STUN, TURN and peer datagrams share it (demultiplexed by first byte, RFC 7983), so the server reflexive
+	 * and relayed candidates map the very port the checks and the game traffic use
+	 */
+	FSocket* Socket;
+
+	/** Whether Socket belongs to an FICEAgentPool (never destroyed here, read through DeliverPacket) */
+	bool bSharedSocket;
+
+	/** Whether the TURN allocation may be multiplexed on a pool socket (always allowed on an own socket) */
+	bool bMultiplexTURNOnSharedSocket;
+
+	/** Datagrams received by the receive thread, consumed by the game thread */
+	TUniquePtr<FICEPacketRing> ReceiveRing;
+
+	/** Optional receive thread draining Socket (see FICEAgentConfig::bUseIOThread) */
+	TUniquePtr<FICEReceiveThread> ReceiveThread;
+
+	/** Ring drop count already reported in the log */
+	uint32 ReportedDroppedPackets;
+
+	/** Socket the TURN allocation lives on: Socket itself, or a dedicated socket on a pool (an allocation is per 5-tuple) */
+	FSocket* TURNSocket;
+
+	/** TURN server address (cached for refresh) */
+	TSharedPtr<FInternetAddr> TURNServerAddr;
+
+	/** TURN relay address allocated by server */
+	TSharedPtr<FInternetAddr> TURNRelayAddr;
+
+	/** Configured address (host:port) of the server holding the live allocation */
+	FString ActiveTURNServer;
+
+	/** Credentials learnt from each TURN server, shared by every agent (game thread only) */
+	static TMap<FString, FICETURNCredentials> TURNCredentialCache;
+
+	/** RTT measured to each configured server (host:port), shared by every agent (game thread only) */
+	static TMap<FString, FICEServerRTT> ServerRTTCache;
+
+	/** Indices in Config.TURNServers, in the order allocations are tried (fastest first) */
+	TArray<int32> TURNServerOrder;
+
+	/** Whether the TURN server for this gathering pass has been chosen (probes answered, timed out or skipped) */
+	bool bTURNServerSelected;
+
+	/** TURN allocation lifetime (seconds) */
+	int32 TURNAllocationLifetime;
+
+	/** Time since last TURN refresh (seconds) */
+	float TimeSinceTURNRefresh;
+
+	/** Channel bound for the selected relayed pair (0 while Send indications are used) */
+	uint16 TURNChannelNumber;
+
+	/** Time since the last ChannelBind attempt for the selected relayed pair (seconds) */
+	float TimeSinceChannelBindAttempt;
+
+	/** Interval between ChannelBind retries while relaying over Send indications (seconds) */
+	static constexpr float CHANNEL_BIND_RETRY_INTERVAL = 5.0f;
+
+	/** Time since the selected relayed pair's permission/channel were last refreshed (seconds) */
+	float TimeSinceRelayBindRefresh;
+
+	/** Interval between permission/channel refreshes, below the 5 minute permission lifetime (seconds) */
+	static constexpr float RELAY_BIND_REFRESH_INTERVAL = 240.0f;
+
+	/** Whether TURN allocation is active */
+	bool bTURNAllocationActive;
+
+	/** Refresh/CreatePermission/ChannelBind requests waiting for a response */
+	TArray<FICETURNTransaction> TURNTransactions;
+
+	/** Initial retransmission timeout of TURN requests, doubled on every retransmission (RFC 5389 RTO) */
+	static constexpr float TURN_INITIAL_RTO = 0.5f;
+
+	/** Transmissions of a TURN request before giving up (RFC 5389 Rc) */
+	static constexpr int32 TURN_MAX_TRANSMISSIONS = 7;
+
+	/** Wait after the last transmission, in multiples of the initial RTO (RFC 5389 Rm) */
+	static constexpr int32 TURN_FINAL_WAIT_FACTOR = 16;
+
+	/** Connection state */
+	bool bIsConnected;
+
+	/** Selected candidate pair */
+	FICECandidate SelectedLocalCandidate;
+	FICECandidate SelectedRemoteCandidate;
+
+	/** Resolved address of the selected remote candidate */
+	TSharedPtr<FInternetAddr> SelectedRemoteAddr;
+
+	/** Check token of the selected pair (pairs are re-sorted when candidates arrive, indexes don't last) */
+	uint32 SelectedCheckToken;
+
+	/** Stable peer address reported to the net driver (see GetPeerAddress) */
+	TSharedPtr<FInternetAddr> PeerAddr;
+
+	/** Whether an ICE restart is in progress on a connected agent */
+	bool bRestartInProgress;
+
+	/** Whether direct pairs are checked in the background while the selected pair uses a relay */
+	bool bDirectUpgradeInProgress;
+
+	/** Rounds of direct checks started since the relayed pair was selected */
+	int32 DirectUpgradeRounds;
+
+	/** Time since the last round of direct checks ended (seconds) */
+	float TimeSinceDirectUpgradeRound;
+
+	/** Whether the TURN allocation is kept until the peer follows us to the direct pair */
+	bool bTURNReleasePending;
+
+	/** Time since the connection moved to a direct pair (seconds) */
+	float TimeSinceDirectUpgrade;
+
+	/** Relayed connections moved to a direct pair (kept across sessions) */
+	uint32 DirectUpgradeCount;
+
+	/** Token of the outstanding consent check (RFC 7675), answered like any HELLO request */
+	uint32 ConsentToken;
+
+	/** Whether a consent check is waiting for its response */
+	bool bConsentPending;
+
+	/** Time since the last consent check was sent (seconds) */
+	float TimeSinceConsentCheck;
+
+	/** Randomized delay before the next consent check (seconds) */
+	float NextConsentCheckDelay;
+
+	/** Time since the last consent response, or since the pair was selected (seconds) */
+	float TimeSinceConsent;
+
+	/** Sender address of received datagrams (reused across receives) */
+	TSharedPtr<FInternetAddr> ReceiveFromAddr;
+
+	/** Scratch buffer used to concatenate gathered sends (starts with SEND_HEADROOM reserved bytes) */
+	TArray<uint8> SendGatherBuffer;
+
+	/** Scratch buffer used to frame relayed sends that come without headroom */
+	TArray<uint8> RelaySendBuffer;
+
+	/** Scratch buffer encrypted sends are sealed in (SEND_HEADROOM, record header, payload, tag) */
+	TArray<uint8> SecureSendBuffer;
+
+	/** Scratch buffer FEC data and parity packets are framed in (SEND_HEADROOM, FEC header, payload) */
+	TArray<uint8> FECSendBuffer;
+
+	/** Datagram coalesced messages are appended to (SEND_HEADROOM, record header if encrypted, bundle, tag room) */
+	TArray<uint8> CoalesceBuffer;
+
+	/** Bytes of the pending bundle, 0 when nothing is queued */
+	int32 CoalescedSize;
+
+	/** When the first message of the pending bundle was queued (FPlatformTime::Seconds) */
+	double CoalesceStartTime;
+
+	/** Messages sent through the coalescing layer and datagrams they were packed into */
+	uint32 CoalescedMessageCount;
+	uint32 CoalescedDatagramCount;
+
+	/** Messages of the last received bundle not returned yet (still framed) and the read position in it */
+	TArray<uint8> ReceiveBundleBuffer;
+	int32 ReceiveBundleOffset;
+
+	/** Heap allocations made by the send path (scratch buffer growth) */
+	uint32 SendAllocationCount;
+
+	/** Current connection state */
+	EICEConnectionState ConnectionState;
+
+	/** Total number of times connectivity checks were started */
+	int32 TotalConnectionAttempts;
+
+	/** Maximum total connection attempts before giving up */
+	static constexpr int32 MAX_TOTAL_ATTEMPTS = 10;
+
+	/** Host candidates kept when a machine has many interfaces (each one multiplies the checklist) */
+	static constexpr int32 MAX_HOST_CANDIDATES = 8;
+
+	/** Thread-safe access to connection state (only guards state transitions, packets go through ReceiveRing) */
+	mutable FCriticalSection ConnectionLock;
+
+	/** Whether this agent is the controlling agent */
+	bool bControlling;
+
+	/** Local username fragment and password (RFC 8445 Section 5.3), regenerated on ICE restart */
+	FString LocalUfrag;
+	FString LocalPassword;
+
+	/** Credentials of the remote peer */
+	FString RemoteUfrag;
+	FString RemotePassword;
+
+	/** Length of generated username fragments and passwords (RFC 8445 minimums are 4 and 22) */
+	static constexpr int32 UFRAG_LENGTH = 8;
+	static constexpr int32 PASSWORD_LENGTH = 24;
+
+	/**
+	 * HMAC keys of the handshake (short-term credentials, RFC 8445 Section 7.2.2): requests are signed with the
+	 * password of the agent they are sent to and answered with the same key, so ours checks the peer's requests and
+	 * signs our responses, and the peer's signs our requests and checks its responses
+	 */
+	FSTUNHMACKey LocalHandshakeKey;
+	FSTUNHMACKey RemoteHandshakeKey;
+
+	/** USERNAME of our requests ("RFRAG:LFRAG") and the one expected in the peer's ("LFRAG:RFRAG", "LFRAG:" until signaled) */
+	TArray<uint8> OutgoingHandshakeUsername;
+	TArray<uint8> IncomingHandshakeUsername;
+
+	/** Sequence number of the next signed handshake packet */
+	uint32 NextHandshakeSequence;
+
+	/** Replay window over the peer's sequence numbers: the highest one accepted and a bit for each of the ones before it */
+	uint32 RemoteSequenceMax;
+	uint64 RemoteSequenceWindow;
+	bool bRemoteSequenceSeen;
+
+	/** Handshake packets rejected before any state work */
+	uint32 RejectedHandshakeCount;
+
+	/** The peer's last credentials could not be used: every HELLO is rejected, unsigned ones included, until valid ones arrive */
+	bool bRemoteCredentialsRejected;
+
+	/** Encryption of game datagrams (FICEAgentConfig::bEncryptTraffic), keyed by the shares of the signed HELLOs */
+	FICESecureChannel SecureChannel;
+
+	/** Latest key share of the peer, kept until its password is known to derive the keys */
+	uint8 RemoteKeyShare[FICESecureChannel::KEY_SHARE_SIZE];
+	bool bHasRemoteKeyShare;
+
+	/** Pacer in front of the send path (FICEAgentConfig::bPaceSends) */
+	FICESendScheduler SendScheduler;
+
+	/** Parity groups of the sent and received datagrams, used once bFECActive */
+	FICEFECCodec FECCodec;
+
+	/** Whether FEC is enabled here and the peer advertised it */
+	bool bFECActive;
+
+	/** Counters and histograms (ICE.STATS) */
+	FICEAgentStats Stats;
+
+	/** FPlatformTime::Seconds() when the current connectivity checks started, 0 once connected */
+	double ChecksStartTime;
+
+	/** Candidate pairs, sorted by descending priority */
+	TArray<FICECandidatePair> CheckList;
+
+	/** Pairs (by check token) to check before the ordinary ones */
+	TArray<uint32> TriggeredCheckQueue;
+
+	/** Whether connectivity checks are running */
+	bool bChecksInProgress;
+
+	/** Time since the last paced check was sent (seconds) */
+	float TimeSinceLastPacedCheck;
+
+	/** Next correlation token handed out to a candidate pair */
+	uint32 NextCheckToken;
+
+	/** Next TURN channel number handed out to a relayed pair */
+	uint16 NextRelayChannel;
+
+	/** Interval between retransmissions of a pending check (seconds) */
+	static constexpr float CHECK_RETRANSMIT_INTERVAL = 0.25f;
+
+	/** Checks sent for a pair before it is considered failed */
+	static constexpr int32 MAX_CHECK_TRANSMISSIONS = 8;
+
+	/** STUN/TURN requests currently in flight while gathering */
+	TArray<FICEGatherRequest> GatherRequests;
+
+	/** Whether candidate gathering is in progress */
+	bool bGatheringInProgress;
+
+	/** Whether server requests wait for a hostname lookup (started from TickGathering) */
+	bool bWaitingForDNS;
+
+	/** Time elapsed since gathering started (seconds) */
+	float TimeSinceGatheringStart;
+
+	/** Maximum time to wait for a single STUN/TURN gathering response (seconds) */
+	static constexpr float GATHER_REQUEST_TIMEOUT = 3.0f;
+
+	/**
+	 * Update the current connection state and notify listeners
+	 * @param NewState - The new connection state to transition to
+	 */
+	void UpdateConnectionState(EICEConnectionState NewState);
 
 	/**
-	 * Get all gathered candidates
-	 * @return Array of gathered ICE candidates
+	 * Get string representation of connection state
+	 * @param State - The state to convert to string
+	 * @return String representation of the state
 	 */
-	TArray<FICECandidate> GetLocalCandidates() const;
+	FString GetConnectionStateName(EICEConnectionState State) const;
 
 	/**
-	 * Add a remote candidate received from peer
-	 * @param Candidate - The remote candidate to add
+	 * Complete the handshake process and establish connection
+	 * Called when the check of a candidate pair has succeeded
+	 * @param PairIndex - Index of the succeeded pair in CheckList
 	 */
-	void AddRemoteCandidate(const FICECandidate& Candidate);
+	void CompleteHandshake(int32 PairIndex);
 
 	/**
-	 * Start connectivity checks with remote candidates
-	 * Will attempt direct connection first, then fall back to relay if needed
-	 * @return True if the process started successfully
+	 * Make a succeeded pair the selected one and enter Connected
+	 * @param PairIndex - Index of the pair in CheckList
 	 */
-	bool StartConnectivityChecks();
+	void SelectPair(int32 PairIndex);
 
 	/**
-	 * Check if connection is established
-	 * @return True if connected
+	 * Start checking direct pairs in the background of a relayed connection
+	 * Relayed pairs left in the checklist stop being checked; failed direct pairs are retried by TickDirectUpgrade
 	 */
-	bool IsConnected() const;
+	void StartDirectUpgrade();
 
 	/**
-	 * Tick function for periodic processing
-	 * Handles connection retries and timeouts
+	 * Retry failed direct pairs every DirectUpgradeInterval and release the TURN allocation once it isn't needed
 	 * @param DeltaTime - Time elapsed since last tick
 	 */
-	void Tick(float DeltaTime);
+	void TickDirectUpgrade(float DeltaTime);
 
 	/**
-	 * Get current connection state
-	 * @return Current state of the ICE connection
+	 * Decide whether a direct pair that just succeeded should replace the relayed one
+	 * A pair answered only after a retransmission can't be timed and is checked once more
+	 * @param PairIndex - Index of the succeeded direct pair
+	 * @return True if the pair measured a lower RTT than the selected pair (or the relay was never timed)
 	 */
-	EICEConnectionState GetConnectionState() const 
-	{
-		FScopeLock Lock(&ConnectionLock);
-		return ConnectionState;
-	}
-
-	/** Event that fires when connection state changes */
-	FOnConnectionStateChanged OnConnectionStateChanged;
+	bool ShouldUpgradeToPair(int32 PairIndex);
 
 	/**
-	 * Bind to connection state changes
-	 * @param InDelegate - The delegate to call when connection state changes
-	 * @return Handle to the bound delegate
+	 * Account for a move from a relayed pair to a direct one; the TURN allocation is released once the peer follows
+	 * @param NewPair - Direct pair about to be selected
 	 */
-	FDelegateHandle OnConnectionStateChanged_Handle(const FOnConnectionStateChanged::FDelegate& InDelegate)
-	{
-		return OnConnectionStateChanged.Add(InDelegate);
-	}
+	void RecordDirectUpgrade(const FICECandidatePair& NewPair);
 
-private:
 	/**
-	 * Send data through the established connection
-	 * @param Data - The data to send
-	 * @param Size - Size of the data in bytes
-	 * @return True if send was successful
+	 * Move to the direct pair game data from the peer arrived on: the peer upgraded first, staying on the relay
+	 * would leave each side sending on a path the other one no longer reads
+	 * @param FromAddr - Sender of the game datagram
+	 * @return True if the connection moved to that pair
 	 */
-	bool SendData(const uint8* Data, int32 Size);
+	bool FollowPeerToDirectPair(const FInternetAddr& FromAddr);
+
+	/** Deallocate the TURN allocation (Refresh with a zero lifetime, RFC 5766 Section 7) and drop relayed pairs */
+	void ReleaseTURNAllocation();
 
 	/**
-	 * Receive data from the connection
-	 * @param Data - Buffer to receive data into
-	 * @param MaxSize - Maximum size of the buffer
-	 * @param OutSize - Number of bytes actually received
-	 * @return True if receive was successful
+	 * Find the selected pair in the checklist
+	 * @return The pair, or null if none is selected
 	 */
-	bool ReceiveData(uint8* Data, int32 MaxSize, int32& OutSize);
+	FICECandidatePair* FindSelectedPair();
+	const FICECandidatePair* FindSelectedPair() const;
 
 	/**
-	 * Close the connection and clean up resources
+	 * Send consent checks on the selected pair and fail the connection once consent expires (RFC 7675)
+	 * @param DeltaTime - Time elapsed since last tick
 	 */
-	void Close();
+	void TickConsent(float DeltaTime);
 
 	/**
-	 * Send handshake packet to verify bidirectional communication
-	 * @return True if handshake packet was sent successfully
+	 * Record the response to a timed request on a pair
+	 * @param Pair - Pair the response arrived on
+	 * @param bTimed - Whether the response can be attributed to a single transmission (RTT sample)
 	 */
-	bool SendHandshake();
+	void RecordPairResponse(FICECandidatePair& Pair, bool bTimed);
 
 	/**
-	 * Process received data and handle handshake packets
-	 * @return True if data was processed successfully
+	 * Compute the priority of a candidate pair (RFC 8445 Section 6.1.2.3)
+	 * @param ControllingPriority - Priority of the controlling agent's candidate (G)
+	 * @param ControlledPriority - Priority of the controlled agent's candidate (D)
+	 * @return Pair priority
 	 */
-	bool ProcessReceivedData();
+	static uint64 ComputePairPriority(uint32 ControllingPriority, uint32 ControlledPriority);
 
-private:
-	/** Agent configuration */
-	FICEAgentConfig Config;
+	/**
+	 * Add a pair to the checklist while checks are running or being formed
+	 * Redundant pairs (same path to the same remote address) keep only the highest priority one
+	 * @param Local - Local candidate
+	 * @param Remote - Remote candidate
+	 * @return Index of the pair in CheckList, or INDEX_NONE if it was pruned
+	 */
+	int32 AddCandidatePair(const FICECandidate& Local, const FICECandidate& Remote);
 
-	/** Local candidates */
-	TArray<FICECandidate> LocalCandidates;
+	/** Recompute pair priorities (after a role change) and re-sort CheckList */
+	void SortCheckList();
 
-	/** Remote candidates */
-	TArray<FICECandidate> RemoteCandidates;
+	/**
+	 * Set the state of a new pair: Waiting if no other pair shares its foundation, Frozen otherwise
+	 * @param PairIndex - Index in CheckList
+	 */
+	void InitializePairState(int32 PairIndex);
 
-	/** Socket for communication */
-	FSocket* Socket;
+	/**
+	 * Unfreeze every Frozen pair sharing a foundation
+	 * @param Foundation - Pair foundation
+	 */
+	void UnfreezePairsWithFoundation(const FString& Foundation);
 
-	/** TURN relay socket (persistent for TURN connections) */
-	FSocket* TURNSocket;
+	/**
+	 * Pick the next pair to check: triggered checks first, then the highest priority Waiting
+	 * pair, then the highest priority Frozen pair
+	 * @return Index in CheckList, or INDEX_NONE if nothing is left to check
+	 */
+	int32 SelectNextPairToCheck();
 
-	/** TURN server address (cached for refresh) */
-	TSharedPtr<FInternetAddr> TURNServerAddr;
+	/**
+	 * Handle Tick logic while connectivity checks are running
+	 * Sends one new check per pacing interval and retransmits pending checks
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void TickConnectivityChecks(float DeltaTime);
 
-	/** TURN relay address allocated by server */
-	TSharedPtr<FInternetAddr> TURNRelayAddr;
+	/**
+	 * Retransmit pending checks, pace new ones and reflect the outcome in the connection state
+	 * Reads nothing from the sockets, so it also runs while connected during an ICE restart
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void AdvanceConnectivityChecks(float DeltaTime);
 
-	/** TURN allocation lifetime (seconds) */
-	int32 TURNAllocationLifetime;
+	/**
+	 * Create the agent socket shared by gathering, every candidate pair and the TURN allocation
+	 * @return True if the socket is ready
+	 */
+	bool CreateCheckSocket();
 
-	/** Time since last TURN refresh (seconds) */
-	float TimeSinceTURNRefresh;
+	/**
+	 * Convert an address to the family of the agent socket
+	 * A dual-stack socket reaches IPv4 hosts through IPv4-mapped addresses (::ffff:a.b.c.d), which is also how
+	 * it reports their datagrams, so every address compared with a sender goes through here
+	 * @param Addr - Resolved address
+	 * @return The address to send to, Addr itself when no mapping is needed
+	 */
+	TSharedPtr<FInternetAddr> ToSocketAddress(const TSharedPtr<FInternetAddr>& Addr) const;
 
-	/** TURN channel number for ChannelBind */
-	uint16 TURNChannelNumber;
+	/**
+	 * Address of a socket address as written in candidates (IPv4-mapped addresses are unmapped)
+	 * @param Addr - Socket address
+	 * @return Address without port
+	 */
+	static FString GetCandidateAddress(const FInternetAddr& Addr);
 
-	/** Whether TURN allocation is active */
-	bool bTURNAllocationActive;
+	/** Check whether the TURN allocation is multiplexed on Socket */
+	bool IsTURNMultiplexed() const { return TURNSocket && TURNSocket == Socket; }
 
-	/** Transaction ID for current TURN request */
-	uint8 TURNTransactionID[12];
+	/** Forget the TURN socket, destroying it only when it's a dedicated one */
+	void ReleaseTURNSocket();
 
-	/** Connection state */
-	bool bIsConnected;
+	/**
+	 * Check whether a datagram received on Socket comes from a STUN/TURN server rather than the peer (RFC 7983)
+	 * First byte 0-3 is STUN; 64-127 is ChannelData only when sent by the TURN server, the HELLO magic ("I") lies in that range too
+	 * @param Buffer - Datagram
+	 * @param Size - Datagram size
+	 * @param FromAddr - Sender address
+	 * @return True for server traffic, to be passed to HandleServerDatagram
+	 */
+	bool IsServerDatagram(const uint8* Buffer, int32 Size, const FInternetAddr& FromAddr) const;
 
-	/** Selected candidate pair */
-	FICECandidate SelectedLocalCandidate;
-	FICECandidate SelectedRemoteCandidate;
+	/**
+	 * Handle a server datagram received on Socket
+	 * Responses are matched against gathering requests and TURN transactions; relayed data is located in place
+	 * @param Buffer - Datagram
+	 * @param Size - Datagram size
+	 * @param FromAddr - Sender address
+	 * @param OutOffset - Relayed payload start within Buffer
+	 * @param OutSize - Relayed payload size
+	 * @param OutChannelNumber - Channel the payload came through (optional)
+	 * @return True if the datagram carries relayed peer data, false if it was consumed
+	 */
+	bool HandleServerDatagram(const uint8* Buffer, int32 Size, const FInternetAddr& FromAddr, int32& OutOffset, int32& OutSize, uint16* OutChannelNumber);
 
-	/** Current connection state */
-	EICEConnectionState ConnectionState;
+	/** Start the receive thread for Socket if enabled in the configuration */
+	void StartReceiveThread();
 
-	/** Number of direct connection attempts made */
-	int32 DirectConnectionAttempts;
+	/** Stop the receive thread; must be called before Socket is destroyed */
+	void StopReceiveThread();
 
-	/** Total number of connection attempts (direct + relay) */
-	int32 TotalConnectionAttempts;
+	/**
+	 * Read the next datagram received on Socket, from the receive ring when the I/O thread runs
+	 * @param Buffer - Buffer to receive data into
+	 * @param BufferSize - Size of the buffer
+	 * @param OutSize - Number of bytes received
+	 * @param OutFromAddr - Sender address
+	 * @return True if a datagram was read
+	 */
+	bool ReceiveDirectPacket(uint8* Buffer, int32 BufferSize, int32& OutSize, FInternetAddr& OutFromAddr);
 
-	/** Maximum number of direct connection attempts before falling back to TURN */
-	static constexpr int32 MAX_DIRECT_ATTEMPTS = 3;
+	/**
+	 * Receive the next game datagram on the selected path, opening it when traffic is encrypted
+	 * @param Packet - Caller-owned buffer
+	 * @return True if a datagram was received
+	 */
+	bool ReceiveAppPacket(FICEPacket& Packet);
 
-	/** Maximum total connection attempts before giving up */
-	static constexpr int32 MAX_TOTAL_ATTEMPTS = 10;
+	/**
+	 * Receive the next datagram from the peer on the selected path, answering handshake packets on the way
+	 * @param Packet - Caller-owned buffer
+	 * @return True if a datagram was received
+	 */
+	bool ReceiveDatagram(FICEPacket& Packet);
 
-	/** Delay between connection attempts (seconds) */
-	float RetryDelay;
+	/**
+	 * Receive the next datagram, stripped of its FEC header, or one rebuilt from parity (ReceiveDatagram without FEC)
+	 * @param Packet - Caller-owned buffer
+	 * @return True if a datagram was received
+	 */
+	bool ReceiveFECDatagram(FICEPacket& Packet);
 
-	/** Time elapsed since last connection attempt */
-	float TimeSinceLastAttempt;
+	/**
+	 * Return the first message of a received bundle in place, the others are kept for the next receives
+	 * @param Packet - Received bundle, adjusted to its first message
+	 * @return False if the bundle is malformed
+	 */
+	bool UnpackBundle(FICEPacket& Packet);
 
-	/** Thread-safe access to connection state */
-	mutable FCriticalSection ConnectionLock;
+	/**
+	 * Copy the next message kept from a received bundle into a packet
+	 * @param Packet - Caller-owned buffer
+	 * @return False once every kept message was returned
+	 */
+	bool PopBundledMessage(FICEPacket& Packet);
 
-	/** Handshake state tracking */
-	bool bHandshakeSent;
-	bool bHandshakeReceived;
-	float HandshakeTimeout;
-	float TimeSinceHandshakeStart;
-	float TimeSinceLastHandshakeSend;
-	
-	/** Maximum time to wait for handshake response (seconds) */
-	static constexpr float MAX_HANDSHAKE_TIMEOUT = 5.0f;
-	
-	/** Retry interval for handshake packets (seconds) */
-	static constexpr float HANDSHAKE_RETRY_INTERVAL = 1.0f;
+	/**
+	 * Answer handshake packets at the head of the receive queues once connected
+	 * Game datagrams are left queued for ReceiveData/ReceiveBatch
+	 */
+	void ProcessConnectedHandshakes();
 
 	/**
-	 * Update the current connection state and notify listeners
-	 * @param NewState - The new connection state to transition to
+	 * Check if a datagram is a handshake packet
+	 * @param Buffer - Datagram
+	 * @param Size - Datagram size
+	 * @return True if it carries the handshake magic number
 	 */
-	void UpdateConnectionState(EICEConnectionState NewState);
+	bool IsHandshakePacket(const uint8* Buffer, int32 Size) const;
 
 	/**
-	 * Get string representation of connection state
-	 * @param State - The state to convert to string
-	 * @return String representation of the state
+	 * Build a handshake packet, signed when its type carries the authenticated flag
+	 * @param OutPacket - Receives up to MAX_HANDSHAKE_PACKET_SIZE bytes
+	 * @param PacketType - HELLO request or response, with the authenticated flag
+	 * @param Token - Correlation token
+	 * @return Packet size
 	 */
-	FString GetConnectionStateName(EICEConnectionState State) const;
+	int32 BuildHandshakePacket(uint8* OutPacket, uint8 PacketType, uint32 Token);
+
+	/** Type of the HELLO requests of this agent: signed once the peer's password is known */
+	uint8 GetHandshakeRequestType() const;
 
 	/**
-	 * Check if handshake should be retried based on current state and timing
-	 * @return True if handshake should be retried
+	 * Check the credentials of a handshake packet, before any lookup or state change
+	 * Signed packets must name this agent (requests), fit the replay window and carry a valid MESSAGE-INTEGRITY;
+	 * unsigned ones are only accepted while the peer hasn't signaled credentials (candidates exchanged by hand)
+	 * @param Buffer - Packet data, magic number already verified
+	 * @param Size - Packet size
+	 * @return True if the packet may be processed (its sequence number is then recorded)
 	 */
-	bool ShouldRetryHandshake() const;
+	bool AuthenticateHandshakePacket(const uint8* Buffer, int32 Size);
+
+	/** Whether a sequence number of the peer was already accepted or is too old for the replay window */
+	bool IsHandshakeReplay(uint32 Sequence) const;
+
+	/** Record an accepted sequence number of the peer in the replay window */
+	void RecordHandshakeSequence(uint32 Sequence);
+
+	/** Forget the peer's sequence numbers (new peer credentials) */
+	void ResetHandshakeReplayWindow();
+
+	/** Derive the handshake keys and usernames from the current local and remote credentials */
+	void UpdateHandshakeCredentials();
 
 	/**
-	 * Complete the handshake process and establish connection
-	 * Called when both send and receive handshake have completed
+	 * Store the key share of an authenticated handshake packet and derive the traffic keys from it
+	 * @param KeyShare - FICESecureChannel::KEY_SHARE_SIZE bytes
 	 */
-	void CompleteHandshake();
+	void AcceptRemoteKeyShare(const uint8* KeyShare);
+
+	/** Derive the traffic keys once both the peer's key share and password are known */
+	void TryEstablishSecureChannel();
 
 	/**
-	 * Clean up the socket and update state to Failed
-	 * Helper method to reduce code duplication in error paths
+	 * Handle a handshake packet received on any path
+	 * @param Buffer - Packet data
+	 * @param Size - Packet size
+	 * @param FromAddr - Sender address (direct path only, null when received through TURN)
+	 * @param RelayChannel - TURN channel the packet arrived on (0 for the direct path)
+	 * @return True if the packet was a handshake packet
 	 */
-	void CleanupSocketOnError();
+	bool HandleHandshakePacket(const uint8* Buffer, int32 Size, const FInternetAddr* FromAddr, uint16 RelayChannel);
 
 	/**
-	 * Select the candidate with the highest priority from an array
-	 * @param Candidates - Array of candidates to search
-	 * @return The candidate with the highest priority, or default if array is empty
+	 * Send a raw handshake packet on the path used by a candidate pair
+	 * @param Pair - Pair whose path is used
+	 * @param PacketType - HELLO request or response, with the authenticated flag
+	 * @param Token - Correlation token
+	 * @return True if the packet was sent
 	 */
-	FICECandidate SelectHighestPriorityCandidate(const TArray<FICECandidate>& Candidates) const;
+	bool SendHandshakePacket(const FICECandidatePair& Pair, uint8 PacketType, uint32 Token);
 
 	/**
-	 * Handle Tick logic for direct connection state
-	 * @param DeltaTime - Time elapsed since last tick
+	 * Send a raw handshake packet directly to an address on the check socket
+	 * @param RemoteAddr - Destination
+	 * @param PacketType - HELLO request or response, with the authenticated flag
+	 * @param Token - Correlation token
+	 * @return True if the packet was sent
 	 */
-	void TickConnectingDirect(float DeltaTime);
+	bool SendHandshakePacket(const FInternetAddr& RemoteAddr, uint8 PacketType, uint32 Token);
 
 	/**
-	 * Handle Tick logic for relay connection state
-	 * @param DeltaTime - Time elapsed since last tick
+	 * Find the direct pair whose remote address matches a sender
+	 * @param FromAddr - Sender address
+	 * @return Index in CheckList, or INDEX_NONE
 	 */
-	void TickConnectingRelay(float DeltaTime);
+	int32 FindDirectPairForAddress(const FInternetAddr& FromAddr) const;
 
 	/**
-	 * Handle Tick logic for handshake state
-	 * @param DeltaTime - Time elapsed since last tick
+	 * Queue a triggered check for a pair (RFC 8445 Section 7.3.1.4)
+	 * @param PairIndex - Index in CheckList
 	 */
-	void TickPerformingHandshake(float DeltaTime);
+	void TriggerCheck(int32 PairIndex);
 
 	/**
 	 * Validate socket subsystem is available
@@ -354,95 +1745,350 @@ private:
 	bool VerifyHandshakeMagicNumber(const uint8* Buffer) const;
 
 	/**
-	 * Parse server address into host and port
+	 * Resolve a configured server address through the shared DNS cache, without blocking
 	 * @param ServerAddress - Server address string (host:port or just host)
-	 * @param OutHost - Parsed host name
-	 * @param OutPort - Parsed port (or default if not specified)
-	 * @param DefaultPort - Default port to use if not in address
+	 * @param OutAddr - Receives the address with its port when Resolved (IPv6 only on a dual-stack socket)
+	 * @return Resolved, Pending while the hostname is looked up for the first time, or Failed
 	 */
-	void ParseServerAddress(const FString& ServerAddress, FString& OutHost, int32& OutPort, int32 DefaultPort = 3478) const;
+	EICEResolveStatus ResolveServerAddress(const FString& ServerAddress, TSharedPtr<FInternetAddr>& OutAddr) const;
 
-	/**
-	 * Build a STUN binding request message
-	 * @param OutBuffer - Buffer to fill with STUN request (must be at least 20 bytes)
-	 */
-	void BuildSTUNBindingRequest(uint8* OutBuffer) const;
+	/** Whether a STUN/TURN server hostname is still being looked up for the first time */
+	bool IsServerResolutionPending() const;
 
 	/**
-	 * Parse STUN response to extract XOR-MAPPED-ADDRESS
-	 * @param Response - Response buffer
-	 * @param ResponseSize - Size of response
+	 * Extract XOR-MAPPED-ADDRESS from a STUN Binding response
+	 * @param Response - Parsed response
 	 * @param OutPublicIP - Extracted public IP
 	 * @param OutPublicPort - Extracted public port
 	 * @return True if successfully parsed
 	 */
-	bool ParseSTUNResponse(const uint8* Response, int32 ResponseSize, FString& OutPublicIP, int32& OutPublicPort) const;
+	bool ParseSTUNResponse(const FSTUNMessageView& Response, FString& OutPublicIP, int32& OutPublicPort) const;
+
+	/**
+	 * Pick a new random local username fragment and password, drawn from OpenSSL's CSPRNG
+	 * The ufrag goes on the wire in clear, so a predictable generator would give the password (the HELLO key) away
+	 * @return False if no secure random bytes were available, the credentials are left empty
+	 */
+	bool GenerateLocalCredentials();
 
-	/** Gather host candidates (local network interfaces) */
+	/** Gather host candidates: one per local interface address, IPv6 ones on a dual-stack socket */
 	void GatherHostCandidates();
 
+	/** Send the STUN requests and TURN probes/allocations of every configured server */
+	void GatherServerCandidates();
+
 	/** Gather server reflexive candidates (via STUN) */
 	void GatherServerReflexiveCandidates();
 
 	/** Gather relayed candidates (via TURN) */
 	void GatherRelayedCandidates();
 
-	/** Perform STUN binding request */
-	bool PerformSTUNRequest(const FString& ServerAddress, FString& OutPublicIP, int32& OutPublicPort);
+	/**
+	 * Add a gathered local candidate and notify listeners
+	 * @param Candidate - The candidate to add
+	 */
+	void AddLocalCandidate(const FICECandidate& Candidate);
 
-	/** Perform TURN allocation request */
-	bool PerformTURNAllocation(const FString& ServerAddress, const FString& Username, const FString& Credential, FString& OutRelayIP, int32& OutRelayPort);
+	/** Forget every local candidate of a type */
+	void RemoveLocalCandidatesOfType(EICECandidateType Type);
 
-	/** Perform TURN allocation request with optional authentication */
-	bool PerformTURNAllocationRequest(const TSharedPtr<FInternetAddr>& TURNAddr, 
-		const FString& Username, const FString& Credential, const FString& Realm, const FString& Nonce,
-		FString& OutRelayIP, int32& OutRelayPort, bool bIsRetry = false);
+	/** Forget every local candidate */
+	void ResetLocalCandidates();
 
-	/** Perform TURN CreatePermission request */
-	bool PerformTURNCreatePermission(const FString& PeerAddress, int32 PeerPort);
+	/**
+	 * Send a non-blocking STUN binding request used to discover the server reflexive address
+	 * @param ServerAddress - STUN server address (host:port)
+	 * @return True if the request was sent
+	 */
+	bool StartSTUNRequest(const FString& ServerAddress);
 
-	/** Perform TURN ChannelBind request */
-	bool PerformTURNChannelBind(const FString& PeerAddress, int32 PeerPort, uint16 ChannelNumber);
+	/**
+	 * Start a non-blocking TURN allocation on the first usable server from OrderIndex onwards
+	 * @param OrderIndex - Position in TURNServerOrder to start from
+	 * @return True if an Allocate request was sent
+	 */
+	bool StartTURNAllocation(int32 OrderIndex);
 
-	/** Perform TURN Refresh request to keep allocation alive */
-	bool PerformTURNRefresh();
+	/**
+	 * Send a Binding request to every TURN server at once; the first to answer gets the allocation
+	 * @return True if at least one probe was sent
+	 */
+	bool StartTURNProbes();
 
-	/** Send data through TURN relay using Send indication or ChannelData */
-	bool SendDataThroughTURN(const uint8* Data, int32 Size, const FString& PeerAddress, int32 PeerPort);
+	/**
+	 * Order the TURN servers by cached RTT, fastest first
+	 * @return False if a server has no measurement younger than ServerSelectionTTL (the servers must be probed)
+	 */
+	bool GetCachedTURNServerOrder();
 
-	/** Receive data from TURN relay (unwrap ChannelData or Data indication) */
-	bool ReceiveDataFromTURN(uint8* Data, int32 MaxSize, int32& OutSize);
+	/**
+	 * Allocate on the chosen server, failing over to the others in order
+	 * @param FastestServerIndex - Index in Config.TURNServers tried first (INDEX_NONE keeps the configured order)
+	 */
+	void SelectTURNServer(int32 FastestServerIndex);
 
-	/** Calculate candidate priority */
-	int32 CalculatePriority(EICECandidateType Type, int32 LocalPreference, int32 ComponentId);
+	/**
+	 * Remember the outcome of a request to a server
+	 * @param ServerAddress - Configured server address (host:port)
+	 * @param RTT - Round-trip time (ms), ignored when the server didn't answer
+	 * @param bReachable - Whether the server answered
+	 */
+	static void RecordServerRTT(const FString& ServerAddress, float RTT, bool bReachable);
 
-	/** Helper function to calculate MD5 hash for TURN authentication */
-	void CalculateMD5(const FString& Input, uint8* OutHash);
+	/**
+	 * Route a response to the handler of its gathering request
+	 * @param Request - Request the response answers
+	 * @param Response - Parsed response
+	 */
+	void DispatchGatherResponse(FICEGatherRequest& Request, const FSTUNMessageView& Response);
+
+	/**
+	 * Build and send a TURN Allocate request, authenticated when credentials are provided
+	 * @param Request - Gathering request to update with the new transaction
+	 * @param Credentials - Realm, nonce and key for the server (null for the unauthenticated first request)
+	 * @return True if the request was sent
+	 */
+	bool SendTURNAllocateRequest(FICEGatherRequest& Request, const FICETURNCredentials* Credentials);
+
+	/** Key of a TURN server in TURNCredentialCache */
+	FString GetTURNCredentialCacheKey(const FString& ServerAddress) const;
+
+	/**
+	 * Remember the realm/nonce of a server challenge, deriving the long-term key only when the realm changes
+	 * @return The cached credentials
+	 */
+	const FICETURNCredentials& CacheTURNCredentials(const FString& ServerAddress, const FString& Realm, const FString& Nonce);
+
+	/** Emit the relayed candidate of the live TURN allocation */
+	void AddRelayedCandidate();
+
+	/**
+	 * Handle a TURN Allocate response matching the request transaction
+	 * @param Request - The gathering request being answered
+	 * @param Response - Parsed response
+	 */
+	void HandleTURNAllocateResponse(FICEGatherRequest& Request, const FSTUNMessageView& Response);
+
+	/**
+	 * Handle a STUN Binding response matching the request transaction
+	 * @param Request - The gathering request being answered
+	 * @param Response - Parsed response
+	 */
+	void HandleSTUNBindingResponse(FICEGatherRequest& Request, const FSTUNMessageView& Response);
+
+	/**
+	 * Poll pending gathering requests, handle timeouts, TURN failover and the gathering deadline
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void TickGathering(float DeltaTime);
+
+	/**
+	 * Find the pending gathering request answered by a response
+	 * @param Response - Parsed STUN response
+	 * @return Index in GatherRequests, INDEX_NONE if no request owns the transaction
+	 */
+	int32 FindGatherRequest(const FSTUNMessageView& Response) const;
+
+	/**
+	 * Dispatch a STUN Binding or TURN Allocate response to its gathering request
+	 * @param Buffer - Datagram
+	 * @param Size - Datagram size
+	 * @return True if the datagram answered a pending gathering request
+	 */
+	bool HandleGatherResponse(const uint8* Buffer, int32 Size);
+
+	/**
+	 * Release the sockets owned by a gathering request
+	 * @param Request - The request to release
+	 */
+	void ReleaseGatherRequest(FICEGatherRequest& Request);
+
+	/** Abandon every pending gathering request */
+	void CancelGatherRequests();
+
+	/** Mark gathering as finished and notify listeners */
+	void CompleteGathering();
+
+	/** Start a TURN Refresh request to keep the allocation alive */
+	bool StartTURNRefresh();
+
+	/** Start a TURN CreatePermission request for the remote candidate of a relayed pair */
+	bool StartTURNCreatePermission(const FICECandidatePair& Pair);
+
+	/** Start a TURN ChannelBind request binding the relayed pair's channel to its remote candidate */
+	bool StartTURNChannelBind(const FICECandidatePair& Pair);
+
+	/**
+	 * Encode a transaction with a fresh transaction ID and the current long-term credentials, then send it
+	 * @param Transaction - Transaction to (re)encode
+	 * @return True if the request was sent
+	 */
+	bool SendTURNTransaction(FICETURNTransaction& Transaction);
+
+	/** Check whether a TURN request of the given kind (and channel, for ChannelBind) is outstanding */
+	bool HasPendingTURNTransaction(EICETURNTransactionType Type, uint16 ChannelNumber = 0) const;
+
+	/** Retransmit outstanding TURN requests and expire the ones that ran out of transmissions */
+	void TickTURNTransactions(float DeltaTime);
+
+	/**
+	 * Match a datagram from the TURN server against the outstanding transactions
+	 * @param Buffer - Datagram received on the TURN socket
+	 * @param Size - Datagram size
+	 * @return True if the datagram was a STUN response (consumed, even if it matched nothing)
+	 */
+	bool HandleTURNResponse(const uint8* Buffer, int32 Size);
+
+	/**
+	 * Apply the outcome of a finished TURN transaction
+	 * @param Transaction - The finished transaction
+	 * @param bSucceeded - Whether a success response arrived
+	 * @param Response - Success or error response (null on timeout)
+	 */
+	void CompleteTURNTransaction(const FICETURNTransaction& Transaction, bool bSucceeded, const FSTUNMessageView* Response);
+
+	/** Drain a dedicated TURN socket: answer relayed checks and dispatch TURN responses (no-op when multiplexed) */
+	bool ProcessTURNSocket();
+
+	/** Send data to the selected remote candidate through the TURN relay (ChannelData once bound, Send indication otherwise) */
+	bool SendDataThroughTURN(const uint8* Data, int32 Size);
+
+	/** Send a datagram on the selected path, behind an FEC header once FEC is active (SendData without encryption) */
+	bool SendDatagram(const uint8* Data, int32 Size);
+
+	/** Send a datagram whose payload starts SEND_HEADROOM bytes into Buffer (SendDataInPlace without encryption) */
+	bool SendDatagramInPlace(uint8* Buffer, int32 PayloadSize);
+
+	/** Send a datagram as is on the selected path */
+	bool TransmitDatagram(const uint8* Data, int32 Size);
+
+	/**
+	 * Count a game datagram sent on the selected path
+	 * @param bSent - Result of the send
+	 * @param Size - Datagram size
+	 * @param bRelayed - Whether it went through the TURN relay
+	 * @return bSent
+	 */
+	bool CountSentDatagram(bool bSent, int32 Size, bool bRelayed);
+
+	/** Count a game datagram received on the selected path */
+	void CountReceivedDatagram(int32 Size, bool bRelayed);
+
+	/** Send a datagram whose payload starts SEND_HEADROOM bytes into Buffer as is */
+	bool TransmitDatagramInPlace(uint8* Buffer, int32 PayloadSize);
+
+	/**
+	 * Send a datagram behind its FEC header, then the parity of its group if it completed one
+	 * @param Data - Datagram
+	 * @param Size - Size of the datagram
+	 * @return True if the datagram was sent
+	 */
+	bool SendFECDatagram(const uint8* Data, int32 Size);
+
+	/**
+	 * Seal buffers into one encrypted record and send it
+	 * @param Buffers - Plaintext sent back to back
+	 * @return False if the channel isn't established yet or the send failed
+	 */
+	bool SealAndSend(TArrayView<const TArrayView<const uint8>> Buffers);
+
+	/**
+	 * Append a message to the pending bundle, flushing the bundle first if the message doesn't fit
+	 * @param Buffers - Message sent back to back
+	 * @return False if the message can't be sent on this connection
+	 */
+	bool CoalesceSend(TArrayView<const TArrayView<const uint8>> Buffers);
+
+	/**
+	 * Send a datagram past the pacer: coalesced, sealed or as is
+	 * @param Buffers - Datagram payload, sent back to back
+	 * @return True if send was successful
+	 */
+	bool SendMessage(TArrayView<const TArrayView<const uint8>> Buffers);
+
+	/**
+	 * Admit a datagram through the pacer
+	 * @param Buffers - Datagram payload
+	 * @param Priority - Pacing class
+	 * @param OutResult - Result of the send call when the datagram isn't sent now (queued, dropped or not connected)
+	 * @return True if the caller sends the datagram now
+	 */
+	bool PaceSend(TArrayView<const TArrayView<const uint8>> Buffers, EICESendPriority Priority, bool& OutResult);
+
+	/** Send the paced datagrams whose tokens came in */
+	void DrainPacedSends();
+
+	/**
+	 * Send data to a peer in a TURN Send indication (RFC 5766 Section 10)
+	 * Needs a permission for the peer but no channel
+	 * @param PeerAddr - Peer address as seen by the TURN server
+	 * @param Data - Payload
+	 * @param Size - Payload size in bytes
+	 * @return True if the whole indication was sent
+	 */
+	bool SendTURNSendIndication(const FInternetAddr& PeerAddr, const uint8* Data, int32 Size);
+
+	/**
+	 * Largest relayed payload that fits the path MTU
+	 * @param bChannelData - ChannelData framing (4 bytes) instead of a Send indication
+	 * @return Maximum payload size in bytes
+	 */
+	int32 GetMaxRelayPayloadSize(bool bChannelData) const;
+
+	/** Keep the selected relayed pair's permission and channel alive, retrying ChannelBind while Send indications are used */
+	void TickRelayBindings(float DeltaTime);
+
+	/**
+	 * Find the relayed pair whose remote candidate matches a peer address from a Data indication
+	 * @return Index in CheckList, or INDEX_NONE
+	 */
+	int32 FindRelayedPairForPeer(uint32 PeerIP, uint16 PeerPort) const;
 
-	/** Helper function to calculate HMAC-SHA1 for MESSAGE-INTEGRITY */
-	void CalculateHMACSHA1(const uint8* Data, int32 DataLen, const uint8* Key, int32 KeyLen, uint8* OutHash);
+	/** Wrap data in a ChannelData message and send it to the TURN server */
+	bool SendTURNChannelData(uint16 ChannelNumber, const uint8* Data, int32 Size);
+
+	/**
+	 * Send a ChannelData message whose payload already sits SEND_HEADROOM bytes into Buffer
+	 * @param ChannelNumber - Bound channel
+	 * @param Buffer - Reserved header followed by the payload; the header is written in place
+	 * @param Size - Payload size in bytes
+	 * @return True if the whole message was sent
+	 */
+	bool SendTURNChannelDataInPlace(uint16 ChannelNumber, uint8* Buffer, int32 Size);
 
 	/**
-	 * Helper function to append USERNAME attribute to TURN request buffer
-	 * @param Buffer - Buffer to write to
-	 * @param Offset - Current offset in buffer, will be updated
-	 * @param Username - Username to add
+	 * Make sure a scratch buffer can hold Size bytes without reallocating on the next send
+	 * @param Buffer - Scratch buffer to resize
+	 * @param Size - Required size in bytes
+	 * @return Pointer to the buffer data
 	 */
-	void AppendTURNUsernameAttribute(TArray<uint8>& Buffer, int32& Offset, const FString& Username);
+	uint8* ReserveSendScratch(TArray<uint8>& Buffer, int32 Size);
+
+	/** Receive data from TURN relay (unwrap ChannelData or Data indication), optionally reporting the channel */
+	bool ReceiveDataFromTURN(uint8* Data, int32 MaxSize, int32& OutSize, uint16* OutChannelNumber = nullptr);
 
 	/**
-	 * Helper function to filter candidates by type
-	 * @param Candidates - Source array of candidates
-	 * @param Type - Type of candidate to filter for
-	 * @return Filtered array of candidates matching the type
+	 * Locate the payload of a datagram received from the TURN server, without copying
+	 * @param Buffer - Datagram received on the TURN socket
+	 * @param BytesRead - Datagram size
+	 * @param OutOffset - Payload start within Buffer
+	 * @param OutSize - Payload size
+	 * @param OutChannelNumber - Channel of a ChannelData message, or for a Data indication the channel assigned
+	 *                           to the relayed pair of the sending peer (optional, unchanged if no pair matches)
+	 * @return True if the datagram is ChannelData or a Data indication
 	 */
-	TArray<FICECandidate> FilterCandidatesByType(const TArray<FICECandidate>& Candidates, EICECandidateType Type) const;
+	bool UnwrapTURNPacket(const uint8* Buffer, int32 BytesRead, int32& OutOffset, int32& OutSize, uint16* OutChannelNumber) const;
+
+	/** Calculate candidate priority */
+	int32 CalculatePriority(EICECandidateType Type, int32 LocalPreference, int32 ComponentId);
+
+	/** Helper function to calculate MD5 hash for TURN authentication */
+	void CalculateMD5(const FString& Input, uint8* OutHash);
 
 	/**
-	 * Helper function to filter candidates by multiple types (more efficient for multiple types)
-	 * @param Candidates - Source array of candidates
-	 * @param Types - Array of types to filter for
-	 * @return Filtered array of candidates matching any of the types
+	 * Append USERNAME, REALM, NONCE and MESSAGE-INTEGRITY (if credentials are cached)
+	 * @param Message - STUN message with header and request attributes already written
+	 * @return False if the message overflowed its buffer
 	 */
-	TArray<FICECandidate> FilterCandidatesByTypes(const TArray<FICECandidate>& Candidates, const TArray<EICECandidateType>& Types) const;
+	bool FinalizeTURNRequest(FSTUNMessage& Message);
 };
@@ -0,0 +1,201 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ICEAgent.h"
+#include "IPAddress.h"
+
+class FSocket;
+class FICEPacketRing;
+class FICEReceiveThread;
+
+/**
+ * Set of ICE agents sharing one UDP socket, one agent per remote peer
+ * Lets a host run ICE with several peers at once: every agent keeps its own candidates, checklist and
+ * state machine, while the pool owns the only bound port and routes each received datagram to the agent
+ * of its sender. Idle agents are not ticked, so Tick costs O(active agents).
+ */
+class FICEAgentPool : public TSharedFromThis<FICEAgentPool>
+{
+public:
+	/**
+	 * @param InConfig - Configuration given to every agent of the pool
+	 */
+	FICEAgentPool(const FICEAgentConfig& InConfig);
+	~FICEAgentPool();
+
+	/**
+	 * Create the agent for a remote peer, or return the existing one
+	 * @param PeerId - Application-defined peer identifier (empty for the default agent)
+	 * @return The peer's agent
+	 */
+	TSharedRef<FICEAgent> CreateAgent(const FString& PeerId);
+
+	/**
+	 * Find the agent of a remote peer
+	 * @param PeerId - Peer identifier
+	 * @return The agent, or null if none was created for this peer
+	 */
+	TSharedPtr<FICEAgent> FindAgent(const FString& PeerId) const;
+
+	/**
+	 * Close and forget the agent of a remote peer
+	 * @param PeerId - Peer identifier
+	 * @return True if an agent was removed
+	 */
+	bool RemoveAgent(const FString& PeerId);
+
+	/** Every agent of the pool, keyed by peer identifier */
+	const TMap<FString, TSharedPtr<FICEAgent>>& GetAgents() const { return Agents; }
+
+	/** Number of agents currently ticked */
+	int32 GetNumActiveAgents() const { return ActiveAgents.Num(); }
+
+	/** Number of agents with an established connection */
+	int32 GetNumConnectedAgents() const;
+
+	/**
+	 * Route pending datagrams of the shared socket, then tick every active agent
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void Tick(float DeltaTime);
+
+	/**
+	 * Receive one game datagram from any connected agent (agents are served round-robin)
+	 * Handshake packets are answered internally and never returned
+	 * @param Data - Buffer to receive data into
+	 * @param MaxSize - Maximum size of the buffer
+	 * @param OutSize - Number of bytes actually received
+	 * @param OutFromAddr - Receives the peer address (FICEAgent::GetPeerAddress) of the agent the datagram came through
+	 * @return True if a datagram was received
+	 */
+	bool ReceiveData(uint8* Data, int32 MaxSize, int32& OutSize, FInternetAddr& OutFromAddr);
+
+	/**
+	 * Send a datagram to the connected agent whose peer address is Destination
+	 * @param Destination - Peer address of the target agent
+	 * @param Data - The data to send
+	 * @param Size - Size of the data in bytes
+	 * @param Priority - Pacing class of the datagram (FICEAgentConfig::bPaceSends)
+	 * @return True if an agent sent the datagram
+	 */
+	bool SendDataTo(const FInternetAddr& Destination, const uint8* Data, int32 Size, EICESendPriority Priority = EICESendPriority::Normal);
+
+	/** Send the coalesced messages of every connected agent now (see FICEAgent::FlushSends) */
+	void FlushSends();
+
+	/**
+	 * Check whether a connected agent has a datagram waiting
+	 * @param PendingDataSize - Size of the pending data, 0 when unknown
+	 * @return True if there is data to read
+	 */
+	bool HasPendingData(uint32& PendingDataSize);
+
+	/**
+	 * Find the connected agent whose peer address is Addr
+	 * @param Addr - Remote address
+	 * @return The agent, or null
+	 */
+	TSharedPtr<FICEAgent> FindConnectedAgent(const FInternetAddr& Addr) const;
+
+	/** Port of the shared socket, 0 if it couldn't be bound */
+	int32 GetLocalPort() const;
+
+	/** Address of the shared socket */
+	void GetLocalAddress(FInternetAddr& OutAddr) const;
+
+	/** Datagrams dropped because they matched no agent */
+	uint32 GetUnroutedCount() const { return UnroutedCount; }
+
+private:
+	/** Binding requests answered for one source address in the current window */
+	struct FBindingAnswerBudget
+	{
+		double WindowStart = 0.0;
+		int32 NumAnswers = 0;
+	};
+
+	/**
+	 * Bind the shared socket (and its receive thread if enabled)
+	 * @return True if the socket is ready
+	 */
+	bool CreateSharedSocket();
+
+	/** Release the shared socket and its receive thread */
+	void DestroySharedSocket();
+
+	/** Read every pending datagram of the shared socket and deliver it to its agent */
+	void DispatchSharedSocket();
+
+	/**
+	 * Deliver a datagram to the agent of its sender
+	 * Known senders are looked up in Routes; unknown ones are matched against the active agents and remembered
+	 * @param Data - Datagram
+	 * @param Size - Datagram size
+	 * @param FromAddr - Sender address
+	 */
+	void RouteDatagram(const uint8* Data, int32 Size, const TSharedRef<FInternetAddr>& FromAddr);
+
+	/**
+	 * Answer a Binding request no agent owns like a STUN server, so searching peers can measure their RTT to us
+	 * Searchers hold no credentials yet, so only unauthenticated requests (no USERNAME) are answered, each source
+	 * address up to MAX_BINDING_ANSWERS_PER_SOURCE per BINDING_ANSWER_WINDOW
+	 * @return True if the request was answered
+	 */
+	bool AnswerBindingRequest(const uint8* Data, int32 Size, const FInternetAddr& FromAddr);
+
+	/** Forget every route leading to an agent */
+	void RemoveRoutes(const FICEAgent* Agent);
+
+	/** Tick an agent again (it left the idle set) */
+	void MarkActive(const TSharedPtr<FICEAgent>& Agent);
+
+	/** Agent state listener: wakes the agent up and drops routes learnt for its previous peer */
+	void OnAgentStateChanged(EICEConnectionState NewState, TWeakPtr<FICEAgent> WeakAgent);
+
+	/** Configuration given to every agent */
+	FICEAgentConfig Config;
+
+	/** Agents by peer identifier */
+	TMap<FString, TSharedPtr<FICEAgent>> Agents;
+
+	/** Agents ticked by the pool (gathering, checking, connected or holding a TURN allocation) */
+	TArray<TSharedPtr<FICEAgent>> ActiveAgents;
+
+	/** Agent of each known sender address */
+	TMap<TSharedRef<const FInternetAddr>, TWeakPtr<FICEAgent>, FDefaultSetAllocator, FInternetAddrConstKeyMapFuncs<TWeakPtr<FICEAgent>>> Routes;
+
+	/** Socket shared by every agent */
+	FSocket* Socket;
+
+	/** Datagrams received by the receive thread, routed on the game thread */
+	TUniquePtr<FICEPacketRing> ReceiveRing;
+
+	/** Optional receive thread draining Socket (see FICEAgentConfig::bUseIOThread) */
+	TUniquePtr<FICEReceiveThread> ReceiveThread;
+
+	/** Sender address of polled datagrams (reused across receives) */
+	TSharedPtr<FInternetAddr> ReceiveFromAddr;
+
+	/** Next connected agent served by ReceiveData */
+	int32 NextReceiveAgent;
+
+	/** Datagrams dropped because they matched no agent */
+	uint32 UnroutedCount;
+
+	/** Binding requests answered per source address (IP without port), expired windows are pruned by Tick */
+	TMap<FString, FBindingAnswerBudget> BindingAnswerBudgets;
+
+	/** Datagrams routed per Tick before the rest is left for the next frame */
+	static constexpr int32 MAX_DISPATCH_PER_TICK = 256;
+
+	/** Binding requests answered per source address and window, the rest is dropped (bounds reflection towards a spoofed victim) */
+	static constexpr int32 MAX_BINDING_ANSWERS_PER_SOURCE = 8;
+
+	/** Length of a source address's answer window (seconds) */
+	static constexpr double BINDING_ANSWER_WINDOW = 1.0;
+
+	/** Source addresses tracked at once, requests from new ones are dropped until windows expire */
+	static constexpr int32 MAX_BINDING_ANSWER_SOURCES = 1024;
+};
@@ -0,0 +1,201 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ICEAgent.h"
+#include "ICENetworkSimulator.h"
+
+/**
+ * Pair of NATs a benchmark scenario connects across
+ */
+struct FICEBenchmarkScenario
+{
+	/** NAT of the controlling agent */
+	EICENATType ControllingNAT;
+
+	/** NAT of the controlled agent */
+	EICENATType ControlledNAT;
+
+	FICEBenchmarkScenario()
+		: ControllingNAT(EICENATType::FullCone)
+		, ControlledNAT(EICENATType::FullCone)
+	{}
+
+	FICEBenchmarkScenario(EICENATType InControllingNAT, EICENATType InControlledNAT)
+		: ControllingNAT(InControllingNAT)
+		, ControlledNAT(InControlledNAT)
+	{}
+
+	/** "Controlling-Controlled" NAT names */
+	FString GetName() const;
+};
+
+/**
+ * Parameters of a benchmark run (ICE.BENCH)
+ */
+struct FICEBenchmarkSettings
+{
+	/** Scenarios run in order, every NAT pairing below when empty */
+	TArray<FICEBenchmarkScenario> Scenarios;
+
+	/** Connections set up per scenario, connect time percentiles are taken over them */
+	int32 Trials;
+
+	/** Impairments of the simulated network */
+	FICENetworkConditions Conditions;
+
+	/** Seed of the first trial's loss and jitter draws, the next trials count up from it */
+	int32 Seed;
+
+	/** Time a trial may take to connect before it counts as failed (seconds) */
+	float ConnectTimeout;
+
+	/** Length of the transfer measured on the first connection of each scenario (seconds, 0 skips it) */
+	float TransferDuration;
+
+	/** Rate the controlling agent offers during the transfer (bytes per second) */
+	float TransferRate;
+
+	/** Payload of each transfer datagram, capped by FICEAgent::GetMaxPayloadSize (bytes) */
+	int32 PayloadSize;
+
+	/** Agent settings; servers and TURN credentials are set to the simulator's */
+	FICEAgentConfig AgentConfig;
+
+	FICEBenchmarkSettings()
+		: Trials(5)
+		, Seed(1)
+		, ConnectTimeout(15.0f)
+		, TransferDuration(2.0f)
+		, TransferRate(2000000.0f)
+		, PayloadSize(1000)
+	{}
+
+	/** Every pairing of the simulated NAT types, from direct paths to relay-only ones */
+	static TArray<FICEBenchmarkScenario> GetDefaultScenarios();
+};
+
+/**
+ * Measurements of one scenario
+ */
+struct FICEBenchmarkResult
+{
+	FICEBenchmarkScenario Scenario;
+
+	/** Trials run, and those that connected through a direct or a relayed pair */
+	int32 Trials = 0;
+	int32 DirectConnections = 0;
+	int32 RelayedConnections = 0;
+
+	/** Time from the start of gathering until both agents finished it, and until both were connected (ms) */
+	TArray<float> GatherTimes;
+	TArray<float> ConnectTimes;
+
+	/** Duration of every agent Tick while connecting, and during the transfer (microseconds) */
+	TArray<float> ConnectTickTimes;
+	TArray<float> TransferTickTimes;
+
+	/** Whether the transfer ran, and over a relayed pair */
+	bool bTransferred = false;
+	bool bTransferRelayed = false;
+
+	/** Transfer datagrams offered, accepted by SendData and received by the peer, with their bytes */
+	uint64 OfferedPackets = 0;
+	uint64 SentPackets = 0;
+	uint64 ReceivedPackets = 0;
+	uint64 ReceivedBytes = 0;
+
+	/** Measured transfer time (seconds) */
+	double TransferTime = 0.0;
+
+	/** Send scratch buffer growths of both agents during the transfer (FICEAgent::GetSendAllocationCount) */
+	uint32 SendAllocations = 0;
+
+	/** Simulated network counters, summed over the trials */
+	uint32 LostDatagrams = 0;
+	uint32 FilteredDatagrams = 0;
+	uint32 RelayedDatagrams = 0;
+
+	/** Received transfer bytes per second */
+	double GetGoodput() const { return TransferTime > 0.0 ? (double)ReceivedBytes / TransferTime : 0.0; }
+
+	/** Send scratch buffer growths per transfer datagram sent */
+	double GetAllocationsPerPacket() const { return SentPackets > 0 ? (double)SendAllocations / (double)SentPackets : 0.0; }
+
+	/**
+	 * Nearest-rank percentile of the connect times
+	 * @param Percentile - [0, 100]
+	 * @return Connect time (ms), 0 if no trial connected
+	 */
+	float GetConnectTimePercentile(float Percentile) const;
+};
+
+/**
+ * Connects pairs of agents across simulated NATs and measures them
+ * Each trial starts an FICENetworkSimulator, puts a controlling and a controlled agent behind the scenario's NATs
+ * and signals their credentials and server reflexive/relayed candidates directly (host candidates would reach each
+ * other without crossing the NATs). The same thread ticks the simulator and both agents until they connect, timing
+ * every agent Tick. The first connection of each scenario then carries a one-way transfer at TransferRate to measure
+ * goodput and the send path's allocations.
+ *
+ * Run blocks the calling thread for the whole benchmark; results are reported as JSON for tracking across builds.
+ */
+class FICEBenchmark
+{
+public:
+	explicit FICEBenchmark(const FICEBenchmarkSettings& InSettings);
+
+	/**
+	 * Run every scenario
+	 * @return False if the simulator could not start
+	 */
+	bool Run();
+
+	/** Measurements of each scenario after Run */
+	const TArray<FICEBenchmarkResult>& GetResults() const { return Results; }
+
+	/**
+	 * Serialize the settings and results
+	 * @param bPretty - Indented output instead of a single line
+	 */
+	FString ToJson(bool bPretty) const;
+
+	/**
+	 * Write ToJson(true) to a file
+	 * @param Path - File written, see MakeOutputPath
+	 * @return False if the file could not be written
+	 */
+	bool SaveJson(const FString& Path) const;
+
+	/**
+	 * Write a summary of every scenario
+	 * @param Ar - Output device
+	 */
+	void Dump(FOutputDevice& Ar) const;
+
+	/**
+	 * Timestamped results file in Saved/ICEBenchmark
+	 * @param Name - Prefix of the file name
+	 */
+	static FString MakeOutputPath(const FString& Name);
+
+private:
+	/**
+	 * Connect one pair of agents, and measure a transfer over it if asked
+	 * @return False if the simulator could not start
+	 */
+	bool RunTrial(int32 Trial, bool bMeasureTransfer, FICEBenchmarkResult& Result);
+
+	/** Tick the simulator and both agents once, timing the agents */
+	void Pump(FICENetworkSimulator& Simulator, FICEAgent& Controlling, FICEAgent& Controlled, TArray<float>& TickTimes);
+
+	/** Send at the transfer rate from the controlling agent and drain the controlled one */
+	void MeasureTransfer(FICENetworkSimulator& Simulator, FICEAgent& Controlling, FICEAgent& Controlled, FICEBenchmarkResult& Result);
+
+	FICEBenchmarkSettings Settings;
+	TArray<FICEBenchmarkResult> Results;
+
+	/** Time of the last Pump, for the agents' DeltaTime */
+	double LastPumpTime;
+};
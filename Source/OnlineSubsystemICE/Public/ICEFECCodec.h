@@ -0,0 +1,194 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Outcome of a datagram handed to FICEFECCodec::Receive
+ */
+enum class EICEFECResult : uint8
+{
+	/** Data packet, its payload starts HEADER_SIZE bytes in */
+	Data,
+	/** Parity packet or duplicate of a recovered packet, nothing to deliver (check PopRecovered) */
+	Consumed,
+	/** Not an FEC packet, or malformed */
+	Invalid
+};
+
+/**
+ * Forward error correction of an agent's datagrams (FICEAgentConfig::bEnableFEC)
+ * Datagrams are sent in groups; after the last one of a group goes a parity packet, the XOR of the group's payloads
+ * (zero-padded to the longest) and of their lengths, from which the receiver rebuilds any one missing datagram without
+ * a retransmission. The group size follows the loss estimate, the larger of the consent check loss and the loss seen
+ * on received groups: the redundancy is ~REDUNDANCY_SCALE / loss, and below MinLossRate groups carry no parity at all
+ * (their headers still let the peer measure loss).
+ *
+ * Data packet:   [0xFE] [Group (2 bytes)] [Index (1 byte)] [Count (1 byte)] [Flags (1 byte)] [Payload]
+ * Parity packet: [0xFF] [Group (2 bytes)] [Count (1 byte)] [Length XOR (2 bytes)] [Payload XOR]
+ * The first bytes lie outside STUN, ChannelData, the HELLO magic, records and bundles. A data packet with a Count
+ * of 0 is larger than MAX_PROTECTED_SIZE and not part of any group.
+ */
+class ONLINESUBSYSTEMICE_API FICEFECCodec
+{
+public:
+	/**
+	 * @param InMinLossRate - Loss estimate under which groups carry no parity
+	 * @param InMaxGroupSize - Largest group, sent when the loss estimate is low (MIN_GROUP_SIZE to MAX_GROUP_SIZE)
+	 */
+	FICEFECCodec(float InMinLossRate, int32 InMaxGroupSize);
+
+	/**
+	 * Write the header of a data packet and fold its payload into the parity of its group
+	 * @param Payload - Datagram sent after the header
+	 * @param Size - Size of the datagram
+	 * @param OutHeader - HEADER_SIZE bytes
+	 * @return True if the packet completed a group whose parity must be sent now (BuildParity)
+	 */
+	bool EncodePacket(const uint8* Payload, int32 Size, uint8* OutHeader);
+
+	/** Size of the parity packet of the group just completed */
+	int32 GetParityPacketSize() const { return HEADER_SIZE + SendParitySize; }
+
+	/**
+	 * Write the parity packet of the group just completed and start the next group
+	 * @param OutPacket - GetParityPacketSize bytes
+	 * @return Size of the parity packet
+	 */
+	int32 BuildParity(uint8* OutPacket);
+
+	/**
+	 * Account for a received datagram, rebuilding a missing one once its group allows it
+	 * @param Datagram - Received datagram, FEC header included
+	 * @param Size - Size of the datagram
+	 * @return What the caller delivers
+	 */
+	EICEFECResult Receive(const uint8* Datagram, int32 Size);
+
+	/** Whether a rebuilt datagram waits for PopRecovered */
+	bool HasRecovered() const { return bHasRecovered; }
+
+	/** Size of the rebuilt datagram, valid if HasRecovered */
+	int32 GetRecoveredSize() const { return RecoveredSize; }
+
+	/**
+	 * Take the datagram rebuilt from parity
+	 * @param OutData - Destination buffer
+	 * @param Capacity - Size of the destination buffer
+	 * @param OutSize - Size of the rebuilt datagram
+	 * @return False if nothing was rebuilt (or it didn't fit and was dropped)
+	 */
+	bool PopRecovered(uint8* OutData, int32 Capacity, int32& OutSize);
+
+	/**
+	 * Update the loss estimate with a consent check of the selected pair
+	 * @param bLost - Whether the check went unanswered
+	 */
+	void AddLossSample(bool bLost);
+
+	/** Forget the groups in flight and the loss estimate (new connection) */
+	void Reset();
+
+	/** Loss rate the group size is chosen from */
+	float GetLossEstimate() const { return FMath::Max(PathLossEstimate, ReceiveLossEstimate); }
+
+	/** Size of the group being sent, 0 if it carries no parity */
+	int32 GetGroupSize() const { return bSendParity ? SendGroupSize : 0; }
+
+	/** Parity packets sent */
+	uint32 GetParitySentCount() const { return ParitySentCount; }
+
+	/** Received datagrams rebuilt from parity */
+	uint32 GetRecoveredCount() const { return RecoveredCount; }
+
+	/** Datagrams of received groups that were lost and could not be rebuilt */
+	uint32 GetUnrecoveredCount() const { return UnrecoveredCount; }
+
+	/** Bytes of FEC header in front of every datagram */
+	static constexpr int32 HEADER_SIZE = 6;
+
+	/** First byte of data and parity packets */
+	static constexpr uint8 DATA_MARKER = 0xFE;
+	static constexpr uint8 PARITY_MARKER = 0xFF;
+
+	/** Largest datagram folded into parity (UDP payload of a 1500-byte Ethernet MTU) */
+	static constexpr int32 MAX_PROTECTED_SIZE = 1472;
+
+	/** Range of the group size; one parity packet per MIN_GROUP_SIZE datagrams is the most redundancy sent */
+	static constexpr int32 MIN_GROUP_SIZE = 2;
+	static constexpr int32 MAX_GROUP_SIZE = 32;
+
+	/** Group size ~ REDUNDANCY_SCALE / loss, so about one group in forty loses two datagrams or more */
+	static constexpr float REDUNDANCY_SCALE = 0.2f;
+
+private:
+	/** Received group being accounted for */
+	struct FReceiveGroup
+	{
+		/** XOR of the received payloads and parity, zero-padded to AccumulatedSize */
+		uint8 Accumulator[MAX_PROTECTED_SIZE];
+		int32 AccumulatedSize;
+		uint16 LengthXOR;
+		uint16 Group;
+		uint8 Count;
+		uint8 ReceivedCount;
+		uint32 ReceivedMask;
+		bool bActive;
+		bool bHasParity;
+		bool bParityReceived;
+		bool bRecovered;
+	};
+
+	/** Groups tracked at once, a datagram reordered further back is delivered but not accounted for */
+	static constexpr int32 RECEIVE_GROUPS = 4;
+
+	/** Weight of a new sample in the loss estimates */
+	static constexpr float PATH_LOSS_GAIN = 0.1f;
+	static constexpr float RECEIVE_LOSS_GAIN = 0.125f;
+
+	/** Pick the size of the next group from the loss estimate */
+	void StartSendGroup();
+
+	/**
+	 * Slot of a received group, finishing the one it replaces
+	 * @return Null if the group is older than the one in its slot
+	 */
+	FReceiveGroup* FindReceiveGroup(uint16 Group, uint8 Count, bool bHasParity);
+
+	/** Count a replaced group's losses into the receive loss estimate */
+	void FinishReceiveGroup(FReceiveGroup& Slot);
+
+	/** XOR a payload into an accumulator, zero-extending it first */
+	static void FoldPayload(uint8* Accumulator, int32& AccumulatedSize, const uint8* Payload, int32 Size);
+
+	/** Rebuild the missing datagram of a group if parity and all the others arrived */
+	void TryRecover(FReceiveGroup& Slot);
+
+	float MinLossRate;
+	int32 MaxGroupSize;
+
+	/** Group being sent */
+	uint8 SendAccumulator[MAX_PROTECTED_SIZE];
+	int32 SendParitySize;
+	uint16 SendLengthXOR;
+	uint16 SendGroup;
+	int32 SendGroupSize;
+	int32 SendIndex;
+	bool bSendParity;
+
+	FReceiveGroup ReceiveGroups[RECEIVE_GROUPS];
+
+	/** Datagram rebuilt from parity, delivered before the next received one */
+	uint8 Recovered[MAX_PROTECTED_SIZE];
+	int32 RecoveredSize;
+	bool bHasRecovered;
+
+	/** Loss measured by consent checks and on received groups */
+	float PathLossEstimate;
+	float ReceiveLossEstimate;
+
+	uint32 ParitySentCount;
+	uint32 RecoveredCount;
+	uint32 UnrecoveredCount;
+};
@@ -0,0 +1,58 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "IpNetDriver.h"
+#include "ICESendScheduler.h"
+#include "ICENetDriver.generated.h"
+
+class FICEAgentPool;
+
+/**
+ * Net driver that carries replication over the ICE connection
+ * Instead of opening its own UDP socket (and a fresh, unpunched NAT binding) it reuses the socket or TURN
+ * channels of the ICE agent pool: a client goes through its connected agent, a listen server through every
+ * session peer agent at once. Falls back to a regular IpNetDriver socket when ICE isn't in use.
+ *
+ * Enable it in DefaultEngine.ini:
+ * [/Script/Engine.Engine]
+ * !NetDriverDefinitions=ClearArray
+ * +NetDriverDefinitions=(DefName="GameNetDriver",DriverClassName="/Script/OnlineSubsystemICE.ICENetDriver",DriverClassNameFallback="/Script/OnlineSubsystemUtils.IpNetDriver")
+ */
+UCLASS(transient, config=Engine)
+class ONLINESUBSYSTEMICE_API UICENetDriver : public UIpNetDriver
+{
+	GENERATED_BODY()
+
+public:
+	// UIpNetDriver
+	virtual bool InitListen(FNetworkNotify* InNotify, FURL& LocalURL, bool bReuseAddressAndPort, FString& Error) override;
+	virtual FUniqueSocket CreateAndBindSocket(TSharedRef<FInternetAddr> BindAddr, int32 Port, bool bReuseAddressAndPort, int32 DesiredRecvSize, int32 DesiredSendSize, FString& Error) override;
+	virtual void TickFlush(float DeltaSeconds) override;
+
+	/**
+	 * Pace every datagram of the driver in one class (e.g. Bulk while streaming a level), see FSocketICE::SetSendPriority
+	 * @param Priority - Class of the datagrams sent from now on
+	 */
+	void SetSendPriority(EICESendPriority Priority);
+
+	/** Classify the driver's datagrams by size again (the default) */
+	void ClearSendPriority();
+
+private:
+	/**
+	 * Find the agent pool of the ICE online subsystem
+	 * @return Agent pool, or null if the subsystem isn't running
+	 */
+	TSharedPtr<FICEAgentPool> FindAgentPool() const;
+
+	/** Whether the driver is a listen server (set before the socket is created) */
+	bool bListening = false;
+
+	/** Agent pool the socket sends through, flushed after the connections (coalesced sends) */
+	TWeakPtr<FICEAgentPool> AgentPool;
+
+	/** Class set by SetSendPriority, applied to the socket whenever it is created */
+	TOptional<EICESendPriority> SendPriorityOverride;
+};
@@ -0,0 +1,246 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/RandomStream.h"
+
+class FSocket;
+class FInternetAddr;
+class FSTUNMessage;
+class FSTUNMessageView;
+
+/**
+ * NAT behaviours simulated by FICENetworkSimulator (RFC 4787 terms)
+ */
+enum class EICENATType : uint8
+{
+	/** Endpoint-independent mapping and filtering: anyone may send to the mapping once it exists */
+	FullCone,
+	/** Endpoint-independent mapping, address and port-dependent filtering: hole punching works */
+	PortRestricted,
+	/** A mapping per destination, filtered to that destination: only a relay gets through from another NAT */
+	Symmetric
+};
+
+/** Name of a NAT type, as parsed by ParseNATType */
+ONLINESUBSYSTEMICE_API const TCHAR* LexToString(EICENATType NATType);
+
+/**
+ * Parse a NAT type name (case-insensitive)
+ * @return False if the name is unknown
+ */
+ONLINESUBSYSTEMICE_API bool ParseNATType(const FString& Name, EICENATType& OutNATType);
+
+/**
+ * Impairments applied to every datagram crossing the simulated network
+ */
+struct FICENetworkConditions
+{
+	/** One-way delay of each hop: peer to peer, or client to relay and relay to peer (ms) */
+	float Latency;
+
+	/** Uniform variation of the delay, +/- (ms); datagrams may be reordered */
+	float Jitter;
+
+	/** Fraction of datagrams dropped on each hop [0, 1] */
+	float LossRate;
+
+	FICENetworkConditions()
+		: Latency(20.0f)
+		, Jitter(2.0f)
+		, LossRate(0.0f)
+	{}
+};
+
+/**
+ * In-process Internet for agents on loopback: NATs, impairments and a STUN/TURN server
+ * Every public endpoint (NAT mappings, the server, TURN relays) is a loopback socket owned by the simulator. A
+ * datagram an agent sends to one of them is first translated by the agent's NAT (AddHost), which picks or creates
+ * the mapping it leaves from; it then waits out the simulated delay (or is lost) before reaching its destination.
+ * Datagrams for a mapping are filtered as the NAT would and sent to the agent from the socket of their public
+ * source, so agents see the public addresses they would on the Internet.
+ *
+ * The server answers Binding requests with the mapping it sees, and implements enough of TURN (RFC 5766) for the
+ * agent: Allocate (no authentication), Refresh, CreatePermission, ChannelBind, Send/Data indications and
+ * ChannelData. Every endpoint is 127.0.0.1, so NAT filters compare ports while TURN permissions (per IP) admit any
+ * peer once one is installed.
+ */
+class ONLINESUBSYSTEMICE_API FICENetworkSimulator
+{
+public:
+	/**
+	 * @param InConditions - Impairments of every hop
+	 * @param Seed - Seed of the loss and jitter draws, a run is repeatable up to socket timing
+	 */
+	FICENetworkSimulator(const FICENetworkConditions& InConditions, int32 Seed);
+	~FICENetworkSimulator();
+
+	FICENetworkSimulator(const FICENetworkSimulator&) = delete;
+	FICENetworkSimulator& operator=(const FICENetworkSimulator&) = delete;
+
+	/**
+	 * Open the STUN/TURN server socket
+	 * @return False if the socket could not be created
+	 */
+	bool Start();
+
+	/** Server address for FICEAgentConfig::STUNServers and TURNServers ("127.0.0.1:port") */
+	FString GetServerAddress() const;
+
+	/**
+	 * Put an agent socket behind a NAT, datagrams from unknown ports are dropped
+	 * @param PrivatePort - Port of the agent socket (FICEAgent::GetLocalPort)
+	 * @param NATType - Behaviour of its NAT
+	 */
+	void AddHost(int32 PrivatePort, EICENATType NATType);
+
+	/** Read every public socket and deliver the datagrams whose delay has elapsed */
+	void Tick();
+
+	/** Datagrams delivered to an agent */
+	uint32 GetDeliveredCount() const { return DeliveredCount; }
+
+	/** Datagrams dropped by the simulated loss */
+	uint32 GetLostCount() const { return LostCount; }
+
+	/** Datagrams rejected by a NAT filter or a missing TURN permission */
+	uint32 GetFilteredCount() const { return FilteredCount; }
+
+	/** Datagrams forwarded through a TURN relay, both directions */
+	uint32 GetRelayedCount() const { return RelayedCount; }
+
+	/** Datagrams whose delay has not elapsed yet */
+	int32 GetInFlightCount() const { return InFlight.Num(); }
+
+private:
+	/** What a public port stands for */
+	enum class EEndpointKind : uint8
+	{
+		Server,
+		Mapping,
+		Relay
+	};
+
+	struct FEndpoint
+	{
+		FSocket* Socket = nullptr;
+		EEndpointKind Kind = EEndpointKind::Server;
+
+		/** Index in Mappings or Allocations */
+		int32 Index = INDEX_NONE;
+	};
+
+	/** Agent socket behind a NAT */
+	struct FHost
+	{
+		int32 PrivatePort = 0;
+		EICENATType NATType = EICENATType::FullCone;
+	};
+
+	/** Public port a host's datagrams leave from */
+	struct FMapping
+	{
+		int32 HostIndex = INDEX_NONE;
+		int32 PublicPort = 0;
+
+		/** Destination of a symmetric mapping, 0 for the endpoint-independent ones */
+		int32 RemotePort = 0;
+
+		/** Public ports that were sent to, and so may answer through a filtering NAT */
+		TSet<int32> Contacted;
+	};
+
+	/** TURN allocation of a client, keyed by the client's public port */
+	struct FAllocation
+	{
+		int32 ClientPort = 0;
+		int32 RelayPort = 0;
+
+		/** Cleared by a Refresh with a zero lifetime, the relay port stays reserved */
+		bool bActive = true;
+
+		/** Permitted peer IPs (host byte order) */
+		TSet<uint32> Permissions;
+
+		/** Channel to peer port, and back */
+		TMap<uint16, int32> Channels;
+		TMap<int32, uint16> PeerChannels;
+	};
+
+	/** Datagram waiting out its delay */
+	struct FInFlightDatagram
+	{
+		double DeliveryTime = 0.0;
+		int32 ToPort = 0;
+		int32 FromPort = 0;
+		TArray<uint8> Data;
+	};
+
+	/**
+	 * Open a public socket
+	 * @return Its port, 0 on failure
+	 */
+	int32 OpenEndpoint(EEndpointKind Kind, int32 Index);
+
+	/** Mapping of a host towards a destination, created on first use (0 on failure) */
+	int32 GetMappingPort(int32 HostIndex, int32 RemotePort);
+
+	/** A datagram an agent sent to a public port: through its NAT, then onto the network */
+	void HandlePrivateDatagram(int32 ToPort, int32 SourcePort, const uint8* Data, int32 Size);
+
+	/** Put a datagram on the network, where it is delayed or lost */
+	void Send(int32 ToPort, int32 FromPort, const uint8* Data, int32 Size);
+
+	/** A datagram reached a public port */
+	void Deliver(int32 ToPort, int32 FromPort, const uint8* Data, int32 Size);
+
+	/** STUN/TURN request, indication or ChannelData from a client */
+	void HandleServerDatagram(int32 FromPort, const uint8* Data, int32 Size);
+
+	/** Peer datagram reaching a relay, forwarded to its client */
+	void HandleRelayDatagram(FAllocation& Allocation, int32 FromPort, const uint8* Data, int32 Size);
+
+	/** Answer a TURN request that needs an allocation, 437 without one */
+	void HandleAllocationRequest(int32 FromPort, const FSTUNMessageView& Request);
+
+	/** Send a message from the server */
+	void SendServerMessage(int32 ToPort, const FSTUNMessage& Message);
+
+	/** Send an error response (RFC 5389 Section 15.6) */
+	void SendErrorResponse(int32 ToPort, const FSTUNMessageView& Request, int32 ErrorCode);
+
+	/** Point the scratch address at a loopback port */
+	FInternetAddr& GetLoopbackAddr(int32 Port);
+
+	FICENetworkConditions Conditions;
+	FRandomStream Random;
+
+	int32 ServerPort;
+
+	TMap<int32, FEndpoint> Endpoints;
+	TArray<FHost> Hosts;
+	TMap<int32, int32> HostsByPort;
+	TArray<FMapping> Mappings;
+	TArray<FAllocation> Allocations;
+	TMap<int32, int32> AllocationsByClient;
+
+	/** Heap ordered by delivery time */
+	TArray<FInFlightDatagram> InFlight;
+
+	/** Ports read by Tick, copied out since reads may open endpoints */
+	TArray<int32> ReadPorts;
+
+	TArray<uint8> ReceiveBuffer;
+
+	/** Data indication or ChannelData being built for a relay's client */
+	TArray<uint8> RelayBuffer;
+
+	TSharedPtr<FInternetAddr> ScratchAddr;
+	TSharedPtr<FInternetAddr> FromAddr;
+
+	uint32 DeliveredCount;
+	uint32 LostCount;
+	uint32 FilteredCount;
+	uint32 RelayedCount;
+};
@@ -0,0 +1,65 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ICEAgent.h"
+
+/**
+ * Everything a peer needs to start checks with an agent, packed into one signaling message
+ * Binary layout: "IO" magic, version, length-prefixed ufrag and password, candidate count, then every
+ * candidate in FICECandidate::ToBinary form (raw address bytes, ~14 bytes for an IPv4 host candidate).
+ * The base64 form is what travels through signaling, a full offer fits well within one small packet.
+ */
+struct FICEOffer
+{
+	/** Username fragment of the offering agent */
+	FString Ufrag;
+
+	/** Password of the offering agent */
+	FString Password;
+
+	/** Every local candidate of the offering agent */
+	TArray<FICECandidate> Candidates;
+
+	/**
+	 * Build the offer of an agent from its credentials and current local candidates
+	 * @param Agent - Offering agent
+	 * @return The offer
+	 */
+	static FICEOffer FromAgent(const FICEAgent& Agent);
+
+	/**
+	 * Pack the offer
+	 * Candidates without a numeric address are left out
+	 * @param Out - Receives the binary offer
+	 * @return False if the credentials don't fit the format
+	 */
+	bool ToBinary(TArray<uint8>& Out) const;
+
+	/**
+	 * Unpack an offer written by ToBinary
+	 * @param Data - Binary offer
+	 * @param Size - Size of the offer
+	 * @param OutOffer - Decoded offer
+	 * @return False if the offer is truncated, malformed or of another version
+	 */
+	static bool FromBinary(const uint8* Data, int32 Size, FICEOffer& OutOffer);
+
+	/** Pack the offer as base64 text (empty on failure) */
+	FString ToBase64() const;
+
+	/**
+	 * Unpack a base64 offer
+	 * @param Blob - Text written by ToBase64
+	 * @param OutOffer - Decoded offer
+	 * @return False if the text is not a valid offer
+	 */
+	static bool FromBase64(const FString& Blob, FICEOffer& OutOffer);
+
+	/** Format version written after the magic */
+	static constexpr uint8 VERSION = 1;
+
+	/** Most candidates an offer carries (count is one byte) */
+	static constexpr int32 MAX_CANDIDATES = 255;
+};
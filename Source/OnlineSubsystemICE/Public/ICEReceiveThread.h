@@ -0,0 +1,117 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include <atomic>
+
+class FSocket;
+class FInternetAddr;
+class FRunnableThread;
+
+/**
+ * Datagram slot of the receive ring
+ * Buffers are allocated once when the ring is created
+ */
+struct FICEPacketSlot
+{
+	/** Maximum datagram size stored in a slot */
+	static constexpr int32 MAX_PACKET_SIZE = 2048;
+
+	/** Datagram payload */
+	uint8 Data[MAX_PACKET_SIZE];
+
+	/** Number of valid bytes in Data */
+	int32 Size;
+
+	/** Sender address */
+	TSharedPtr<FInternetAddr> FromAddr;
+
+	FICEPacketSlot()
+		: Size(0)
+	{}
+};
+
+/**
+ * Single-producer/single-consumer lock-free ring of received datagrams
+ * The I/O thread writes slots in place, the game thread reads them in place; no allocation after construction
+ */
+class FICEPacketRing
+{
+public:
+	/**
+	 * @param Capacity - Number of slots (rounded up to a power of two)
+	 */
+	explicit FICEPacketRing(int32 Capacity);
+
+	/**
+	 * Producer: get the next free slot
+	 * @return Slot to fill, or nullptr if the ring is full
+	 */
+	FICEPacketSlot* BeginWrite();
+
+	/** Producer: publish the slot returned by BeginWrite */
+	void EndWrite();
+
+	/**
+	 * Consumer: get the oldest received datagram
+	 * @return Slot to read, or nullptr if the ring is empty
+	 */
+	const FICEPacketSlot* BeginRead() const;
+
+	/** Consumer: release the slot returned by BeginRead */
+	void EndRead();
+
+	/** Number of datagrams dropped because the ring was full */
+	uint32 GetDroppedCount() const { return DroppedCount.load(std::memory_order_relaxed); }
+
+	/** Producer: record a datagram that didn't fit */
+	void AddDropped() { DroppedCount.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+	TArray<FICEPacketSlot> Slots;
+	uint32 Mask;
+
+	/** Next slot written by the producer */
+	std::atomic<uint32> Head;
+
+	/** Next slot read by the consumer */
+	std::atomic<uint32> Tail;
+
+	std::atomic<uint32> DroppedCount;
+};
+
+/**
+ * Receive thread of an ICE agent
+ * Drains the agent socket in a loop into an FICEPacketRing so receive latency doesn't depend on frame rate
+ */
+class FICEReceiveThread : public FRunnable
+{
+public:
+	/**
+	 * Create and start the thread
+	 * @param InSocket - Socket to drain (must outlive the thread)
+	 * @param InRing - Ring the datagrams are written to (must outlive the thread)
+	 */
+	FICEReceiveThread(FSocket* InSocket, FICEPacketRing& InRing);
+
+	/** Stops the thread and waits for it to exit */
+	virtual ~FICEReceiveThread();
+
+	/** Check if the thread was created */
+	bool IsRunning() const { return Thread != nullptr; }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	FSocket* Socket;
+	FICEPacketRing& Ring;
+	FRunnableThread* Thread;
+	std::atomic<bool> bStopping;
+
+	/** Time the thread blocks waiting for data before checking for a stop request (milliseconds) */
+	static constexpr int32 WAIT_TIME_MS = 5;
+};
@@ -0,0 +1,144 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct evp_pkey_st;
+struct evp_cipher_ctx_st;
+
+/**
+ * Encrypted datagram channel of an agent (FICEAgentConfig::bEncryptTraffic)
+ * Keyed from the ICE handshake, Noise NNpsk2-style: each agent puts an ephemeral X25519 key share in its signed
+ * HELLOs, so the shares are authenticated by the ICE passwords, and both sides derive
+ *   PRK = HMAC-SHA256("ICE secure channel", X25519(shares) || controlling password || controlled password)
+ * from which HKDF expands one AES-256-GCM key and IV per direction.
+ *
+ * Record layout: [0x17 (1 byte)] [Sequence (8 bytes)] [Ciphertext] [Tag (16 bytes)]
+ * The first byte lies in the DTLS range of RFC 7983, apart from STUN, ChannelData and the HELLO magic. The nonce
+ * is the direction IV XOR the sequence number, which never repeats for one key; the header is authenticated as AAD
+ * and replayed records are dropped by a 64-record window. OpenSSL picks the hardware AES-GCM path (AES-NI, ARMv8
+ * crypto extensions) when available; cipher contexts are set up once, so sealing and opening allocate nothing.
+ */
+class ONLINESUBSYSTEMICE_API FICESecureChannel
+{
+public:
+	FICESecureChannel();
+	~FICESecureChannel();
+
+	FICESecureChannel(const FICESecureChannel&) = delete;
+	FICESecureChannel& operator=(const FICESecureChannel&) = delete;
+
+	/**
+	 * Generate the ephemeral key share sent to the peer, if there is none yet
+	 * @return True if a key share is available
+	 */
+	bool EnsureKeyShare();
+
+	/** Whether a local key share was generated */
+	bool HasKeyShare() const { return KeyPair != nullptr; }
+
+	/** Local key share (KEY_SHARE_SIZE bytes, valid once HasKeyShare) */
+	const uint8* GetLocalKeyShare() const { return LocalKeyShare; }
+
+	/**
+	 * Derive the traffic keys from the peer's key share
+	 * A channel already established with the same share and role is kept, so an ICE restart (new passwords) doesn't rekey
+	 * @param RemoteKeyShare - KEY_SHARE_SIZE bytes received in an authenticated HELLO
+	 * @param bControlling - ICE role of this agent, selects the key of each direction
+	 * @param LocalPassword - ICE password of this agent
+	 * @param RemotePassword - ICE password of the peer
+	 * @return True if the channel is established
+	 */
+	bool Establish(const uint8* RemoteKeyShare, bool bControlling, const FString& LocalPassword, const FString& RemotePassword);
+
+	/** Whether traffic keys are derived */
+	bool IsEstablished() const { return bEstablished; }
+
+	/** Forget the key share and the traffic keys (new session) */
+	void Reset();
+
+	/**
+	 * Encrypt a record in place
+	 * @param Record - RECORD_HEADER_SIZE reserved bytes, the payload, then TAG_SIZE bytes of room
+	 * @param PayloadSize - Size of the payload
+	 * @return Record size (PayloadSize + RECORD_OVERHEAD), 0 if the channel isn't established
+	 */
+	int32 Seal(uint8* Record, int32 PayloadSize);
+
+	/**
+	 * Decrypt a record in place
+	 * @param Record - Received record
+	 * @param Size - Record size
+	 * @param OutPayloadSize - Plaintext size, the plaintext starts RECORD_HEADER_SIZE bytes into Record
+	 * @return False if the record is malformed, replayed or fails authentication
+	 */
+	bool Open(uint8* Record, int32 Size, int32& OutPayloadSize);
+
+	/**
+	 * Fill a buffer from OpenSSL's CSPRNG
+	 * @return False if the generator could not be seeded
+	 */
+	static bool GenerateRandomBytes(uint8* OutBytes, int32 Size);
+
+	/** Whether a datagram looks like a record (first byte and minimum size) */
+	static bool IsRecord(const uint8* Data, int32 Size);
+
+	/** Records dropped by Open */
+	uint32 GetRejectedRecordCount() const { return RejectedRecordCount; }
+
+	/** Size of an X25519 key share */
+	static constexpr int32 KEY_SHARE_SIZE = 32;
+
+	/** First byte of a record */
+	static constexpr uint8 RECORD_TYPE = 0x17;
+
+	/** Type and sequence number in front of the ciphertext */
+	static constexpr int32 RECORD_HEADER_SIZE = 9;
+
+	/** GCM authentication tag after the ciphertext */
+	static constexpr int32 TAG_SIZE = 16;
+
+	/** Bytes a record adds to its payload */
+	static constexpr int32 RECORD_OVERHEAD = RECORD_HEADER_SIZE + TAG_SIZE;
+
+private:
+	/** Replay window size in records */
+	static constexpr int32 REPLAY_WINDOW_SIZE = 64;
+
+	static constexpr int32 KEY_SIZE = 32;
+	static constexpr int32 IV_SIZE = 12;
+
+	/** Free the cipher contexts */
+	void ReleaseCiphers();
+
+	/** Nonce of a record: the direction IV XOR the big-endian sequence number */
+	static void MakeNonce(const uint8* IV, uint64 Sequence, uint8* OutNonce);
+
+	/** Ephemeral X25519 key pair */
+	evp_pkey_st* KeyPair;
+	uint8 LocalKeyShare[KEY_SHARE_SIZE];
+
+	/** Peer share the keys were derived from */
+	uint8 RemoteKeyShare[KEY_SHARE_SIZE];
+
+	/** AES-256-GCM contexts with their key schedule, reused for every record */
+	evp_cipher_ctx_st* SendContext;
+	evp_cipher_ctx_st* ReceiveContext;
+	uint8 SendIV[IV_SIZE];
+	uint8 ReceiveIV[IV_SIZE];
+
+	/** Sequence number of the next sealed record */
+	uint64 SendSequence;
+
+	/** Highest sequence number opened and a bit for each of the ones before it */
+	uint64 ReceiveSequenceMax;
+	uint64 ReceiveWindow;
+	bool bReceivedAny;
+
+	/** Whether the traffic keys were derived as the controlling agent */
+	bool bKeysControlling;
+
+	bool bEstablished;
+	uint32 RejectedRecordCount;
+};
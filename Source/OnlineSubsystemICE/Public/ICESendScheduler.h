@@ -0,0 +1,157 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Priority classes of paced sends, served in this order
+ */
+enum class EICESendPriority : uint8
+{
+	/** Voice and other streams that are useless late */
+	Realtime,
+	/** Movement and gameplay replication */
+	Interactive,
+	/** Default class */
+	Normal,
+	/** Level load, downloads and other bulk transfers */
+	Bulk,
+
+	Count
+};
+
+/**
+ * Send pacer of an agent (FICEAgentConfig::bPaceSends)
+ * A token bucket holds sends to the estimated path bandwidth so bursts (level load) don't overflow the TURN relay's
+ * queue or the NAT: a datagram leaves right away while tokens last and nothing of its class or a higher one waits,
+ * otherwise it is copied into its class queue, drained in priority order as tokens come back. Each class queue is
+ * bounded; a full one drops the new datagram.
+ *
+ * The bandwidth estimate is delay-based (LEDBAT-like): queuing delay is the RTT measured by consent checks minus the
+ * smallest RTT of the last two BASE_RTT_WINDOWs. Above TargetQueuingDelay the rate backs off multiplicatively; below
+ * it the rate grows, but only if the pacer actually held sends back since the last sample (app-limited flows keep
+ * their rate). A lost consent check halves the rate.
+ */
+class ONLINESUBSYSTEMICE_API FICESendScheduler
+{
+public:
+	/**
+	 * @param InInitialRate - Starting send rate (bytes per second)
+	 * @param InMinRate - Floor of the send rate (bytes per second)
+	 * @param InMaxRate - Ceiling of the send rate (bytes per second)
+	 * @param InBurstSize - Tokens the bucket can hold, sent back to back after an idle period (bytes)
+	 * @param InQueueLimit - Bytes each priority class may hold back
+	 * @param InTargetQueuingDelay - Queuing delay the estimate steers to (seconds)
+	 */
+	FICESendScheduler(float InInitialRate, float InMinRate, float InMaxRate, int32 InBurstSize, int32 InQueueLimit, float InTargetQueuingDelay);
+
+	/**
+	 * Take the tokens of a datagram sent right away
+	 * @param WireSize - Datagram size on the wire, headers included
+	 * @param Priority - Class of the datagram
+	 * @return False if the datagram must be queued (no tokens, or datagrams of its class or a higher one wait)
+	 */
+	bool TryConsume(int32 WireSize, EICESendPriority Priority);
+
+	/**
+	 * Copy a datagram into its class queue
+	 * @param Buffers - Datagram payload, sent back to back
+	 * @param WireSize - Datagram size on the wire, headers included
+	 * @param Priority - Class of the datagram
+	 * @return False if the class queue is full and the datagram was dropped
+	 */
+	bool Enqueue(TArrayView<const TArrayView<const uint8>> Buffers, int32 WireSize, EICESendPriority Priority);
+
+	/**
+	 * Send queued datagrams, highest class first, while tokens last
+	 * @param Send - Sends one datagram; a failed send is dropped like a sent one
+	 * @return Number of datagrams sent
+	 */
+	int32 Drain(TFunctionRef<bool(TArrayView<const uint8>)> Send);
+
+	/**
+	 * Update the bandwidth estimate with an RTT sample of the selected pair
+	 * @param RTT - Round-trip time (ms)
+	 */
+	void AddRTTSample(float RTT);
+
+	/** Back off after a consent check went unanswered */
+	void OnLoss();
+
+	/** Drop queued datagrams and restart the estimate (new connection) */
+	void Reset();
+
+	/** Whether datagrams are waiting for tokens */
+	bool HasQueued() const { return NumQueued > 0; }
+
+	/** Current send rate (bytes per second) */
+	float GetRate() const { return Rate; }
+
+	/** Latest queuing delay estimate (seconds) */
+	float GetQueuingDelay() const { return QueuingDelay; }
+
+	/** Bytes waiting in a class queue */
+	int32 GetQueuedBytes(EICESendPriority Priority) const { return Queues[(int32)Priority].QueuedBytes; }
+
+	/** Datagrams sent after waiting in a queue */
+	uint32 GetDelayedCount() const { return DelayedCount; }
+
+	/** Datagrams dropped because their class queue was full */
+	uint32 GetDroppedCount() const { return DroppedCount; }
+
+	/** Span of each base RTT window (seconds) */
+	static constexpr double BASE_RTT_WINDOW = 30.0;
+
+private:
+	/** Datagram waiting in a class queue */
+	struct FEntry
+	{
+		/** Position of the payload in the queue storage */
+		int32 Offset;
+		int32 Size;
+		int32 WireSize;
+	};
+
+	/** Datagrams of one priority class, in send order */
+	struct FClassQueue
+	{
+		/** Payloads back to back; the consumed prefix is compacted once it is the larger part */
+		TArray<uint8> Storage;
+		TArray<FEntry> Entries;
+		int32 Head = 0;
+		int32 QueuedBytes = 0;
+	};
+
+	/** Add the tokens earned since the last refill */
+	void Refill(double Now);
+
+	float InitialRate;
+	float MinRate;
+	float MaxRate;
+	int32 BurstSize;
+	int32 QueueLimit;
+	float TargetQueuingDelay;
+
+	/** Send rate (bytes per second) */
+	float Rate;
+
+	/** Bytes that may be sent now; goes negative by at most one datagram */
+	double Tokens;
+	double LastRefillTime;
+
+	/** Whether the pacer held a datagram back since the last RTT sample */
+	bool bRateLimited;
+
+	/** Smallest RTT of the current and previous base windows (seconds), and when the current one started */
+	float CurrentWindowMinRTT;
+	float PreviousWindowMinRTT;
+	double WindowStartTime;
+	float QueuingDelay;
+
+	FClassQueue Queues[(int32)EICESendPriority::Count];
+	int32 NumQueued;
+
+	uint32 DelayedCount;
+	uint32 DroppedCount;
+};
@@ -0,0 +1,154 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OnlineSessionSettings.h"
+
+class FSocket;
+class FInternetAddr;
+
+/**
+ * A search result was measured, or every probe to it went unanswered (its PingInMs is then left at MAX_QUERY_PING)
+ * Params: Search, ResultIndex, bReachable
+ */
+DECLARE_DELEGATE_ThreeParams(FOnICESearchResultPinged, const TSharedRef<FOnlineSessionSearch>& /*Search*/, int32 /*ResultIndex*/, bool /*bReachable*/);
+
+/**
+ * Measures the round trip time to search results with STUN Binding requests
+ * Every result advertises the server reflexive addresses of its host (see FOnlineSessionInfoICE::GetPingAddresses),
+ * which the host's agent pool answers like a STUN server. Probes to every address of every result leave at once from
+ * one socket, up to MaxInFlight outstanding, so pinging a whole page costs about one round trip; the first answer
+ * of a result sets its PingInMs and its other probes are dropped. Unanswered probes are resent once after Timeout.
+ * RTTs are measured when Tick reads the answer, so they include up to one frame.
+ */
+class FICESessionPinger
+{
+public:
+	/**
+	 * @param InMaxInFlight - Probes outstanding at once, the others wait in a queue
+	 * @param InTimeout - Time before an unanswered probe is resent or given up (seconds)
+	 * @param bInDualStack - Whether IPv6 addresses can be probed (FICEAgentConfig::bEnableIPv6)
+	 */
+	FICESessionPinger(int32 InMaxInFlight, float InTimeout, bool bInDualStack);
+	~FICESessionPinger();
+
+	/**
+	 * Probe a range of search results, their probes are sent right away up to the in-flight cap
+	 * Results without an FOnlineSessionInfoICE or ping addresses are skipped
+	 * @param Search - Search holding the results
+	 * @param FirstResult - Index of the first result to probe
+	 * @param NumResults - Number of results to probe
+	 * @return Number of results probed
+	 */
+	int32 PingResults(const TSharedRef<FOnlineSessionSearch>& Search, int32 FirstResult, int32 NumResults);
+
+	/**
+	 * Drop every probe of a search
+	 * @param Search - Search whose results were being pinged
+	 */
+	void CancelSearch(const FOnlineSessionSearch& Search);
+
+	/**
+	 * Read answers, resend or give up on timed out probes and send queued ones
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void Tick(float DeltaTime);
+
+	/**
+	 * Whether results of a search are still being measured
+	 * @param Search - Search to check
+	 */
+	bool IsPinging(const FOnlineSessionSearch& Search) const;
+
+	/** Probes sent and not answered yet */
+	int32 GetNumInFlight() const { return InFlight.Num(); }
+
+	/** Probes waiting for the in-flight cap */
+	int32 GetNumQueued() const { return Queue.Num() - QueueHead; }
+
+	/** Fired once per result probed */
+	FOnICESearchResultPinged OnResultPinged;
+
+	/** Attempts per address before it is given up */
+	static constexpr int32 MAX_ATTEMPTS = 2;
+
+	/** Answers read per Tick */
+	static constexpr int32 MAX_RECEIVE_PER_TICK = 256;
+
+private:
+	/** One search result being measured */
+	struct FTarget
+	{
+		TWeakPtr<FOnlineSessionSearch> Search;
+
+		/** Registry id of the result, its index may shift if the search is refilled */
+		FString SessionId;
+
+		/** Index of the result when it was queued */
+		int32 ResultIndex = INDEX_NONE;
+
+		/** Probes queued or in flight */
+		int32 NumOutstanding = 0;
+
+		/** Whether an answer was received */
+		bool bAnswered = false;
+	};
+
+	/** One probe to one address of a target */
+	struct FProbe
+	{
+		TSharedPtr<FTarget> Target;
+		TSharedPtr<FInternetAddr> Addr;
+		uint8 TransactionID[12];
+		double SentTime = 0.0;
+		int32 Attempt = 0;
+	};
+
+	/** Create the socket on first use */
+	bool EnsureSocket();
+
+	/** Send queued probes until the in-flight cap is reached */
+	void SendQueued();
+
+	/**
+	 * Send a probe and track it as in flight
+	 * @return False if the socket refused it
+	 */
+	bool SendProbe(FProbe&& Probe);
+
+	/** Match an answer with its probe */
+	void HandleAnswer(const uint8* Data, int32 Size, const FInternetAddr& FromAddr);
+
+	/**
+	 * A probe is done (answered, or given up): report the target once it has no probe left
+	 * @param Probe - Finished probe
+	 * @param RTT - Measured round trip time, negative if unanswered (seconds)
+	 */
+	void FinishProbe(const FProbe& Probe, double RTT);
+
+	/** Find the current index of a target's result, INDEX_NONE if it left the search */
+	static int32 FindResultIndex(const FOnlineSessionSearch& Search, const FTarget& Target);
+
+	/** Probes outstanding at once */
+	int32 MaxInFlight;
+
+	/** Time before an unanswered probe is resent or given up (seconds) */
+	float Timeout;
+
+	/** Whether the socket is dual-stack */
+	bool bDualStack;
+
+	/** Socket every probe leaves from */
+	FSocket* Socket;
+
+	/** Sender address of received answers (reused) */
+	TSharedPtr<FInternetAddr> ReceiveFromAddr;
+
+	/** Probes waiting for the in-flight cap, consumed from QueueHead */
+	TArray<FProbe> Queue;
+	int32 QueueHead;
+
+	/** Probes in flight, by the first 4 bytes of their transaction ID */
+	TMap<uint32, FProbe> InFlight;
+};
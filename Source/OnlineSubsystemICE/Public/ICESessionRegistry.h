@@ -0,0 +1,176 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OnlineSessionSettings.h"
+#include "Interfaces/IHttpRequest.h"
+
+class FJsonObject;
+
+/**
+ * A page of search results was appended to the search object
+ * Params: FirstNewResult (index of the first result of the page in SearchResults), NumNewResults
+ */
+DECLARE_DELEGATE_TwoParams(FOnICERegistrySearchPage, int32 /*FirstNewResult*/, int32 /*NumNewResults*/);
+
+/** The search finished (last page received, MaxSearchResults reached, or the registry failed) */
+DECLARE_DELEGATE_OneParam(FOnICERegistrySearchComplete, bool /*bWasSuccessful*/);
+
+/**
+ * Client of the session registry (lobby) service backing FindSessions
+ * Hosts advertise their sessions, refreshed every HeartbeatInterval so the registry can expire dead hosts;
+ * searches send the query settings to the registry, which filters on its indexed keys and answers in pages.
+ *
+ * REST protocol (JSON bodies):
+ *   PUT    <URL>/sessions/<id>                          advertise or refresh a session (see MakeAdvertisement)
+ *   DELETE <URL>/sessions/<id>                          withdraw it
+ *   GET    <URL>/sessions?limit=N[&cursor=C][&q=K:OP:V]  one page: {"sessions":[...],"next":C}, no "next" on the last page
+ * Query operators are eq, ne, gt, gte, lt, lte, near, in and notin (comma-separated values); keys the registry
+ * doesn't index are ignored by it and filtered here (see MatchesQuery), so results are always consistent with the query.
+ */
+class FICESessionRegistry
+{
+public:
+	/**
+	 * @param InURL - Registry service URL
+	 * @param InPageSize - Sessions requested per page
+	 * @param InHeartbeatInterval - Time between refreshes of advertised sessions (seconds)
+	 */
+	FICESessionRegistry(const FString& InURL, int32 InPageSize, float InHeartbeatInterval);
+	~FICESessionRegistry();
+
+	/**
+	 * Refresh advertised sessions when their heartbeat is due
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void Tick(float DeltaTime);
+
+	/**
+	 * Advertise a hosted session, or update its advertisement
+	 * @param SessionId - Registry identifier of the session (see FOnlineSessionInfoICE)
+	 * @param Session - Session as advertised: settings, owner and open slots
+	 * @param HostPeerId - Signaling identifier of the host, joining peers' offers are sent to it
+	 * @param PingAddresses - Server reflexive addresses of the host, searching peers ping them
+	 */
+	void Advertise(const FString& SessionId, const FOnlineSession& Session, const FString& HostPeerId, const TArray<FString>& PingAddresses);
+
+	/**
+	 * Stop advertising a session
+	 * @param SessionId - Registry identifier of the session
+	 */
+	void Withdraw(const FString& SessionId);
+
+	/** Whether a session is advertised */
+	bool IsAdvertised(const FString& SessionId) const { return Advertised.Contains(SessionId); }
+
+	/**
+	 * Start a search, results are appended to SearchSettings->SearchResults page by page
+	 * A running search is cancelled first; the completion delegate fires exactly once unless CancelSearch is called
+	 * @param SearchSettings - Query settings and result storage
+	 * @param OnPage - Fired after each page
+	 * @param OnComplete - Fired once the search is done
+	 * @return True if the first page was requested
+	 */
+	bool Search(const TSharedRef<FOnlineSessionSearch>& SearchSettings, const FOnICERegistrySearchPage& OnPage, const FOnICERegistrySearchComplete& OnComplete);
+
+	/** Cancel the running search without firing its completion delegate */
+	void CancelSearch();
+
+	/** Whether a search is running */
+	bool IsSearching() const { return CurrentSearch.IsValid(); }
+
+	/** Number of sessions advertised by this peer */
+	int32 GetNumAdvertised() const { return Advertised.Num(); }
+
+	/** Registry service URL */
+	const FString& GetURL() const { return URL; }
+
+	/**
+	 * Evaluate search parameters against a session
+	 * Keys are looked up in the session settings; the SEARCH_* keys with a meaning of their own
+	 * (lobbies/presence, dedicated, empty/non-empty servers, minimum open slots) are checked against the session.
+	 * Numeric values compare by value regardless of their type; other keys absent from the session fail the match.
+	 * @param Session - Session to test
+	 * @param QuerySettings - Search parameters
+	 * @return True if every parameter holds
+	 */
+	static bool MatchesQuery(const FOnlineSession& Session, const FOnlineSearchSettings& QuerySettings);
+
+	/** Largest page the registry is asked for */
+	static constexpr int32 MAX_PAGE_SIZE = 200;
+
+private:
+	/** Advertisement of a hosted session */
+	struct FAdvertisement
+	{
+		/** JSON body sent on every refresh */
+		FString Body;
+
+		/** Time until the next refresh (seconds) */
+		float TimeToHeartbeat = 0.0f;
+	};
+
+	/** Search in progress */
+	struct FSearch
+	{
+		TSharedPtr<FOnlineSessionSearch> SearchSettings;
+		FOnICERegistrySearchPage OnPage;
+		FOnICERegistrySearchComplete OnComplete;
+
+		/** Query string shared by every page */
+		FString Query;
+
+		/** Page request in flight */
+		FHttpRequestPtr Request;
+	};
+
+	/**
+	 * Build the JSON body advertising a session
+	 *   {"id":S,"name":N,"host":P,"owner":U,"slots":N,"open":N,"dedicated":B,"lobby":B,"presence":B,
+	 *    "joinInProgress":B,"ping":["ip:port",...],"settings":{"KEY":value,...}}
+	 * Only settings advertised via the online service are included.
+	 */
+	static FString MakeAdvertisement(const FString& SessionId, const FOnlineSession& Session, const FString& HostPeerId, const TArray<FString>& PingAddresses);
+
+	/**
+	 * Parse a session entry of a search page
+	 * @param Json - Session entry
+	 * @param OutResult - Search result, its SessionInfo is an FOnlineSessionInfoICE
+	 * @return False if the entry has no id
+	 */
+	static bool ParseSession(const FJsonObject& Json, FOnlineSessionSearchResult& OutResult);
+
+	/** Encode the query settings of a search as q=KEY:OP:VALUE parameters */
+	static FString MakeQueryString(const FOnlineSearchSettings& QuerySettings);
+
+	/** Send the advertisement of a session and schedule its next refresh */
+	void SendAdvertisement(const FString& SessionId, FAdvertisement& Advertisement);
+
+	/**
+	 * Request the next page of the current search
+	 * @param Cursor - Cursor returned with the previous page, empty for the first one
+	 */
+	void RequestPage(const FString& Cursor);
+
+	/** Handle a page of the current search */
+	void OnPageComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSucceeded);
+
+	/** End the current search */
+	void CompleteSearch(bool bWasSuccessful);
+
+	/** Registry URL, without trailing slash */
+	FString URL;
+
+	/** Sessions requested per page */
+	int32 PageSize;
+
+	/** Time between refreshes of advertised sessions (seconds) */
+	float HeartbeatInterval;
+
+	/** Sessions advertised by this peer, by registry identifier */
+	TMap<FString, FAdvertisement> Advertised;
+
+	/** Running search, null when idle */
+	TUniquePtr<FSearch> CurrentSearch;
+};
@@ -0,0 +1,191 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ICEAgent.h"
+
+class FOnlineSessionICE;
+class IICESignalingTransport;
+class FJsonObject;
+
+/**
+ * Exchanges ICE offers with the peers of a session through a signaling server
+ * Local candidates trickled by the session are batched per agent and sent every BatchInterval as one
+ * FICEOffer; offers received are applied to the peer's agent straight away, and checks start with the
+ * first one, so a join completes without any manual candidate exchange.
+ *
+ * Protocol (one JSON object per message, one room per session: its registry id, else its name):
+ *   {"type":"join","session":S,"peer":P,"host":true|false}  joins the room of a session
+ *   {"type":"leave","session":S,"peer":P}                   leaves it
+ *   {"type":"offer","session":S,"from":P,"to":Q,"offer":B}  relayed to Q, an empty "to" means the room host
+ * The transport is a WebSocket (ws/wss URL) falling back to HTTP long-polling if it cannot connect,
+ * or long-polling only for an http/https URL (see FICEHttpSignaling).
+ */
+class FICESignalingClient
+{
+public:
+	/**
+	 * @param InSession - Session interface whose agents are signaled (owns the client)
+	 * @param InURL - Signaling server URL
+	 * @param InBatchInterval - Time local candidates are collected before being sent (seconds)
+	 */
+	FICESignalingClient(FOnlineSessionICE& InSession, const FString& InURL, float InBatchInterval);
+	~FICESignalingClient();
+
+	/**
+	 * Send batched candidates, reconnect or switch transport when needed
+	 * @param DeltaTime - Time elapsed since last tick
+	 */
+	void Tick(float DeltaTime);
+
+	/**
+	 * Join the signaling room of a session
+	 * @param SessionName - Session created or joined
+	 * @param RoomId - Room shared by every peer of the session (see FOnlineSessionICE::GetSignalingRoomId)
+	 * @param bHost - True if this peer hosts the session (offers from new peers get their own agent)
+	 */
+	void JoinRoom(FName SessionName, const FString& RoomId, bool bHost);
+
+	/**
+	 * Leave the signaling room of a session
+	 * @param SessionName - Session destroyed
+	 */
+	void LeaveRoom(FName SessionName);
+
+	/** Whether the transport is connected */
+	bool IsConnected() const;
+
+	/** Signaling identifier of this peer (random, one per process) */
+	const FString& GetLocalPeerId() const { return LocalPeerId; }
+
+	/** Name of the current transport */
+	const TCHAR* GetTransportName() const;
+
+	/** Offers sent and received since startup */
+	int32 GetNumOffersSent() const { return NumOffersSent; }
+	int32 GetNumOffersReceived() const { return NumOffersReceived; }
+
+	/** Delay before reconnecting after the server is lost (seconds) */
+	static constexpr float RECONNECT_DELAY = 2.0f;
+
+private:
+	/** Signaling room of a local session */
+	struct FRoom
+	{
+		/** Identifier shared with the other peers */
+		FString RoomId;
+
+		/** Whether this peer hosts the session */
+		bool bHost = false;
+	};
+
+	/** Local candidates waiting to be sent to one remote peer */
+	struct FPendingOffer
+	{
+		/** Session the agent belongs to */
+		FName SessionName;
+
+		/** Candidates gathered since the last batch */
+		TArray<FICECandidate> Candidates;
+
+		/** Time since the first candidate of the batch was queued (seconds) */
+		float Age = 0.0f;
+	};
+
+	/** Create the transport (WebSocket, or long-poll) and connect it */
+	void CreateTransport(bool bLongPoll);
+
+	/** Transport callbacks */
+	void OnTransportConnected();
+	void OnTransportClosed(bool bWasConnected);
+	void OnTransportMessage(const FString& Message);
+
+	/** Session candidate listeners: queue the candidates of an agent */
+	void OnLocalCandidatesReady(FName SessionName, const TArray<FICECandidate>& Candidates);
+	void OnPeerLocalCandidatesReady(FName SessionName, const FString& PeerId, const TArray<FICECandidate>& Candidates);
+
+	/**
+	 * Queue candidates of a local agent
+	 * @param SessionName - Session of the agent
+	 * @param AgentPeerId - Peer of the agent (empty for the default agent, whose remote peer is the room host)
+	 * @param Candidates - New local candidates
+	 */
+	void QueueCandidates(FName SessionName, const FString& AgentPeerId, const TArray<FICECandidate>& Candidates);
+
+	/**
+	 * Send the queued candidates of an agent as one offer
+	 * @param AgentPeerId - Peer of the agent
+	 * @param Pending - Queued candidates, emptied
+	 */
+	void SendOffer(const FString& AgentPeerId, FPendingOffer& Pending);
+
+	/**
+	 * Apply an offer received from a remote peer, starting checks when it is the first one
+	 * @param RoomId - Room the offer was sent in
+	 * @param FromPeer - Signaling identifier of the sender
+	 * @param Offer - Base64 FICEOffer
+	 */
+	void HandleRemoteOffer(const FString& RoomId, const FString& FromPeer, const FString& Offer);
+
+	/**
+	 * Release the agent of a peer that left a hosted room
+	 * @param RoomId - Room the peer left
+	 * @param Peer - Signaling identifier of the peer
+	 */
+	void HandleRemoteLeave(const FString& RoomId, const FString& Peer);
+
+	/**
+	 * Serialize and send a message, or queue it until the transport connects
+	 * @param Message - JSON message
+	 */
+	void SendMessage(const TSharedRef<FJsonObject>& Message);
+
+	/** Build the join message of a room */
+	TSharedRef<FJsonObject> MakeJoinMessage(const FRoom& Room) const;
+
+	/** Session interface whose agents are signaled */
+	FOnlineSessionICE& Session;
+
+	/** URL as configured */
+	FString URL;
+
+	/** Time local candidates are collected before being sent (seconds) */
+	float BatchInterval;
+
+	/** Signaling identifier of this peer */
+	FString LocalPeerId;
+
+	/** Current transport */
+	TUniquePtr<IICESignalingTransport> Transport;
+
+	/** Whether the current transport is the long-poll fallback */
+	bool bUsingLongPoll;
+
+	/** Set from transport callbacks, handled from Tick (a transport is never destroyed from its own callback) */
+	bool bTransportClosed;
+	bool bTransportEverConnected;
+
+	/** Time until the next reconnection attempt (seconds) */
+	float ReconnectDelay;
+
+	/** Rooms joined, by local session name */
+	TMap<FName, FRoom> Rooms;
+
+	/** Candidates waiting to be sent, by agent peer identifier */
+	TMap<FString, FPendingOffer> PendingOffers;
+
+	/** Messages queued while the transport is disconnected */
+	TArray<FString> OutgoingQueue;
+
+	/** Handles of the session candidate listeners */
+	FDelegateHandle LocalCandidatesHandle;
+	FDelegateHandle PeerLocalCandidatesHandle;
+
+	/** Offers sent and received since startup */
+	int32 NumOffersSent;
+	int32 NumOffersReceived;
+
+	/** Messages queued while disconnected before the oldest ones are dropped */
+	static constexpr int32 MAX_QUEUED_MESSAGES = 256;
+};
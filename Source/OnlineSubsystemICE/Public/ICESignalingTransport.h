@@ -0,0 +1,141 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/IHttpRequest.h"
+
+class IWebSocket;
+
+/** Text message received from the signaling server */
+DECLARE_DELEGATE_OneParam(FOnICESignalingMessage, const FString& /*Message*/);
+
+/** The transport reached the signaling server */
+DECLARE_DELEGATE(FOnICESignalingConnected);
+
+/** The transport lost (or never reached) the signaling server */
+DECLARE_DELEGATE_OneParam(FOnICESignalingClosed, bool /*bWasConnected*/);
+
+/**
+ * Connection to a signaling server carrying text messages (one JSON object each)
+ * Implementations run on the game thread and never block; FICESignalingClient reconnects on close.
+ */
+class IICESignalingTransport
+{
+public:
+	virtual ~IICESignalingTransport() = default;
+
+	/** Start connecting, OnConnected or OnClosed fires once it is known */
+	virtual void Connect() = 0;
+
+	/** Disconnect without firing OnClosed */
+	virtual void Close() = 0;
+
+	/** Whether messages can be sent */
+	virtual bool IsConnected() const = 0;
+
+	/**
+	 * Send one message
+	 * @param Message - JSON text
+	 * @return False if the transport is not connected
+	 */
+	virtual bool Send(const FString& Message) = 0;
+
+	/** Transport name for logs */
+	virtual const TCHAR* GetName() const = 0;
+
+	FOnICESignalingMessage OnMessage;
+	FOnICESignalingConnected OnConnected;
+	FOnICESignalingClosed OnClosed;
+};
+
+/**
+ * Signaling over a WebSocket (WebSockets module), one text frame per message
+ */
+class FICEWebSocketSignaling : public IICESignalingTransport
+{
+public:
+	/**
+	 * @param InURL - ws:// or wss:// URL of the signaling server
+	 */
+	explicit FICEWebSocketSignaling(const FString& InURL);
+	virtual ~FICEWebSocketSignaling();
+
+	virtual void Connect() override;
+	virtual void Close() override;
+	virtual bool IsConnected() const override;
+	virtual bool Send(const FString& Message) override;
+	virtual const TCHAR* GetName() const override { return TEXT("WebSocket"); }
+
+private:
+	/** URL of the signaling server */
+	FString URL;
+
+	/** Current connection */
+	TSharedPtr<IWebSocket> WebSocket;
+
+	/** Whether the current connection was ever established */
+	bool bWasConnected;
+};
+
+/**
+ * Signaling over HTTP long-polling, for networks where WebSockets are blocked
+ * Messages are POSTed to <URL>/messages, newline-separated, with one request in flight so ordering holds;
+ * GET <URL>/messages?peer=<id> is held by the server until messages arrive and re-issued as soon as it returns.
+ */
+class FICEHttpSignaling : public IICESignalingTransport
+{
+public:
+	/**
+	 * @param InURL - http:// or https:// URL of the signaling server
+	 * @param InPeerId - Signaling identifier of this peer, the server queues its messages under it
+	 */
+	FICEHttpSignaling(const FString& InURL, const FString& InPeerId);
+	virtual ~FICEHttpSignaling();
+
+	virtual void Connect() override;
+	virtual void Close() override;
+	virtual bool IsConnected() const override { return bConnected; }
+	virtual bool Send(const FString& Message) override;
+	virtual const TCHAR* GetName() const override { return TEXT("HTTP long-poll"); }
+
+	/** How long the server may hold a poll before answering empty (seconds) */
+	static constexpr int32 POLL_WAIT_SECONDS = 25;
+
+private:
+	/** Issue the next poll */
+	void StartPoll();
+
+	/** Handle the end of a poll: dispatch its messages and poll again */
+	void OnPollComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSucceeded);
+
+	/** POST every queued message in one request, if none is in flight */
+	void FlushSendQueue();
+
+	/** Handle the end of a POST */
+	void OnSendComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSucceeded);
+
+	/** Report the loss of the server once */
+	void HandleFailure();
+
+	/** URL of the signaling server, without trailing slash */
+	FString URL;
+
+	/** Signaling identifier of this peer */
+	FString PeerId;
+
+	/** Poll waiting for messages */
+	FHttpRequestPtr PollRequest;
+
+	/** POST in flight */
+	FHttpRequestPtr SendRequest;
+
+	/** Messages waiting for the next POST */
+	TArray<FString> SendQueue;
+
+	/** Whether a poll or send succeeded since Connect */
+	bool bConnected;
+
+	/** Whether Connect was called and Close/failure hasn't happened since */
+	bool bActive;
+};
@@ -8,6 +8,10 @@
 #include "OnlineSubsystemICEPackage.h"
 
 class FOnlineSubsystemICE;
+class FICEAgentPool;
+class FICESignalingClient;
+class FICESessionRegistry;
+class FICESessionPinger;
 enum class EICEConnectionState : uint8;
 
 /**
@@ -16,6 +20,12 @@ enum class EICEConnectionState : uint8;
  */
 DECLARE_MULTICAST_DELEGATE_TwoParams(FOnLocalCandidatesReady, FName, const TArray<struct FICECandidate>&);
 
+/**
+ * Delegate for local ICE candidates of a session peer (see FOnlineSessionICE::AddSessionPeer)
+ * Params: SessionName, PeerId, Candidates
+ */
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnPeerLocalCandidatesReady, FName, const FString&, const TArray<struct FICECandidate>&);
+
 /**
  * Delegate for remote ICE candidate received notification
  * This allows external systems to be notified when candidates are received
@@ -23,6 +33,45 @@ DECLARE_MULTICAST_DELEGATE_TwoParams(FOnLocalCandidatesReady, FName, const TArra
  */
 DECLARE_MULTICAST_DELEGATE_TwoParams(FOnRemoteCandidateReceived, FName, const struct FICECandidate&);
 
+/**
+ * Session info of a session found through the registry (see FICESessionRegistry)
+ * Hosts advertising a session get one as well, its id names the signaling room of the session
+ */
+class FOnlineSessionInfoICE : public FOnlineSessionInfo
+{
+public:
+	/**
+	 * @param InSessionId - Registry identifier of the session
+	 * @param InHostPeerId - Signaling identifier of the host
+	 * @param InPingAddresses - Server reflexive addresses of the host, answered by its agent pool (see FICESessionPinger)
+	 */
+	FOnlineSessionInfoICE(const FString& InSessionId, const FString& InHostPeerId, const TArray<FString>& InPingAddresses = TArray<FString>());
+
+	// FOnlineSessionInfo Interface
+	virtual const uint8* GetBytes() const override { return SessionId->GetBytes(); }
+	virtual int32 GetSize() const override { return SessionId->GetSize(); }
+	virtual bool IsValid() const override { return SessionId->IsValid(); }
+	virtual const FUniqueNetId& GetSessionId() const override { return *SessionId; }
+	virtual FString ToString() const override { return SessionId->ToString(); }
+	virtual FString ToDebugString() const override;
+
+	/** Signaling identifier of the host */
+	const FString& GetHostPeerId() const { return HostPeerId; }
+
+	/** Addresses the host can be pinged at ("ip:port") */
+	const TArray<FString>& GetPingAddresses() const { return PingAddresses; }
+
+private:
+	/** Registry identifier of the session */
+	FUniqueNetIdRef SessionId;
+
+	/** Signaling identifier of the host */
+	FString HostPeerId;
+
+	/** Addresses the host can be pinged at */
+	TArray<FString> PingAddresses;
+};
+
 /**
  * Session interface implementation for ICE
  * Handles session creation, joining, and P2P connection management
@@ -89,30 +138,122 @@ public:
 
 	/**
 	 * Add remote ICE candidate manually (for testing)
+	 * @param PeerId - Session peer the candidate comes from (empty for the default agent)
+	 */
+	void AddRemoteICECandidate(const FString& CandidateString, const FString& PeerId = FString());
+
+	/**
+	 * Get local ICE candidates, gathering them only if the agent has none yet
+	 * @param PeerId - Session peer (empty for the default agent)
 	 */
-	void AddRemoteICECandidate(const FString& CandidateString);
+	TArray<FString> GetLocalICECandidates(const FString& PeerId = FString());
 
 	/**
-	 * Get local ICE candidates
+	 * Get one base64 offer packing the agent's credentials and every local candidate (see FICEOffer)
+	 * Gathering is started if needed; call again once OnLocalCandidatesReady fires for a complete offer
+	 * @param PeerId - Session peer (empty for the default agent)
+	 * @return The offer, empty if there is no agent for the peer
 	 */
-	TArray<FString> GetLocalICECandidates();
+	FString GetLocalICEOffer(const FString& PeerId = FString());
+
+	/**
+	 * Apply the offer of a remote peer: its credentials and every candidate it carries
+	 * @param Offer - Base64 offer from the peer's GetLocalICEOffer
+	 * @param PeerId - Session peer the offer comes from (empty for the default agent)
+	 * @return True if the offer was valid and applied
+	 */
+	bool AddRemoteICEOffer(const FString& Offer, const FString& PeerId = FString());
 
 	/**
 	 * Start ICE connectivity checks
+	 * @param PeerId - Session peer (empty for the default agent)
+	 */
+	bool StartICEConnectivityChecks(const FString& PeerId = FString());
+
+	/**
+	 * Restart ICE after a network change without dropping the session
+	 * New candidates are trickled through OnLocalCandidatesReady/OnPeerLocalCandidatesReady as for the first connection;
+	 * add the peer's new candidates and call StartICEConnectivityChecks, traffic moves once a new pair succeeds
+	 * @param PeerId - Session peer (empty for the default agent)
+	 * @return True if gathering started
+	 */
+	bool RestartICEConnection(const FString& PeerId = FString());
+
+	/**
+	 * Start ICE with one more remote peer of a hosted session
+	 * The peer gets its own controlling agent on the session socket; its candidates are trickled through
+	 * OnPeerLocalCandidatesReady and its state reported through OnICEPeerConnectionStateChanged.
+	 * A session takes at most its NumPublicConnections + NumPrivateConnections peers
+	 * @param SessionName - Hosted session the peer joins
+	 * @param PeerId - Application-defined peer identifier, unique across sessions
+	 * @return True if gathering started for the peer, false if the session is full
 	 */
-	bool StartICEConnectivityChecks();
+	bool AddSessionPeer(FName SessionName, const FString& PeerId);
+
+	/**
+	 * Close the connection with a session peer and release its agent
+	 * @param PeerId - Peer identifier
+	 * @return True if the peer was known
+	 */
+	bool RemoveSessionPeer(const FString& PeerId);
 
 	/**
 	 * Dump ICE connection status
 	 */
 	void DumpICEStatus(FOutputDevice& Ar);
 
+	/**
+	 * Dump the traffic counters and latency histograms of every agent
+	 */
+	void DumpICEStats(FOutputDevice& Ar);
+
+	/**
+	 * Start the counters and histograms of every agent over
+	 */
+	void ResetICEStats();
+
+	/**
+	 * Get the ICE agent carrying this session's peer-to-peer traffic
+	 * Once connected, use its SendData/ReceiveBatch API to exchange game datagrams
+	 */
+	TSharedPtr<class FICEAgent> GetICEAgent() const { return ICEAgent; }
+
+	/**
+	 * Get the ICE agent of a session peer
+	 * @param PeerId - Peer identifier (empty for the default agent)
+	 * @return The agent, or null if the peer is unknown
+	 */
+	TSharedPtr<class FICEAgent> GetICEAgent(const FString& PeerId) const;
+
+	/** Pool holding the default agent and every session peer agent, all sharing one UDP port */
+	TSharedPtr<FICEAgentPool> GetAgentPool() const { return AgentPool; }
+
+	/** Client exchanging candidates through the signaling server, null if no SignalingURL is configured */
+	FICESignalingClient* GetSignalingClient() const { return SignalingClient.Get(); }
+
+	/** Client of the session registry backing FindSessions, null if no RegistryURL is configured */
+	FICESessionRegistry* GetSessionRegistry() const { return SessionRegistry.Get(); }
+
+	/** Pinger measuring PingInMs of registry search results, null if no RegistryURL is configured */
+	FICESessionPinger* GetSessionPinger() const { return SessionPinger.Get(); }
+
+	/**
+	 * Signaling room of a session, shared by the host and every joining peer
+	 * @param SessionName - Local session name
+	 * @return The registry id of the session if it has one, else the session name
+	 */
+	FString GetSignalingRoomId(FName SessionName) const;
+
 	/**
 	 * Delegate called when local ICE candidates are ready
+	 * Candidates are trickled: the delegate fires as each candidate is gathered
 	 * Applications can bind to this to send candidates to remote peers
 	 */
 	FOnLocalCandidatesReady OnLocalCandidatesReady;
 
+	/** Delegate called as each local candidate of a session peer agent is gathered */
+	FOnPeerLocalCandidatesReady OnPeerLocalCandidatesReady;
+
 	/**
 	 * Delegate called when a remote candidate is received
 	 * Applications can bind to this to monitor candidate reception
@@ -126,7 +267,48 @@ public:
 	DECLARE_MULTICAST_DELEGATE_TwoParams(FOnICEConnectionStateChanged, FName, EICEConnectionState);
 	FOnICEConnectionStateChanged OnICEConnectionStateChanged;
 
+	/**
+	 * Delegate called when the ICE connection state of a session peer changes
+	 * Params: SessionName, PeerId, NewState
+	 */
+	DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnICEPeerConnectionStateChanged, FName, const FString&, EICEConnectionState);
+	FOnICEPeerConnectionStateChanged OnICEPeerConnectionStateChanged;
+
+	/**
+	 * Delegate called as each page of registry results is appended to the search, before OnFindSessionsComplete
+	 * Params: SearchSettings, FirstNewResult, NumNewResults
+	 */
+	DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnFindSessionsPageReceived, const TSharedRef<FOnlineSessionSearch>&, int32, int32);
+	FOnFindSessionsPageReceived OnFindSessionsPageReceived;
+
+	/**
+	 * Delegate called as the PingInMs of a registry search result is measured (bReachable false if its host never answered)
+	 * Pages are pinged as they arrive; OnFindSessionsComplete fires once every result of the search is measured
+	 * Params: SearchSettings, ResultIndex, bReachable
+	 */
+	DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnSearchResultPinged, const TSharedRef<FOnlineSessionSearch>&, int32, bool);
+	FOnSearchResultPinged OnSearchResultPinged;
+
 private:
+	/**
+	 * Session a peer's notifications are reported for
+	 * @param PeerId - Session peer (empty for the default agent)
+	 * @return The peer's session, else the first session, else NAME_None
+	 */
+	FName GetNotificationSessionName(const FString& PeerId) const;
+
+	/**
+	 * Advertise a hosted session on the registry, or withdraw it once it is no longer advertised
+	 * @param SessionName - Hosted session
+	 */
+	void UpdateRegistryAdvertisement(FName SessionName);
+
+	/** Pinger listener: report the result, and complete the search once its last result is measured */
+	void OnSearchResultPingComplete(const TSharedRef<FOnlineSessionSearch>& Search, int32 ResultIndex, bool bReachable);
+
+	/** Complete the current search once its last page arrived and no ping is left */
+	void TryCompleteFindSessions();
+
 	/** Reference to the main subsystem */
 	FOnlineSubsystemICE* Subsystem;
 
@@ -136,9 +318,40 @@ private:
 	/** Current search object */
 	TSharedPtr<FOnlineSessionSearch> CurrentSessionSearch;
 
-	/** ICE agent for P2P connectivity */
+	/** Agents of this session interface, sharing one UDP socket */
+	TSharedPtr<FICEAgentPool> AgentPool;
+
+	/** Default ICE agent for P2P connectivity (created by and owned by AgentPool) */
 	TSharedPtr<class FICEAgent> ICEAgent;
 
+	/** Session using the default agent (used for trickled notifications and state changes) */
+	FName GatheringSessionName;
+
+	/** Session of each peer added with AddSessionPeer */
+	TMap<FString, FName> PeerSessions;
+
+	/** Time the agent of each failed session peer has been in the Failed state (seconds) */
+	TMap<FString, float> FailedPeerTimes;
+
+	/** Time a session peer's agent may stay Failed, revived by a late check from the peer, before the peer is removed (seconds) */
+	static constexpr float FAILED_PEER_TIMEOUT = 30.0f;
+
+	/** Signaling server client (see SignalingURL) */
+	TUniquePtr<FICESignalingClient> SignalingClient;
+
+	/** Session registry client (see RegistryURL) */
+	TUniquePtr<FICESessionRegistry> SessionRegistry;
+
+	/** RTT prober of registry search results */
+	TUniquePtr<FICESessionPinger> SessionPinger;
+
+	/** Whether the last page of the current search arrived, its completion waiting for pings; and its outcome */
+	bool bFindSessionsAwaitingPings;
+	bool bFindSessionsSucceeded;
+
+	/** Results whose PingSearchResults call is waiting for an answer, by registry id */
+	TSet<FString> PendingPingRequests;
+
 	/** Remote peer address for manual signaling */
 	FString RemotePeerIP;
 	int32 RemotePeerPort;
@@ -79,6 +79,166 @@ public:
 	 */
 	const FString& GetTURNCredential() const { return TURNCredential; }
 
+	/**
+	 * Get total candidate gathering deadline (seconds)
+	 */
+	float GetGatheringTimeout() const { return GatheringTimeout; }
+
+	/**
+	 * Get pacing interval between connectivity checks (seconds)
+	 */
+	float GetConnectivityCheckInterval() const { return ConnectivityCheckInterval; }
+
+	/**
+	 * Check if ICE agents receive on a dedicated I/O thread
+	 */
+	bool IsIOThreadEnabled() const { return bUseIOThread; }
+
+	/**
+	 * Get path MTU used to size relayed datagrams (bytes)
+	 */
+	int32 GetPathMTU() const { return PathMTU; }
+
+	/**
+	 * Check if IPv6 host candidates are gathered (dual-stack agent sockets)
+	 */
+	bool IsIPv6Enabled() const { return bEnableIPv6; }
+
+	/**
+	 * Get mean interval between consent checks on the selected pair (seconds)
+	 */
+	float GetConsentCheckInterval() const { return ConsentCheckInterval; }
+
+	/**
+	 * Get time without consent before a connection is considered lost (seconds)
+	 */
+	float GetConsentTimeout() const { return ConsentTimeout; }
+
+	/**
+	 * Get delay between rounds of direct checks on a relayed connection (seconds, 0 disables the upgrade)
+	 */
+	float GetDirectUpgradeInterval() const { return DirectUpgradeInterval; }
+
+	/**
+	 * Get number of direct check rounds tried before staying on the relay
+	 */
+	int32 GetMaxDirectUpgradeRounds() const { return MaxDirectUpgradeRounds; }
+
+	/**
+	 * Get how long measured server RTTs and the chosen TURN server are reused (seconds)
+	 */
+	float GetServerSelectionTTL() const { return ServerSelectionTTL; }
+
+	/**
+	 * Get how long resolved STUN/TURN hostnames are cached (seconds)
+	 */
+	float GetDNSCacheTTL() const { return DNSCacheTTL; }
+
+	/**
+	 * Get signaling server URL (ws/wss, or http/https for long-polling; empty disables signaling)
+	 */
+	const FString& GetSignalingURL() const { return SignalingURL; }
+
+	/**
+	 * Get how long trickled candidates are collected before being signaled (seconds)
+	 */
+	float GetSignalingBatchInterval() const { return SignalingBatchInterval; }
+
+	/**
+	 * Get session registry URL (empty restricts FindSessions to the sessions of this process)
+	 */
+	const FString& GetRegistryURL() const { return RegistryURL; }
+
+	/**
+	 * Get how many sessions each registry search page holds
+	 */
+	int32 GetRegistryPageSize() const { return RegistryPageSize; }
+
+	/**
+	 * Get how often advertised sessions are refreshed on the registry (seconds)
+	 */
+	float GetRegistryHeartbeatInterval() const { return RegistryHeartbeatInterval; }
+
+	/**
+	 * Get how many search result pings may be outstanding at once
+	 */
+	int32 GetPingMaxInFlight() const { return PingMaxInFlight; }
+
+	/**
+	 * Get how long a search result ping waits for its answer before it is resent or given up (seconds)
+	 */
+	float GetPingTimeout() const { return PingTimeout; }
+
+	/**
+	 * Check if game datagrams are encrypted (AES-256-GCM keyed from the signed connectivity checks)
+	 */
+	bool IsTrafficEncryptionEnabled() const { return bEncryptTraffic; }
+
+	/**
+	 * Check if unsigned connectivity checks are exchanged until the peer's credentials are known (legacy peers)
+	 */
+	bool IsUnsignedHandshakeAllowed() const { return bAllowUnsignedHandshake; }
+
+	/**
+	 * Check if small game datagrams are coalesced into MTU-sized ones
+	 */
+	bool IsSendCoalescingEnabled() const { return bCoalesceSends; }
+
+	/**
+	 * Get how long a coalesced message may wait for more before its datagram is sent (seconds)
+	 */
+	float GetCoalesceWindow() const { return CoalesceWindow; }
+
+	/**
+	 * Check if game datagrams are paced to the estimated path bandwidth
+	 */
+	bool IsSendPacingEnabled() const { return bPaceSends; }
+
+	/**
+	 * Get the send rate used before the first bandwidth estimate (bytes per second)
+	 */
+	float GetPacingInitialRate() const { return PacingInitialRate; }
+
+	/**
+	 * Get the floor of the estimated send rate (bytes per second)
+	 */
+	float GetPacingMinRate() const { return PacingMinRate; }
+
+	/**
+	 * Get the ceiling of the estimated send rate (bytes per second)
+	 */
+	float GetPacingMaxRate() const { return PacingMaxRate; }
+
+	/**
+	 * Get how many bytes may leave back to back after an idle period
+	 */
+	int32 GetPacingBurstSize() const { return PacingBurstSize; }
+
+	/**
+	 * Get how many bytes each priority class may hold back
+	 */
+	int32 GetPacingQueueLimit() const { return PacingQueueLimit; }
+
+	/**
+	 * Get the queuing delay the bandwidth estimate steers to (seconds)
+	 */
+	float GetPacingTargetDelay() const { return PacingTargetDelay; }
+
+	/**
+	 * Check if game datagrams are protected with forward error correction when the peer supports it
+	 */
+	bool IsFECEnabled() const { return bEnableFEC; }
+
+	/**
+	 * Get the loss rate under which no parity is sent
+	 */
+	float GetFECMinLossRate() const { return FECMinLossRate; }
+
+	/**
+	 * Get how many datagrams share one parity packet at the lowest loss rate
+	 */
+	int32 GetFECMaxGroupSize() const { return FECMaxGroupSize; }
+
 public:
 	/** Only the factory makes instances */
 	FOnlineSubsystemICE() = delete;
@@ -102,6 +262,90 @@ private:
 
 	/** TURN credential */
 	FString TURNCredential;
+
+	/** Candidate gathering deadline (seconds) */
+	float GatheringTimeout;
+
+	/** Connectivity check pacing interval, Ta (seconds) */
+	float ConnectivityCheckInterval;
+
+	/** Receive on a dedicated I/O thread instead of polling from Tick */
+	bool bUseIOThread;
+
+	/** Path MTU, relayed datagrams larger than this are dropped instead of fragmented (bytes) */
+	int32 PathMTU;
+
+	/** Gather IPv6 host candidates on dual-stack sockets */
+	bool bEnableIPv6;
+
+	/** Consent check interval on the selected pair (seconds) */
+	float ConsentCheckInterval;
+
+	/** Time without consent before the connection fails (seconds) */
+	float ConsentTimeout;
+
+	/** Delay between rounds of direct checks while relayed (seconds) */
+	float DirectUpgradeInterval;
+
+	/** Direct check rounds before staying on the relay */
+	int32 MaxDirectUpgradeRounds;
+
+	/** Lifetime of measured server RTTs (seconds) */
+	float ServerSelectionTTL;
+
+	/** Lifetime of cached server hostname lookups (seconds) */
+	float DNSCacheTTL;
+
+	/** Signaling server URL */
+	FString SignalingURL;
+
+	/** Candidate batching interval of the signaling client (seconds) */
+	float SignalingBatchInterval;
+
+	/** Session registry URL */
+	FString RegistryURL;
+
+	/** Sessions per registry search page */
+	int32 RegistryPageSize;
+
+	/** Refresh interval of advertised sessions (seconds) */
+	float RegistryHeartbeatInterval;
+
+	/** Search result pings outstanding at once */
+	int32 PingMaxInFlight;
+
+	/** Answer timeout of search result pings (seconds) */
+	float PingTimeout;
+
+	/** Encrypt game datagrams */
+	bool bEncryptTraffic;
+
+	/** Accept unsigned connectivity checks before credentials are signaled */
+	bool bAllowUnsignedHandshake;
+
+	/** Coalesce small game datagrams */
+	bool bCoalesceSends;
+
+	/** Longest wait of a coalesced message (seconds) */
+	float CoalesceWindow;
+
+	/** Pace game datagrams */
+	bool bPaceSends;
+
+	/** Pacing rates (bytes per second), burst and queue sizes (bytes), target queuing delay (seconds) */
+	float PacingInitialRate;
+	float PacingMinRate;
+	float PacingMaxRate;
+	int32 PacingBurstSize;
+	int32 PacingQueueLimit;
+	float PacingTargetDelay;
+
+	/** Protect game datagrams with adaptive XOR parity */
+	bool bEnableFEC;
+
+	/** Loss rate under which no parity is sent, and datagrams per parity packet at the lowest loss */
+	float FECMinLossRate;
+	int32 FECMaxGroupSize;
 };
 
 typedef TSharedPtr<FOnlineSubsystemICE, ESPMode::ThreadSafe> FOnlineSubsystemICEPtr;
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "Modules/ModuleInterface.h"
+#include "Containers/Ticker.h"
 
 /**
  * Online subsystem module class for ICE (Interactive Connectivity Establishment)
@@ -26,4 +27,7 @@ private:
 
 	/** Console command objects */
 	TArray<IConsoleObject*> ConsoleCommands;
+
+	/** Periodic ICE.STATS dump, invalid when off */
+	FTSTicker::FDelegateHandle StatsTickerHandle;
 };
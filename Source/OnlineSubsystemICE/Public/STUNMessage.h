@@ -0,0 +1,288 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/SecureHash.h"
+
+class FInternetAddr;
+
+/** STUN/TURN message types used by the agent (RFC 5389/5766) */
+namespace STUNMessageType
+{
+	constexpr uint16 BINDING_REQUEST = 0x0001;
+	constexpr uint16 BINDING_SUCCESS = 0x0101;
+	constexpr uint16 ALLOCATE_REQUEST = 0x0003;
+	constexpr uint16 ALLOCATE_SUCCESS = 0x0103;
+	constexpr uint16 ALLOCATE_ERROR = 0x0113;
+	constexpr uint16 REFRESH_REQUEST = 0x0004;
+	constexpr uint16 SEND_INDICATION = 0x0016;
+	constexpr uint16 DATA_INDICATION = 0x0017;
+	constexpr uint16 CREATE_PERMISSION_REQUEST = 0x0008;
+	constexpr uint16 CHANNEL_BIND_REQUEST = 0x0009;
+}
+
+/** STUN/TURN attribute types used by the agent (RFC 5389/5766) */
+namespace STUNAttribute
+{
+	constexpr uint16 USERNAME = 0x0006;
+	constexpr uint16 MESSAGE_INTEGRITY = 0x0008;
+	constexpr uint16 ERROR_CODE = 0x0009;
+	constexpr uint16 CHANNEL_NUMBER = 0x000C;
+	constexpr uint16 LIFETIME = 0x000D;
+	constexpr uint16 XOR_PEER_ADDRESS = 0x0012;
+	constexpr uint16 DATA = 0x0013;
+	constexpr uint16 REALM = 0x0014;
+	constexpr uint16 NONCE = 0x0015;
+	constexpr uint16 XOR_RELAYED_ADDRESS = 0x0016;
+	constexpr uint16 REQUESTED_TRANSPORT = 0x0019;
+	constexpr uint16 XOR_MAPPED_ADDRESS = 0x0020;
+}
+
+/** Transport address decoded from an XOR-*-ADDRESS attribute */
+struct ONLINESUBSYSTEMICE_API FSTUNAddress
+{
+	/** Address family (0x01 = IPv4, 0x02 = IPv6) */
+	uint8 Family = 0;
+
+	/** Port in host byte order */
+	uint16 Port = 0;
+
+	/** Address bytes in network order (4 used for IPv4, 16 for IPv6) */
+	uint8 Address[16] = {};
+
+	bool IsIPv4() const { return Family == 0x01; }
+	bool IsIPv6() const { return Family == 0x02; }
+
+	/** IPv4 address in host byte order (0 for IPv6) */
+	uint32 GetIPv4() const;
+
+	/** Address without port, dotted quad for IPv4 or RFC 5952 text for IPv6 */
+	FString ToString() const;
+};
+
+/**
+ * Writer for STUN messages (RFC 5389 Section 6)
+ * Serializes into a fixed inline buffer, or into a caller-provided one for messages carrying payloads
+ * (Send indications). The header length is kept up to date after every attribute, so the message can be sent as
+ * soon as the last attribute is added. Writes past the capacity set the overflow flag and are dropped.
+ */
+class ONLINESUBSYSTEMICE_API FSTUNMessage
+{
+public:
+	static constexpr int32 HEADER_SIZE = 20;
+	static constexpr int32 TRANSACTION_ID_LENGTH = 12;
+	static constexpr uint32 MAGIC_COOKIE = 0x2112A442;
+
+	/** Capacity of the inline buffer: header, credentials and MESSAGE-INTEGRITY of any TURN request */
+	static constexpr int32 INLINE_CAPACITY = 512;
+
+	/**
+	 * Start a message in the inline buffer
+	 * @param MessageType - STUN message type (method and class)
+	 * @param TransactionID - 12 byte transaction ID
+	 */
+	FSTUNMessage(uint16 MessageType, const uint8* TransactionID);
+
+	/**
+	 * Start a message in an external buffer
+	 * @param MessageType - STUN message type (method and class)
+	 * @param TransactionID - 12 byte transaction ID
+	 * @param InBuffer - Destination buffer, must outlive the writer
+	 * @param InCapacity - Size of InBuffer
+	 */
+	FSTUNMessage(uint16 MessageType, const uint8* TransactionID, uint8* InBuffer, int32 InCapacity);
+
+	FSTUNMessage(const FSTUNMessage&) = delete;
+	FSTUNMessage& operator=(const FSTUNMessage&) = delete;
+
+	/**
+	 * Append an attribute, zero padded to a 4-byte boundary
+	 * @return False if the attribute doesn't fit
+	 */
+	bool AddAttribute(uint16 Type, const uint8* Value, int32 Length);
+
+	/**
+	 * Append an attribute and return its value for the caller to fill (padding is already zeroed)
+	 * @return Pointer to Length writable bytes, null if the attribute doesn't fit
+	 */
+	uint8* AddAttributeUninitialized(uint16 Type, int32 Length);
+
+	/** Append a 32-bit big-endian attribute (LIFETIME, REQUESTED-TRANSPORT...) */
+	bool AddUInt32(uint16 Type, uint32 Value);
+
+	/** Append a string attribute (TURN credentials are ASCII as per RFC 5766) */
+	bool AddString(uint16 Type, const FString& Value);
+
+	/** Append an XOR-*-ADDRESS attribute for an IPv4 or IPv6 address */
+	bool AddXorAddress(uint16 Type, const FInternetAddr& Addr);
+
+	/**
+	 * Append MESSAGE-INTEGRITY over everything written so far (RFC 5389 Section 15.4)
+	 * Must be the last attribute.
+	 * @param Key - HMAC key (MD5(username:realm:password) for long-term credentials)
+	 * @param KeyLength - Size of Key
+	 */
+	bool AddMessageIntegrity(const uint8* Key, int32 KeyLength);
+
+	/** True if every write fitted in the buffer */
+	bool IsValid() const { return !bOverflow; }
+
+	const uint8* GetData() const { return Buffer; }
+	int32 Num() const { return Size; }
+
+	/** Fill a fresh random transaction ID */
+	static void GenerateTransactionID(uint8* OutTransactionID);
+
+	/** HMAC-SHA1 as per RFC 2104, used for MESSAGE-INTEGRITY (see FSTUNHMACKey to sign many messages with one key) */
+	static void CalculateHMACSHA1(const uint8* Data, int32 DataLen, const uint8* Key, int32 KeyLen, uint8* OutHash);
+
+private:
+	/** Reserve an attribute header plus padded value, returns the value or null on overflow */
+	uint8* Reserve(uint16 Type, int32 Length);
+
+	/** Write the current attribute length into the header */
+	void UpdateLength();
+
+	uint8* Buffer;
+	int32 Capacity;
+	int32 Size;
+	bool bOverflow;
+
+	uint8 InlineBuffer[INLINE_CAPACITY];
+};
+
+/**
+ * Zero-copy parser for STUN messages
+ * Parse() validates the header and indexes every attribute in one pass; accessors then return views into the
+ * original datagram, which must stay alive as long as the view is used. Any attribute running past the declared
+ * message length rejects the whole message, so accessors never read outside the datagram.
+ */
+class ONLINESUBSYSTEMICE_API FSTUNMessageView
+{
+public:
+	/** Attributes indexed per message, later ones are ignored */
+	static constexpr int32 MAX_ATTRIBUTES = 24;
+
+	/**
+	 * Cheap check that a datagram looks like a STUN message: leading bits 00, magic cookie and a length
+	 * that is a multiple of 4 and fits in the datagram
+	 */
+	static bool IsSTUNMessage(const uint8* Data, int32 DataSize);
+
+	/**
+	 * Parse a datagram
+	 * @param Data - Datagram start
+	 * @param DataSize - Datagram size (trailing bytes past the STUN length are ignored)
+	 * @return True if the datagram is a well-formed STUN message
+	 */
+	bool Parse(const uint8* Data, int32 DataSize);
+
+	bool IsValid() const { return Data != nullptr; }
+
+	uint16 GetMessageType() const { return MessageType; }
+
+	/** Class bits (RFC 5389 Section 6) */
+	bool IsRequest() const { return (MessageType & 0x0110) == 0x0000; }
+	bool IsIndication() const { return (MessageType & 0x0110) == 0x0010; }
+	bool IsSuccessResponse() const { return (MessageType & 0x0110) == 0x0100; }
+	bool IsErrorResponse() const { return (MessageType & 0x0110) == 0x0110; }
+	bool IsResponse() const { return (MessageType & 0x0100) != 0; }
+
+	const uint8* GetTransactionID() const { return Data + 8; }
+	bool HasTransactionID(const uint8* TransactionID) const;
+
+	/** Message start and total size (header included) */
+	const uint8* GetData() const { return Data; }
+	int32 Num() const { return Size; }
+
+	/**
+	 * First attribute of a type
+	 * @return View of the attribute value, empty if absent
+	 */
+	TArrayView<const uint8> FindAttribute(uint16 Type) const;
+	bool HasAttribute(uint16 Type) const;
+
+	/** Read a 32-bit big-endian attribute */
+	bool GetUInt32(uint16 Type, uint32& OutValue) const;
+
+	/** Read a string attribute (empty if absent) */
+	FString GetString(uint16 Type) const;
+
+	/** Decode an XOR-*-ADDRESS attribute */
+	bool GetXorAddress(uint16 Type, FSTUNAddress& OutAddress) const;
+
+	/**
+	 * Decode ERROR-CODE
+	 * @param OutReason - Optional reason phrase
+	 * @return Error code (e.g. 401), 0 if absent
+	 */
+	int32 GetErrorCode(FString* OutReason = nullptr) const;
+
+private:
+	struct FAttributeEntry
+	{
+		uint16 Type;
+		uint16 Length;
+		int32 Offset;
+	};
+
+	const uint8* Data = nullptr;
+	int32 Size = 0;
+	uint16 MessageType = 0;
+	int32 NumAttributes = 0;
+	FAttributeEntry Attributes[MAX_ATTRIBUTES];
+};
+
+/**
+ * HMAC-SHA1 key (RFC 2104) with its key schedule derived once: when the key is set, the inner and outer padded key
+ * blocks are absorbed into two SHA-1 contexts, so authenticating a message copies them and only hashes the message
+ * and the inner hash, with no block compression for the pads.
+ * Used for MESSAGE-INTEGRITY with short-term credentials, where the same key signs every check of a session.
+ */
+class ONLINESUBSYSTEMICE_API FSTUNHMACKey
+{
+public:
+	FSTUNHMACKey();
+	FSTUNHMACKey(const uint8* Key, int32 KeyLength);
+
+	/** Derive the key schedule of a new key */
+	void SetKey(const uint8* Key, int32 KeyLength);
+
+	/** Set the key to the UTF-8 bytes of a password (short-term credentials, RFC 5389 Section 15.4) */
+	void SetKey(const FString& Password);
+
+	/** Forget the key */
+	void Reset();
+
+	/** Whether a key is set */
+	bool IsSet() const { return bSet; }
+
+	/**
+	 * Compute the HMAC of a message
+	 * @param Data - Message
+	 * @param DataLength - Message size
+	 * @param OutHash - Receives HASH_SIZE bytes
+	 */
+	void Calculate(const uint8* Data, int32 DataLength, uint8* OutHash) const;
+
+	/**
+	 * Check the HMAC of a message in constant time
+	 * @param Data - Message
+	 * @param DataLength - Message size
+	 * @param Hash - HASH_SIZE bytes to compare with
+	 * @return True if a key is set and the hash matches
+	 */
+	bool Verify(const uint8* Data, int32 DataLength, const uint8* Hash) const;
+
+	/** Size of the HMAC */
+	static constexpr int32 HASH_SIZE = 20;
+
+private:
+	static constexpr int32 BLOCK_SIZE = 64;
+
+	/** SHA-1 states after the inner (key ^ ipad) and outer (key ^ opad) blocks */
+	FSHA1 InnerContext;
+	FSHA1 OuterContext;
+	bool bSet;
+};
@@ -0,0 +1,105 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sockets.h"
+#include "ICESendScheduler.h"
+
+class FICEAgent;
+class FICEAgentPool;
+
+/**
+ * FSocket facade over a connected ICE agent, or over every connected agent of an agent pool
+ * Lets engine code (UICENetDriver) exchange datagrams over the already-punched ICE socket or TURN channel.
+ * Over a single agent every datagram goes to/comes from the agent's selected remote candidate and destination
+ * addresses are ignored. Over a pool, datagrams are sent to the agent whose peer address is the destination and
+ * received ones report the peer address of the agent they came through. Peer addresses survive ICE restarts, so
+ * the engine keeps its connection when the traffic migrates to another pair.
+ * The engine doesn't tell what a datagram carries, so its pacing class (EICESendPriority) is guessed from its size:
+ * small ones are acks and movement (Interactive), full ones are bulk replication such as level loads (Bulk).
+ * SetSendPriority overrides the guess for every datagram until ClearSendPriority.
+ * Destroying this socket leaves the agents' sockets untouched.
+ */
+class FSocketICE : public FSocket
+{
+public:
+	/**
+	 * @param InAgent - Connected agent carrying the traffic
+	 * @param InSocketDescription - Debug description
+	 */
+	FSocketICE(const TSharedRef<FICEAgent>& InAgent, const FString& InSocketDescription);
+
+	/**
+	 * @param InPool - Pool whose connected agents carry the traffic (listen server with several peers)
+	 * @param InSocketDescription - Debug description
+	 */
+	FSocketICE(const TSharedRef<FICEAgentPool>& InPool, const FString& InSocketDescription);
+	virtual ~FSocketICE() = default;
+
+	// FSocket
+	virtual bool Shutdown(ESocketShutdownMode Mode) override;
+	virtual bool Close() override;
+	virtual bool Bind(const FInternetAddr& Addr) override;
+	virtual bool Connect(const FInternetAddr& Addr) override;
+	virtual bool Listen(int32 MaxBacklog) override;
+	virtual bool WaitForPendingConnection(bool& bHasPendingConnection, const FTimespan& WaitTime) override;
+	virtual bool HasPendingData(uint32& PendingDataSize) override;
+	virtual FSocket* Accept(const FString& InSocketDescription) override;
+	virtual FSocket* Accept(FInternetAddr& OutAddr, const FString& InSocketDescription) override;
+	virtual bool SendTo(const uint8* Data, int32 Count, int32& BytesSent, const FInternetAddr& Destination) override;
+	virtual bool Send(const uint8* Data, int32 Count, int32& BytesSent) override;
+	virtual bool RecvFrom(uint8* Data, int32 BufferSize, int32& BytesRead, FInternetAddr& Source, ESocketReceiveFlags::Type Flags = ESocketReceiveFlags::None) override;
+	virtual bool Recv(uint8* Data, int32 BufferSize, int32& BytesRead, ESocketReceiveFlags::Type Flags = ESocketReceiveFlags::None) override;
+	virtual bool Wait(ESocketWaitConditions::Type Condition, FTimespan WaitTime) override;
+	virtual ESocketConnectionState GetConnectionState() override;
+	virtual void GetAddress(FInternetAddr& OutAddr) override;
+	virtual bool GetPeerAddress(FInternetAddr& OutAddr) override;
+	virtual bool SetNonBlocking(bool bIsNonBlocking = true) override;
+	virtual bool SetBroadcast(bool bAllowBroadcast = true) override;
+	virtual bool SetNoDelay(bool bIsNoDelay = true) override;
+	virtual bool JoinMulticastGroup(const FInternetAddr& GroupAddress) override;
+	virtual bool JoinMulticastGroup(const FInternetAddr& GroupAddress, const FInternetAddr& InterfaceAddress) override;
+	virtual bool LeaveMulticastGroup(const FInternetAddr& GroupAddress) override;
+	virtual bool LeaveMulticastGroup(const FInternetAddr& GroupAddress, const FInternetAddr& InterfaceAddress) override;
+	virtual bool SetMulticastLoopback(bool bLoopback) override;
+	virtual bool SetMulticastTtl(uint8 TimeToLive) override;
+	virtual bool SetMulticastInterface(const FInternetAddr& InterfaceAddress) override;
+	virtual bool SetReuseAddr(bool bAllowReuse = true) override;
+	virtual bool SetLinger(bool bShouldLinger = true, int32 Timeout = 0) override;
+	virtual bool SetRecvErr(bool bUseErrorQueue = true) override;
+	virtual bool SetSendBufferSize(int32 Size, int32& NewSize) override;
+	virtual bool SetReceiveBufferSize(int32 Size, int32& NewSize) override;
+	virtual int32 GetPortNo() override;
+
+	/**
+	 * Send every datagram in one pacing class, instead of classifying them by size
+	 * @param Priority - Class of the datagrams sent from now on
+	 */
+	void SetSendPriority(EICESendPriority Priority) { SendPriorityOverride = Priority; }
+
+	/** Classify datagrams by size again */
+	void ClearSendPriority() { SendPriorityOverride.Reset(); }
+
+	/**
+	 * Pacing class of a datagram about to be sent
+	 * @param Size - Datagram size in bytes
+	 */
+	EICESendPriority GetSendPriority(int32 Size) const;
+
+	/** Datagrams up to this size (bytes) are Interactive: acks, movement and other small updates */
+	static constexpr int32 INTERACTIVE_DATAGRAM_SIZE = 256;
+
+	/** Datagrams from this size on (bytes) are Bulk: the engine fills its packets only when it has a backlog to send */
+	static constexpr int32 BULK_DATAGRAM_SIZE = 1000;
+
+private:
+	/** Agent carrying the traffic (weak: the session owns it) */
+	TWeakPtr<FICEAgent> Agent;
+
+	/** Pool carrying the traffic when the socket serves several peers (weak: the session owns it) */
+	TWeakPtr<FICEAgentPool> Pool;
+
+	/** Class set by SetSendPriority, unset while datagrams are classified by size */
+	TOptional<EICESendPriority> SendPriorityOverride;
+};